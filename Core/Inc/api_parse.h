@@ -20,6 +20,45 @@ int api_parse_float_fixed3(const char *s, float *out);
 int api_parse_qstring(const char *s, char *out, size_t out_sz);
 int api_parse_u16(const char* s, uint16_t* out);
 
+/* Decimal, or hexadecimal with a 0x/0X prefix (e.g. ACK_BLKS mask=). */
+int api_parse_u32_auto(const char *s, uint32_t *out);
+
+/*
+ * Single-pass tokenizer for host lines: CMD{(","|" ")field}, field = key "=" value
+ * or a bare flag (e.g. FORCE, OFF). Spans point into the line, which must stay
+ * alive and unchanged; a value ends at ',', ' ' or NUL, so api_parse_* can read
+ * it in place. "..." values keep their quotes and may contain separators.
+ * Fields beyond API_KV_MAX are ignored.
+ */
+#define API_KV_MAX 16
+
+typedef struct {
+    const char *key;
+    const char *val;   /* NULL for a bare flag */
+    uint8_t klen;
+    uint8_t vlen;
+} api_kv_t;
+
+typedef struct {
+    const char *cmd;
+    uint8_t cmd_len;
+    uint8_t n;
+    api_kv_t kv[API_KV_MAX];
+} api_tokens_t;
+
+void api_tokenize(const char *line, api_tokens_t *t);
+int api_tok_is_cmd(const api_tokens_t *t, const char *cmd);
+/* Value of key=..., or NULL if absent. */
+const char *api_tok_val(const api_tokens_t *t, const char *key);
+/* 1 if key is present and its value is exactly s. */
+int api_tok_val_is(const api_tokens_t *t, const char *key, const char *s);
+/* 1 if the bare flag is present. */
+int api_tok_flag(const api_tokens_t *t, const char *flag);
+
+/* Decimal formatting for values printf cannot handle on the target. */
+#define API_U64_STR_MAX 21 /* 20 digits + NUL */
+int api_format_u64(char *out, size_t out_sz, uint64_t v);
+
 #ifdef __cplusplus
 }
 #endif
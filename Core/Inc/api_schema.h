@@ -66,6 +66,60 @@ extern "C" {
 #define PROTO_CRC16_INIT 0xFFFFu      /* CCITT-FALSE initial value */
 #endif
 
+/* --- Binary LIVE frames (STREAM_START,fmt=bin) ---
+ * Wire: 0x00 <COBS(record)> 0x00. ASCII lines never contain 0x00, so the host
+ * switches to frame mode on a 0x00 and back to lines after the closing 0x00.
+ * Record, little-endian: type u8, sensor u8, seq u16 (per sensor), x/y/z i16 raw
+ * counts, then for
+ *   PROTO_BIN_LIVE_DT:  dt_us u16, time since the previous record of this sensor
+ *   PROTO_BIN_LIVE_ABS: ts_us u64, sent first, every 256 records and whenever
+ *                       dt_us does not fit
+ * and finally CRC-16/CCITT-FALSE u16 over all preceding record bytes.
+ * With HELLO,codec=delta the DT records become PROTO_BIN_LIVE_ZZ: type, sensor,
+ * seq u16, then zigzag varints dx, dy, dz against the previous record of this
+ * sensor and a varint dt_us (protocol_delta.h), then the CRC. ABS records stay
+ * full-width keyframes; a lost frame corrupts the deltas up to the next ABS.
+ */
+#define PROTO_BIN_DELIM    0x00u
+#define PROTO_BIN_LIVE_DT  0x01u
+#define PROTO_BIN_LIVE_ABS 0x02u
+#define PROTO_BIN_LIVE_ZZ  0x03u
+#define PROTO_BIN_REC_MAX  20u  /* LIVE_ABS: 10 + 8 + CRC (LIVE_ZZ: at most 4 + 9 + 3 + CRC) */
+#define STREAM_FMT_TEXT    "text"
+#define STREAM_FMT_BIN     "bin"
+#define PROTO_CODEC_RAW    "raw"
+#define PROTO_CODEC_DELTA  "delta"
+#define PROTO_CODEC_BIN    "bin"   /* BLOCKS mode=BIN; LIVE behaves as raw */
+#define PROTO_CRC_16       "crc16"
+#define PROTO_CRC_32       "crc32" /* BLOCK_HEADER/BLOCK_END bär crc32= i stället för crc16= */
+#define PROTO_RESULT_BLOCKS  "blocks"
+#define PROTO_RESULT_SUMMARY "summary" /* DAMP: bara DAMP_RESULT, ingen BLOCKS-dump */
+#define PROTO_TRG_DET_PEAK "peak"  /* SET_TRG det=: ett sampel mot k_mult·Δ₀ */
+#define PROTO_TRG_DET_STA  "sta"   /* SET_TRG det=: medelenergi över win_ms mot k_mult·baslinje */
+#define PROTO_TRG_CH_XYZ   "xyz"
+#define PROTO_TRG_CH_MAG   "mag"
+#define PROTO_FLT_OFF      "off"   /* SET_CFG flt= (conditioning.h) */
+#define PROTO_FLT_LP       "lp"
+#define PROTO_FLT_HP       "hp"
+#define PROTO_FLT_BP       "bp"
+
+/* --- BLOCKS acknowledgement ---
+ * ACK_BLK,blk=<n>                 acknowledges block n
+ * NACK_BLK,blk=<n>[,code=<c>]     requests a resend of block n
+ * ACK_BLKS,base=<b>,mask=<m>      selective ACK (HELLO_ACK advertises sack=1):
+ *                                 every block before b is received, and bit i of
+ *                                 the 32-bit mask (decimal or 0x hex) marks block
+ *                                 b+i as received. Unacked blocks sent before the
+ *                                 newest acked one are resent without waiting for
+ *                                 the retransmit timeout.
+ * HELLO,win=<1..32> and blk_lines=<32..512> set the ceilings for blocks in
+ * flight and lines per block (defaults PROTO_WINDOW_DEFAULT and
+ * PROTO_BLOCK_LINES_DEFAULT). Below them the device adapts per block:
+ * NACKs shrink blocks, timeouts shrink the window, clean runs grow both, and
+ * the timeout follows the measured ACK round trip (starting at
+ * PROTO_BLOCK_TIMEOUT_MS). BLOCK_HEADER lines= is authoritative per block.
+ */
+
 /* API v3.3.0 ABNF-konform inputpolicy */
 #ifndef PROTO_FLOAT_DEC_MAX
 #define PROTO_FLOAT_DEC_MAX 3   /* högst tre decimaler i indata */
@@ -86,46 +140,169 @@ extern "C" {
  */
 
 // --- MCU -> PC Message Prefixes ---
+/*
+ * TX lanes: HELLO_ACK, ACK, NACK, ERROR and TRIGGER_EDGE go on a control lane
+ * that is sent ahead of queued bulk output at the next line boundary. They can
+ * therefore precede earlier bulk lines, also between the DATA lines of a
+ * BLOCK (outside its CRC). A binary frame is never split.
+ */
 #define MSG_HELLO_ACK       "HELLO_ACK"
 #define MSG_ACK             "ACK"
 #define MSG_NACK            "NACK"
 #define MSG_ERROR           "ERROR"
+// STATUS,op=<mode>,trg=<state>,axis=MAG,ref=0|1 (ref=1 while a ZERO/ARM reference capture runs)
 #define MSG_STATUS          "STATUS"
+// CFG,odr_hz=<u32>,burst_ms=<u32>,hb_ms=<u32>,stream_rate_hz=<u32>,wm=<u>,flt=off|lp|hp|bp,flt_n=<u>,flt_f1=<u>,flt_f2=<u>,flt_path=<0..7>
 #define MSG_CFG             "CFG"
-#define MSG_HB              "HB" // Format: HB,tick=<u32>[,host_hi=<u32>,host_lo=<u32>],tx_free=<u>,tx_drop=<u32>
+#define MSG_HB              "HB" // Format: HB,tick=<u32>[,host_hi=<u32>,host_lo=<u32>],tx_free=<u>,tx_drop=<u32>,ctrl_drop=<u32> (bytes dropped per TX lane)
+// TIME_SYNC_INFO,n=<u>,span_ms=<u32>,skew_ppb=<i32>,resid_us=<i32>,restart=0|1,stamp=0|1
+// after each TIME_SYNC ACK (hostclock.h): pairs in the fit window, their span,
+// the fitted rate error of the device clock (0 until span_ms >= 2000) and this
+// sync against the previous prediction. restart=1: the window began anew.
+// With stamp=1, DATA_HEADER, TRIGGER_EDGE, LIVE and LIVE_BATCH carry
+// host_us=<u64>: the host time of ts_us (DATA_HEADER: of ts0_us).
+#define MSG_TIME_SYNC_INFO  "TIME_SYNC_INFO"
+// TRG_SETTINGS,k_mult=<f>,hold_ms=<u32>,sleep=0|1,act_mg=<u>,inact_mg=<u>,inact_s=<u>,pre_ms=<u>,win_ms=<u>,det=peak|sta,ch=xyz|mag
 #define MSG_TRG_SETTINGS    "TRG_SETTINGS"
+// TRIGGER_EDGE,burst_id=<u32>,edge=RISING,ts_us=<u64>,val_raw=<i32>,th_raw=<i32>,axis=x|y|z|xyz|mag,idx=<u32>
+// ts_us is the stamp of the crossing sample, idx its index among the primary
+// sensor's samples since ARM (the test hook sends neither axis nor idx).
+// det=peak: axis=x|y|z, val_raw = |v - μ_arm| and th_raw in counts.
+// det=sta: axis=ch, val_raw = mean energy over win_ms and th_raw = k_mult ·
+// armed baseline, both in counts²; the sample is the one closing the window.
 #define MSG_TRIGGER_EDGE    "TRIGGER_EDGE"
+// DAMP bursts are transmitted while they are recorded: DATA_HEADER is sent with
+// the first captured sample and samples= is the planned count (an upper bound).
+// Blocks follow as they fill; COMPLETE,samples= carries the actual count.
+// ts0_us=<u64> is the stamp of the burst's first primary-sensor sample (older
+// than the trigger with pre_ms), on the same timeline as the DK/key ts_us.
 #define MSG_DATA_HEADER     "DATA_HEADER"
 #define MSG_DATA            "DATA"
+// DATA_HEADER,...,mode=DELTA (HELLO,codec=delta) replaces DATA lines by
+//   DK,<ts_us>,<ax>,<ay>,<az>,<sensor>   key: mm/s^2, first line of a sensor in a block
+//   DD,<dt_us>,<dax>,<day>,<daz>,<sensor> delta to the previous line of that sensor
+// Every block decodes on its own, so retransmitted blocks need no context.
+// Blocks are emitted without blocking the main loop, so other message lines
+// (ACK, STATUS, ...) may appear between the lines of a block; the block CRC
+// covers only its DATA/DK/DD lines.
+// DATA_HEADER,...,mode=BIN (HELLO,codec=bin) adds rec=<bytes>,scale=<m/s^2 per LSB>
+// and off<i>=<x>:<y>:<z> (m/s^2) per sensor i, so a = raw * scale - off. Each
+// block body is then one frame 0x00 <COBS(records)> 0x00 instead of lines;
+// BLOCK_HEADER lines= is the sample count and the block CRC covers the frame
+// bytes as sent, delimiters included. Records, little-endian, 9 bytes:
+//   sample: sensor u8, x/y/z i16 raw counts, dt_us u16 since the previous
+//           sample of that sensor in the block (0 after a key)
+//   key:    PROTO_BLK_BIN_KEY|sensor u8, ts_us u64, before the first sample of
+//           each sensor in a block
+#define PROTO_BLK_BIN_KEY   0x80u
+#define PROTO_BLK_BIN_REC   9u
+#define MSG_DATA_KEY        "DK"
+#define MSG_DATA_DELTA      "DD"
 #define MSG_COMPLETE        "COMPLETE"
 #define MSG_COUNTDOWN_ID    "COUNTDOWN_ID"
 #define MSG_CAL_ACTION      "CAL_ACTION"
-#define MSG_PREVIEW_HEADER  "PREVIEW_HEADER"
-#define MSG_PREVIEW         "PREVIEW"
-#define MSG_PREVIEW_END     "PREVIEW_END"
 #define MSG_LIVE            "LIVE"
+// LIVE_BATCH,seq=<u32>,n=<u>,sensor=<u>,ts_us=<u64>[,host_us=<u64>],s=<dt_us>:<ax>:<ay>:<az>[;...]
+// n consecutive samples of one sensor; ts_us stamps the first, each dt_us is
+// the time since the previous sample in the line (0 for the first).
+#define MSG_LIVE_BATCH      "LIVE_BATCH"
+// STREAM_STATUS,rate_hz=<u>,div=<u>,gov=<0..4>,aa_hz=<u>,q=<u>,tx_free=<u>,drops=<u32>,credit=<0|1>,credits=<u>
+// Every second while streaming and on each rate governor step. rate_hz/div are
+// effective (requested divider << gov); drops is the running live_drops count.
+#define MSG_STREAM_STATUS   "STREAM_STATUS"
 #define MSG_SUMMARY         "SUMMARY"
+// SUMMARY_STATS,burst_id=<u32>,sensor=<u>,axis=x|y|z|mag,n=<u32>,mean_ms2=<f>,std_ms2=<f>,rms_ms2=<f>,peak_ms2=<f>,crest=<f>
+// One line per sensor and axis after every burst (WEIGHT after SUMMARY, DAMP
+// just before COMPLETE,reason=ok). Computed online while the burst is drained;
+// std is the population std, rms includes the mean, peak is max |value|.
+#define MSG_SUMMARY_STATS   "SUMMARY_STATS"
+// DAMP_RESULT,burst_id=<u32>,sensor=0,axis=x|y|z,n=<u>,f_hz=<f>,zeta=<f>,delta=<f>,amp_ms2=<f>,cycles=<u>,ok=0|1
+// Damping analysis of the primary sensor's axis with the largest std: FFT peak
+// from the onset (largest deviation) and the logarithmic decrement of the
+// per-period envelope. The only output of a result=summary burst; with
+// result=blocks it precedes COMPLETE when the whole burst fit the store.
+#define MSG_DAMP_RESULT     "DAMP_RESULT"
+// CAL_INFO,status=restored,seq=<u32>,cfg=1,off=0|1,zero=0|1 at boot when a flash
+// record exists (cal_store.h); off=1 replaces the boot offset calibration.
 #define MSG_CAL_INFO        "CAL_INFO"
+// CAL_STORE_INFO,valid=0|1,seq=<u32>,off=0|1,zero=0|1,used=<u32>,size=<u32>,erases=<u32>
+#define MSG_CAL_STORE_INFO  "CAL_STORE_INFO"
 #define MSG_USER_BTN        "USER_BTN"
+// GET_DIAG[,RESET] (all builds): DIAG_PROF_INFO,cpu_hz=<u32>,probes=<u>,enabled=0|1
+// then one line per probe (prof.h):
+// DIAG_PROF,name=<s>,unit=cyc|B|ms,n=<u32>,min=<u32>,max=<u32>,mean=<u32>,lo=<u>,hist=<u32>/<u32>/...
+// hist= lists the log2 bins from lo up to the last non-empty one; bin k counts
+// values in [2^(k-1), 2^k), bin 0 the value 0. RESET clears the probes after sending.
+#define MSG_DIAG_PROF_INFO  "DIAG_PROF_INFO"
+#define MSG_DIAG_PROF       "DIAG_PROF"
+// TRACE[,RESET] (trace.h): ACK, then
+// TRACE_INFO,cpu_hz=<u32>,ring=<u>,n=<u32>,seq=<u32>,lost=<u32>,itm_lost=<u32>,enabled=0|1
+// and n records oldest first, up to 8 per line:
+// TRACE_DATA,seq=<u32>,hex=<24 hex digits per record: hdr, cyc, arg>
+// seq counts records since boot or RESET; lost were overwritten before the dump.
+// Tools/host/trace_decode turns a log with these lines into a timeline.
+#define MSG_TRACE_INFO      "TRACE_INFO"
+#define MSG_TRACE_DATA      "TRACE_DATA"
+// BENCH[,test=crc16|dataline|sendf|txdrain|drain|burst|all] (IDLE only; all = every
+// test except burst). Cycles are DWT CYCCNT at cpu_hz, for comparing releases:
+// BENCH_START,tests=<s>,cpu_hz=<u32>,baud=<u32>   (baud 0 over USB CDC)
+// BENCH_RES,test=crc16,bytes=4096,reps=<u>,cyc=<u32>,Bps=<u32>        cyc per 4 KB block
+// BENCH_RES,test=dataline,lines=<u>,bytes=<u32>,cyc=<u32>             cyc per DATA line
+// BENCH_RES,test=sendf,lines=<u>,cyc=<u32>                            cyc per COMM_Sendf line
+// BENCH_RES,test=txdrain,bytes=<u32>,us=<u32>,Bps=<u32>,expect_Bps=<u32>
+// BENCH_RES,test=drain,odr_hz=<u>,wm=<u>,batches=<u32>,cyc=<u32>,cyc_max=<u32>,load_pm=<u>
+//   one line per ODR; cyc is watermark edge -> FIFO empty per batch, load_pm
+//   that time per batch period in permille (batches=0 with PROF_ENABLE=0)
+// BENCH_END,tests=<s>
+// BENCH_FILL,... lines are load for sendf/txdrain; hosts drop them.
+// test=burst returns after BENCH_START: a normal BLOCKS burst of PROTO_BENCH_BURST_SAMPLES
+// follows (the host ACKs it as usual), then
+// BENCH_RES,test=burst,samples=<u>,capture_ms=<u32>,total_ms=<u32>,bytes=<u32>,Bps=<u32>,ok=0|1
+// and BENCH_END. total_ms ends at ACK_COMPLETE; ok=0 after PROTO_BENCH_BURST_TIMEOUT_MS.
+#define MSG_BENCH_START     "BENCH_START"
+#define MSG_BENCH_RES       "BENCH_RES"
+#define MSG_BENCH_END       "BENCH_END"
+#define MSG_BENCH_FILL      "BENCH_FILL"
+#define PROTO_BENCH_BURST_SAMPLES   8000u
+#define PROTO_BENCH_BURST_TIMEOUT_MS 60000u
 
 // --- PC -> MCU Command Prefixes ---
-#define CMD_HELLO               "HELLO"
+#define CMD_HELLO               "HELLO"      // HELLO[,codec=raw|delta|bin][,crc=crc16|crc32][,win=<1..32>][,blk_lines=<32..512>]
 #define CMD_GET_STATUS          "GET_STATUS"
 #define CMD_GET_CFG             "GET_CFG"
+// SET_CFG[,odr_hz=][,burst_ms=][,hb_ms=][,stream_rate_hz=][,flt=off|lp|hp|bp][,flt_n=<1..4>][,flt_f1=<hz>][,flt_f2=<hz>][,flt_path=<0..7>]
+// flt: Butterworth biquad cascade, flt_n sections per edge (bp: flt_n HP at flt_f1 + flt_n LP at flt_f2).
+// flt_path: 1 = burst, 2 = LIVE, 4 = trigger (with ZERO/ARM). Corners must be below 0.49 * odr_hz.
 #define CMD_SET_CFG             "SET_CFG"
 #define CMD_HB                  "HB"         // HB,OFF | HB,ON | HB,ms=<u32>
-#define CMD_TIME_SYNC           "TIME_SYNC" // Format: TIME_SYNC,host_ms=<u64>
-#define CMD_STREAM_START        "STREAM_START"
+#define CMD_TIME_SYNC           "TIME_SYNC" // Format: TIME_SYNC,host_ms=<u64>|host_us=<u64>[,stamp=0|1]
+#define CMD_STREAM_START        "STREAM_START"  // STREAM_START[,fmt=text|bin][,batch=<1..16>][,credits=<1..65535>]
 #define CMD_STREAM_STOP         "STREAM_STOP"
+#define CMD_STREAM_CREDIT       "STREAM_CREDIT" // STREAM_CREDIT,n=<1..65535>: grants n more samples
 #define CMD_GET_TRG             "GET_TRG"
-#define CMD_SET_TRG             "SET_TRG"
-#define CMD_MODE                "MODE"
+#define CMD_SET_TRG             "SET_TRG"    // SET_TRG[,k_mult=][,win_ms=<50..500>][,hold_ms=][,sleep=0|1][,act_mg=][,inact_mg=][,inact_s=][,pre_ms=<0..1000>][,det=peak|sta][,ch=xyz|mag]
+#define CMD_MODE                "MODE"       // MODE,TRIGGER_ON[,cd_s=<5..10>][,zero=stored] | MODE,TRIGGER_OFF
+#define CMD_BENCH               "BENCH"      // BENCH[,test=<name>|all], see MSG_BENCH_*
 #define CMD_CAL_READY           "CAL_READY"  // CAL_READY,phase=<hold_zero|hold_arm>
-#define CMD_ARM                 "ARM"
+// CAL_STORE[,SAVE|CLEAR]: SAVE writes SET_CFG, SET_TRG, the sensor offsets and the
+// ZERO profile to flash; they are restored at boot. IDLE or WAIT_ARM with sampling
+// stopped (103); an erase stalls the CPU up to 2 s. NACK flash_error (106) on failure.
+// Answers ACK and CAL_STORE_INFO.
+#define CMD_CAL_STORE           "CAL_STORE"
+// ARM and START_BURST_* answer NACK slot_busy (105) while one burst is being sent
+// and the next is already captured. A burst captured during another's transfer
+// sends its DATA_HEADER after that burst's ACK_COMPLETE.
+#define CMD_ARM                 "ARM"        // ARM[,result=blocks|summary]
 #define CMD_START_BURST_WEIGHT  "START_BURST_WEIGHT"
-#define CMD_START_BURST_DAMPING "START_BURST_DAMPING"
+#define CMD_START_BURST_DAMPING "START_BURST_DAMPING" // START_BURST_DAMPING,seconds=<1..600>[,result=blocks|summary]
+// GET_PREVIEW[,n=<1..448>][,decim=<1..64>]: the newest n primary-sensor samples,
+// every decim:th, as a burst DATA_HEADER,type=PREVIEW over BLOCKS (session codec,
+// ACK_BLK/ACK_COMPLETE as for DAMP bursts). IDLE only (103); NACK slot_busy (105)
+// while two bursts hold the store. decim is further capped so the gap between
+// two samples fits the store's u16 stamp delta (param_range, 102).
 #define CMD_GET_PREVIEW         "GET_PREVIEW"
-#define CMD_GET_DIAG            "GET_DIAG"
+#define CMD_GET_DIAG            "GET_DIAG"   // GET_DIAG[,RESET]: link/ring counters and DIAG_PROF probes
+#define CMD_TRACE               "TRACE"      // TRACE[,RESET]: event trace ring, see MSG_TRACE_*
 #define CMD_REBOOT              "REBOOT"
 #define CMD_STOP                "STOP"
 #define CMD_ZERO                "ZERO"
@@ -36,7 +36,9 @@ typedef struct AppContext {
     TriggerSettings_t trigger_settings;
 
     // Real-time data and flags
-    TimeSync_t tsync;
+    PayloadCodec_t codec; // Session payload codec (HELLO,codec=)
+    BlockCrc_t blk_crc;   // Session BLOCKS CRC (HELLO,crc=)
+    BurstResult_t burst_result; // Next DAMP burst (ARM/START_BURST_DAMPING,result=)
     DiagCounters_t diag;
     volatile bool stop_flag;
     volatile bool is_dumping;
@@ -49,12 +51,13 @@ typedef struct AppContext {
     // Pointers to HAL handles to avoid global extern declarations
     TIM_HandleTypeDef* htim2; // For microsecond timestamps
     TIM_HandleTypeDef* htim3; // For sampling
-    I2C_HandleTypeDef* hi2c1; // For sensor
+    I2C_HandleTypeDef* hi2c1; // For sensor (I2C backend)
+    SPI_HandleTypeDef* hspi2; // For sensor (SPI backend, see sensor_bus.h)
 
 } AppContext_t;
 
 // Initializes the context with default values and HAL handles.
-void AppContext_Init(AppContext_t* ctx, TIM_HandleTypeDef* htim2, TIM_HandleTypeDef* htim3, I2C_HandleTypeDef* hi2c1);
+void AppContext_Init(AppContext_t* ctx, TIM_HandleTypeDef* htim2, TIM_HandleTypeDef* htim3, I2C_HandleTypeDef* hi2c1, SPI_HandleTypeDef* hspi2);
 
 // Centralized function to change the operational mode and send a STATUS update.
 void AppContext_SetOpMode(AppContext_t* ctx, OpMode_t new_mode);
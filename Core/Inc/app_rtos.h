@@ -0,0 +1,84 @@
+/* filename: Core/Inc/app_rtos.h */
+#ifndef APP_RTOS_H_
+#define APP_RTOS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sched.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Valfritt RTOS-bygge (FreeRTOS via CMSIS-RTOS v2), -DAPP_USE_RTOS=1.
+ * Kräver CubeMX:s FreeRTOS-middleware (CMSIS_V2) med HAL-tidbasen kvar på
+ * SysTick (USE_CUSTOM_SYSTICK_HANDLER_IMPLEMENTATION=1) och
+ * configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY <= 3, eftersom I2C/SPI-DMA
+ * (prio 3) och UART (prio 6) postar trådflaggor. Med COMM_USE_USB_CDC gäller
+ * samma gräns för OTG_FS-avbrottet (usbd_conf.c).
+ *
+ * Samma uppgiftstabell som den kooperativa loopen (sched.h) fördelas på tre trådar:
+ *  - ACQ   (osPriorityHigh): packar upp råa banker när drain-ISR:en lämnar över
+ *          en (SCHED_EV_BANK, i stället för PendSV som ägs av kärnan), kör
+ *          Trigger_Pump och Sensor_Pump.
+ *  - XPORT (osPriorityAboveNormal): BurstManager_Pump/TB_Pump och LIVE mot COMM.
+ *  - CMD   (osPriorityBelowNormal): kommandon, telemetri, nedräkning, STOP och LED.
+ * Modulerna är skrivna för en tråd, så varje pass körs under ett gemensamt
+ * mutex med prioritetsarv. Uppackningen körs utanför det, precis som PendSV
+ * kunde avbryta huvudloopen var som helst. Blockerande TX-väntan
+ * (APP_WAIT_EVENT) släpper mutexet, så en CMD-tråd som väntar på plats i
+ * TX-ringen inte håller ACQ borta.
+ */
+#ifndef APP_USE_RTOS
+#define APP_USE_RTOS 0
+#endif
+
+#ifndef APP_RTOS_STACK_ACQ
+#define APP_RTOS_STACK_ACQ    1536u   // bytes
+#endif
+#ifndef APP_RTOS_STACK_XPORT
+#define APP_RTOS_STACK_XPORT  1536u
+#endif
+#ifndef APP_RTOS_STACK_CMD
+#define APP_RTOS_STACK_CMD    3072u   // kommandohanterarna formaterar på stacken
+#endif
+
+#if APP_USE_RTOS
+
+/**
+ * @brief Skapar mutex och trådar för tabellen och startar kärnan. Återvänder inte.
+ * @param ctx   Applikationskontext som skickas till varje uppgift.
+ * @param tasks Uppgiftstabell; måste leva under hela körningen.
+ * @param n     Antal uppgifter.
+ */
+void App_RtosStart(AppContext_t* ctx, const SchedTask_t* tasks, size_t n);
+
+/**
+ * @brief Sätter trådflaggor hos de trådar vars uppgifter väntar på ev. ISR-säker.
+ */
+void App_RtosNotify(uint32_t ev);
+
+/**
+ * @brief Väntar ett tick med applikationsmutexet släppt om anroparen håller det.
+ *        Före kärnstart: __WFE().
+ */
+void App_RtosBlockWait(void);
+
+/**
+ * @brief Skickar GET_DIAG-raderna för trådarna: stackmarginal, pass, längsta
+ *        väntan på mutexet samt högvattenmärken för sampel-, RX- och TX-ringen
+ *        och TB-kön.
+ */
+void App_RtosSendDiag(void);
+
+#define APP_WAIT_EVENT() App_RtosBlockWait()
+#else
+#define APP_WAIT_EVENT() __WFE()
+#endif /* APP_USE_RTOS */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APP_RTOS_H_ */
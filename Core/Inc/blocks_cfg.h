@@ -17,7 +17,8 @@ typedef struct {
 
 void        BlocksCfg_Init(uint16_t def_window, uint16_t def_lines, uint8_t def_retries);
 BlocksCfg_t BlocksCfg_Get(void);
-/* Returnerar 1 vid OK, 0 vid valideringsfel. Tillämpar direkt på BLOCKS-transporten. */
+/* Returnerar 1 vid OK, 0 vid valideringsfel. Tillämpar direkt på BLOCKS-transporten.
+ * window och lines är tak; TB:s länkregulator kör inom dem. */
 int         BlocksCfg_Set(uint16_t window, uint16_t lines, uint8_t retries);
 
 #ifdef __cplusplus
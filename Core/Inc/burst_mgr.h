@@ -18,26 +18,48 @@ extern "C" {
 typedef enum {
     BM_TYPE_WEIGHT = 0,
     BM_TYPE_DAMP_TRG = 1,
-    BM_TYPE_DAMP_CD  = 2
+    BM_TYPE_DAMP_CD  = 2,
+    BM_TYPE_PREVIEW  = 3
 } BM_Type;
 
+/* Burstlagret: 13 bitar per axel (ADXL345 full-res) plus sensorbit i 5 byte och
+ * en u16-tidsdifferens, 7 byte per sampel. DAMP-bursts köas medan de spelas in
+ * och TB renderar blocket vid köning, så lagret är en ring som bara behöver rymma
+ * det som ännu inte köats; en DAMP-burst kan vara BM_BURST_MAX_SAMPLES lång
+ * (u16 i DATA_HEADER/COMPLETE). WEIGHT sparas helt och begränsas till lagret.
+ * Lagret delas av två burstplatser: nästa burst spelas in medan den förra sänds
+ * och får sin DATA_HEADER när den förra är kvitterad (ACK_COMPLETE). */
+#ifndef BM_STORE_SAMPLES
+#define BM_STORE_SAMPLES 8192U
+#endif
+#define BM_BURST_MAX_SAMPLES 65535U
+
 /* Init underlying BLOCKS-transport and burst manager state. */
 void BM_Init(uint16_t window, uint16_t blk_lines, uint8_t max_retries);
 void BurstManager_Init(AppContext_t* ctx);
 
-/* Starta ny burst: sänder DATA_HEADER och primar BLOCKS. */
-void BM_Begin(BM_Type type, uint32_t burst_id, uint32_t ts0_us, uint16_t samples, uint32_t odr_hz);
+/* Starta ny burst: sänder DATA_HEADER och primar BLOCKS. ts0_us är första
+ * samplets Timebase-tid (även för host_us=). samples är planerat antal; block
+ * får köas medan bursten spelas in (BM_SetSamples före BM_EndOk). */
+void BM_Begin(BM_Type type, uint32_t burst_id, uint64_t ts0_us, uint16_t samples, uint32_t odr_hz,
+              PayloadCodec_t codec);
 void BurstManager_Start(AppContext_t* ctx, DataKind_t kind, uint32_t burst_id, uint32_t duration_ms);
+/* DAMP_TRG från triggern: samplingen går vidare utan omstart och sensorringarna
+ * spolas tillbaka så att bursten börjar trigger_settings.pre_ms före ts_trig
+ * (TIM2-stämpeln för triggersamplet). Rader före triggern räknas in i bursten. */
+void BurstManager_StartTriggered(AppContext_t* ctx, uint32_t burst_id, uint32_t ts_trig);
 
 /* Köa block för aktuell burst. 'lines' måste vara <= konfigurerad blk_lines. */
 int  BM_Enqueue(const TB_BlockGen* blk);
+/* Faktiskt antal sampel, rapporteras i COMPLETE. */
+void BM_SetSamples(uint16_t samples);
 
 /* Anropas regelbundet i main-loop. Sköter sändning, timeouts och ACK/NACK. */
 void BM_Pump(void);
 void BurstManager_Pump(AppContext_t* ctx);
 
 /* Hook för värdrader. Returnerar 1 om hanterad. Delger ACK_BLK/NACK_BLK och ACK_COMPLETE. */
-int  BM_HandleHostLine(const char* line);
+int  BM_HandleHostLine(const api_tokens_t* t);
 
 /* Avsluta bursten. COMPLETE skickas med reason=ok eller aborted. */
 void BM_EndOk(void);
@@ -46,12 +68,33 @@ void BM_EndAborted(uint32_t code);
 /* Tillståndsfrågor för gating av HB/LIVE och sekvensering. */
 uint8_t BM_IsActive(void);
 uint8_t BM_IsWaitingAckComplete(void);
+uint8_t BM_IsEnding(void); /* COMPLETE köat eller skickat (t.ex. transporten avbröt) */
 
 /* New functions to manage state from other modules */
 void BurstManager_Reset(AppContext_t* ctx);
 void BurstManager_Configure(AppContext_t* ctx, DataKind_t kind, uint32_t seconds, uint32_t cycles);
 uint32_t BurstManager_GetNextBurstId(AppContext_t* ctx);
 DataKind_t BurstManager_GetCurrentKind(AppContext_t* ctx);
+/* En ny burst kan startas: ingen inspelning pågår och en plats är ledig (annars
+ * sänds en burst och en till väntar). ARM/START_* nekar med slot_busy. */
+bool BurstManager_CanCapture(AppContext_t* ctx);
+
+/* BENCH: renderar lines DATA-rader (codec=raw) ur lagret med samma generator som
+ * BLOCKS, utan att köa dem. Innehållet är vad lagret råkar hålla; bara tiden är
+ * intressant. Returnerar antal bytes, eller -1 om en burst spelas in eller sänds. */
+int32_t BurstManager_BenchLines(uint16_t lines);
+/* BENCH,test=burst: en vanlig DAMP-burst (result=blocks) med minst samples sampel,
+ * utan nedräkning. Returnerar false om ingen plats är ledig. */
+bool BurstManager_StartBench(AppContext_t* ctx, uint16_t samples);
+
+/* GET_PREVIEW: kopierar de senaste n sampel (var decim:e) ur primärsensorns
+ * historik till lagret och sänder dem som en burst av typen PREVIEW, med
+ * kvittens och omsändning som DAMP-bursts och sessionens codec. Samplingen
+ * störs inte. Returnerar false om ingen plats eller lagret inte räcker. */
+#define BM_PREVIEW_MAX_DECIM 64U
+bool BurstManager_StartPreview(AppContext_t* ctx, uint16_t n, uint16_t decim);
+/* Största decim där avståndet mellan två sampel ryms i lagrets u16-tidsdifferens. */
+uint16_t BurstManager_PreviewMaxDecim(const AppContext_t* ctx);
 
 
 #ifdef __cplusplus
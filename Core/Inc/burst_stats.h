@@ -0,0 +1,55 @@
+/* filename: Core/Inc/burst_stats.h */
+#ifndef BURST_STATS_H_
+#define BURST_STATS_H_
+
+#include <stdint.h>
+#include "main.h" // SENSOR_MAX_DEVICES
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Löpande burststatistik per sensor och kanal (x, y, z och magnituden |a|),
+ * uppdaterad per sampel medan bursten dräneras. Welford i float: stabil varians
+ * utan double-summor och utan ett andra pass efter insamlingen.
+ */
+typedef enum {
+    BSTAT_X = 0,
+    BSTAT_Y,
+    BSTAT_Z,
+    BSTAT_MAG,
+    BSTAT_CHANNELS
+} BurstStatChan_t;
+
+typedef struct {
+    uint32_t n;
+    float    mean;
+    float    m2;     /* summa av kvadrerade avvikelser från medel */
+    float    peak;   /* största |värde| */
+} BurstStat_t;
+
+typedef struct {
+    BurstStat_t ch[SENSOR_MAX_DEVICES][BSTAT_CHANNELS];
+} BurstStats_t;
+
+/* Nollställ alla kanaler. */
+void  BurstStats_Reset(BurstStats_t* st);
+
+/* Lägg till ett kalibrerat sampel (m/s^2) från sensor. */
+void  BurstStats_Add(BurstStats_t* st, uint8_t sensor, float ax, float ay, float az);
+
+/* Populationens standardavvikelse. */
+float BurstStat_Std(const BurstStat_t* s);
+
+/* RMS inklusive medel (sqrt(mean^2 + var)). */
+float BurstStat_Rms(const BurstStat_t* s);
+
+/* Crest factor peak / RMS, 0 om RMS är 0. */
+float BurstStat_Crest(const BurstStat_t* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BURST_STATS_H_ */
@@ -0,0 +1,103 @@
+/* filename: Core/Inc/cal_store.h */
+#ifndef CAL_STORE_H_
+#define CAL_STORE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "main.h"          // RuntimeCfg_t, TriggerSettings_t, SENSOR_MAX_DEVICES
+#include "app_context.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Kalibrering och konfiguration i flash: en egen sektor som logg av poster.
+ *  - Varje CAL_STORE,SAVE lägger en ny post efter den förra; sektorn raderas
+ *    först när nästa post inte ryms (eller inte ligger på raderad flash), så
+ *    en radering per ~1000 sparningar. Nyaste giltiga post gäller.
+ *  - Post: huvud (magic, version, längd, sekvens, raderingar), data och
+ *    CRC-32/MPEG-2 över båda (proto_crc32_ref). Magic skrivs först och CRC:n
+ *    sist, så en post som avbröts av strömavbrott underkänns och hoppas över.
+ *  - Ny CAL_STORE_VERSION eller annan datastorlek gör gamla poster ogiltiga;
+ *    då startar enheten med standardvärdena som förut.
+ *  - Radering av en 128 KB-sektor stoppar CPU:n 1-2 s (flash läses inte under
+ *    tiden), så SAVE och CLEAR tillåts bara i IDLE/WAIT_ARM utan sampling eller burst.
+ *  - Sektorn får inte användas av programmet; standard är sista sektorn på
+ *    STM32F446RE (512 KB), så bilden måste vara under 384 KB.
+ */
+#ifndef CAL_STORE_SECTOR
+#define CAL_STORE_SECTOR FLASH_SECTOR_7
+#define CAL_STORE_ADDR   0x08060000u
+#define CAL_STORE_SIZE   (128u * 1024u)
+#endif
+
+#define CAL_STORE_VERSION 1u
+
+/* Vilka delar en post innehåller (cfg och trg finns alltid). */
+#define CAL_STORE_F_OFFSETS 0x01u   // Sensorernas offset i m/s^2
+#define CAL_STORE_F_ZERO    0x02u   // ZERO-brusprofilen (μ₀, Δ₀)
+
+typedef struct {
+    RuntimeCfg_t cfg;
+    TriggerSettings_t trg;
+    uint8_t parts;                         // CAL_STORE_F_*
+    uint8_t dev_count;                     // Sensorer när offseten mättes
+    int16_t zero_mu_raw[3];
+    uint16_t zero_noise_absmax[3];
+    float off_ms2[SENSOR_MAX_DEVICES][3];
+} CalStoreData_t;
+
+/**
+ * @brief Söker igenom sektorn efter nyaste giltiga post. Anropas en gång vid start.
+ */
+void CalStore_Init(void);
+
+/**
+ * @brief Läser nyaste giltiga post.
+ * @return true om en post fanns (out fylld), annars false.
+ */
+bool CalStore_Load(CalStoreData_t* out);
+
+/**
+ * @brief Lägger till en post; raderar sektorn först om den är full.
+ * @return HAL_OK, eller HAL_ERROR om programmering/verifiering misslyckades.
+ */
+HAL_StatusTypeDef CalStore_Save(const CalStoreData_t* d);
+
+/**
+ * @brief Raderar sektorn, så att nästa start använder standardvärdena.
+ */
+HAL_StatusTypeDef CalStore_Clear(void);
+
+/**
+ * @brief Skickar CAL_STORE_INFO för nyaste posten.
+ */
+void CalStore_SendInfo(void);
+
+/**
+ * @brief Sätter ctx->cfg och ctx->trigger_settings från nyaste posten.
+ * @note Före Sensor_Init, så att ODR och filter kommer från posten direkt.
+ * @return true om en post fanns.
+ */
+bool CalStore_RestoreConfig(AppContext_t* ctx);
+
+/**
+ * @brief Återställer offset och ZERO-profil från nyaste posten och skickar
+ *        CAL_INFO,status=restored.
+ * @note Efter Sensor_Init och Trigger_Init. Offseten används bara om antalet
+ *       sensorer är detsamma som när de mättes.
+ * @return true om offseten återställdes (startkalibreringen kan hoppas över).
+ */
+bool CalStore_RestoreCalibration(void);
+
+/**
+ * @brief Sparar aktuell konfiguration, offset och ZERO-profil (CAL_STORE,SAVE).
+ */
+HAL_StatusTypeDef CalStore_SaveContext(AppContext_t* ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAL_STORE_H_ */
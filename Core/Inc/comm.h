@@ -18,8 +18,23 @@ extern "C" {
 
 /* --- Configuration --- */
 #define COMM_TX_RING_SIZE 4096U   /* Ökat för att undvika drop/trunkering vid burst-sekvenser */
-#define COMM_TX_DMA_SIZE  512U    /* Större DMA-chunk => färre avbrott och jämnare tömning */
+#define COMM_TX_DMA_SIZE  512U    /* Max bytes per DMA-start direkt ur ringen (ingen kopia) */
 #define RX_RING_BUFFER_SIZE 2048U /* Flyttad hit från comm.c för global synlighet */
+#define COMM_TX_CTRL_SIZE 1024U   /* Kontroll-lane: ACK/NACK/ERROR/TRIGGER_EDGE före bulkdata */
+#define COMM_TX_MARKS     32U     /* Radgränser i bulkringen som DMA kan byta lane vid (2^n) */
+
+/*
+ * Värdlänk, väljs vid byggning (som SENSOR_BUS_USE_SPI):
+ *  0 = USART2 921600 baud via ST-LINK VCP (standard)
+ *  1 = USB CDC-ACM på OTG FS (PA11/PA12, 12 Mbit/s). Kräver CubeMX USB_DEVICE-
+ *      middleware (usb_device.h, usbd_cdc_if.h), HAL_PCD och 48 MHz CLK48.
+ *      I usbd_cdc_if.c anropas COMM_UsbRxCallback() från CDC_Receive_FS
+ *      (före ReceivePacket) och COMM_UsbTxCpltCallback() från CDC_TransmitCplt_FS.
+ * Ringar, lanes och hela COMM_*-API:t är desamma för båda.
+ */
+#ifndef COMM_USE_USB_CDC
+#define COMM_USE_USB_CDC 0
+#endif
 
 
 /* GCC printf-format checking where available */
@@ -83,6 +98,19 @@ void COMM_OnRxEvent(UART_HandleTypeDef *huart, uint16_t Size);
  */
 void COMM_TxCpltCallback(UART_HandleTypeDef *huart);
 
+#if COMM_USE_USB_CDC
+/**
+ * @brief USB CDC OUT data (USB ISR context). Feeds the same RX ring and line
+ *        assembler (COMM_Process_Budgeted) as the UART.
+ */
+void COMM_UsbRxCallback(const uint8_t *buf, uint32_t len);
+
+/**
+ * @brief USB CDC IN transfer complete (USB ISR context); starts the next span.
+ */
+void COMM_UsbTxCpltCallback(void);
+#endif
+
 /**
  * @brief Strong implementation of telemetry write function.
  * Atomically enqueues a block of data for transmission. The entire block is
@@ -93,7 +121,68 @@ void COMM_TxCpltCallback(UART_HandleTypeDef *huart);
  */
 size_t Telemetry_Write(const char* data, size_t len);
 
-/* TX Buffer introspection */
+/*
+ * Zero-copy TX: reserve room at the ring head, write in place, then publish.
+ * A reservation covers one or two spans (p[1]/len[1] is the part after the
+ * wrap, len[1] == 0 when contiguous). Only one reservation can be open; while
+ * it is, Telemetry_Write() drops. Thread context only, like all producers.
+ */
+typedef struct {
+    char*    p[2];
+    uint16_t len[2];
+} COMM_TxSpan;
+
+/**
+ * @brief Reserves exactly len bytes.
+ * @return 1 if reserved, 0 if there is not enough room or a reservation is open.
+ */
+int      COMM_TxReserve(uint16_t len, COMM_TxSpan* span);
+
+/**
+ * @brief Reserves as much as is free, up to max_len bytes.
+ * @return Number of bytes reserved (0 if none).
+ */
+uint16_t COMM_TxReserveUpTo(uint16_t max_len, COMM_TxSpan* span);
+
+/**
+ * @brief Publishes the first n reserved bytes and closes the reservation.
+ * @param n Bytes written from the start of span p[0]; 0 cancels.
+ */
+void     COMM_TxCommit(uint16_t n);
+
+/**
+ * @brief Opens a line of at most PROTO_MAX_LINE bytes to be built in place.
+ * @return Write pointer: into the TX ring when the line fits before the ring
+ *         end, otherwise a static scratch line that COMM_LineEnd() copies over.
+ * @note Non-blocking and for thread context only. Every call must be followed
+ *       by COMM_LineEnd(); until then Telemetry_Write drops.
+ */
+char*    COMM_LineBegin(void);
+
+/**
+ * @brief Publishes the line [begin, end) opened by COMM_LineBegin().
+ * @return Bytes queued, 0 if the line did not fit (dropped and counted).
+ */
+int      COMM_LineEnd(const char* end);
+
+/*
+ * Kontroll-lane. Hela rader köas i en egen ring som DMA-schemaläggaren alltid
+ * tömmer först, vid nästa radgräns i bulkringen. Raderna kan därför komma före
+ * bulkdata som köades tidigare, även mellan raderna i ett BLOCK.
+ */
+
+/**
+ * @brief Queues data on the control lane atomically (all or nothing).
+ * @return len if queued, 0 if dropped (counted in COMM_TxCtrlDropCount).
+ */
+size_t   COMM_WriteCtrl(const char* data, size_t len);
+
+/**
+ * @brief printf-style send on the control lane. Same limits as COMM_Sendf.
+ */
+int      COMM_SendfCtrl(const char* fmt, ...) COMM_PRINTF_ATTR(1, 2);
+
+/* TX Buffer introspection (bulk lane) */
 uint16_t COMM_TxFree(void);
 
 /* TX is truly idle only when DMA is not active, ring is empty, and no staged DMA length. */
@@ -101,12 +190,40 @@ void    COMM_SendLine(const char* s);
 int     COMM_SendfLine(const char* fmt, ...);
 uint8_t COMM_TxIsIdle(void);
 
-/* Blocking variants for correctness-critical transmissions */
+/* Blocking variants for correctness-critical transmissions.
+ * They sleep in COMM_TxWaitFree() and drop (counted) after COMM_TX_BLOCK_TIMEOUT_MS. */
 size_t  Telemetry_WriteBlocking(const char* data, size_t len);
 int     COMM_SendfBlocking(const char* fmt, ...);
 
+/* --- Waiting for bulk TX space --- */
+#define COMM_WAIT_FOREVER        0xFFFFFFFFU
+#define COMM_TX_BLOCK_TIMEOUT_MS 1000U   /* Hela ringen går ut på ~45 ms vid 921600; längre = länken står */
+#define COMM_TX_NOTIFY_MAX       4U
+
+/**
+ * @brief Sleeps (WFE) until the bulk ring has len bytes free.
+ *        Woken by the TX-complete event (SEV) or any other interrupt; never
+ *        masks interrupts while waiting. Thread context only.
+ * @param timeout_ms Max wait in ms, or COMM_WAIT_FOREVER.
+ * @return HAL_OK when the space is there, HAL_TIMEOUT, or HAL_ERROR if len can
+ *         never fit or a COMM_TxReserve is open.
+ */
+HAL_StatusTypeDef COMM_TxWaitFree(uint16_t len, uint32_t timeout_ms);
+
+typedef void (*COMM_TxFreeFn)(void* arg);
+
+/**
+ * @brief One-shot notification when the bulk ring has len bytes free.
+ * @note  fn runs from COMM_Process/COMM_Process_Budgeted (thread context), so it
+ *        may write to COMM and register again. Up to COMM_TX_NOTIFY_MAX pending.
+ * @return 1 if registered, 0 if the table is full or len can never fit.
+ */
+int COMM_TxNotifyFree(uint16_t len, COMM_TxFreeFn fn, void* arg);
+
 /* Diagnostic getters */
-uint32_t COMM_TxDropCount(void);
+uint32_t COMM_TxDropCount(void);      /* bulk lane */
+uint32_t COMM_TxSentBytes(void);      /* both lanes, completed spans (wraps) */
+uint32_t COMM_TxCtrlDropCount(void);  /* control lane */
 uint32_t COMM_RxOverflowCount(void);
 uint16_t COMM_TxRingUsage(void);
 uint16_t COMM_RxRingUsage(void);
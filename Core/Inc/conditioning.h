@@ -0,0 +1,57 @@
+/* filename: Core/Inc/conditioning.h */
+#ifndef CONDITIONING_H_
+#define CONDITIONING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "main.h"   // Sample_t, RuntimeCfg_t, SENSOR_MAX_DEVICES
+#include "filter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Signalkonditionering före burst-, LIVE- och triggervägen: en biquad-kaskad
+ * (filter.h) som väljs med SET_CFG,flt=lp|hp|bp,flt_n=,flt_f1=,flt_f2=,flt_path=.
+ *  - Koefficienterna är gemensamma; varje väg har eget tillstånd per sensor.
+ *  - Utdata avrundas tillbaka till råa counts, så formatering, kodekar och
+ *    kalibrering nedströms är oförändrade.
+ *  - Första samplet efter Cond_Reset sätter kaskaden i DC-jämvikt: ett högpass
+ *    börjar på 0 i stället för att ringa ut 1 g.
+ *  - Triggervägen filtrerar även ZERO/ARM, så Δ₀ och μ_arm mäts på samma signal
+ *    som triggern ser. Efter en ändring av den vägen behövs ny ZERO och ARM.
+ */
+typedef enum {
+    COND_OFF = 0,
+    COND_LP,
+    COND_HP,
+    COND_BP
+} CondType_t;
+
+/* flt_path-bitar */
+#define COND_PATH_BURST 0x01u
+#define COND_PATH_LIVE  0x02u
+#define COND_PATH_TRG   0x04u
+#define COND_PATH_ALL   (COND_PATH_BURST | COND_PATH_LIVE | COND_PATH_TRG)
+
+/* Stycklängd för Cond_Apply-anropare som kopierar ur sensorringen. */
+#define COND_CHUNK FILTER_BLOCK_MAX
+
+/* Designar om kaskaden från cfg (flt, flt_n, flt_f1_hz, flt_f2_hz, odr_hz) och nollställer alla vägar. */
+void Cond_Configure(const RuntimeCfg_t* cfg);
+
+/* True om vägen (en COND_PATH_*-bit) filtreras. */
+bool Cond_IsOn(uint8_t path);
+
+/* Nästa sampel på vägen sätter om tillståndet (efter glapp i dataflödet). */
+void Cond_Reset(uint8_t path);
+
+/* Filtrerar n sampel från samma sensor på plats; gör inget om vägen är av. */
+void Cond_Apply(uint8_t path, Sample_t* s, uint16_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONDITIONING_H_ */
@@ -0,0 +1,53 @@
+/* filename: Core/Inc/damp_analysis.h */
+#ifndef DAMP_ANALYSIS_H_
+#define DAMP_ANALYSIS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Dämpningsanalys av en inspelad DAMP-burst (en kanal):
+ *  - Dominant frekvens: reell FFT över DAMP_FFT_N sampel från toppen (insvängningen),
+ *    Hann-fönster och gaussisk interpolation mellan binnarna (bråkdels bin).
+ *  - Dämpning: största |avvikelse| per period ger envelopen; logaritmiskt dekrement
+ *    delta som minsta kvadrat-lutning av ln(A_i) per period, zeta = delta / sqrt(4 pi^2 + delta^2).
+ * FFT:n är in-tree (radix-2, float på M4F-FPU:n). Med DAMP_USE_CMSIS_DSP=1 och
+ * CMSIS-DSP länkat används arm_rfft_fast_f32 i stället; spektrumformatet är detsamma.
+ */
+
+#ifndef DAMP_FFT_N
+#define DAMP_FFT_N 1024U          /* 2-potens, 64..4096; 1.28 s vid 800 Hz */
+#endif
+#define DAMP_MAX_CYCLES    256U   /* Perioder i envelopen */
+#define DAMP_MIN_CYCLES    3U     /* Färre ger ok=0 */
+#define DAMP_ENV_FLOOR     0.05f  /* Envelopen slutar under 5 % av första toppen */
+
+/* Hämtar kanalvärde för lagerposition i; false om positionen hör till en annan kanal. */
+typedef bool (*DampSampleFn)(uint16_t i, float* v, void* user);
+
+typedef struct {
+    float    f_hz;       /* dominant frekvens */
+    float    delta;      /* logaritmiskt dekrement per period */
+    float    zeta;       /* dämpningskvot */
+    float    amp0;       /* första envelopetopp (enhet som indata) */
+    uint16_t cycles;     /* perioder i anpassningen */
+    uint16_t n;          /* kanalens sampel */
+    bool     ok;
+} DampResult_t;
+
+/**
+ * @brief Analyserar lagerpositionerna 0..count-1 (kanalen som get väljer ut).
+ * @param fs_hz Kanalens samplingsfrekvens.
+ * @return out->ok; false om kanalen är för kort, utan topp eller har färre än DAMP_MIN_CYCLES perioder.
+ */
+bool Damp_Analyze(DampSampleFn get, void* user, uint16_t count, float fs_hz, DampResult_t* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DAMP_ANALYSIS_H_ */
@@ -18,4 +18,38 @@
  */
 void DevDiag_RunAllTests(AppContext_t* ctx);
 
+// --- BENCH: mätningar för jämförelse mellan firmwareversioner (api_schema.h) ---
+#define DEVDIAG_BENCH_CRC16    0x01u
+#define DEVDIAG_BENCH_DATALINE 0x02u
+#define DEVDIAG_BENCH_SENDF    0x04u
+#define DEVDIAG_BENCH_TXDRAIN  0x08u
+#define DEVDIAG_BENCH_DRAIN    0x10u
+#define DEVDIAG_BENCH_BURST    0x20u
+#define DEVDIAG_BENCH_ALL      0x1Fu  // allt utom burst, som kräver värdens kvittenser
+
+/**
+ * @brief Översätter test=<namn> till en testmask.
+ * @param name Testnamn, "all" eller NULL (= all).
+ * @return Mask, eller 0 för okänt namn.
+ */
+uint8_t DevDiag_BenchMask(const char* name);
+
+/**
+ * @brief Sant medan BENCH,test=burst väntar på sin burst.
+ */
+bool DevDiag_BenchBusy(void);
+
+/**
+ * @brief Kör de blockerande testerna i mask och skickar BENCH_START/BENCH_RES.
+ * @note Bara i IDLE utan pågående burst. Med DEVDIAG_BENCH_BURST startas en
+ * burst och BENCH_END skickas av DevDiag_BenchPump, annars direkt.
+ * @param name Testnamnet som ekas i BENCH_START/BENCH_END.
+ */
+void DevDiag_Bench(AppContext_t* ctx, uint8_t mask, const char* name);
+
+/**
+ * @brief Följer burst-testet till ACK_COMPLETE eller timeout (huvudloopen).
+ */
+void DevDiag_BenchPump(AppContext_t* ctx);
+
 #endif // DEV_DIAGNOSTICS_H
\ No newline at end of file
@@ -28,6 +28,47 @@ void  Filter_Reset(iir_filter_t* f);
 /* Process one sample and return the filtered value. */
 float Filter_Update(iir_filter_t* f, float input);
 
+/*
+ * Biquad cascade for three axes (x, y, z), Butterworth sections from the same
+ * bilinear design as Filter_Init.
+ *  - Coefficients are shared by all axes and instances; every state holds one
+ *    cascade's history.
+ *  - State is structure-of-arrays with the three axes side by side, so the
+ *    three independent recursions of a section interleave on the FPU pipeline.
+ *  - A band-pass is n high-pass sections at f1 followed by n low-pass at f2.
+ *  - With FILTER_USE_CMSIS_DSP=1 and CMSIS-DSP linked, the cascade runs on
+ *    arm_biquad_cascade_df1_f32 per axis; results are the same.
+ */
+#define FILTER_CASCADE_N_MAX 4U                           /* Sections per band edge */
+#define FILTER_CASCADE_STAGES (2U * FILTER_CASCADE_N_MAX) /* BP: HP + LP */
+#define FILTER_BLOCK_MAX 32U                              /* Samples per Filter_CascadeRun chunk */
+
+typedef enum {
+    FILTER_LOWPASS = 0,
+    FILTER_HIGHPASS,
+    FILTER_BANDPASS
+} filter_type_t;
+
+typedef struct {
+    uint8_t n_stages;
+    float   coef[FILTER_CASCADE_STAGES][5];  /* b0, b1, b2, -a1, -a2 (CMSIS DF1 order) */
+    float   dc_gain[FILTER_CASCADE_STAGES];  /* 1 for LP sections, 0 for HP */
+} filter_cascade_t;
+
+typedef struct {
+    float h[FILTER_CASCADE_STAGES][4][3];    /* x1, x2, y1, y2 per section, axes side by side */
+} filter_xyz_state_t;
+
+/* n sections per band edge (1..FILTER_CASCADE_N_MAX); f2_hz is only used for BP. */
+void Filter_CascadeDesign(filter_cascade_t* c, filter_type_t type, float f1_hz, float f2_hz,
+                          uint8_t n, float fs_hz);
+
+/* Seeds every section at its DC steady state for a constant input v0[3]. */
+void Filter_CascadeSeed(const filter_cascade_t* c, filter_xyz_state_t* s, const float v0[3]);
+
+/* Filters n interleaved x, y, z triplets in place (n <= FILTER_BLOCK_MAX). */
+void Filter_CascadeRun(const filter_cascade_t* c, filter_xyz_state_t* s, float* xyz, uint16_t n);
+
 #ifdef __cplusplus
 }
 #endif
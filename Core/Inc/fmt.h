@@ -0,0 +1,44 @@
+/* filename: Core/Inc/fmt.h */
+#ifndef FMT_H_
+#define FMT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Snabb talformatering för radgeneratorerna (DATA, DK/DD, PREVIEW, SUMMARY, LIVE).
+ *  - Heltal till decimal utan vsnprintf.
+ *  - fmt_f3 ger exakt samma text som printf("%.3f"): float-värdet skalas med
+ *    1000 i 64-bitars heltal (mantissan är 24 bitar, så det är exakt) och
+ *    avrundas till närmaste, lika avstånd till jämn, som newlib/glibc.
+ *    Utanför |v| < 2^32 samt NaN/Inf faller den tillbaka på snprintf.
+ *  - Funktionerna skriver utan NUL och returnerar pekaren efter sista tecknet,
+ *    så en rad byggs med p = fmt_xxx(p, ...). Anroparen ansvarar för plats.
+ */
+
+/* Största antal tecken per anrop. */
+#define FMT_U32_MAX 10u
+#define FMT_I32_MAX 11u
+#define FMT_U64_MAX 20u
+#define FMT_F3_MAX  48u   /* "-" + 39 heltalssiffror (FLT_MAX) + ".000" med marginal */
+
+char* fmt_u32(char* p, uint32_t v);
+char* fmt_i32(char* p, int32_t v);
+char* fmt_u64(char* p, uint64_t v);
+
+/* Värde i tusendelar (Q-format, 3 decimaler) som "[-]i.fff". */
+char* fmt_milli(char* p, int64_t milli);
+
+/* Som printf("%.3f", v). */
+char* fmt_f3(char* p, float v);
+
+/* Kopierar strängen s utan NUL. */
+char* fmt_str(char* p, const char* s);
+
+/**
+ * @brief Jämför formateraren mot snprintf över ett fast svep av värden.
+ * @return Antal avvikande utdata (0 = byte-identiskt).
+ */
+uint32_t fmt_selftest(void);
+
+#endif /* FMT_H_ */
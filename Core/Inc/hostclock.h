@@ -0,0 +1,89 @@
+/* filename: Core/Inc/hostclock.h */
+#ifndef HOSTCLOCK_H
+#define HOSTCLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Host clock model fitted from TIME_SYNC samples.
+ *
+ * Each TIME_SYNC pairs the host time with Timebase_NowUs64(). The last
+ * HOSTCLOCK_WINDOW pairs are fitted by least squares in 64-bit fixed point:
+ *
+ *   host_us = y0 + (dev_us - x0) + off + skew * ((dev_us - x0) - mx)
+ *
+ * with (x0, y0) the newest pair, off/mx the mean residual and mean device
+ * offset of the window, and skew in Q32 (host seconds per device second - 1).
+ * TIM2 runs from the HSI, so skew is of the order ±1 %; it is only fitted
+ * once the window spans HOSTCLOCK_MIN_SPAN_US, before that the model is an
+ * offset on the nominal rate.
+ *
+ * A new pair further than HOSTCLOCK_STEP_US from the prediction, plus the
+ * rate uncertainty over the time since the previous pair (the host clock was
+ * stepped, or a stale sync), restarts the window from that pair, as does a
+ * fitted skew beyond HOSTCLOCK_MAX_SKEW_PPM.
+ *
+ * The model is swapped under PRIMASK, so readers in other threads or ISRs
+ * (HB, TRIGGER_EDGE, LIVE) always see one consistent fit.
+ */
+
+#ifndef HOSTCLOCK_WINDOW
+#define HOSTCLOCK_WINDOW 8u
+#endif
+#define HOSTCLOCK_MIN_SPAN_US  2000000u    // 2 s between oldest and newest sync
+#define HOSTCLOCK_MAX_SKEW_PPM 20000u      // twice the HSI tolerance
+#define HOSTCLOCK_FIT_TOL_PPM  500u        // rate uncertainty once skew is fitted
+#define HOSTCLOCK_STEP_US      50000u
+
+typedef struct {
+    uint8_t  n;          // Pairs in the window
+    bool     restarted;  // The window was restarted by this pair
+    int32_t  skew_ppb;   // Fitted skew, 0 until the span is long enough
+    int32_t  resid_us;   // This pair against the previous model (0 for the first)
+    uint32_t span_ms;    // Oldest to newest pair
+} HostClockFit_t;
+
+/**
+ * @brief Forgets all syncs and turns host stamping off (HELLO).
+ */
+void HostClock_Reset(void);
+
+/**
+ * @brief Adds one TIME_SYNC pair and refits the model.
+ * @param host_us Host time in microseconds.
+ * @param dev_us Timebase_NowUs64() when the sync was received.
+ * @param[out] fit Window state after the fit (may be NULL).
+ */
+void HostClock_AddSync(uint64_t host_us, uint64_t dev_us, HostClockFit_t* fit);
+
+/**
+ * @brief True once at least one TIME_SYNC has been received.
+ */
+bool HostClock_HasSync(void);
+
+/**
+ * @brief Maps device microseconds to host microseconds.
+ * @return False (and *host_us = 0) before the first TIME_SYNC.
+ */
+bool HostClock_ToHostUs(uint64_t dev_us, uint64_t* host_us);
+
+/**
+ * @brief Enables the host_us= field on DATA_HEADER, TRIGGER_EDGE and LIVE (TIME_SYNC,stamp=).
+ */
+void HostClock_SetStamping(bool on);
+
+/**
+ * @brief True if stamping is enabled and a model exists.
+ */
+bool HostClock_IsStamping(void);
+
+/**
+ * @brief Appends ",host_us=<u64>" for dev_us when stamping, nothing otherwise.
+ * @note Writes no NUL (fmt.h convention); at most HOSTCLOCK_FIELD_MAX chars.
+ * @return Pointer past the last written character.
+ */
+char* HostClock_FmtField(char* p, uint64_t dev_us);
+#define HOSTCLOCK_FIELD_MAX (9u + 20u)
+
+#endif // HOSTCLOCK_H
@@ -66,6 +66,7 @@ typedef enum {
     KIND_DAMP_TRG,      // For TRG_DAMPING (normative)
     KIND_DAMP_CD,       // For START_BURST_DAMPING (normative)
     KIND_WEIGHT,        // For START_BURST_WEIGHT (normative)
+    KIND_PREVIEW,       // GET_PREVIEW: history snapshot sent as a burst
 } DataKind_t;
 
 // Detailed state of the absolute value trigger logic
@@ -81,14 +82,28 @@ typedef enum {
     TRG_AXIS_Y,
     TRG_AXIS_Z,
     TRG_AXIS_THETA,   // |θ| in degrees (internal)
-    TRG_AXIS_MAG      // Vector magnitude (reported to host when THETA is used)
+    TRG_AXIS_MAG,     // Vector magnitude (reported to host when THETA is used); det=sta ch=mag
+    TRG_AXIS_XYZ      // Energy summed over x, y and z; det=sta ch=xyz
 } TriggerAxis_t;
 
+// Trigger detector, SET_TRG det=
+typedef enum {
+    TRG_DET_PEAK = 0, // Single sample: |v - μ_arm| > k_mult·Δ₀ on any axis
+    TRG_DET_STA       // Mean energy over win_ms > k_mult · armed baseline (STA/LTA)
+} TrgDetector_t;
+
 // Configuration for the trigger system
 typedef struct {
     float k_mult;      // v3.3.2: Sensitivity multiplier [2.0, 20.0]
     uint32_t win_ms;   // v3.3.2: Analysis window size [50, 500] ms
     uint32_t hold_ms;  // Unchanged: Holdoff period after trigger
+    bool sleep_en;     // Gate acquisition on ADXL345 activity/inactivity while armed
+    uint16_t act_mg;   // Activity threshold (62.5 mg/LSB in the sensor)
+    uint16_t inact_mg; // Inactivity threshold
+    uint8_t inact_s;   // Seconds below inact_mg before the sensor auto-sleeps
+    uint16_t pre_ms;   // Pre-trigger window kept in the sample ring while armed [0, 1000]
+    TrgDetector_t det; // Detector; win_ms is the STA window for TRG_DET_STA
+    TriggerAxis_t ch;  // STA channel: TRG_AXIS_XYZ or TRG_AXIS_MAG
 } TriggerSettings_t;
 
 // Represents a single raw sample from the ADC
@@ -96,6 +111,7 @@ typedef struct {
     int16_t x;
     int16_t y;
     int16_t z;
+    uint8_t sensor;     // Index of the ADXL345 that produced it (fills padding)
     uint32_t timestamp; // TIM2 ticks (us)
 } Sample_t;
 
@@ -105,6 +121,11 @@ typedef struct {
   uint32_t burst_ms;
   uint32_t odr_hz;
   uint32_t stream_rate_hz;
+  uint8_t flt;        // Conditioning filter, CondType_t (conditioning.h): off/lp/hp/bp
+  uint8_t flt_n;      // Biquad sections per band edge [1, 4]
+  uint8_t flt_path;   // COND_PATH_* mask: 1 = burst, 2 = LIVE, 4 = trigger
+  uint16_t flt_f1_hz; // LP/HP corner, BP lower edge
+  uint16_t flt_f2_hz; // BP upper edge
 } RuntimeCfg_t;
 
 // Diagnostic counters for telemetry
@@ -116,17 +137,28 @@ typedef struct {
   uint32_t last_err;
 } DiagCounters_t;
 
-// Time synchronization state with host
-typedef struct {
-  bool     has_sync;
-  uint64_t host_ms_at_sync;
-  uint32_t tick_at_sync;
-} TimeSync_t;
+// Payload codec for a host session, selected by HELLO,codec=
+typedef enum {
+  PAYLOAD_CODEC_RAW = 0, // Full-width values: CSV DATA lines, LIVE_DT/ABS records
+  PAYLOAD_CODEC_DELTA,   // Per-axis deltas: DK/DD lines, LIVE_ZZ records
+  PAYLOAD_CODEC_BIN      // Raw counts in one COBS frame per block; LIVE as RAW
+} PayloadCodec_t;
+
+// BLOCKS integrity check for a host session, selected by HELLO,crc=
+typedef enum {
+  BLOCK_CRC_16 = 0, // CRC-16/CCITT-FALSE (protocol_crc16.h)
+  BLOCK_CRC_32      // CRC-32/MPEG-2 on the hardware CRC unit (protocol_crc32.h)
+} BlockCrc_t;
+
+// What a DAMP burst sends, selected per burst by ARM/START_BURST_DAMPING,result=
+typedef enum {
+  BURST_RESULT_BLOCKS = 0, // DATA_HEADER, BLOCKS and COMPLETE (DAMP_RESULT too when the burst fits the store)
+  BURST_RESULT_SUMMARY     // Only the DAMP_RESULT line; the burst is capped at the store
+} BurstResult_t;
 
 /* Globals (to be defined in main.c) */
 extern RuntimeCfg_t g_cfg;
 extern DiagCounters_t g_diag;
-extern TimeSync_t g_tsync;
 extern TriggerSettings_t g_trigger_settings;
 
 
@@ -159,6 +191,27 @@ void process_command(char *line);
 #define ADXL345_INT1_Pin        GPIO_PIN_7
 #define ADXL345_INT1_GPIO_Port  GPIOA
 #define ADXL345_INT1_EXTI_IRQn  EXTI9_5_IRQn
+// ADXL345 INT1 is also jumpered to PB10 (Arduino D6) = TIM2_CH3, so the watermark
+// edge is latched in hardware. TIM2 has no channel on PA7; without the jumper the
+// sensor driver falls back to reading TIM2 in the EXTI callback.
+#define ADXL345_INT1_CAP_Pin       GPIO_PIN_10
+#define ADXL345_INT1_CAP_GPIO_Port GPIOB
+#ifndef SENSOR_TS_EDGE_CAPTURE
+#define SENSOR_TS_EDGE_CAPTURE 1
+#endif
+// ADXL345 chip select -> PB12 (SPI2 backend only, SENSOR_BUS_USE_SPI=1)
+#define ADXL345_CS_Pin          GPIO_PIN_12
+#define ADXL345_CS_GPIO_Port    GPIOB
+// Optional second ADXL345 on the same bus: I2C address 0x1D (SDO=VDDIO),
+// INT1 -> PA6 (Arduino D12, shares EXTI9_5), chip select -> PC7 (Arduino D9).
+// It is probed at init; without it the firmware runs single-sensor.
+#ifndef SENSOR_MAX_DEVICES
+#define SENSOR_MAX_DEVICES 2
+#endif
+#define ADXL345_2_INT1_Pin       GPIO_PIN_6
+#define ADXL345_2_INT1_GPIO_Port GPIOA
+#define ADXL345_2_CS_Pin         GPIO_PIN_7
+#define ADXL345_2_CS_GPIO_Port   GPIOC
 
 #define USART_TX_Pin GPIO_PIN_2
 #define USART_TX_GPIO_Port GPIOA
@@ -0,0 +1,105 @@
+/* filename: Core/Inc/prof.h */
+#ifndef PROF_H_
+#define PROF_H_
+
+#include <stdint.h>
+#include "main.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Profilering på DWT->CYCCNT med namngivna mätpunkter.
+ *  - Varje mätpunkt håller n, min, max, summa och ett log2-histogram: fack k
+ *    räknar värden i [2^(k-1), 2^k), fack 0 värdet 0.
+ *  - En mätpunkt skrivs bara från en prioritetsnivå (ISR:er på samma nivå
+ *    avbryter inte varandra), så Prof_Record behöver inget lås.
+ *  - Tider i CPU-cykler (unit=cyc), TX-ringen i bytes, block-RTT i ms.
+ *  - GET_DIAG skickar alla mätpunkter även i produktionsbygget; GET_DIAG,RESET
+ *    nollställer efteråt. -DPROF_ENABLE=0 kompilerar bort mätningen.
+ */
+#ifndef PROF_ENABLE
+#define PROF_ENABLE 1
+#endif
+
+#define PROF_HIST_BINS 33u
+
+typedef struct {
+    uint32_t n;
+    uint32_t min;      // UINT32_MAX så länge n = 0
+    uint32_t max;
+    uint64_t sum;
+    uint32_t hist[PROF_HIST_BINS];
+} ProfStat_t;
+
+typedef enum {
+    PROF_EXTI_DMA = 0,      // Vattenmärkesflank -> första FIFO-posten klar
+    PROF_DRAIN,             // Vattenmärkesflank -> FIFO tom
+    PROF_ISR_EXTI,          // ADXL INT1
+    PROF_ISR_BUS,           // I2C1/SPI2 och deras DMA
+    PROF_ISR_UART,          // USART2 och TX-DMA
+    PROF_ISR_TIM2,
+    PROF_ISR_PENDSV,        // Uppackning av råa banker
+    PROF_LOOP,              // Huvudloopens period (pass till pass, inklusive vila)
+    PROF_PUMP_INPUT,
+    PROF_PUMP_TELEMETRY,
+    PROF_PUMP_BURST,
+    PROF_PUMP_TRIGGER,
+    PROF_PUMP_STREAM,
+    PROF_PUMP_SENSOR,
+    PROF_PUMP_COUNTDOWN,
+    PROF_PUMP_HOUSEKEEPING,
+    PROF_TX_OCC,            // TX-ringens fyllnad före varje klart spann (max = högvatten)
+    PROF_BLK_RTT,           // Block till ACK_BLK utan omsändning
+    PROF_COUNT,
+    PROF_NONE = 0xFF
+} ProfProbe_t;
+
+/**
+ * @brief Startar CYCCNT och nollställer alla mätpunkter.
+ * @note CYCCNT startas även med PROF_ENABLE=0; BENCH läser den via Prof_Cycles.
+ */
+void Prof_Init(void);
+
+/**
+ * @brief Nollställer alla mätpunkter.
+ */
+void Prof_Reset(void);
+
+/**
+ * @brief Nollställer en mätpunkt (BENCH mäter en punkt i taget).
+ */
+void Prof_ResetProbe(ProfProbe_t p);
+
+/**
+ * @brief Ögonblicksbild av en mätpunkt, tagen med avbrotten maskade.
+ */
+void Prof_Get(ProfProbe_t p, ProfStat_t* out);
+
+/**
+ * @brief Lägger in ett värde i mätpunkten.
+ */
+void Prof_Record(ProfProbe_t p, uint32_t v);
+
+/**
+ * @brief Skickar DIAG_PROF_INFO och en DIAG_PROF-rad per mätpunkt (blockerande).
+ */
+void Prof_SendDiag(void);
+
+/* Alltid CYCCNT, oberoende av PROF_ENABLE. */
+static inline uint32_t Prof_Cycles(void) { return DWT->CYCCNT; }
+
+#if PROF_ENABLE
+static inline uint32_t Prof_Now(void) { return DWT->CYCCNT; }
+static inline void Prof_Since(ProfProbe_t p, uint32_t t0) { Prof_Record(p, DWT->CYCCNT - t0); }
+#else
+static inline uint32_t Prof_Now(void) { return 0u; }
+static inline void Prof_Since(ProfProbe_t p, uint32_t t0) { (void)p; (void)t0; }
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PROF_H_ */
@@ -0,0 +1,71 @@
+/* filename: Core/Inc/protocol_cobs.h */
+#ifndef PROTOCOL_COBS_H_
+#define PROTOCOL_COBS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * COBS (Consistent Overhead Byte Stuffing) för binära ramar.
+ *  - Utdata innehåller aldrig 0x00, så 0x00 kan användas som ramavgränsare.
+ *  - Overhead: 1 byte per påbörjade 254 indatabytes.
+ *  - Avgränsaren ingår inte; anroparen lägger till den.
+ */
+
+/* Största kodade längd för n indatabytes (utan avgränsare). */
+#define PROTO_COBS_MAX(n) ((n) + ((n) / 254u) + 1u)
+
+/*
+ * Inkrementell kodare: indata kan matas i bitar direkt in i utbufferten.
+ * o är antal bytes hittills inklusive den reserverade kodbyten; efter ytterligare
+ * n bytes indata är o högst o + PROTO_COBS_MAX(n).
+ */
+typedef struct {
+    uint8_t* out;
+    size_t   o;
+    size_t   code_idx;
+    uint8_t  code;
+} proto_cobs_enc_t;
+
+static inline void proto_cobs_enc_init(proto_cobs_enc_t* e, uint8_t* out) {
+    e->out = out;
+    e->code_idx = 0;
+    e->o = 1;
+    e->code = 1;
+}
+
+static inline void proto_cobs_enc_put(proto_cobs_enc_t* e, const uint8_t* in, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        if (in[i] == 0u) {
+            e->out[e->code_idx] = e->code;
+            e->code_idx = e->o++;
+            e->code = 1;
+        } else {
+            e->out[e->o++] = in[i];
+            if (++e->code == 0xFFu) {
+                e->out[e->code_idx] = e->code;
+                e->code_idx = e->o++;
+                e->code = 1;
+            }
+        }
+    }
+}
+
+/* Skriver sista kodbyten. Returnerar antal skrivna bytes. */
+static inline size_t proto_cobs_enc_finish(proto_cobs_enc_t* e) {
+    e->out[e->code_idx] = e->code;
+    return e->o;
+}
+
+/*
+ * Kodar len bytes från in till out (minst PROTO_COBS_MAX(len) bytes).
+ * Returnerar antal skrivna bytes.
+ */
+static inline size_t proto_cobs_encode(const uint8_t* in, size_t len, uint8_t* out) {
+    proto_cobs_enc_t e;
+    proto_cobs_enc_init(&e, out);
+    proto_cobs_enc_put(&e, in, len);
+    return proto_cobs_enc_finish(&e);
+}
+
+#endif /* PROTOCOL_COBS_H_ */
@@ -34,8 +34,14 @@ static inline void proto_crc16_init(proto_crc16_t* ctx) {
     ctx->crc = (uint16_t)PROTO_CRC16_INIT;
 }
 
-/* Bitvis uppdatering, oflätad rad (ingen reflektion). */
-static inline uint16_t proto_crc16_update_byte(uint16_t crc, uint8_t b) {
+/* 256-posters tabell och uppstartskontroll, se protocol_crc16.c. */
+extern const uint16_t proto_crc16_table[256];
+
+/* Returnerar 1 om tabellen ger samma resultat som den bitvisa referensen. */
+int proto_crc16_selftest(void);
+
+/* Bitvis referens (ingen reflektion); används bara av självtestet. */
+static inline uint16_t proto_crc16_update_byte_ref(uint16_t crc, uint8_t b) {
     crc ^= ((uint16_t)b) << 8;
     for (uint8_t i = 0; i < 8; ++i) {
         if (crc & 0x8000u) crc = (uint16_t)((crc << 1) ^ PROTO_CRC16_POLY);
@@ -44,6 +50,11 @@ static inline uint16_t proto_crc16_update_byte(uint16_t crc, uint8_t b) {
     return crc;
 }
 
+/* Tabelldriven uppdatering, en uppslagning per byte. */
+static inline uint16_t proto_crc16_update_byte(uint16_t crc, uint8_t b) {
+    return (uint16_t)((crc << 8) ^ proto_crc16_table[(uint8_t)((crc >> 8) ^ b)]);
+}
+
 static inline void proto_crc16_update(proto_crc16_t* ctx, const void* data, size_t len) {
     const uint8_t* p = (const uint8_t*)data;
     for (size_t i = 0; i < len; ++i) {
@@ -0,0 +1,29 @@
+/* filename: Core/Inc/protocol_crc32.h */
+#ifndef PROTOCOL_CRC32_H_
+#define PROTOCOL_CRC32_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * CRC-32/MPEG-2 för BLOCKS i crc32-läge (HELLO,crc=crc32), via STM32F4:s CRC-enhet.
+ *  - Poly: 0x04C11DB7, Init: 0xFFFFFFFF, RefIn/RefOut: false, XorOut: 0x00000000
+ *  - Enheten tar bara 32-bitars ord. Bytes matas i trådordning (varje ord
+ *    byte-vänds) och sista ordet nollfylls, så värdet är CRC-32/MPEG-2 över
+ *    blockets bytes följda av 0-3 nollbytes upp till jämn multipel av 4.
+ *  - Samma datainkludering som CRC16: alla DATA-rader inkl. CRLF.
+ */
+
+/* Startar CRC-enhetens klocka och kör självtestet; 1 om enheten kan användas. */
+int proto_crc32_selftest(void);
+
+/* 1 om självtestet har godkänt enheten (annars används CRC16). */
+int proto_crc32_available(void);
+
+/* Hårdvaru-CRC över len bytes; data bör vara 4-bytejusterad (DMA-vänlig). */
+uint32_t proto_crc32_hw(const void* data, size_t len);
+
+/* Bitvis mjukvarureferens med samma utfyllnad; används av självtestet. */
+uint32_t proto_crc32_ref(const void* data, size_t len);
+
+#endif /* PROTOCOL_CRC32_H_ */
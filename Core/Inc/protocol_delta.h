@@ -0,0 +1,41 @@
+/* filename: Core/Inc/protocol_delta.h */
+#ifndef PROTOCOL_DELTA_H_
+#define PROTOCOL_DELTA_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Delta-kodning för samplepayloads (HELLO,codec=delta).
+ *  - Varje axel skickas som differens mot föregående sample från samma sensor.
+ *  - zigzag: 0,-1,1,-2,2,... -> 0,1,2,3,4,...; små differenser blir små tal.
+ *  - varint: 7 bitar per byte, minst signifikant först, bit 7 = fler bytes följer.
+ * En int16-differens (|d| <= 65535) tar högst 3 byte, oftast 1.
+ */
+
+/* Största varint-längd för ett 32-bitars värde. */
+#define PROTO_VARINT_MAX32 5u
+
+static inline uint32_t proto_zigzag32(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t proto_unzigzag32(uint32_t u) {
+    return (int32_t)(u >> 1) ^ -(int32_t)(u & 1u);
+}
+
+/*
+ * Skriver v som varint till out (minst PROTO_VARINT_MAX32 bytes).
+ * Returnerar antal skrivna bytes.
+ */
+static inline size_t proto_varint_put(uint8_t* out, uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80u) {
+        out[n++] = (uint8_t)(v | 0x80u);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+#endif /* PROTOCOL_DELTA_H_ */
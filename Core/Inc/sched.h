@@ -0,0 +1,91 @@
+/* filename: Core/Inc/sched.h */
+#ifndef SCHED_H_
+#define SCHED_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "app_context.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Händelsestyrd kooperativ schemaläggning för huvudloopen.
+ *  - ISR:er postar händelsebitar; main() tar alla väntande bitar per varv och
+ *    kör bara de pumpar vars mask matchar.
+ *  - SCHED_EV_TICK postas av SysTick bara när en frist som en pump begärt med
+ *    Sched_ArmTimeout() har löpt ut (HB, nedräkning, TB-omsändning, stall- och
+ *    holdoff-tider). Utan frist kör pumparna enbart på sina egna händelser.
+ *  - När inget väntar sover kärnan i WFI. Kontrollen görs med avbrotten maskade,
+ *    så en händelse som postas mellan kontrollen och WFI väcker ändå kärnan.
+ *  - I RTOS-bygget (app_rtos.h) blir bitarna trådflaggor till den tråd som äger
+ *    respektive uppgift; samma tabell används i båda byggena.
+ */
+#define SCHED_EV_RX       (1u << 0)  // Bytes i RX-ringen (UART idle, USB OUT)
+#define SCHED_EV_TX       (1u << 1)  // TX-spann klart, plats i ringen
+#define SCHED_EV_SAMPLES  (1u << 2)  // PendSV har publicerat sampel i ringarna
+#define SCHED_EV_TICK     (1u << 3)  // En frist (Sched_ArmTimeout) har löpt ut
+#define SCHED_EV_CMD      (1u << 4)  // Kommandon körda: tillstånd kan ha ändrats
+#define SCHED_EV_BANK     (1u << 5)  // Rå bank väntar på uppackning (RTOS; annars PendSV)
+#define SCHED_EV_ALL      0x1Fu      // Alla pumphändelser (utan BANK)
+
+// Tråd som äger en uppgift i RTOS-bygget. Ignoreras i den kooperativa loopen.
+typedef enum {
+    SCHED_THREAD_ACQ = 0,   // Uppackning, trigger, sensor-FSM (hög prio)
+    SCHED_THREAD_XPORT,     // Burst/TB och LIVE mot COMM
+    SCHED_THREAD_CMD,       // Kommandon, telemetri, nedräkning (låg prio)
+    SCHED_THREAD_COUNT
+} SchedThread_t;
+
+typedef struct {
+    void   (*run)(AppContext_t* ctx);
+    uint32_t events;   // SCHED_EV_* som väcker uppgiften
+    uint8_t  thread;   // SchedThread_t
+    uint8_t  probe;    // ProfProbe_t för körtiden, PROF_NONE = ingen
+} SchedTask_t;
+
+/**
+ * @brief Postar händelsebitar. Säker från alla kontexter (ISR och tråd).
+ */
+void Sched_Post(uint32_t ev);
+
+/**
+ * @brief Hämtar och nollställer alla väntande händelsebitar.
+ */
+uint32_t Sched_Take(void);
+
+/**
+ * @brief Kör de uppgifter i tabellen vars händelsemask matchar ev, i tabellordning.
+ */
+void Sched_RunTasks(AppContext_t* ctx, const SchedTask_t* tasks, size_t n, uint32_t ev);
+
+/**
+ * @brief Begär SCHED_EV_TICK om ms millisekunder (0 = nästa SysTick). Säker från alla kontexter.
+ * @note Det finns en frist; flera begäran slås ihop till den tidigaste. Den förbrukas när
+ *       TICK postas, så en pump som fortfarande väntar på tid begär en ny varje gång den körs.
+ */
+void Sched_ArmTimeout(uint32_t ms);
+
+/**
+ * @brief Anropas från SysTick_Handler: postar SCHED_EV_TICK när fristen har löpt ut.
+ */
+void Sched_SysTick(void);
+
+/**
+ * @brief Sover i WFI tills ett avbrott kommer, om inga bitar väntar.
+ */
+void Sched_Idle(void);
+
+/**
+ * @brief Antal varv med minst en händelse respektive antal WFI-vilor sedan start.
+ */
+uint32_t Sched_Passes(void);
+uint32_t Sched_Sleeps(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCHED_H_ */
@@ -0,0 +1,104 @@
+/* filename: Core/Inc/sensor_bus.h */
+#ifndef SENSOR_BUS_H
+#define SENSOR_BUS_H
+
+#include "app_context.h"
+
+/*
+ * Register-level transport for the ADXL345s.
+ *
+ * All register access from sensor_hal.c and the diagnostics goes through this
+ * interface, so the FIFO drain state machine does not care whether the sensors
+ * sit on I2C1 (400 kHz) or SPI2 (4-wire, mode 3). The backend is selected at
+ * compile time with SENSOR_BUS_USE_SPI. Every call names the sensor (0 or 1,
+ * see SENSOR_MAX_DEVICES); it selects the I2C address or the chip select.
+ *
+ * Only one asynchronous read may be in flight; the sensor driver arbitrates.
+ * It completes in SensorBus_RxCpltCallback() or SensorBus_ErrorCallback(),
+ * which are implemented by the sensor driver and run in DMA/peripheral ISR
+ * context (NVIC prio 3).
+ */
+
+// 0 = I2C1 (default, SDO=GND -> 0x53), 1 = SPI2 + DMA
+#ifndef SENSOR_BUS_USE_SPI
+#define SENSOR_BUS_USE_SPI 0
+#endif
+
+// Largest single asynchronous read supported by the SPI staging buffers.
+// The FIFO drain reads one 6-byte entry per transaction.
+#define SENSOR_BUS_MAX_XFER 8
+
+/**
+ * @brief Binds the bus to the HAL handles in the context.
+ * @param ctx Pointer to the application context.
+ * @return HAL_OK, or HAL_ERROR if the selected backend has no handle.
+ */
+HAL_StatusTypeDef SensorBus_Init(AppContext_t* ctx);
+
+/**
+ * @brief Blocking read of one or more consecutive registers.
+ * @param sensor Sensor index.
+ * @param reg First register address.
+ * @param[out] buf Destination buffer.
+ * @param len Number of bytes to read.
+ * @param timeout_ms HAL timeout.
+ * @return HAL status of the transfer.
+ */
+HAL_StatusTypeDef SensorBus_ReadRegs(uint8_t sensor, uint8_t reg, uint8_t* buf, uint16_t len, uint32_t timeout_ms);
+
+/**
+ * @brief Blocking write of a single register.
+ * @param sensor Sensor index.
+ * @param reg Register address.
+ * @param value Value to write.
+ * @param timeout_ms HAL timeout.
+ * @return HAL status of the transfer.
+ */
+HAL_StatusTypeDef SensorBus_WriteReg(uint8_t sensor, uint8_t reg, uint8_t value, uint32_t timeout_ms);
+
+/**
+ * @brief Starts a non-blocking read of consecutive registers.
+ * @note Completion is signalled through SensorBus_RxCpltCallback() or
+ * SensorBus_ErrorCallback(). The buffer must stay valid until then.
+ * @param sensor Sensor index, passed back to the callback.
+ * @param reg First register address.
+ * @param[out] buf Destination buffer.
+ * @param len Number of bytes (1..SENSOR_BUS_MAX_XFER).
+ * @return HAL_OK if the transfer was started.
+ */
+HAL_StatusTypeDef SensorBus_ReadRegsAsync(uint8_t sensor, uint8_t reg, uint8_t* buf, uint16_t len);
+
+/**
+ * @brief Checks whether the bus peripheral is idle.
+ * @return True if no transfer is in progress.
+ */
+bool SensorBus_IsReady(void);
+
+/**
+ * @brief Waits (bounded) for the bus to become idle.
+ * @param to_ms Maximum wait in milliseconds.
+ */
+void SensorBus_WaitReady(uint32_t to_ms);
+
+/**
+ * @brief Aborts an ongoing transfer, waiting at most to_ms for the bus.
+ * @param to_ms Maximum wait in milliseconds.
+ */
+void SensorBus_AbortIfBusy(uint32_t to_ms);
+
+/**
+ * @brief Returns the DMA handle used for sensor reads (for diagnostics).
+ * @return DMA handle, or NULL if none is linked.
+ */
+DMA_HandleTypeDef* SensorBus_GetRxDma(void);
+
+/**
+ * @brief Short name of the active backend ("I2C" or "SPI").
+ */
+const char* SensorBus_Name(void);
+
+// --- Callbacks implemented by the sensor driver (ISR context) ---
+void SensorBus_RxCpltCallback(uint8_t sensor);
+void SensorBus_ErrorCallback(uint8_t sensor);
+
+#endif // SENSOR_BUS_H
@@ -10,13 +10,24 @@
 
 #include "app_context.h"
 
+// Single-producer (FIFO drain ISR) / single-consumer (main loop) ring, one
+// per sensor. The size must be a power of two; indices are free-running and masked.
 #define SAMPLE_RING_BUFFER_SIZE 512
+#define SAMPLE_RING_MASK (SAMPLE_RING_BUFFER_SIZE - 1U)
+#if (SAMPLE_RING_BUFFER_SIZE & SAMPLE_RING_MASK) != 0
+#error "SAMPLE_RING_BUFFER_SIZE must be a power of two"
+#endif
 
-// A snapshot of the ring buffer for the PREVIEW command.
-typedef struct {
-  uint16_t count;
-  Sample_t buf[SAMPLE_RING_BUFFER_SIZE];
-} PreviewSnap_t;
+// History window (primary sensor): the most recently produced samples stay readable through
+// Sensor_HistoryRead() whether or not the consumer has taken them. Readers
+// never move the tail; a sample is valid as long as the producer has not wrapped
+// onto its slot. The margin leaves room for one drain burst after opening.
+#define SAMPLE_HISTORY_MAX (SAMPLE_RING_BUFFER_SIZE - 64U)
+
+// Pre-trigger window: how far Sensor_RewindTo() may move a tail back. Half the
+// ring, so the producer keeps room for drain bursts while the rewound samples
+// are read (256 samples = 320 ms at 800 Hz).
+#define SAMPLE_PRETRIG_MAX (SAMPLE_RING_BUFFER_SIZE / 2U)
 
 // A struct to hold the results of the ADXL345 self-test.
 typedef struct {
@@ -32,20 +43,27 @@ typedef struct {
     bool health_pass;
 } AdxlSelfTestResult_t;
 
+// Active consumer of the sample stream; selects the FIFO watermark policy.
+typedef enum {
+    SENSOR_CONSUMER_NONE = 0,  // Default watermark
+    SENSOR_CONSUMER_LIVE,      // LIVE streaming: low latency
+    SENSOR_CONSUMER_TRIGGER,   // Trigger armed: low latency
+    SENSOR_CONSUMER_BURST      // Burst capture: maximum batching
+} SensorConsumer_t;
+
 // --- FIX: Flyttad från sensor_hal.c för att göra den publik för diagnostik ---
 // --- I2C State Machine ---
 typedef enum {
     I2C_STATE_IDLE,
-    I2C_STATE_WAIT_FIFO_DATA, // State after EXTI, waiting for DMA read of FIFO data
-    I2C_STATE_DRAIN_STATUS,   // State after data read, waiting for FIFO_STATUS read
-    I2C_STATE_CLEAR_INT_SOURCE
+    I2C_STATE_WAIT_FIFO_DATA, // Waiting for one 6-byte FIFO entry read
+    I2C_STATE_DRAIN_STATUS,   // Known entries consumed, waiting for FIFO_STATUS read
+    I2C_STATE_PARKED,         // Both raw banks await unpacking; PendSV resumes the drain
+    I2C_STATE_INT_SOURCE,     // Activity gate: waiting for the INT_SOURCE read after an INT1 edge
+    I2C_STATE_GATE_DROP       // Activity gate: discarding a sleep-rate FIFO entry after a wake
 } I2CState_t;
 
 
 // --- Exporterade variabler för diagnostik ---
-extern volatile uint16_t sample_ring_head;
-extern volatile uint16_t sample_ring_tail;
-extern volatile I2CState_t g_i2c_state; // FIX: Exponerad för diagnostik
 extern volatile bool g_sampling_active; // FIX: Exponerad för diagnostik
 
 // --- FIX: Exporterade debug-räknare för diagnostik ---
@@ -57,23 +75,61 @@ extern volatile uint32_t g_debug_dma_start_ok;
 extern volatile uint32_t g_debug_dma_start_fail;
 extern volatile uint32_t g_debug_dma_complete_count;
 extern volatile uint32_t g_debug_samples_processed;
+extern volatile uint32_t g_debug_ts_edge_captured;  // Batches stamped from the TIM2_CH3 latch
+extern volatile uint32_t g_debug_ts_edge_fallback;  // Batches stamped from EXTI entry time
+extern volatile uint32_t g_debug_ts_drift_rejected; // Out-of-tolerance period measurements
+extern volatile uint32_t g_debug_bank_parked;       // Drain stalls waiting for a free raw bank
+extern volatile uint32_t g_debug_gate_wakeups;      // Activity events while the gate was asleep
+extern volatile uint32_t g_debug_gate_sleeps;       // Inactivity events (sensor entered auto-sleep)
+extern volatile uint32_t g_debug_gate_wake_dropped; // 8 Hz FIFO entries discarded on wake
+extern volatile uint32_t g_debug_merge_unordered;   // Spans served past a silent sensor's last stamp (ring half full)
 
 
 /**
- * @brief Initializes the ADXL345 sensor.
+ * @brief Initializes the ADXL345 sensors.
+ * @note Sensor 0 must answer; further sensors (up to SENSOR_MAX_DEVICES) are
+ * probed and used if present.
  * @param ctx Pointer to the application context.
  * @return HAL_StatusTypeDef HAL_OK on success, HAL_ERROR on failure.
  */
 HAL_StatusTypeDef Sensor_Init(AppContext_t* ctx);
 
 /**
- * @brief Performs initial offset calibration for the accelerometer.
+ * @brief Number of sensors found by Sensor_Init().
+ * @return 1..SENSOR_MAX_DEVICES (0 before init).
+ */
+uint8_t Sensor_DeviceCount(void);
+
+/**
+ * @brief Current state of a sensor's FIFO drain engine (for diagnostics).
+ * @param sensor Sensor index.
+ */
+I2CState_t Sensor_GetDrainState(uint8_t sensor);
+
+/**
+ * @brief Starts the background offset calibration.
+ * @note Samples come from the normal watermark/DMA drain; the first
+ * OFFSET_CAL_SETTLE_MS of data is discarded. Sampling is started if it is off
+ * and stopped again when the job ends, unless another module has started it
+ * in the meantime. Completion is reported as CAL_INFO,status=offset_done or
+ * status=offset_failed from Sensor_Pump().
  * @param ctx Pointer to the application context.
  */
-void Sensor_PerformOffsetCalibration(AppContext_t* ctx);
+void Sensor_StartOffsetCalibration(AppContext_t* ctx);
 
 /**
- * @brief Enables sampling.
+ * @brief Checks if the offset calibration job is still running.
+ */
+bool Sensor_IsOffsetCalibrating(void);
+
+/**
+ * @brief Runs the sensor module's background jobs. Call from the main loop.
+ * @param ctx Pointer to the application context.
+ */
+void Sensor_Pump(AppContext_t* ctx);
+
+/**
+ * @brief Enables sampling on all sensors at once.
  * @param ctx Pointer to the application context.
  */
 void Sensor_StartSampling(AppContext_t* ctx);
@@ -106,6 +162,50 @@ HAL_StatusTypeDef Sensor_SetODR(AppContext_t* ctx, uint32_t odr_hz);
  */
 void Sensor_ReconfigureTimer(AppContext_t* ctx, uint32_t odr_hz);
 
+/**
+ * @brief Selects the FIFO watermark for an ODR and consumer.
+ * @param odr_hz Output data rate in Hz.
+ * @param consumer Active consumer.
+ * @return Watermark in FIFO entries (1..31).
+ */
+uint8_t Sensor_WatermarkFor(uint32_t odr_hz, SensorConsumer_t consumer);
+
+/**
+ * @brief Sets the active consumer and applies its watermark to the sensor.
+ * @note Briefly masks the watermark EXTI and waits for the drain to go idle.
+ * Sensor_SetODR() re-applies the policy for the stored consumer.
+ * @param ctx Pointer to the application context.
+ * @param consumer New consumer.
+ * @return HAL_OK, or an error if FIFO_CTL could not be written.
+ */
+HAL_StatusTypeDef Sensor_SetConsumer(AppContext_t* ctx, SensorConsumer_t consumer);
+
+/**
+ * @brief Programs or removes the activity/inactivity gate.
+ * @note The gate is active while the trigger is the consumer and
+ * trigger_settings.sleep_en is set. Each sensor then runs with LINK and
+ * AUTO_SLEEP: after inact_s seconds below inact_mg it drops to 8 Hz sampling
+ * and INT1 only reports activity. The drain engine reads INT_SOURCE on every
+ * INT1 edge. The first activity event discards the 8 Hz entries still in
+ * the FIFO (counted in g_debug_gate_wake_dropped) and restarts the full-rate
+ * drain with the entries that follow.
+ * Called by Sensor_SetConsumer(); call it directly after changing the settings.
+ * @param ctx Pointer to the application context.
+ * @return HAL_OK, or an error if a register could not be written.
+ */
+HAL_StatusTypeDef Sensor_UpdateActivityGate(AppContext_t* ctx);
+
+/**
+ * @brief True while the gate is active and every sensor is in auto-sleep.
+ * @note The main loop may then sleep (WFI) until the next interrupt.
+ */
+bool Sensor_IsActivityGateAsleep(void);
+
+/**
+ * @brief Returns the FIFO watermark currently programmed into the sensor.
+ */
+uint8_t Sensor_GetWatermark(void);
+
 /**
  * @brief Finds the closest supported ODR value for a given request.
  * @param req_odr The requested ODR.
@@ -114,29 +214,96 @@ void Sensor_ReconfigureTimer(AppContext_t* ctx, uint32_t odr_hz);
 uint32_t Sensor_SnapODR(uint32_t req_odr);
 
 /**
- * @brief Safely retrieves one sample from the internal ring buffer.
+ * @brief Retrieves one sample from the internal ring buffer.
  * @param[out] sample Pointer to a Sample_t struct to be filled.
  * @return True if a sample was retrieved, false if the buffer was empty.
  */
 bool Sensor_GetSample(Sample_t* sample);
 
 /**
- * @brief Converts TIM2 timer ticks into microseconds.
- * @param ctx Pointer to the application context.
- * @param ticks The number of ticks from TIM2.
- * @return The equivalent duration in microseconds.
+ * @brief Unpacks received raw FIFO banks into the sample ring.
+ * @note Called from PendSV_Handler (lowest priority). Decodes, timestamps and
+ * forwards each entry to streaming, then resumes a parked drain.
  */
-uint32_t Sensor_TicksToUs(AppContext_t* ctx, uint32_t ticks);
+void Sensor_ServiceRawBanks(void);
 
 /**
- * @brief Takes a snapshot of the current sample ring buffer for preview purposes.
- * @param ctx Pointer to the application context.
- * @return A const pointer to the internal preview snapshot buffer.
+ * @brief Copies up to max samples out of the ring buffer.
+ * @note Lock-free; must only be called from the main loop (single consumer).
+ * @param[out] out Destination array.
+ * @param max Capacity of out.
+ * @return Number of samples copied.
+ */
+uint16_t Sensor_GetSamples(Sample_t* out, uint16_t max);
+
+/**
+ * @brief Returns the longest contiguous run of unread samples without copying.
+ * @note The span stays valid until Sensor_CommitSamples(); the producer never
+ * writes into unread slots. Main loop only. With several sensors the rings are
+ * merged by timestamp: a span comes from one sensor (see Sample_t::sensor) and
+ * ends before the oldest unread sample of another. While another sensor is
+ * sampling with its ring empty, the span also ends at the newest stamp that
+ * sensor has published, so 0 can be returned with samples waiting; only a
+ * stopped or gate-asleep sensor, or a ring past half full, is not waited for.
+ * @param[out] span Set to the first unread sample.
+ * @return Number of samples in the span (0 if the ring is empty).
  */
-const PreviewSnap_t* Sensor_GetPreviewSnapshot(AppContext_t* ctx);
+uint16_t Sensor_PeekSamples(const Sample_t** span);
+
+/**
+ * @brief Releases samples obtained with Sensor_PeekSamples().
+ * @param n Number of samples consumed (at most the span length).
+ */
+void Sensor_CommitSamples(uint16_t n);
+
+/**
+ * @brief Makes already consumed samples stamped at or after ts_from unread again.
+ * @note Index rebasing only: each ring's tail moves back, nothing is copied and
+ * sampling keeps running. At most SAMPLE_PRETRIG_MAX samples per sensor, and
+ * never onto slots the producer may reuse (SAMPLE_HISTORY_MAX). Main loop only.
+ * @param ts_from Oldest TIM2 stamp to bring back.
+ * @return Number of samples made unread (all sensors).
+ */
+uint16_t Sensor_RewindTo(uint32_t ts_from);
+
+/**
+ * @brief Number of unread samples in the ring buffers (all sensors).
+ */
+uint16_t Sensor_RingCount(void);
+
+/**
+ * @brief Discards all unread samples (consumer side).
+ */
+void Sensor_FlushSamples(void);
+
+/**
+ * @brief Returns the primary sensor's ODR as seen by TIM2 (drift-corrected sample period).
+ * @note Equals the nominal ODR until the drift estimator has converged, or
+ * when SENSOR_TS_DRIFT_EST is 0.
+ * @return ODR in Hz, or 0 before the first Sensor_SetODR().
+ */
+float Sensor_GetMeasuredOdrHz(void);
+
+/**
+ * @brief Opens a window over the primary sensor's most recently produced samples.
+ * @note Does not stop sampling or touch the consumer side of the ring.
+ * @param max_count Largest window wanted (capped at SAMPLE_HISTORY_MAX).
+ * @param[out] count Number of samples in the window.
+ * @return Free-running index of the oldest sample in the window.
+ */
+uint32_t Sensor_HistoryOpen(uint16_t max_count, uint16_t* count);
+
+/**
+ * @brief Copies one sample out of the history window.
+ * @param index Free-running index (start returned by Sensor_HistoryOpen() + offset).
+ * @param[out] out Destination sample.
+ * @return False if the sample was overwritten by the producer (out is then invalid).
+ */
+bool Sensor_HistoryRead(uint32_t index, Sample_t* out);
 
 /**
  * @brief Converts a raw sample to calibrated m/s^2 values.
+ * @note Uses the offsets of the sensor that produced the sample.
  * @param ctx Pointer to the application context.
  * @param raw Pointer to the raw Sample_t data.
  * @param[out] ax Pointer to store the calibrated X-axis value in m/s^2.
@@ -146,16 +313,65 @@ const PreviewSnap_t* Sensor_GetPreviewSnapshot(AppContext_t* ctx);
 void Sensor_ConvertToMps2(AppContext_t* ctx, const Sample_t* raw, float* ax, float* ay, float* az);
 
 /**
- * @brief Performs the ADXL345 self-test procedure.
- * @note This is a blocking function that takes direct control of the sensor.
- * It should only be called when the system is idle.
+ * @brief Converts n raw samples to calibrated m/s^2, structure-of-arrays in and out.
+ * @note Same values as Sensor_ConvertToMps2(). With sensor == NULL all samples are
+ *       from sensor 0 and the loop has constant scale and offsets.
+ * @param x, y, z Raw counts per axis.
+ * @param sensor Producing sensor per sample, or NULL.
+ * @param n Number of samples.
+ * @param[out] ax, ay, az Calibrated values in m/s^2.
+ */
+void Sensor_ConvertBatch(const int16_t* x, const int16_t* y, const int16_t* z, const uint8_t* sensor,
+                         uint16_t n, float* ax, float* ay, float* az);
+
+/**
+ * @brief As Sensor_ConvertBatch() but in mm/s^2 (milli m/s^2) with integer math only.
+ * @note Fixed point with 24 fractional bits, rounded to nearest; pairs with fmt_milli(),
+ *       so the %.3f columns are produced without float. Can differ from the float
+ *       path by 1 mm/s^2 where float rounding moves a value across a half.
+ */
+void Sensor_ConvertBatchMilli(const int16_t* x, const int16_t* y, const int16_t* z, const uint8_t* sensor,
+                              uint16_t n, int32_t* mx, int32_t* my, int32_t* mz);
+
+/**
+ * @brief Conversion factors behind Sensor_ConvertToMps2(): a = raw * scale - off.
+ * @param sensor Sensor index (out of range maps to sensor 0, as in the conversion).
+ * @param[out] off_ms2 Per-axis offsets in m/s^2.
+ * @return Scale in m/s^2 per LSB.
+ */
+float Sensor_GetScaleMps2(uint8_t sensor, float off_ms2[3]);
+
+/**
+ * @brief Sets a sensor's offsets, as if the offset calibration had measured them.
+ * @note Used to restore offsets from flash (cal_store.h). Ignored for a sensor
+ *       that was not found by Sensor_Init().
+ * @param sensor Sensor index.
+ * @param off_ms2 Per-axis offsets in m/s^2.
+ */
+void Sensor_SetOffsets(uint8_t sensor, const float off_ms2[3]);
+
+/**
+ * @brief Checks if every sensor has offsets from a completed calibration or Sensor_SetOffsets().
+ */
+bool Sensor_OffsetsValid(void);
+
+/**
+ * @brief Starts the ADXL345 self-test procedure in the background.
+ * @note Tests the primary sensor. The test takes direct control of it: sampling is stopped,
+ * the registers it touches are saved and restored, and sampling is resumed
+ * afterwards if it was running. It is driven by Sensor_Pump() and reports
+ * through Telemetry_SendSelfTestResult() (ADXL_ST_CFG / ADXL_ST_RAW).
  * @param ctx Pointer to the application context.
  * @param avg_count The number of samples to average for OFF and ON states.
  * @param settle_count The number of samples to discard after enabling self-test.
  * @param force_odr_hz If non-zero, forces a specific ODR for the test.
- * @param[out] results Pointer to a struct to store the test results.
- * @return HAL_StatusTypeDef HAL_OK on success, HAL_ERROR or HAL_TIMEOUT on failure.
+ * @return HAL_OK if started, HAL_BUSY if a test is already running.
+ */
+HAL_StatusTypeDef Sensor_StartSelfTest(AppContext_t* ctx, uint8_t avg_count, uint8_t settle_count, uint32_t force_odr_hz);
+
+/**
+ * @brief Checks if a self-test is in progress.
  */
-HAL_StatusTypeDef Sensor_PerformSelfTest(AppContext_t* ctx, uint8_t avg_count, uint8_t settle_count, uint32_t force_odr_hz, AdxlSelfTestResult_t* results);
+bool Sensor_IsSelfTestRunning(void);
 
 #endif // SENSOR_HAL_H
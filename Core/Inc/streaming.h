@@ -4,6 +4,20 @@
 
 #include "app_context.h"
 
+// LIVE output format (STREAM_START,fmt=...)
+typedef enum {
+    STREAM_FORMAT_TEXT = 0, // LIVE lines, decimated to stream_rate_hz
+    STREAM_FORMAT_BIN       // COBS frames (api_schema.h), every sample at the full ODR
+} StreamFormat_t;
+
+// Most samples per LIVE_BATCH line (STREAM_START,batch=N); fewer are sent
+// when the line would exceed PROTO_MAX_LINE or the queue holds fewer.
+#define STREAM_BATCH_MAX 16U
+
+// Largest credit balance (STREAM_START,credits= / STREAM_CREDIT,n=); grants
+// beyond it saturate.
+#define STREAM_CREDIT_MAX 65535U
+
 /**
  * @brief Initializes the streaming module.
  * @param ctx Pointer to the application context.
@@ -13,8 +27,38 @@ void Streaming_Init(AppContext_t* ctx);
 /**
  * @brief Starts the live streaming of sensor data.
  * @param ctx Pointer to the application context.
+ * @param fmt Output format.
+ * @param batch Text format: samples per line (1 = LIVE, 2..STREAM_BATCH_MAX = LIVE_BATCH).
+ * @param credits Initial credit grant; 0 streams without credits until STREAM_CREDIT.
+ */
+void Streaming_Start(AppContext_t* ctx, StreamFormat_t fmt, uint8_t batch, uint32_t credits);
+
+/**
+ * @brief Format of the current (or last) stream.
+ */
+StreamFormat_t Streaming_GetFormat(void);
+
+/**
+ * @brief Samples per text line of the current stream (1 for plain LIVE and binary).
+ */
+uint8_t Streaming_GetBatch(void);
+
+/**
+ * @brief Corner of the anti-alias low-pass ahead of the text divider.
+ * @return Cutoff in Hz, 0 when the stage is bypassed (effective div == 1).
+ */
+uint32_t Streaming_GetAntiAliasHz(void);
+
+/**
+ * @brief True while a stream is running.
+ */
+bool Streaming_IsActive(void);
+
+/**
+ * @brief Grants n more samples to the stream and enables credit mode.
+ * @return The new balance (saturates at STREAM_CREDIT_MAX).
  */
-void Streaming_Start(AppContext_t* ctx);
+uint32_t Streaming_AddCredits(uint32_t n);
 
 /**
  * @brief Stops the live streaming of sensor data.
@@ -31,7 +75,8 @@ void Streaming_Pump(AppContext_t* ctx);
 
 /**
  * @brief Processes a new sample from an ISR context for potential streaming.
- *        This function handles decimation and prepares data for the main loop pump.
+ *        Text format: anti-alias low-pass at the full ODR, then decimation.
+ *        The result is queued for the main loop pump.
  * @param ctx Pointer to the application context.
  * @param s Pointer to the new sample.
  */
@@ -52,7 +97,7 @@ void Streaming_UpdateDivider(AppContext_t* ctx);
 /**
  * @brief Gets the current decimation divider value.
  * @param ctx Pointer to the application context.
- * @return The decimation divider.
+ * @return The decimation divider (1 for the binary format).
  */
 uint32_t Streaming_GetDivider(AppContext_t* ctx);
 
@@ -3,6 +3,7 @@
 #define TELEMETRY_H
 
 #include "app_context.h"
+#include "sensor_hal.h" // For AdxlSelfTestResult_t
 
 /**
  * @brief Initializes the telemetry module.
@@ -65,6 +66,12 @@ void Telemetry_SendERROR(const char* src, uint32_t code, const char* msg);
  */
 void Telemetry_SendStreamStartACK(AppContext_t* ctx);
 
+/**
+ * @brief Sends the ACK for STREAM_CREDIT with the resulting balance.
+ * @param credits Credit balance after the grant.
+ */
+void Telemetry_SendStreamCreditACK(uint32_t credits);
+
 /**
  * @brief Sends a CAL_INFO message to the host.
  * @param ctx Pointer to the application context.
@@ -78,10 +85,15 @@ void Telemetry_SendCalInfo(AppContext_t* ctx);
 void Telemetry_SendDiag(AppContext_t* ctx);
 
 /**
- * @brief Sends a snapshot of the most recent sensor data as a PREVIEW.
- * @param ctx Pointer to the application context.
+ * @brief Sends the ADXL_ST_CFG / ADXL_ST_RAW report of a finished self-test.
+ * @param status HAL_OK on success, otherwise the failure (timeout or bus error).
+ * @param results Measured OFF/ON averages and deltas (used when status is HAL_OK).
+ * @param odr_hz The ODR the test ran at.
+ * @param avg_count Samples averaged per state.
+ * @param settle_count Samples discarded after enabling self-test.
  */
-void Telemetry_SendPreview(AppContext_t* ctx);
+void Telemetry_SendSelfTestResult(HAL_StatusTypeDef status, const AdxlSelfTestResult_t* results,
+                                  uint32_t odr_hz, uint8_t avg_count, uint8_t settle_count);
 
 // --- UI and Utility ---
 
@@ -0,0 +1,66 @@
+/* filename: Core/Inc/timebase.h */
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include "main.h"
+
+/*
+ * Microsecond timebase on the free-running TIM2 counter.
+ *
+ * The tick -> us factor is computed once in Timebase_Init() (after the clock
+ * configuration), so conversions are a multiply and a shift. TIM2 is extended
+ * to 64 bits by counting update (wrap) interrupts, which keeps timestamps
+ * monotonic beyond the ~71 minute wrap of the 32-bit counter.
+ *
+ * Sample timestamps are still stored as 32-bit TIM2 ticks; Timebase_ExtendTicks()
+ * maps such a stamp back to the 64-bit timeline when it is formatted.
+ */
+
+/**
+ * @brief Caches the tick rate of htim and starts it with the wrap interrupt.
+ * @param htim TIM2 handle (32-bit, free-running).
+ * @return HAL status of the timer start.
+ */
+HAL_StatusTypeDef Timebase_Init(TIM_HandleTypeDef* htim);
+
+/**
+ * @brief Timer tick rate in Hz (cached at init).
+ */
+uint32_t Timebase_TickHz(void);
+
+/**
+ * @brief Current 64-bit tick count. Safe from any context.
+ */
+uint64_t Timebase_NowTicks64(void);
+
+/**
+ * @brief Current time in microseconds since Timebase_Init().
+ */
+uint64_t Timebase_NowUs64(void);
+
+/**
+ * @brief Converts a 32-bit tick interval to microseconds.
+ * @note Saturates at 0xFFFFFFFF.
+ */
+uint32_t Timebase_TicksToUs(uint32_t ticks);
+
+/**
+ * @brief Converts a 64-bit tick count or interval to microseconds.
+ */
+uint64_t Timebase_TicksToUs64(uint64_t ticks);
+
+/**
+ * @brief Extends a 32-bit TIM2 stamp to 64 bits.
+ * @note The stamp must lie within ±2^31 ticks (~35 min) of now.
+ * @param ticks32 Raw TIM2 counter value.
+ * @return The stamp on the 64-bit timeline.
+ */
+uint64_t Timebase_ExtendTicks(uint32_t ticks32);
+
+/**
+ * @brief Converts a 32-bit TIM2 sample stamp to 64-bit microseconds.
+ * @note Shorthand for Timebase_TicksToUs64(Timebase_ExtendTicks(ticks32)).
+ */
+uint64_t Timebase_StampToUs64(uint32_t ticks32);
+
+#endif // TIMEBASE_H
@@ -0,0 +1,109 @@
+/* filename: Core/Inc/trace.h */
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binär händelsespårning för RX/TX-vägen och BLOCKS.
+ *  - En post är tre ord: hdr = 0xA5 << 24 | id << 16 | a16, CYCCNT och arg.
+ *    Trace_Log skriver posten i RAM-ringen med avbrotten maskade (~30 cykler)
+ *    och formaterar ingenting, så den går från ISR och stör inte TX-ringen.
+ *  - Ringen håller de senaste TRACE_RING_LEN posterna. TRACE,DUMP läser ut den
+ *    över länken i efterhand; i debuggern ligger den i s_trace_ring.
+ *  - Trace_Pump strömmar ringen till ITM-stimulusport TRACE_ITM_PORT (SWO på
+ *    PB3) när debuggern har slagit på ITM och porten. Annars gör den inget.
+ *  - Tools/host/trace_decode avkodar både SWO-fångster och TRACE_DATA-rader.
+ *  - -DTRACE_ENABLE=0 kompilerar bort loggningen (Trace_Log blir tom).
+ */
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE 1
+#endif
+
+#ifndef TRACE_RING_LEN
+#define TRACE_RING_LEN 256u          // poster, tvåpotens (12 bytes styck)
+#endif
+_Static_assert((TRACE_RING_LEN & (TRACE_RING_LEN - 1u)) == 0u, "TRACE_RING_LEN must be a power of two");
+
+#ifndef TRACE_ITM_PORT
+#define TRACE_ITM_PORT 1u            // port 0 lämnas åt printf över SWO
+#endif
+
+#define TRACE_SYNC 0xA5u
+
+/*
+ * Händelser: X(id, namn, a16-fält, arg-fält, arg-format). arg-format 'u' är
+ * decimalt, 'x' hex och 'h' två 16-bitarshalvor "hi/lo". Tabellen delas med
+ * värdavkodaren; nya händelser läggs sist så att gamla fångster avkodas lika.
+ */
+#define TRACE_EVENTS(X) \
+    X(TRACE_EV_TX_DROP,     "tx_drop",     "len",    "free",         'u') /* rad/skrivning tappad, ringen full */ \
+    X(TRACE_EV_TX_DMA,      "tx_dma",      "len",    "ring",         'u') /* bulkspann startat, ring = fyllnad före */ \
+    X(TRACE_EV_TX_CTRL,     "tx_ctrl",     "len",    "ring",         'u') /* kontroll-lanens spann startat */ \
+    X(TRACE_EV_TX_DONE,     "tx_done",     "len",    "ring",         'u') /* spann ute, ring = fyllnad före */ \
+    X(TRACE_EV_RX,          "rx",          "len",    "ovf",          'u') /* mottaget, ovf = RX-överflöden totalt */ \
+    X(TRACE_EV_TB_BEGIN,    "tb_begin",    "win",    "burst_id",     'u') \
+    X(TRACE_EV_TB_END,      "tb_end",      "blks",   "burst_id",     'u') \
+    X(TRACE_EV_TB_SEND,     "tb_send",     "blk",    "retries/lines",'h') /* BLOCK_END köad */ \
+    X(TRACE_EV_TB_ACK,      "tb_ack",      "blk",    "rtt_ms",       'u') /* rtt_ms = 0xFFFFFFFF efter omsändning */ \
+    X(TRACE_EV_TB_ACKS,     "tb_acks",     "base",   "mask",         'x') \
+    X(TRACE_EV_TB_NACK,     "tb_nack",     "blk",    "code",         'u') \
+    X(TRACE_EV_TB_RETX,     "tb_retx",     "blk",    "retries",      'u') \
+    X(TRACE_EV_TB_TIMEOUT,  "tb_timeout",  "win",    "rto_ms",       'u') /* efter backoff */ \
+    X(TRACE_EV_TB_STATUS,   "tb_status",   "queue",  "inflight/win", 'h') /* kö eller fönster ändrat */ \
+    X(TRACE_EV_TB_ABORT,    "tb_abort",    "blk",    "code",         'u') \
+    X(TRACE_EV_MARK,        "mark",        "a16",    "arg",          'x') /* fri markör för felsökning */
+
+#define TRACE_X_ENUM(id, name, a16, arg, f) id,
+typedef enum {
+    TRACE_EVENTS(TRACE_X_ENUM)
+    TRACE_EV_COUNT
+} TraceEvent_t;
+#undef TRACE_X_ENUM
+
+typedef struct {
+    uint32_t hdr;   // TRACE_SYNC << 24 | id << 16 | a16
+    uint32_t cyc;   // DWT->CYCCNT
+    uint32_t arg;
+} TraceRec_t;
+
+static inline uint32_t Trace_Hdr(TraceEvent_t id, uint16_t a16)
+{
+    return (TRACE_SYNC << 24) | ((uint32_t)id << 16) | a16;
+}
+
+#if TRACE_ENABLE
+/**
+ * @brief Lägger en post i ringen. Från valfri kontext; skriver över den äldsta.
+ */
+void Trace_Log(TraceEvent_t id, uint16_t a16, uint32_t arg);
+#else
+static inline void Trace_Log(TraceEvent_t id, uint16_t a16, uint32_t arg) { (void)id; (void)a16; (void)arg; }
+#endif
+
+/**
+ * @brief Nollställer ringen och ITM-räknarna. CYCCNT måste vara igång (Prof_Init).
+ */
+void Trace_Init(void);
+
+/**
+ * @brief Strömmar nya poster till ITM så länge porten tar emot (huvudloopen).
+ */
+void Trace_Pump(void);
+
+/**
+ * @brief Skickar TRACE_INFO och ringen som TRACE_DATA-rader (blockerande).
+ * @param clear Töm ringen efteråt.
+ * @note Loggningen pausas under utläsningen, så dumpen spårar inte sig själv.
+ */
+void Trace_SendDump(uint8_t clear);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_H_ */
@@ -8,19 +8,33 @@
 #include "api_schema.h"
 #include "protocol_crc16.h"
 #include "comm.h"
-#include "dev_telemetry.h"
+#include "api_parse.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 /* v3.3.0 BLOCKS-transport */
+#ifndef TB_MAX_INFLIGHT
+#define TB_MAX_INFLIGHT 32u   /* Övre gräns för HELLO,win= */
+#endif
+
 typedef int (*TB_GenLineFn)(uint16_t index, char* out, size_t out_sz, void* user);
 
 void TB_Init(uint16_t window, uint16_t blk_lines, uint8_t max_retries);
-void TB_SetWindow(uint16_t window);
-void TB_SetBlockLines(uint16_t blk_lines);
+void TB_SetWindow(uint16_t window);      /* 1..TB_MAX_INFLIGHT, klampas */
+uint16_t TB_GetWindow(void);
+void TB_SetBlockLines(uint16_t blk_lines);  /* tak för regulatorn */
+/* Glömmer RTT-skattning och regulatorstatus (ny värdsession). */
+void TB_ResetLink(void);
+/* Blockstorlek för nästa block: regulatorns värde, begränsat så att arenan rymmer två block. */
+uint16_t TB_GetBlockLines(void);
 void TB_SetMaxRetries(uint8_t max_retries);
+/* Väljer blockens CRC (crc16= eller crc32= i BLOCK_HEADER/END); gäller från nästa TB_BeginBurst. */
+void TB_SetCrc32(uint8_t on);
+/* Binär kropp (DATA_HEADER mode=BIN): generatorn ger poster som sänds som en COBS-ram
+ * per block; gäller från nästa TB_BeginBurst. */
+void TB_SetBinary(uint8_t on);
 
 void TB_BeginBurst(uint32_t burst_id);
 void TB_EndBurst(void);
@@ -36,11 +50,27 @@ void TB_Pump(void);
 int  TB_IsIdle(void);
 
 void TB_OnAckBlk(uint16_t blk);
+void TB_OnAckBlks(uint16_t base, uint32_t mask); /* kumulativ + selektiv, se transport_blocks.c */
 void TB_OnNackBlk(uint16_t blk, uint32_t code);
-int  TB_HandleHostLine(const char* line);
+/* ACK_BLK (vanligast), ACK_BLKS, NACK_BLK ur en tokeniserad värdrad; 1 om hanterad. */
+int  TB_HandleHostLine(const api_tokens_t* t);
 
 uint8_t TB_GetQueueCount(void);
 uint8_t TB_GetInflightCount(void);
+/* ms tills det äldsta skickade blocket når RTO (0 = nu); UINT32_MAX om inget väntar på kvittens. */
+uint32_t TB_MsToTimeout(void);
+
+/* Länkregulatorns aktuella värden (GET_DIAG). */
+typedef struct {
+    uint16_t lines;      /* blockstorlek för nästa block */
+    uint16_t window;     /* aktuellt fönster */
+    uint32_t rto_ms;
+    uint32_t srtt_ms;    /* 0 = inget prov än */
+    uint32_t rttvar_ms;
+    uint32_t nacks;      /* NACK_BLK och snabba omsändningar */
+    uint32_t timeouts;
+} TB_LinkStats;
+void TB_GetLinkStats(TB_LinkStats* out);
 
 #ifdef __cplusplus
 }
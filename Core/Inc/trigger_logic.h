@@ -28,27 +28,46 @@ void Trigger_Init(AppContext_t* ctx);
 void Trigger_Reset(AppContext_t* ctx);
 
 /**
- * @brief Performs the ZERO phase of trigger calibration.
- *        Captures sensor data to establish a baseline noise profile.
+ * @brief Starts the ZERO phase of trigger calibration.
+ *        Captures sensor data for REF_CAPTURE_DURATION_MS to establish a
+ *        baseline noise profile. Advanced by Trigger_Pump(); completion is
+ *        reported as CAL_INFO,status=hold_zero_done and the mode goes to WAIT_ARM.
  * @param ctx Pointer to the application context.
  */
 void Trigger_Zero(AppContext_t* ctx);
 
 /**
- * @brief Performs a quick ZERO calibration for the standalone ZERO command.
+ * @brief Starts a quick ZERO calibration for the standalone ZERO command.
+ *        Runs in OP_MODE_TRG_CAL_ZERO, then stops sampling, sends
+ *        CAL_INFO,status=zero_complete and returns to IDLE.
  * @param ctx Pointer to the application context.
  */
 void Trigger_PerformQuickZero(AppContext_t* ctx);
 
 /**
- * @brief Performs the ARM phase of trigger calibration.
- *        Captures sensor data to establish the armed state's mean values.
+ * @brief Starts the ARM phase of trigger calibration.
+ *        Captures sensor data to establish the armed state's mean values; the
+ *        trigger goes to TRG_STATE_ARMED with CAL_INFO,status=arm_done. On a
+ *        stall or too few samples it reports ERROR and returns to WAIT_ARM.
  * @param ctx Pointer to the application context.
  */
 void Trigger_Arm(AppContext_t* ctx);
 
+/**
+ * @brief True while a ZERO or ARM reference capture is running.
+ */
+bool Trigger_IsCapturingRef(void);
+
+/**
+ * @brief Recomputes the integer trigger limits from k_mult, Δ₀ and μ_arm.
+ *        Called by Trigger_Arm() and whenever the trigger settings change.
+ * @param ctx Pointer to the application context.
+ */
+void Trigger_UpdateThresholds(AppContext_t* ctx);
+
 /**
  * @brief Checks for trigger conditions if the system is armed.
+ *        Evaluates all unread samples per call.
  *        This function should be called periodically in the main application loop.
  * @param ctx Pointer to the application context.
  */
@@ -61,4 +80,16 @@ void Trigger_Pump(AppContext_t* ctx);
  */
 bool Trigger_IsZeroCalibrated(AppContext_t* ctx);
 
+/**
+ * @brief Copies the ZERO noise profile (μ₀ and Δ₀ in raw counts).
+ * @return True if the profile is calibrated (see Trigger_IsZeroCalibrated).
+ */
+bool Trigger_GetZeroProfile(int16_t mu_raw[3], uint16_t noise_absmax[3]);
+
+/**
+ * @brief Installs a previously measured ZERO noise profile (restored from flash).
+ * @note Cleared again by Trigger_Reset, like a measured one.
+ */
+void Trigger_SetZeroProfile(const int16_t mu_raw[3], const uint16_t noise_absmax[3]);
+
 #endif // TRIGGER_LOGIC_H
@@ -8,6 +8,8 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <string.h>
+#include "api_parse.h"
 
 /* Local helpers: no locale, no libc parsing. */
 static inline const char* skip_ws(const char* s) {
@@ -123,4 +125,119 @@ int api_parse_u16(const char* s, uint16_t* out) {
     return 1;
 }
 
+/* Decimal, or hex after 0x/0X. Same terminator rules as api_parse_u32. */
+int api_parse_u32_auto(const char* s, uint32_t* out) {
+    if (!s || !out) return 0;
+    s = skip_ws(s);
+    if (s[0] != '0' || (s[1] != 'x' && s[1] != 'X')) return api_parse_u32(s, out);
+    s += 2;
+    uint32_t acc = 0; int nd = 0;
+    for (;; ++s, ++nd) {
+        uint32_t d;
+        if (*s >= '0' && *s <= '9') d = (uint32_t)(*s - '0');
+        else if (*s >= 'a' && *s <= 'f') d = (uint32_t)(*s - 'a' + 10);
+        else if (*s >= 'A' && *s <= 'F') d = (uint32_t)(*s - 'A' + 10);
+        else break;
+        if (nd >= 8) return 0;
+        acc = (acc << 4) | d;
+    }
+    if (nd == 0) return 0;
+    s = skip_ws(s);
+    if (!is_term_or_eol(*s)) return 0;
+    *out = acc;
+    return 1;
+}
+
+/* --- Tokenizer --- */
+
+static inline int is_sep(char c) {
+    return (c == ',') || (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n');
+}
+
+static inline uint8_t span_len(const char* a, const char* b) {
+    size_t n = (size_t)(b - a);
+    return (n > 255u) ? 255u : (uint8_t)n;
+}
+
+void api_tokenize(const char* line, api_tokens_t* t) {
+    t->n = 0;
+    t->cmd = line ? line : "";
+    const char* s = t->cmd;
+    while (*s && !is_sep(*s)) { ++s; }
+    t->cmd_len = span_len(t->cmd, s);
+    while (*s) {
+        while (*s && is_sep(*s)) { ++s; }
+        if (!*s) break;
+        const char* k = s;
+        while (*s && *s != '=' && !is_sep(*s)) { ++s; }
+        const char* v = NULL;
+        const char* ve = NULL;
+        if (*s == '=') {
+            v = ++s;
+            if (*s == '"') {
+                ++s;
+                while (*s && *s != '"') { ++s; }
+                if (*s == '"') { ++s; }
+            }
+            while (*s && !is_sep(*s)) { ++s; }
+            ve = s;
+        }
+        if (t->n < API_KV_MAX) {
+            api_kv_t* kv = &t->kv[t->n++];
+            kv->key = k;
+            kv->klen = span_len(k, v ? v - 1 : s);
+            kv->val = v;
+            kv->vlen = v ? span_len(v, ve) : 0u;
+        }
+    }
+}
+
+static inline int span_eq(const char* p, uint8_t n, const char* s) {
+    return strncmp(p, s, n) == 0 && s[n] == '\0';
+}
+
+int api_tok_is_cmd(const api_tokens_t* t, const char* cmd) {
+    return span_eq(t->cmd, t->cmd_len, cmd);
+}
+
+const char* api_tok_val(const api_tokens_t* t, const char* key) {
+    for (uint8_t i = 0; i < t->n; ++i) {
+        const api_kv_t* kv = &t->kv[i];
+        if (kv->val && span_eq(kv->key, kv->klen, key)) return kv->val;
+    }
+    return NULL;
+}
+
+int api_tok_val_is(const api_tokens_t* t, const char* key, const char* s) {
+    for (uint8_t i = 0; i < t->n; ++i) {
+        const api_kv_t* kv = &t->kv[i];
+        if (kv->val && span_eq(kv->key, kv->klen, key)) return span_eq(kv->val, kv->vlen, s);
+    }
+    return 0;
+}
+
+int api_tok_flag(const api_tokens_t* t, const char* flag) {
+    for (uint8_t i = 0; i < t->n; ++i) {
+        const api_kv_t* kv = &t->kv[i];
+        if (!kv->val && span_eq(kv->key, kv->klen, flag)) return 1;
+    }
+    return 0;
+}
+
+/* Format unsigned 64-bit integer as decimal (newlib-nano printf has no %llu).
+ * Returns number of chars written (excluding NUL), or 0 if out_sz is too small. */
+int api_format_u64(char* out, size_t out_sz, uint64_t v) {
+    if (!out || out_sz == 0) return 0;
+    char tmp[20];
+    int n = 0;
+    do {
+        tmp[n++] = (char)('0' + (int)(v % 10ULL));
+        v /= 10ULL;
+    } while (v != 0ULL);
+    if ((size_t)n >= out_sz) { out[0] = 0; return 0; }
+    for (int i = 0; i < n; i++) out[i] = tmp[n - 1 - i];
+    out[n] = 0;
+    return n;
+}
+
 /* filename: Core/Src/api_parse.c */
\ No newline at end of file
@@ -11,7 +11,7 @@ PATCH SUMMARY:
 #include "telemetry.h" // Required to call Telemetry_SendStatus
 #include <string.h>
 
-void AppContext_Init(AppContext_t* ctx, TIM_HandleTypeDef* htim2_handle, TIM_HandleTypeDef* htim3_handle, I2C_HandleTypeDef* hi2c1_handle) {
+void AppContext_Init(AppContext_t* ctx, TIM_HandleTypeDef* htim2_handle, TIM_HandleTypeDef* htim3_handle, I2C_HandleTypeDef* hi2c1_handle, SPI_HandleTypeDef* hspi2_handle) {
     memset(ctx, 0, sizeof(AppContext_t));
 
     ctx->op_mode = OP_MODE_INIT;
@@ -22,10 +22,26 @@ void AppContext_Init(AppContext_t* ctx, TIM_HandleTypeDef* htim2_handle, TIM_Han
     ctx->cfg.burst_ms = DEFAULT_BURST_MS;
     ctx->cfg.odr_hz = DEFAULT_ODR_HZ;
     ctx->cfg.stream_rate_hz = DEFAULT_STREAM_HZ;
+    ctx->cfg.flt = 0;          // COND_OFF
+    ctx->cfg.flt_n = 2;
+    ctx->cfg.flt_path = 0;
+    ctx->cfg.flt_f1_hz = 1;
+    ctx->cfg.flt_f2_hz = 50;
 
     ctx->trigger_settings.k_mult = 5.0f;
     ctx->trigger_settings.win_ms = 100;
     ctx->trigger_settings.hold_ms = 1500;
+    ctx->trigger_settings.sleep_en = false;
+    ctx->trigger_settings.act_mg = 125;
+    ctx->trigger_settings.inact_mg = 63;
+    ctx->trigger_settings.inact_s = 10;
+    ctx->trigger_settings.pre_ms = 100;
+    ctx->trigger_settings.det = TRG_DET_PEAK;
+    ctx->trigger_settings.ch = TRG_AXIS_XYZ;
+
+    ctx->codec = PAYLOAD_CODEC_RAW;
+    ctx->blk_crc = BLOCK_CRC_16;
+    ctx->burst_result = BURST_RESULT_BLOCKS;
 
 #ifdef ENABLE_TEST_HOOKS
     ctx->test_trigger_flag = false;
@@ -35,6 +51,7 @@ void AppContext_Init(AppContext_t* ctx, TIM_HandleTypeDef* htim2_handle, TIM_Han
     ctx->htim2 = htim2_handle;
     ctx->htim3 = htim3_handle;
     ctx->hi2c1 = hi2c1_handle;
+    ctx->hspi2 = hspi2_handle;
 }
 
 void AppContext_SetOpMode(AppContext_t* ctx, OpMode_t new_mode) {
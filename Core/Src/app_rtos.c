@@ -0,0 +1,161 @@
+/* filename: Core/Src/app_rtos.c */
+#include "app_rtos.h"
+
+#if APP_USE_RTOS
+
+#include "main.h"
+#include "cmsis_os2.h"
+#include "FreeRTOS.h"
+#include "comm.h"
+#include "sensor_hal.h"
+#include "transport_blocks.h"
+#include "prof.h"
+
+#if configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY > 3
+#error "I2C/SPI-DMA (prio 3) postar trådflaggor: configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY måste vara <= 3"
+#endif
+
+typedef struct {
+    const char*       name;
+    osPriority_t      prio;
+    uint32_t          stack;
+    osThreadId_t      id;
+    uint32_t          mask;          // Union av uppgifternas händelser
+    volatile uint32_t passes;
+    uint32_t          lock_wait_max; // Längsta väntan på mutexet, ms
+} AppRtosThread_t;
+
+static AppRtosThread_t s_thr[SCHED_THREAD_COUNT] = {
+    [SCHED_THREAD_ACQ]   = { "acq",   osPriorityHigh,        APP_RTOS_STACK_ACQ },
+    [SCHED_THREAD_XPORT] = { "xport", osPriorityAboveNormal, APP_RTOS_STACK_XPORT },
+    [SCHED_THREAD_CMD]   = { "cmd",   osPriorityBelowNormal, APP_RTOS_STACK_CMD },
+};
+
+static osMutexId_t s_lock = NULL;
+static AppContext_t* s_ctx = NULL;
+static const SchedTask_t* s_tasks = NULL;
+static size_t s_ntasks = 0;
+
+// Högvattenmärken, uppdateras efter varje pass
+static uint16_t s_ring_hwm = 0;
+static uint16_t s_rx_hwm = 0;
+static uint16_t s_tx_hwm = 0;
+static uint8_t  s_tb_hwm = 0;
+
+static void AppRtos_TrackQueues(void)
+{
+    uint16_t v = Sensor_RingCount();
+    if (v > s_ring_hwm) s_ring_hwm = v;
+    v = COMM_RxRingUsage();
+    if (v > s_rx_hwm) s_rx_hwm = v;
+    v = COMM_TxRingUsage();
+    if (v > s_tx_hwm) s_tx_hwm = v;
+    uint8_t q = TB_GetQueueCount();
+    if (q > s_tb_hwm) s_tb_hwm = q;
+}
+
+static void AppRtos_Thread(void* arg)
+{
+    AppRtosThread_t* t = (AppRtosThread_t*)arg;
+    const uint8_t self = (uint8_t)(t - s_thr);
+
+    for (;;) {
+        uint32_t ev = osThreadFlagsWait(t->mask, osFlagsWaitAny, osWaitForever);
+        if (ev & osFlagsError) continue;
+        t->passes++;
+
+        // Råbankerna har en enda producent (drain-ISR) och konsument (här);
+        // som PendSV tidigare körs uppackningen utan mutexet.
+        if (ev & SCHED_EV_BANK) {
+            const uint32_t c0 = Prof_Now();
+            Sensor_ServiceRawBanks();
+            Prof_Since(PROF_ISR_PENDSV, c0); // same work as PendSV in the loop build
+        }
+
+        uint32_t t0 = osKernelGetTickCount();
+        osMutexAcquire(s_lock, osWaitForever);
+        uint32_t waited = osKernelGetTickCount() - t0;
+        if (waited > t->lock_wait_max) t->lock_wait_max = waited;
+
+        for (size_t i = 0; i < s_ntasks; i++) {
+            if (s_tasks[i].thread == self && (ev & s_tasks[i].events)) {
+                const uint32_t c0 = Prof_Now();
+                s_tasks[i].run(s_ctx);
+                Prof_Since((ProfProbe_t)s_tasks[i].probe, c0);
+            }
+        }
+        AppRtos_TrackQueues();
+        osMutexRelease(s_lock);
+    }
+}
+
+void App_RtosStart(AppContext_t* ctx, const SchedTask_t* tasks, size_t n)
+{
+    s_ctx = ctx;
+    s_tasks = tasks;
+    s_ntasks = n;
+
+    osKernelInitialize();
+
+    static const osMutexAttr_t lock_attr = { .name = "app", .attr_bits = osMutexPrioInherit };
+    s_lock = osMutexNew(&lock_attr);
+
+    s_thr[SCHED_THREAD_ACQ].mask = SCHED_EV_BANK;
+    for (size_t i = 0; i < n; i++) {
+        if (tasks[i].thread < SCHED_THREAD_COUNT) {
+            s_thr[tasks[i].thread].mask |= tasks[i].events;
+        }
+    }
+
+    for (uint8_t k = 0; k < SCHED_THREAD_COUNT; k++) {
+        AppRtosThread_t* t = &s_thr[k];
+        const osThreadAttr_t attr = { .name = t->name, .stack_size = t->stack, .priority = t->prio };
+        t->id = osThreadNew(AppRtos_Thread, t, &attr);
+        if (s_lock == NULL || t->id == NULL) {
+            Error_Handler();
+        }
+        osThreadFlagsSet(t->id, t->mask); // första passet kör allt, som loopen
+    }
+
+    osKernelStart();
+    for (;;) { }
+}
+
+void App_RtosNotify(uint32_t ev)
+{
+    for (uint8_t k = 0; k < SCHED_THREAD_COUNT; k++) {
+        const uint32_t m = ev & s_thr[k].mask;
+        if (m != 0u && s_thr[k].id != NULL) {
+            osThreadFlagsSet(s_thr[k].id, m);
+        }
+    }
+}
+
+void App_RtosBlockWait(void)
+{
+    if (osKernelGetState() != osKernelRunning || __get_IPSR() != 0u) {
+        __WFE();
+        return;
+    }
+    const bool held = (s_lock != NULL) && (osMutexGetOwner(s_lock) == osThreadGetId());
+    if (held) osMutexRelease(s_lock);
+    osDelay(1);
+    if (held) osMutexAcquire(s_lock, osWaitForever);
+}
+
+void App_RtosSendDiag(void)
+{
+    for (uint8_t k = 0; k < SCHED_THREAD_COUNT; k++) {
+        const AppRtosThread_t* t = &s_thr[k];
+        COMM_SendfBlocking("[DEBUG] DIAG_RTOS: task=%s, prio=%d, stack=%lu, stack_free_min=%lu, passes=%lu, lock_wait_max_ms=%lu\r\n",
+                           t->name, (int)t->prio, (unsigned long)t->stack,
+                           (unsigned long)((t->id != NULL) ? osThreadGetStackSpace(t->id) : 0u),
+                           (unsigned long)t->passes, (unsigned long)t->lock_wait_max);
+    }
+    COMM_SendfBlocking("[DEBUG] DIAG_RTOS_Q: ring_hwm=%u/%u, rx_hwm=%u/%u, tx_hwm=%u/%u, tb_hwm=%u\r\n",
+                       s_ring_hwm, (unsigned)(SAMPLE_RING_BUFFER_SIZE * Sensor_DeviceCount()),
+                       s_rx_hwm, (unsigned)RX_RING_BUFFER_SIZE,
+                       s_tx_hwm, (unsigned)COMM_TX_RING_SIZE, s_tb_hwm);
+}
+
+#endif /* APP_USE_RTOS */
@@ -6,8 +6,8 @@ static BlocksCfg_t g_bc;
 
 void BlocksCfg_Init(uint16_t def_window, uint16_t def_lines, uint8_t def_retries)
 {
-    /* Clamp per API v3.3.0 (§16): window[1..8], lines[32..512], retries>=1 */
-    if (def_window < 1u) def_window = 1u; else if (def_window > 8u)  def_window = 8u;
+    /* Clamp per API v3.3.0 (§16): window[1..TB_MAX_INFLIGHT], lines[32..512], retries>=1 */
+    if (def_window < 1u) def_window = 1u; else if (def_window > TB_MAX_INFLIGHT) def_window = TB_MAX_INFLIGHT;
     if (def_lines  < 32u) def_lines  = 32u; else if (def_lines  > 512u) def_lines  = 512u;
     if (def_retries < 1u) def_retries = 1u;
 
@@ -17,6 +17,7 @@ void BlocksCfg_Init(uint16_t def_window, uint16_t def_lines, uint8_t def_retries
     TB_SetWindow(g_bc.window);
     TB_SetBlockLines(g_bc.lines);
     TB_SetMaxRetries(g_bc.retries);
+    TB_ResetLink();
 }
 
 BlocksCfg_t BlocksCfg_Get(void)
@@ -27,7 +28,7 @@ BlocksCfg_t BlocksCfg_Get(void)
 int BlocksCfg_Set(uint16_t window, uint16_t lines, uint8_t retries)
 {
     /* Validate and clamp to safe protocol ranges. */
-    if (window < 1u) window = 1u; else if (window > 8u)  window = 8u;
+    if (window < 1u) window = 1u; else if (window > TB_MAX_INFLIGHT) window = TB_MAX_INFLIGHT;
     if (lines  < 32u) lines  = 32u; else if (lines  > 512u) lines  = 512u;
     if (retries < 1u) retries = 1u;
 
@@ -38,6 +39,7 @@ int BlocksCfg_Set(uint16_t window, uint16_t lines, uint8_t retries)
     TB_SetWindow(g_bc.window);
     TB_SetBlockLines(g_bc.lines);
     TB_SetMaxRetries(g_bc.retries);
+    TB_ResetLink(); /* nya tak: regulatorn börjar om */
     return 1;
 }
 /* filename: Core/Src/blocks_cfg.c */
\ No newline at end of file
@@ -18,6 +18,13 @@ PATCH SUMMARY:
 #include "comm.h"
 #include "countdown.h"
 #include "api_parse.h" // <-- ADDED MISSING INCLUDE for api_parse_u32
+#include "timebase.h"
+#include "fmt.h"
+#include "burst_stats.h"
+#include "damp_analysis.h"
+#include "conditioning.h"
+#include "hostclock.h"
+#include "sched.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -48,6 +55,7 @@ static const char* _type_str(BM_Type t) {
         case BM_TYPE_WEIGHT:   return "WEIGHT";
         case BM_TYPE_DAMP_TRG: return "DAMP_TRG";
         case BM_TYPE_DAMP_CD:  return "DAMP_CD";
+        case BM_TYPE_PREVIEW:  return "PREVIEW";
         default: return "UNKNOWN";
     }
 }
@@ -57,16 +65,42 @@ void BM_Init(uint16_t window, uint16_t blk_lines, uint8_t max_retries) {
     memset((void*)&g_bm, 0, sizeof(g_bm));
 }
 
-void BM_Begin(BM_Type type, uint32_t burst_id, uint32_t ts0_us, uint16_t samples, uint32_t odr_hz) {
+void BM_Begin(BM_Type type, uint32_t burst_id, uint64_t ts0_us, uint16_t samples, uint32_t odr_hz,
+              PayloadCodec_t codec) {
     g_bm.type = type;
     g_bm.burst_id = burst_id;
     g_bm.active = 1;
     g_bm.waiting_ack_complete = 0;
+    g_bm.done_pending = 0; // ett sent STOP mot förra bursten får inte följa med
+    g_bm.aborted = 0;
     g_bm.samples = samples;
     g_bm.odr_hz = odr_hz;
 
-    COMM_Sendf("DATA_HEADER,type=%s,burst_id=%lu,ts0_us=%lu,samples=%u,mode=CSV" PROTO_EOL,
-               _type_str(type), (unsigned long)burst_id, (unsigned long)ts0_us, (unsigned)samples);
+    // mode=BIN bär omräkningen till m/s^2, eftersom posterna är råa räknevärden
+    char bin_info[24 + SENSOR_MAX_DEVICES * 40] = "";
+    const char* mode = "CSV";
+    if (codec == PAYLOAD_CODEC_DELTA) {
+        mode = "DELTA";
+    } else if (codec == PAYLOAD_CODEC_BIN) {
+        mode = "BIN";
+        float off[3];
+        int n = snprintf(bin_info, sizeof bin_info, ",rec=%u,scale=%.9g",
+                         (unsigned)PROTO_BLK_BIN_REC, (double)Sensor_GetScaleMps2(0, off));
+        for (uint8_t i = 0; i < Sensor_DeviceCount() && n > 0 && (size_t)n < sizeof bin_info; ++i) {
+            (void)Sensor_GetScaleMps2(i, off);
+            n += snprintf(&bin_info[n], sizeof bin_info - (size_t)n, ",off%u=%.4f:%.4f:%.4f",
+                          (unsigned)i, (double)off[0], (double)off[1], (double)off[2]);
+        }
+    }
+    char ts0[21];
+    *fmt_u64(ts0, ts0_us) = '\0';
+    char host[HOSTCLOCK_FIELD_MAX + 1u] = "";
+    if (ts0_us != 0U) { // 0: bursten fick inga sampel
+        *HostClock_FmtField(host, ts0_us) = '\0';
+    }
+    COMM_Sendf("DATA_HEADER,type=%s,burst_id=%lu,ts0_us=%s,samples=%u,sensors=%u,mode=%s%s%s" PROTO_EOL,
+               _type_str(type), (unsigned long)burst_id, ts0, (unsigned)samples,
+               (unsigned)Sensor_DeviceCount(), mode, bin_info, host);
     TB_BeginBurst(burst_id);
 }
 
@@ -74,6 +108,12 @@ int BM_Enqueue(const TB_BlockGen* blk) {
     return TB_EnqueueBlock(blk);
 }
 
+void BM_SetSamples(uint16_t samples) {
+    g_bm.samples = samples;
+}
+
+static void BurstSendTxResults(void);
+
 void BM_Pump(void) {
     if (!g_bm.active) return;
     TB_Pump();
@@ -88,6 +128,7 @@ void BM_Pump(void) {
                 uint64_t num = (uint64_t)g_bm.samples * 1000u + (uint64_t)(g_bm.odr_hz / 2u);
                 time_ms = (uint32_t)(num / (uint64_t)g_bm.odr_hz);
             }
+            BurstSendTxResults(); // TB är tomt, så raderna hamnar inte mitt i ett block
             COMM_Sendf("COMPLETE,burst_id=%lu,samples=%u,dropped=%u,time_ms=%lu" PROTO_EOL,
                        (unsigned long)g_bm.burst_id, (unsigned)g_bm.samples, 0u, (unsigned long)time_ms);
         }
@@ -109,19 +150,12 @@ void BM_EndAborted(uint32_t code) {
     g_bm.done_pending = 1;
 }
 
-static int _starts_with(const char* s, const char* pfx) {
-    while (*pfx) {
-        if (*s++ != *pfx++) return 0;
-    }
-    return 1;
-}
-
-int BM_HandleHostLine(const char* line) {
-    if (!line) return 0;
-    if (TB_HandleHostLine(line)) return 1;
+int BM_HandleHostLine(const api_tokens_t* t) {
+    if (!t) return 0;
+    if (TB_HandleHostLine(t)) return 1;
 
-    if (_starts_with(line, "ACK_COMPLETE")) {
-        const char* p = strstr(line, "burst_id=");
+    if (api_tok_is_cmd(t, "ACK_COMPLETE")) {
+        const char* p = api_tok_val(t, "burst_id");
         if (!p) {
             if (g_bm.active && g_bm.waiting_ack_complete) {
                 g_bm.waiting_ack_complete = 0;
@@ -131,7 +165,7 @@ int BM_HandleHostLine(const char* line) {
             }
         } else {
             uint32_t bid = 0;
-            if (api_parse_u32(p + 9, &bid)) {
+            if (api_parse_u32(p, &bid)) {
                 if (g_bm.active && g_bm.burst_id == bid) {
                     g_bm.waiting_ack_complete = 0;
                     g_bm.active = 0;
@@ -146,40 +180,107 @@ int BM_HandleHostLine(const char* line) {
 
 uint8_t BM_IsActive(void) { return g_bm.active; }
 uint8_t BM_IsWaitingAckComplete(void) { return g_bm.waiting_ack_complete; }
+uint8_t BM_IsEnding(void) { return (uint8_t)(g_bm.done_pending || g_bm.waiting_ack_complete); }
 
 
 // =================================================================================
 // SECTION 2: HIGH-LEVEL APPLICATION LOGIC (from refactoring)
 // =================================================================================
 
-#define SAMPLES_PER_BURST 8000
-enum {
-  BM_CTX_MAX_BLOCKS = (SAMPLES_PER_BURST + PROTO_BLOCK_LINES_DEFAULT - 1u) / PROTO_BLOCK_LINES_DEFAULT
-};
+_Static_assert(SENSOR_MAX_DEVICES <= 2, "Burst store packs the sensor index in one bit");
+// Två fulla block (HELLO blk_lines <= 512) och u16-index
+_Static_assert(BM_STORE_SAMPLES >= 2u * 512u && BM_STORE_SAMPLES <= BM_BURST_MAX_SAMPLES,
+               "Burst store must hold two full blocks and be indexable in u16");
+
+// Longest DATA line: "DATA," ts, three fmt_f3 columns, ",0.000," sensor, EOL and NUL.
+// DK/DD lines are shorter (int32 columns).
+#define BM_LINE_MAX (5u + FMT_U64_MAX + 3u * (1u + FMT_F3_MAX) + 7u + FMT_U32_MAX + PROTO_EOL_LEN + 1u)
+_Static_assert(BM_LINE_MAX <= PROTO_MAX_LINE, "DATA line does not fit the TB line buffer");
+
+// Burstplatser: en burst kan spelas in medan den förra fortfarande sänds. Båda
+// delar lagret som ring; sampel i i en burst ligger i slot (pos0 + i) % BM_STORE_SAMPLES
+// och nästa burst börjar där den förra slutade. Sändningen sker i inspelningsordning,
+// en burst i taget genom BM/TB, så högst en inspelad burst väntar på sin tur.
+#define BM_SLOTS 2u
+typedef struct {
+    bool       in_use;
+    bool       captured;    // Insamlingen klar, restblocket får köas
+    bool       tx_begun;    // DATA_HEADER skickat, platsen äger BM/TB
+    bool       tx_ended;    // BM_EndOk anropat
+    bool       summary;     // result=summary: bara DAMP_RESULT, ingen BLOCKS-dump
+    DataKind_t kind;
+    uint32_t   burst_id;
+    uint16_t   pos0;        // Lagrets slot för sampel 0
+    uint32_t   wr0;         // g_store_wr vid start, för avståndet till skrivpositionen
+    uint16_t   target;      // Planerat antal sampel (DATA_HEADER)
+    uint16_t   collected;
+    uint16_t   tx_next;     // Första sample i nästa block
+    PayloadCodec_t codec;   // Latched per burst at start
+    BlockCrc_t blk_crc;
+    uint32_t   odr_hz;
+    uint32_t   ts0[SENSOR_MAX_DEVICES];     // Första stämpeln per sensor
+    uint32_t   ts_last[SENSOR_MAX_DEVICES]; // Rekonstruerad senaste stämpel
+    bool       ts_valid[SENSOR_MAX_DEVICES];
+    // Löpande TIM2-stämpel per sensor vid nästa bloggräns (ts_base för nästa block).
+    uint32_t   run_ts[SENSOR_MAX_DEVICES];
+    bool       run_valid[SENSOR_MAX_DEVICES];
+    BurstStats_t stats;     // Online-statistik (SUMMARY_STATS, WEIGHT:s SUMMARY)
+} BurstSlot_t;
 
 typedef struct {
     uint16_t base;
     AppContext_t* ctx;
+    const BurstSlot_t* slot;
+    uint32_t ts_base[SENSOR_MAX_DEVICES]; // Stämpel för sensorns sista sample före blocket
 } BurstGenCtx_t;
 
-static int16_t burst_data_x[SAMPLES_PER_BURST];
-static int16_t burst_data_y[SAMPLES_PER_BURST];
-static int16_t burst_data_z[SAMPLES_PER_BURST];
-static uint32_t burst_timestamps[SAMPLES_PER_BURST];
-static uint16_t samples_collected_in_burst = 0;
-static int16_t g_median_buf[SAMPLES_PER_BURST];
+// Sampel lagras som x, y, z i 13-bitars tvåkomplement (bit 0..38) och sensorn
+// i bit 39, little-endian.
+#define BM_PACKED_BYTES 5u
+static uint8_t burst_xyz[BM_STORE_SAMPLES][BM_PACKED_BYTES];
+// Tidsstämplar lagras som u16-differens (TIM2-ticks) mot föregående sample från
+// samma sensor, vilket frigör 16 KB till BLOCKS-arenan. Lägsta ODR 100 Hz ger
+// 10 ms, så 65 ms räcker med marginal. Längre luckor mättas; differensen räknas
+// mot den rekonstruerade tiden, så följande sampel hämtar in felet.
+static uint16_t burst_dt[BM_STORE_SAMPLES];
+static BurstSlot_t g_slots[BM_SLOTS];
+static BurstSlot_t *g_cap = NULL;   // Spelas in
+static BurstSlot_t *g_tx = NULL;    // Äger BM/TB
+static uint16_t g_store_pos = 0;    // Nästa slot som skrivs
+static uint32_t g_store_wr = 0;     // Antal skrivna sampel (wrappar, bara differenser används)
+
+#define BM_SLOT(s, i) ((uint16_t)(((uint32_t)(s)->pos0 + (uint32_t)(i)) % BM_STORE_SAMPLES))
+
+static inline uint8_t BurstSensorAt(const BurstSlot_t *s, uint16_t i) {
+    return (uint8_t)(burst_xyz[BM_SLOT(s, i)][BM_PACKED_BYTES - 1u] >> 7);
+}
 
-static DataKind_t g_current_kind = KIND_UNKNOWN;
-static uint32_t g_current_burst_id = 0;
+static inline uint16_t BurstDtAt(const BurstSlot_t *s, uint16_t i) {
+    return burst_dt[BM_SLOT(s, i)];
+}
+
+// Omräknade sampel för radgeneratorn: BM_CONV_CHUNK sampel åt gången ur lagret
+// till SoA och genom Sensor_ConvertBatchMilli, i stället för en omräkning per rad.
+#define BM_CONV_CHUNK 32u
+typedef struct {
+    const BurstSlot_t *slot;  // NULL = tom (nollställs vid varje BurstStart)
+    uint16_t i0;
+    uint16_t n;
+    int16_t  x[BM_CONV_CHUNK], y[BM_CONV_CHUNK], z[BM_CONV_CHUNK];
+    uint8_t  sensor[BM_CONV_CHUNK];
+    int32_t  mx[BM_CONV_CHUNK], my[BM_CONV_CHUNK], mz[BM_CONV_CHUNK];
+} BurstConvCache_t;
+static BurstConvCache_t g_conv;
+
+static DataKind_t g_current_kind = KIND_UNKNOWN; // Senast startade inspelning
 static uint32_t g_burst_id_counter = 0;
 static uint32_t g_active_burst_ms = 0;
 static OpMode_t g_mode_before_burst = OP_MODE_IDLE;
 static uint32_t last_sample_ms_burst = 0;
+#define BM_STALL_MS 500U // Utan nya sampel så länge avbryts bursten (sampling_stalled)
 
-static uint16_t g_burst_tx_next_block = 0;
-static uint16_t g_burst_tx_total_blocks = 0;
-static bool g_burst_tx_ended = false;
-static BurstGenCtx_t g_burst_gen_ctxs[BM_CTX_MAX_BLOCKS];
+// TB renderar blocket i arenan vid enqueue, så en generatorkontext räcker.
+static BurstGenCtx_t g_burst_gen_ctx;
 
 static bool g_burst_after_countdown = false;
 static DataKind_t g_pending_burst_kind = KIND_UNKNOWN;
@@ -187,12 +288,36 @@ static uint32_t g_pending_burst_id = 0;
 static uint32_t g_burst_param_seconds = 0;
 static uint32_t g_burst_param_cycles = 0;
 
+// WEIGHT: median och medel av primärsensorns x räknas medan samplen dräneras.
+// Ett grovhistogram täcker hela 13-bitarsområdet (64 hinkar à 128 LSB) och ett
+// finhistogram fyra hinkar kring första värdet (±1 g vid full-res). Ligger
+// medianen i en hink utanför fönstret räknas bara den hinken om ur lagret.
+#define BM_MED_BUCKET_SHIFT 7u
+#define BM_MED_BUCKETS      (8192u >> BM_MED_BUCKET_SHIFT)
+#define BM_MED_FINE_BUCKETS 4u
+typedef struct {
+    uint16_t n;
+    int32_t  sum;
+    uint8_t  win;                                            // första hinken i finfönstret
+    uint16_t coarse[BM_MED_BUCKETS];
+    uint16_t fine[BM_MED_FINE_BUCKETS << BM_MED_BUCKET_SHIFT];
+} BurstMedian_t;
+static BurstMedian_t g_median;
+
 static void ProcessAndTransmitBurstData(AppContext_t* ctx);
+static uint16_t BurstTargetSamples(const AppContext_t* ctx, const BurstSlot_t *s, uint16_t pre_samples);
+static void BurstEnqueueReady(AppContext_t* ctx, BurstSlot_t *s);
+static void BurstTxStep(AppContext_t* ctx);
 static int GenDataLine(uint16_t index, char *out, size_t out_sz, void *user);
-static float calculate_mean_int16(const int16_t *data, int size);
-static void swap_int16(int16_t *a, int16_t *b);
-static int16_t quickselect_int16(int16_t *arr, int low, int high, int k);
-static int16_t calculate_median_int16(int16_t *data, int size);
+static uint16_t BurstPackStamp(BurstSlot_t *slot, const Sample_t *s);
+static void BurstStore(const BurstSlot_t *slot, uint16_t i, const Sample_t *s);
+static Sample_t BurstLoad(const BurstSlot_t *slot, uint16_t i);
+static uint16_t BurstStoreFree(void);
+static void BurstSendStats(const BurstSlot_t *slot);
+static void BurstSendDampResult(const BurstSlot_t *slot);
+static void Median_Reset(void);
+static void Median_Add(int16_t v);
+static int16_t Median_Get(void);
 
 void BurstManager_Init(AppContext_t* ctx) {
     (void)ctx;
@@ -202,14 +327,20 @@ void BurstManager_Init(AppContext_t* ctx) {
 
 void BurstManager_Reset(AppContext_t* ctx) {
     (void)ctx;
-    samples_collected_in_burst = 0;
+    // Inspelningen och en väntande burst släpps. En burst som redan sänds går
+    // klart med det som hunnit spelas in; BurstTxStep släpper platsen när BM är klar.
+    if (g_tx != NULL && !BM_IsActive()) g_tx = NULL;
+    for (uint8_t k = 0; k < BM_SLOTS; ++k) {
+        if (&g_slots[k] != g_tx) memset(&g_slots[k], 0, sizeof(g_slots[k]));
+    }
+    if (g_tx != NULL && !g_tx->captured) {
+        g_tx->captured = true;
+        BM_SetSamples(g_tx->collected);
+    }
+    g_cap = NULL;
     g_current_kind = KIND_UNKNOWN;
-    g_current_burst_id = 0;
     g_active_burst_ms = 0;
     g_mode_before_burst = OP_MODE_IDLE;
-    g_burst_tx_next_block = 0;
-    g_burst_tx_total_blocks = 0;
-    g_burst_tx_ended = false;
     g_burst_after_countdown = false;
     g_pending_burst_kind = KIND_UNKNOWN;
     g_pending_burst_id = 0;
@@ -227,11 +358,93 @@ void BurstManager_Configure(AppContext_t* ctx, DataKind_t kind, uint32_t seconds
     ctx->is_dumping = true;
 }
 
+static BurstSlot_t *BurstSlotFree(void) {
+    for (uint8_t k = 0; k < BM_SLOTS; ++k) {
+        if (!g_slots[k].in_use) return &g_slots[k];
+    }
+    return NULL;
+}
+
+static void BurstSlotRelease(BurstSlot_t *s) {
+    if (s == g_cap) g_cap = NULL;
+    if (s == g_tx) g_tx = NULL;
+    memset(s, 0, sizeof(*s));
+}
+
+bool BurstManager_CanCapture(AppContext_t* ctx) {
+    (void)ctx;
+    return (g_cap == NULL) && (BurstSlotFree() != NULL);
+}
+
+// Headern väntar på primärsensorns första sampel, så att ts0_us (och host_us)
+// avser bursten och inte sändtillfället. Utan det sampel duger en annan sensors.
+static bool BurstFirstStamp(const BurstSlot_t *s, uint64_t *ts0_us) {
+    for (uint8_t k = 0; k < SENSOR_MAX_DEVICES; ++k) {
+        if (s->ts_valid[k]) {
+            *ts0_us = Timebase_StampToUs64(s->ts0[k]);
+            return true;
+        }
+        if (!s->captured) break;
+    }
+    *ts0_us = 0;
+    return false;
+}
+
+// DATA_HEADER för platsen; därefter köas dess block (BurstTxStep).
+static void BurstTxBegin(BurstSlot_t *s, uint64_t ts0_us) {
+    BM_Type bm_type = (s->kind == KIND_DAMP_CD) ? BM_TYPE_DAMP_CD :
+                      (s->kind == KIND_PREVIEW) ? BM_TYPE_PREVIEW : BM_TYPE_DAMP_TRG;
+    TB_SetCrc32(s->blk_crc == BLOCK_CRC_32);
+    TB_SetBinary(s->codec == PAYLOAD_CODEC_BIN);
+    BM_Begin(bm_type, s->burst_id, ts0_us, s->captured ? s->collected : s->target, s->odr_hz, s->codec);
+    s->tx_begun = true;
+    g_tx = s;
+}
+
+static void BurstStart(AppContext_t* ctx, DataKind_t kind, uint32_t burst_id, uint32_t duration_ms,
+                       uint16_t pre_samples);
+
 void BurstManager_Start(AppContext_t* ctx, DataKind_t kind, uint32_t burst_id, uint32_t duration_ms) {
-    g_current_burst_id = burst_id;
+    BurstStart(ctx, kind, burst_id, duration_ms, 0U);
+}
+
+void BurstManager_StartTriggered(AppContext_t* ctx, uint32_t burst_id, uint32_t ts_trig) {
+    uint16_t pre = 0;
+    // Triggern har redan läst (committat) samplen fram till och med triggern;
+    // de ligger kvar i ringen och blir bara olästa igen.
+    if (Sensor_IsSampling(ctx) && ctx->trigger_settings.pre_ms > 0U) {
+        const uint32_t pre_ticks = (uint32_t)(((uint64_t)ctx->trigger_settings.pre_ms * Timebase_TickHz()) / 1000U);
+        pre = Sensor_RewindTo(ts_trig - pre_ticks);
+    }
+    BurstStart(ctx, KIND_DAMP_TRG, burst_id, ctx->cfg.burst_ms, pre);
+}
+
+static void BurstStart(AppContext_t* ctx, DataKind_t kind, uint32_t burst_id, uint32_t duration_ms,
+                       uint16_t pre_samples) {
+    BurstSlot_t *s = (g_cap == NULL) ? BurstSlotFree() : NULL;
+    if (s == NULL) {
+        // ARM/START_* nekar med slot_busy, så hit ska ingen start komma
+        Telemetry_SendERROR("BURST", 502, "slot_busy");
+        AppContext_SetOpMode(ctx, (kind == KIND_DAMP_TRG) ? OP_MODE_WAIT_ARM : OP_MODE_IDLE);
+        return;
+    }
+    memset(s, 0, sizeof(*s));
+    s->in_use = true;
+    s->kind = kind;
+    s->burst_id = burst_id;
+    s->summary = (kind != KIND_WEIGHT) && (ctx->burst_result == BURST_RESULT_SUMMARY);
+    s->pos0 = g_store_pos;
+    s->wr0 = g_store_wr;
+    s->codec = ctx->codec;
+    s->blk_crc = ctx->blk_crc;
+    s->odr_hz = ctx->cfg.odr_hz;
+    g_cap = s;
     g_current_kind = kind;
     g_active_burst_ms = duration_ms;
-    samples_collected_in_burst = 0;
+    s->target = BurstTargetSamples(ctx, s, pre_samples);
+    Median_Reset();
+    Cond_Reset(COND_PATH_BURST);
+    g_conv.slot = NULL;
     last_sample_ms_burst = HAL_GetTick();
     ctx->diag.i2c_fail = 0;
     ctx->diag.ring_ovf = 0;
@@ -239,10 +452,175 @@ void BurstManager_Start(AppContext_t* ctx, DataKind_t kind, uint32_t burst_id, u
         ctx->is_dumping = true;
         ctx->diag.hb_pauses++;
     }
-    Sensor_StartSampling(ctx);
+    // DAMP-bursts sänds medan de spelas in: DATA_HEADER går ut med första samplet
+    // (BurstTxStep) med planerat antal sampel och varje fullt block (TB_GetBlockLines)
+    // köas så fort det är insamlat. Det slutliga antalet står i COMPLETE. Sänds en
+    // tidigare burst fortfarande går DATA_HEADER ut när den är kvitterad. WEIGHT och
+    // result=summary analyseras efter insamlingen.
+    Sensor_SetConsumer(ctx, SENSOR_CONSUMER_BURST);
+    // En triggad burst fortsätter i den ström som triggern läste; en omstart
+    // skulle kasta triggersamplen och pre-fönstret.
+    if (kind != KIND_DAMP_TRG || !Sensor_IsSampling(ctx)) {
+        Sensor_StartSampling(ctx);
+    }
     AppContext_SetOpMode(ctx, OP_MODE_BURST);
 }
 
+static uint16_t BurstTargetSamples(const AppContext_t* ctx, const BurstSlot_t *s, uint16_t pre_samples) {
+    uint32_t use_ms = (g_active_burst_ms > 0U) ? g_active_burst_ms : ctx->cfg.burst_ms;
+    uint32_t target_samples = (uint32_t)((use_ms * ctx->cfg.odr_hz) / 1000U);
+    if (target_samples == 0U) target_samples = 1U;
+    // Every sensor contributes odr_hz samples per second to the merged stream
+    target_samples *= Sensor_DeviceCount();
+    target_samples += pre_samples;
+    // WEIGHT och result=summary analyseras efter insamlingen och måste rymmas i lagret
+    const uint32_t cap = (s->kind == KIND_WEIGHT || s->summary) ? BM_STORE_SAMPLES : BM_BURST_MAX_SAMPLES;
+    if (target_samples > cap) target_samples = cap;
+    return (uint16_t)target_samples;
+}
+
+// Köar insamlade block tills TB-kön eller arenan är full. Blockstorleken väljs
+// av TB:s länkregulator per block; restblocket köas först när insamlingen är
+// klar. Blockets ts_base sätts från den löpande stämpeln, som flyttas fram
+// först när blocket har köats, så ett nytt försök ger samma innehåll.
+static void BurstEnqueueReady(AppContext_t* ctx, BurstSlot_t *s) {
+    for (;;) {
+        const uint16_t base = s->tx_next;
+        const uint16_t avail = (uint16_t)(s->collected - base);
+        uint16_t lines = TB_GetBlockLines();
+        if (avail < lines) {
+            if (!s->captured || avail == 0U) break;
+            lines = avail;
+        }
+        // En sensor som dyker upp först i detta block börjar på sin första stämpel
+        for (uint8_t k = 0; k < SENSOR_MAX_DEVICES; ++k) {
+            if (!s->run_valid[k] && s->ts_valid[k]) {
+                s->run_ts[k] = s->ts0[k];
+                s->run_valid[k] = true;
+            }
+        }
+        BurstGenCtx_t* gen_ctx = &g_burst_gen_ctx;
+        gen_ctx->base = base;
+        gen_ctx->ctx = ctx;
+        gen_ctx->slot = s;
+        memcpy(gen_ctx->ts_base, s->run_ts, sizeof(gen_ctx->ts_base));
+        TB_BlockGen block_generator = { GenDataLine, gen_ctx, lines };
+        if (!BM_Enqueue(&block_generator)) break;
+        for (uint16_t j = base; j < base + lines; ++j) {
+            s->run_ts[BurstSensorAt(s, j)] += BurstDtAt(s, j);
+        }
+        s->tx_next = (uint16_t)(base + lines);
+    }
+}
+
+// Sändningen i bakgrunden, oberoende av op_mode: köar block för platsen som
+// äger BM, avslutar den när allt är köat och släpper den efter ACK_COMPLETE
+// (eller avbrott). Därefter får en väntande burst sin DATA_HEADER.
+static void BurstTxStep(AppContext_t* ctx) {
+    if (g_tx != NULL) {
+        if (!BM_IsActive()) {
+            if (g_tx != g_cap) BurstSlotRelease(g_tx);
+        } else if (!BM_IsEnding()) {
+            BurstEnqueueReady(ctx, g_tx);
+            if (g_tx->captured && g_tx->tx_next >= g_tx->collected && !g_tx->tx_ended) {
+                BM_EndOk();
+                g_tx->tx_ended = true;
+            }
+        }
+    }
+    if (g_tx == NULL) {
+        for (uint8_t k = 0; k < BM_SLOTS; ++k) {
+            BurstSlot_t *s = &g_slots[k];
+            uint64_t ts0_us;
+            if (s->in_use && !s->tx_begun && !s->summary && s->kind != KIND_WEIGHT &&
+                (BurstFirstStamp(s, &ts0_us) || s->captured)) {
+                BurstTxBegin(s, ts0_us);
+                break;
+            }
+        }
+    }
+}
+
+int32_t BurstManager_BenchLines(uint16_t lines) {
+    if (g_cap != NULL || g_tx != NULL || lines > BM_STORE_SAMPLES) return -1;
+    BurstSlot_t s;
+    memset(&s, 0, sizeof(s));
+    s.pos0 = g_store_pos;
+    s.collected = lines;
+    s.codec = PAYLOAD_CODEC_RAW;
+    BurstGenCtx_t gen_ctx;
+    memset(&gen_ctx, 0, sizeof(gen_ctx));
+    gen_ctx.slot = &s;
+    char line[BM_LINE_MAX];
+    int32_t bytes = 0;
+    for (uint16_t i = 0; i < lines; ++i) {
+        const int n = GenDataLine(i, line, sizeof(line), &gen_ctx);
+        if (n > 0) bytes += n;
+    }
+    g_conv.slot = NULL;   // cachen pekade på den lokala platsen
+    return bytes;
+}
+
+bool BurstManager_StartBench(AppContext_t* ctx, uint16_t samples) {
+    if (!BurstManager_CanCapture(ctx)) return false;
+    const uint32_t per_s = ctx->cfg.odr_hz * Sensor_DeviceCount();
+    if (per_s == 0U) return false;
+    g_mode_before_burst = ctx->op_mode;
+    ctx->burst_result = BURST_RESULT_BLOCKS;
+    const uint32_t ms = ((uint32_t)samples * 1000U + per_s - 1U) / per_s;
+    BurstManager_Start(ctx, KIND_DAMP_CD, ++g_burst_id_counter, ms);
+    return true;
+}
+
+uint16_t BurstManager_PreviewMaxDecim(const AppContext_t* ctx) {
+    // Marginal under UINT16_MAX för jitter i stämplarna
+    const uint64_t ticks = (uint64_t)Timebase_TickHz();
+    if (ctx->cfg.odr_hz == 0U || ticks == 0U) return 1U;
+    uint64_t m = ((uint64_t)(UINT16_MAX - UINT16_MAX / 8U) * ctx->cfg.odr_hz) / ticks;
+    if (m > BM_PREVIEW_MAX_DECIM) m = BM_PREVIEW_MAX_DECIM;
+    return (m < 1U) ? 1U : (uint16_t)m;
+}
+
+// Förhandsvisningen är en färdiginspelad burst: hela fönstret kopieras på en gång,
+// så producenten hinner inte skriva över det medan blocken väntar på länken.
+bool BurstManager_StartPreview(AppContext_t* ctx, uint16_t n, uint16_t decim) {
+    if (decim == 0U || n == 0U) return false;
+    BurstSlot_t *s = (g_cap == NULL) ? BurstSlotFree() : NULL;
+    if (s == NULL || BurstStoreFree() < n) return false;
+
+    uint32_t want = (uint32_t)n * decim;
+    if (want > SAMPLE_HISTORY_MAX) want = SAMPLE_HISTORY_MAX;
+    uint16_t count;
+    const uint32_t start = Sensor_HistoryOpen((uint16_t)want, &count);
+    // Nyaste samplet kommer med; de äldsta count % decim hoppas över
+    const uint16_t m = (uint16_t)(count / decim);
+    const uint32_t first = start + (uint32_t)(count - m * decim) + (decim - 1U);
+
+    memset(s, 0, sizeof(*s));
+    s->in_use = true;
+    s->kind = KIND_PREVIEW;
+    s->burst_id = ++g_burst_id_counter;
+    s->pos0 = g_store_pos;
+    s->wr0 = g_store_wr;
+    s->codec = ctx->codec;
+    s->blk_crc = ctx->blk_crc;
+    s->odr_hz = ctx->cfg.odr_hz / decim;
+    g_conv.slot = NULL;
+    for (uint16_t k = 0; k < m; k++) {
+        Sample_t sample;
+        if (!Sensor_HistoryRead(first + (uint32_t)k * decim, &sample)) continue;
+        burst_dt[BM_SLOT(s, s->collected)] = BurstPackStamp(s, &sample);
+        BurstStore(s, s->collected, &sample);
+        s->collected++;
+    }
+    s->target = s->collected;
+    s->captured = true;
+    g_store_wr += s->collected;
+    g_store_pos = BM_SLOT(s, s->collected);
+    // DATA_HEADER efter kommandots ACK: BurstTxStep börjar sändningen
+    return true;
+}
+
 uint32_t BurstManager_GetNextBurstId(AppContext_t* ctx) {
     (void)ctx;
     return ++g_burst_id_counter;
@@ -259,74 +637,118 @@ void BurstManager_Pump(AppContext_t* ctx) {
     // Always pump the low-level transport state machine if it's active
     if (BM_IsActive()) {
         BM_Pump();
+        const uint32_t rto = TB_MsToTimeout();
+        if (rto != UINT32_MAX) Sched_ArmTimeout(rto); // omsändning om kvittensen uteblir
     }
 
     switch (ctx->op_mode) {
         case OP_MODE_BURST: {
+            BurstSlot_t *s = g_cap;
+            if (s == NULL) break;
             uint32_t use_ms = (g_active_burst_ms > 0U) ? g_active_burst_ms : ctx->cfg.burst_ms;
-            uint32_t target_samples = (uint32_t)((use_ms * ctx->cfg.odr_hz) / 1000U);
-            if (target_samples == 0U) target_samples = 1U;
-            if (target_samples > SAMPLES_PER_BURST) target_samples = SAMPLES_PER_BURST;
-
-            uint16_t samples_before_drain = samples_collected_in_burst;
-            while (samples_collected_in_burst < target_samples) {
-                Sample_t sample;
-                if (!Sensor_GetSample(&sample)) break;
-                burst_data_x[samples_collected_in_burst] = sample.x;
-                burst_data_y[samples_collected_in_burst] = sample.y;
-                burst_data_z[samples_collected_in_burst] = sample.z;
-                burst_timestamps[samples_collected_in_burst] = sample.timestamp;
-                samples_collected_in_burst++;
+            const uint16_t target_samples = s->target;
+
+            uint16_t samples_before_drain = s->collected;
+            const bool cond = Cond_IsOn(COND_PATH_BURST);
+            while (s->collected < target_samples) {
+                const Sample_t* span;
+                Sample_t cbuf[COND_CHUNK];
+                uint16_t n = Sensor_PeekSamples(&span);
+                if (n == 0U) break;
+                const bool kind_weight = (s->kind == KIND_WEIGHT);
+                uint32_t room = (uint32_t)(target_samples - s->collected);
+                // Lagret är fullt tills nästa block köats; samplen väntar i sensorringen
+                const uint16_t store_free = BurstStoreFree();
+                if (room > store_free) room = store_free;
+                if (room == 0U) break;
+                if (n > room) n = (uint16_t)room;
+                if (n > BM_CONV_CHUNK) n = BM_CONV_CHUNK;
+                if (cond) {
+                    // Filtrerad kopia: ringen behåller råa sampel (pre-trigger-rewind läser om dem)
+                    if (n > COND_CHUNK) n = COND_CHUNK;
+                    memcpy(cbuf, span, (size_t)n * sizeof(Sample_t));
+                    Cond_Apply(COND_PATH_BURST, cbuf, n);
+                    span = cbuf;
+                }
+                int16_t vx[BM_CONV_CHUNK], vy[BM_CONV_CHUNK], vz[BM_CONV_CHUNK];
+                uint8_t vs[BM_CONV_CHUNK];
+                for (uint16_t i = 0; i < n; i++) {
+                    burst_dt[BM_SLOT(s, s->collected)] = BurstPackStamp(s, &span[i]);
+                    BurstStore(s, s->collected, &span[i]);
+                    s->collected++;
+                    if (kind_weight && span[i].sensor == 0U) Median_Add(span[i].x);
+                    vx[i] = span[i].x;
+                    vy[i] = span[i].y;
+                    vz[i] = span[i].z;
+                    vs[i] = span[i].sensor;
+                }
+                float ax[BM_CONV_CHUNK], ay[BM_CONV_CHUNK], az[BM_CONV_CHUNK];
+                Sensor_ConvertBatch(vx, vy, vz, vs, n, ax, ay, az);
+                for (uint16_t i = 0; i < n; i++) {
+                    BurstStats_Add(&s->stats, vs[i], ax[i], ay[i], az[i]);
+                }
+                g_store_wr += n;
+                g_store_pos = BM_SLOT(s, s->collected);
+                Sensor_CommitSamples(n);
             }
-            if (samples_collected_in_burst > samples_before_drain) {
+            if (s->collected > samples_before_drain) {
                 last_sample_ms_burst = HAL_GetTick();
             }
 
+            // Bursten avslutades under inspelningen (STOP, stall eller slut på
+            // omsändningar): vänta på ACK_COMPLETE via burst_abort_pending.
+            if (g_tx == s && BM_IsEnding()) {
+                if (!ctx->burst_abort_pending) {
+                    Sensor_StopSampling(ctx);
+                    Sensor_SetConsumer(ctx, SENSOR_CONSUMER_NONE);
+                    ctx->burst_abort_pending = true;
+                }
+                break;
+            }
+
             bool time_up = ((current_tick_ms - ctx->state_timer_start_ms) >= use_ms);
 
             // Stall detection: if sampling stops mid-burst, abort.
-            if (!time_up && samples_collected_in_burst < target_samples) {
-                if (samples_collected_in_burst > 0 && (current_tick_ms - last_sample_ms_burst) > 500) {
-                    Telemetry_SendERROR("BURST", 500, "sampling_stalled");
+            if (!time_up && s->collected < target_samples) {
+                if (s->collected > 0 && (current_tick_ms - last_sample_ms_burst) > BM_STALL_MS) {
+                    if (BurstStoreFree() == 0U) {
+                        // Länken hann inte ta emot blocken: lagret har stått fullt
+                        Telemetry_SendERROR("BURST", 501, "store_overrun");
+                    } else {
+                        Telemetry_SendERROR("BURST", 500, "sampling_stalled");
+                    }
                     Sensor_StopSampling(ctx);
-                    if (BM_IsActive()) {
+                    Sensor_SetConsumer(ctx, SENSOR_CONSUMER_NONE);
+                    if (g_tx == s) {
                         BM_EndAborted(999);
                         ctx->burst_abort_pending = true;
                     } else {
-                        BurstManager_Reset(ctx);
-                        AppContext_SetOpMode(ctx, g_mode_before_burst);
+                        // Inget har sänts för denna burst; en tidigare sänds vidare
+                        const OpMode_t next_mode = (s->kind == KIND_DAMP_TRG) ? OP_MODE_WAIT_ARM : g_mode_before_burst;
+                        BurstSlotRelease(s);
+                        AppContext_SetOpMode(ctx, next_mode);
                     }
                     return;
                 }
             }
 
-            if ((samples_collected_in_burst >= target_samples) || time_up) {
+            if ((s->collected >= target_samples) || time_up) {
                 Sensor_StopSampling(ctx);
+                Sensor_SetConsumer(ctx, SENSOR_CONSUMER_NONE);
                 ProcessAndTransmitBurstData(ctx);
-            }
-            break;
-        }
-        case OP_MODE_BURST_SENDING: {
-            if (g_burst_tx_next_block < g_burst_tx_total_blocks) {
-                uint16_t lines_in_block = (g_burst_tx_next_block == g_burst_tx_total_blocks - 1)
-                    ? (samples_collected_in_burst - g_burst_tx_next_block * PROTO_BLOCK_LINES_DEFAULT)
-                    : PROTO_BLOCK_LINES_DEFAULT;
-                TB_BlockGen block_generator = { GenDataLine, &g_burst_gen_ctxs[g_burst_tx_next_block], lines_in_block };
-                if (BM_Enqueue(&block_generator)) {
-                    g_burst_tx_next_block++;
+            } else {
+                // Står samplingen kommer ingen sampelhändelse: väck pumpen vid
+                // burstens sluttid eller stallgränsen, det som kommer först.
+                const uint32_t now = HAL_GetTick();
+                const uint32_t elapsed = now - ctx->state_timer_start_ms;
+                uint32_t tmo = (elapsed >= use_ms) ? 0U : (use_ms - elapsed);
+                if (s->collected > 0) {
+                    const uint32_t idle = now - last_sample_ms_burst;
+                    const uint32_t stall = (idle > BM_STALL_MS) ? 0U : (BM_STALL_MS + 1U - idle);
+                    if (stall < tmo) tmo = stall;
                 }
-            } else if (!g_burst_tx_ended) {
-                BM_EndOk();
-                g_burst_tx_ended = true;
-            }
-            if (!BM_IsActive() && !ctx->burst_abort_pending) {
-                BurstManager_Reset(ctx);
-                OpMode_t next_mode = (g_current_kind == KIND_DAMP_TRG) ? OP_MODE_WAIT_ARM : g_mode_before_burst;
-                if (next_mode == OP_MODE_IDLE && g_mode_before_burst != OP_MODE_IDLE) next_mode = g_mode_before_burst;
-                else if (next_mode != OP_MODE_WAIT_ARM) next_mode = OP_MODE_IDLE;
-                AppContext_SetOpMode(ctx, next_mode);
+                Sched_ArmTimeout(tmo);
             }
-            HAL_Delay(5);
             break;
         }
         case OP_MODE_COUNTDOWN: {
@@ -356,120 +778,418 @@ void BurstManager_Pump(AppContext_t* ctx) {
     if (ctx->burst_abort_pending) {
         if (!BM_IsActive() && COMM_TxIsIdle()) {
             ctx->burst_abort_pending = false;
+            // STOP utanför en burst har redan valt läge själv
+            const bool in_burst = (ctx->op_mode == OP_MODE_BURST || ctx->op_mode == OP_MODE_BURST_SENDING);
             BurstManager_Reset(ctx);
             OpMode_t next_mode = (g_current_kind == KIND_DAMP_TRG) ? OP_MODE_WAIT_ARM : g_mode_before_burst;
             if (next_mode != OP_MODE_WAIT_ARM) next_mode = OP_MODE_IDLE;
-            AppContext_SetOpMode(ctx, next_mode);
+            if (in_burst) AppContext_SetOpMode(ctx, next_mode);
         }
+    } else {
+        BurstTxStep(ctx);
     }
 }
 
 static void ProcessAndTransmitBurstData(AppContext_t* ctx) {
+    BurstSlot_t *s = g_cap;
     if (!ctx->is_dumping) {
         ctx->is_dumping = true;
         ctx->diag.hb_pauses++;
     }
-    const uint16_t samples = samples_collected_in_burst;
-    if (g_current_kind == KIND_WEIGHT) {
-        if (samples > 0) {
-            float mean_ax_raw = calculate_mean_int16(burst_data_x, samples);
-            memcpy(g_median_buf, burst_data_x, samples * sizeof(int16_t));
-            int16_t median_ax_raw = calculate_median_int16(g_median_buf, samples);
-            float mean_ms2 = 0.0f, std_ms2 = 0.0f;
-            double sum_ms2 = 0.0, sum2_ms2 = 0.0;
-            for(uint16_t i=0; i<samples; ++i) {
-                float ax, ay, az;
-                Sample_t s = {.x=burst_data_x[i], .y=burst_data_y[i], .z=burst_data_z[i]};
-                Sensor_ConvertToMps2(ctx, &s, &ax, &ay, &az);
-                float mag_ms2 = sqrtf(ax*ax + ay*ay + az*az);
-                sum_ms2 += mag_ms2;
-                sum2_ms2 += (double)mag_ms2 * (double)mag_ms2;
-            }
-            mean_ms2 = (samples > 0) ? (float)(sum_ms2 / samples) : 0.0f;
-            float var_ms2 = (samples > 0) ? (float)((sum2_ms2 / samples) - (double)mean_ms2 * (double)mean_ms2) : 0.0f;
-            std_ms2 = (var_ms2 > 0.f) ? sqrtf(var_ms2) : 0.f;
-            COMM_SendfBlocking(MSG_SUMMARY ",mean_ax_raw=%d,median_ax_raw=%d,mean_ms2=%.3f,std_ms2=%.3f,delta_vinkel_deg=%.3f" PROTO_EOL,
-                (int)mean_ax_raw, median_ax_raw, mean_ms2, std_ms2, 0.0f);
+    if (s->kind == KIND_WEIGHT) {
+        // WEIGHT-summeringen avser primärsensorn. Allt är redan räknat under
+        // insamlingen: median/medel av x (g_median) och magnituden (stats).
+        const BurstStat_t *mag = &s->stats.ch[0][BSTAT_MAG];
+        if (mag->n > 0U) {
+            float mean_ax_raw = (float)g_median.sum / g_median.n;
+            int16_t median_ax_raw = Median_Get();
+            float mean_ms2 = mag->mean;
+            float std_ms2 = BurstStat_Std(mag);
+            char line[PROTO_MAX_LINE];
+            char *p = fmt_str(line, MSG_SUMMARY ",mean_ax_raw=");
+            p = fmt_i32(p, (int32_t)mean_ax_raw);
+            p = fmt_str(p, ",median_ax_raw=");    p = fmt_i32(p, median_ax_raw);
+            p = fmt_str(p, ",mean_ms2=");         p = fmt_f3(p, mean_ms2);
+            p = fmt_str(p, ",std_ms2=");          p = fmt_f3(p, std_ms2);
+            p = fmt_str(p, ",delta_vinkel_deg="); p = fmt_f3(p, 0.0f);
+            p = fmt_str(p, PROTO_EOL);
+            (void)Telemetry_WriteBlocking(line, (size_t)(p - line));
         }
+        BurstSendStats(s);
         AppContext_SetOpMode(ctx, g_mode_before_burst != OP_MODE_IDLE ? g_mode_before_burst : OP_MODE_IDLE);
-        BurstManager_Reset(ctx);
+        BurstSlotRelease(s);
         return;
     }
-    uint16_t total_blocks = (samples + PROTO_BLOCK_LINES_DEFAULT - 1) / PROTO_BLOCK_LINES_DEFAULT;
-    if (total_blocks > BM_CTX_MAX_BLOCKS) total_blocks = BM_CTX_MAX_BLOCKS;
-    for (uint16_t i = 0; i < total_blocks; ++i) {
-        g_burst_gen_ctxs[i].base = i * PROTO_BLOCK_LINES_DEFAULT;
-        g_burst_gen_ctxs[i].ctx = ctx;
+    const OpMode_t next_mode = (s->kind == KIND_DAMP_TRG) ? OP_MODE_WAIT_ARM : OP_MODE_IDLE;
+    if (s->summary) {
+        // Hela bursten ligger i lagret: en DAMP_RESULT-rad i stället för BLOCKS
+        BurstSendDampResult(s);
+        BurstSlotRelease(s);
+        AppContext_SetOpMode(ctx, next_mode);
+        return;
     }
-    g_burst_tx_total_blocks = total_blocks;
-    g_burst_tx_next_block = 0;
-    g_burst_tx_ended = false;
-    BM_Type bm_type = (g_current_kind == KIND_DAMP_CD) ? BM_TYPE_DAMP_CD : BM_TYPE_DAMP_TRG;
-    AppContext_SetOpMode(ctx, OP_MODE_BURST_SENDING);
-    BM_Begin(bm_type, g_current_burst_id, 0, samples, ctx->cfg.odr_hz);
-    if (samples == 0) {
-        BM_EndOk();
-        g_burst_tx_ended = true;
+    // DATA_HEADER och alla fulla block är ute eller köade bakom föregående burst;
+    // kvar är restblocket och COMPLETE med det faktiska antalet. Inspelningen
+    // släpps direkt, så nästa burst kan armas/startas medan denna sänds.
+    s->captured = true;
+    if (g_tx == s) BM_SetSamples(s->collected);
+    g_cap = NULL;
+    AppContext_SetOpMode(ctx, next_mode);
+}
+
+// Stats och DAMP_RESULT för bursten som äger BM, strax före dess COMPLETE.
+static void BurstSendTxResults(void) {
+    if (g_tx == NULL) return;
+    BurstSendStats(g_tx);
+    BurstSendDampResult(g_tx);
+}
+
+// Kalibrerade värden är begränsade av 13 bitar; spärren håller bara radlängden statisk.
+static inline float stat_clamp(float v) {
+    return (v > 999999.0f) ? 999999.0f : ((v < -999999.0f) ? -999999.0f : v);
+}
+
+#define BM_STAT_F3_MAX 11u // "-999999.000"
+#define BM_STATS_LINE_MAX (sizeof(MSG_SUMMARY_STATS ",burst_id=,sensor=,axis=mag,n=,mean_ms2=,std_ms2=,rms_ms2=,peak_ms2=,crest=") - 1u + \
+                           3u * FMT_U32_MAX + 5u * BM_STAT_F3_MAX + PROTO_EOL_LEN)
+_Static_assert(BM_STATS_LINE_MAX <= PROTO_MAX_LINE, "SUMMARY_STATS line too long");
+
+// En SUMMARY_STATS-rad per sensor och kanal med sampel.
+static void BurstSendStats(const BurstSlot_t *slot) {
+    static const char *const axis[BSTAT_CHANNELS] = { "x", "y", "z", "mag" };
+    for (uint8_t k = 0; k < SENSOR_MAX_DEVICES; ++k) {
+        for (int c = 0; c < (int)BSTAT_CHANNELS; ++c) {
+            const BurstStat_t *s = &slot->stats.ch[k][c];
+            if (s->n == 0U) continue;
+            char line[PROTO_MAX_LINE];
+            char *p = fmt_str(line, MSG_SUMMARY_STATS ",burst_id=");
+            p = fmt_u32(p, slot->burst_id);
+            p = fmt_str(p, ",sensor=");   p = fmt_u32(p, k);
+            p = fmt_str(p, ",axis=");     p = fmt_str(p, axis[c]);
+            p = fmt_str(p, ",n=");        p = fmt_u32(p, s->n);
+            p = fmt_str(p, ",mean_ms2="); p = fmt_f3(p, stat_clamp(s->mean));
+            p = fmt_str(p, ",std_ms2=");  p = fmt_f3(p, stat_clamp(BurstStat_Std(s)));
+            p = fmt_str(p, ",rms_ms2=");  p = fmt_f3(p, stat_clamp(BurstStat_Rms(s)));
+            p = fmt_str(p, ",peak_ms2="); p = fmt_f3(p, stat_clamp(s->peak));
+            p = fmt_str(p, ",crest=");    p = fmt_f3(p, stat_clamp(BurstStat_Crest(s)));
+            p = fmt_str(p, PROTO_EOL);
+            (void)Telemetry_WriteBlocking(line, (size_t)(p - line));
+        }
     }
 }
 
+// Primärsensorns råvärde på vald axel, skalat till m/s^2 (offset tas bort av analysen).
+typedef struct {
+    const BurstSlot_t *slot;
+    uint8_t axis;
+    float scale;
+} BurstDampChan_t;
+
+static bool BurstDampSample(uint16_t i, float *v, void *user) {
+    const BurstDampChan_t *c = (const BurstDampChan_t *)user;
+    if (BurstSensorAt(c->slot, i) != 0U) return false;
+    const Sample_t s = BurstLoad(c->slot, i);
+    const int16_t raw = (c->axis == BSTAT_X) ? s.x : ((c->axis == BSTAT_Y) ? s.y : s.z);
+    *v = (float)raw * c->scale;
+    return true;
+}
+
+// DAMP_RESULT för primärsensorns axel med störst std. Kräver att hela bursten
+// ligger kvar i lagret; en längre BLOCKS-burst, eller nästa burst, har skrivit över början.
+static void BurstSendDampResult(const BurstSlot_t *slot) {
+    static const char *const axis[3] = { "x", "y", "z" };
+    const uint16_t samples = slot->collected;
+    if (samples == 0U || (uint32_t)(g_store_wr - slot->wr0) > BM_STORE_SAMPLES) return;
+    BurstDampChan_t ch = { slot, BSTAT_X, 0.0f };
+    for (uint8_t c = BSTAT_Y; c <= BSTAT_Z; ++c) {
+        if (BurstStat_Std(&slot->stats.ch[0][c]) > BurstStat_Std(&slot->stats.ch[0][ch.axis])) ch.axis = c;
+    }
+    float off[3];
+    ch.scale = Sensor_GetScaleMps2(0, off);
+    DampResult_t r;
+    const bool ok = Damp_Analyze(BurstDampSample, &ch, samples, (float)slot->odr_hz, &r);
+    char line[PROTO_MAX_LINE];
+    int n = snprintf(line, sizeof line,
+                     MSG_DAMP_RESULT ",burst_id=%lu,sensor=0,axis=%s,n=%u,f_hz=%.3f,zeta=%.5f,delta=%.5f,amp_ms2=%.3f,cycles=%u,ok=%u" PROTO_EOL,
+                     (unsigned long)slot->burst_id, axis[ch.axis], (unsigned)r.n, (double)r.f_hz,
+                     (double)r.zeta, (double)r.delta, (double)stat_clamp(r.amp0), (unsigned)r.cycles, ok ? 1u : 0u);
+    if (n > 0 && (size_t)n < sizeof line) {
+        (void)Telemetry_WriteBlocking(line, (size_t)n);
+    }
+}
+
+static inline uint32_t pack13(int16_t v) {
+    if (v < -4096) v = -4096; // ADXL345 full-res ger högst 13 bitar
+    if (v > 4095) v = 4095;
+    return (uint32_t)v & 0x1FFFu;
+}
+
+static inline int16_t unpack13(uint32_t v) {
+    return (int16_t)((int32_t)((v & 0x1FFFu) ^ 0x1000u) - 0x1000);
+}
+
+static void BurstStore(const BurstSlot_t *slot, uint16_t i, const Sample_t *s) {
+    const uint64_t w = (uint64_t)pack13(s->x) | ((uint64_t)pack13(s->y) << 13) |
+                       ((uint64_t)pack13(s->z) << 26) | ((uint64_t)(s->sensor & 1u) << 39);
+    uint8_t *p = burst_xyz[BM_SLOT(slot, i)];
+    for (unsigned b = 0; b < BM_PACKED_BYTES; ++b) {
+        p[b] = (uint8_t)(w >> (8u * b));
+    }
+}
+
+static Sample_t BurstLoad(const BurstSlot_t *slot, uint16_t i) {
+    const uint8_t *p = burst_xyz[BM_SLOT(slot, i)];
+    uint64_t w = 0;
+    for (unsigned b = 0; b < BM_PACKED_BYTES; ++b) {
+        w |= (uint64_t)p[b] << (8u * b);
+    }
+    Sample_t s = {.x = unpack13((uint32_t)w), .y = unpack13((uint32_t)(w >> 13)),
+                  .z = unpack13((uint32_t)(w >> 26)), .sensor = (uint8_t)(w >> 39)};
+    return s;
+}
+
+// Slots som varken är köade eller insamlade: avståndet från skrivpositionen till
+// äldsta ej köade sampel bland platserna. WEIGHT och result=summary köar aldrig.
+static uint16_t BurstStoreFree(void) {
+    uint32_t used = 0;
+    for (uint8_t k = 0; k < BM_SLOTS; ++k) {
+        const BurstSlot_t *s = &g_slots[k];
+        if (!s->in_use) continue;
+        const uint32_t u = g_store_wr - (s->wr0 + s->tx_next);
+        if (u > used) used = u;
+    }
+    return (uint16_t)(BM_STORE_SAMPLES - used);
+}
+
+static uint16_t BurstPackStamp(BurstSlot_t *slot, const Sample_t *s) {
+    const uint8_t k = (s->sensor < SENSOR_MAX_DEVICES) ? s->sensor : 0U;
+    if (!slot->ts_valid[k]) {
+        slot->ts0[k] = s->timestamp;
+        slot->ts_last[k] = s->timestamp;
+        slot->ts_valid[k] = true;
+    }
+    int32_t d = (int32_t)(s->timestamp - slot->ts_last[k]);
+    if (d < 0) d = 0;
+    if (d > (int32_t)UINT16_MAX) d = UINT16_MAX;
+    slot->ts_last[k] += (uint32_t)d;
+    return (uint16_t)d;
+}
+
+// TIM2-stämpel för sample i: blockets bas plus differenserna för samma sensor.
+static uint32_t BurstStampAt(const BurstGenCtx_t *gen_ctx, uint16_t i) {
+    const BurstSlot_t *s = gen_ctx->slot;
+    const uint8_t k = BurstSensorAt(s, i);
+    uint32_t ts = gen_ctx->ts_base[k];
+    for (uint16_t j = gen_ctx->base; j <= i; ++j) {
+        if (BurstSensorAt(s, j) == k) ts += BurstDtAt(s, j);
+    }
+    return ts;
+}
+
+// Fyller g_conv med sampel i0.. ur lagret (bara insamlade).
+static void BurstConvFill(const BurstSlot_t *slot, uint16_t i0) {
+    BurstConvCache_t *c = &g_conv;
+    uint16_t n = (uint16_t)(slot->collected - i0);
+    if (n > BM_CONV_CHUNK) n = BM_CONV_CHUNK;
+    for (uint16_t k = 0; k < n; ++k) {
+        const Sample_t s = BurstLoad(slot, (uint16_t)(i0 + k));
+        c->x[k] = s.x;
+        c->y[k] = s.y;
+        c->z[k] = s.z;
+        c->sensor[k] = s.sensor;
+    }
+    Sensor_ConvertBatchMilli(c->x, c->y, c->z, c->sensor, n, c->mx, c->my, c->mz);
+    c->slot = slot;
+    c->i0 = i0;
+    c->n = n;
+}
+
+// Calibrated sample i in mm/s^2, the resolution of the CSV %.3f columns.
+// Rising indices come from g_conv; an index behind it (a DD line's previous
+// sample) is converted on its own so the chunk stays in place.
+static void BurstSampleMilli(const BurstGenCtx_t *gen_ctx, uint16_t i, int32_t mm[3]) {
+    BurstConvCache_t *c = &g_conv;
+    if (c->slot != gen_ctx->slot || i < c->i0 || i >= (uint16_t)(c->i0 + c->n)) {
+        if (c->slot == gen_ctx->slot && i < c->i0) {
+            const Sample_t s = BurstLoad(gen_ctx->slot, i);
+            Sensor_ConvertBatchMilli(&s.x, &s.y, &s.z, &s.sensor, 1U, &mm[0], &mm[1], &mm[2]);
+            return;
+        }
+        BurstConvFill(gen_ctx->slot, i);
+    }
+    const uint16_t k = (uint16_t)(i - c->i0);
+    mm[0] = c->mx[k];
+    mm[1] = c->my[k];
+    mm[2] = c->mz[k];
+}
+
+// Previous sample of the same sensor in this block. The generator is called
+// with rising index, so the backward search stays short (the sensors interleave).
+static bool BurstPrevInBlock(const BurstGenCtx_t *gen_ctx, uint16_t i, uint16_t *prev) {
+    uint16_t j = i;
+    const uint8_t k = BurstSensorAt(gen_ctx->slot, i);
+    while (j > gen_ctx->base && BurstSensorAt(gen_ctx->slot, (uint16_t)(j - 1u)) != k) {
+        j--;
+    }
+    if (j == gen_ctx->base) return false;
+    *prev = (uint16_t)(j - 1u);
+    return true;
+}
+
+// mode=DELTA: the first line of each sensor in a block is a DK key, the rest
+// are DD deltas to the previous line of that sensor in the same block.
+static int GenDeltaLine(const BurstGenCtx_t *gen_ctx, uint16_t i, char *out, size_t out_sz) {
+    int32_t cur[3];
+    BurstSampleMilli(gen_ctx, i, cur);
+    uint16_t p;
+    if (out_sz < BM_LINE_MAX) return -1;
+    char *o = out;
+    if (BurstPrevInBlock(gen_ctx, i, &p)) {
+        int32_t prev[3];
+        BurstSampleMilli(gen_ctx, p, prev);
+        o = fmt_str(o, MSG_DATA_DELTA ",");
+        o = fmt_u32(o, Timebase_TicksToUs(BurstDtAt(gen_ctx->slot, i)));
+        for (int k = 0; k < 3; k++) {
+            *o++ = ',';
+            o = fmt_i32(o, cur[k] - prev[k]);
+        }
+    } else {
+        o = fmt_str(o, MSG_DATA_KEY ",");
+        o = fmt_u64(o, Timebase_StampToUs64(BurstStampAt(gen_ctx, i)));
+        for (int k = 0; k < 3; k++) {
+            *o++ = ',';
+            o = fmt_i32(o, cur[k]);
+        }
+    }
+    *o++ = ',';
+    o = fmt_u32(o, BurstSensorAt(gen_ctx->slot, i));
+    o = fmt_str(o, PROTO_EOL);
+    *o = '\0';
+    return (int)(o - out);
+}
+
+static void put_u16le(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+// mode=BIN: PROTO_BLK_BIN_REC-byte records, preceded by a key with the absolute
+// stamp for the first sample of each sensor in the block (api_schema.h).
+static int GenBinRecord(const BurstGenCtx_t *gen_ctx, uint16_t i, char *out, size_t out_sz) {
+    uint8_t *p = (uint8_t *)out;
+    size_t n = 0;
+    uint16_t prev;
+    uint32_t dt_us = 0;
+    if (out_sz < 2u * PROTO_BLK_BIN_REC) return -1;
+    const Sample_t s = BurstLoad(gen_ctx->slot, i);
+    if (BurstPrevInBlock(gen_ctx, i, &prev)) {
+        dt_us = Timebase_TicksToUs(BurstDtAt(gen_ctx->slot, i));
+        if (dt_us > UINT16_MAX) dt_us = UINT16_MAX;
+    } else {
+        uint64_t ts_us = Timebase_StampToUs64(BurstStampAt(gen_ctx, i));
+        p[n++] = (uint8_t)(PROTO_BLK_BIN_KEY | s.sensor);
+        for (int b = 0; b < 8; ++b) {
+            p[n++] = (uint8_t)(ts_us >> (8 * b));
+        }
+    }
+    p[n++] = s.sensor;
+    put_u16le(&p[n], (uint16_t)s.x); n += 2;
+    put_u16le(&p[n], (uint16_t)s.y); n += 2;
+    put_u16le(&p[n], (uint16_t)s.z); n += 2;
+    put_u16le(&p[n], (uint16_t)dt_us); n += 2;
+    return (int)n;
+}
+
 static int GenDataLine(uint16_t index, char *out, size_t out_sz, void *user) {
     const BurstGenCtx_t *gen_ctx = (const BurstGenCtx_t *)user;
-    AppContext_t* app_ctx = gen_ctx->ctx;
     const uint16_t i = (uint16_t)(gen_ctx->base + index);
-    if (i >= SAMPLES_PER_BURST) return -1;
-    float ax_mps2, ay_mps2, az_mps2;
-    Sample_t s = {.x = burst_data_x[i], .y = burst_data_y[i], .z = burst_data_z[i]};
-    Sensor_ConvertToMps2(app_ctx, &s, &ax_mps2, &ay_mps2, &az_mps2);
-    int ret = snprintf(out, out_sz, "DATA,%lu,%.3f,%.3f,%.3f,%.3f" PROTO_EOL,
-        (unsigned long)Sensor_TicksToUs(app_ctx, burst_timestamps[i]),
-        ax_mps2, ay_mps2, az_mps2, 0.0f);
-    if (ret < 0 || (size_t)ret >= out_sz) return -1;
-    return ret;
-}
-
-static float calculate_mean_int16(const int16_t *data, int size) {
-  if (size == 0) return 0.0f;
-  long sum = 0;
-  for (int i = 0; i < size; i++) sum += data[i];
-  return (float)sum / size;
-}
-
-static void swap_int16(int16_t *a, int16_t *b) {
-  int16_t temp = *a; *a = *b; *b = temp;
-}
-
-static int16_t quickselect_int16(int16_t *arr, int low, int high, int k) {
-  while (low <= high) {
-    if (low == high) return arr[low];
-    int pivot_idx = low + (high - low) / 2;
-    int16_t pivot = arr[pivot_idx];
-    swap_int16(&arr[pivot_idx], &arr[high]);
-    int i = low;
-    for (int j = low; j < high; j++) {
-      if (arr[j] < pivot) {
-        swap_int16(&arr[i], &arr[j]);
-        i++;
-      }
-    }
-    swap_int16(&arr[i], &arr[high]);
-    if (k == i) return arr[i];
-    else if (k < i) high = i - 1;
-    else low = i + 1;
-  }
-  return INT16_MIN;
-}
-
-static int16_t calculate_median_int16(int16_t *data, int size) {
-  if (size == 0) return 0;
-  if (size == 1) return data[0];
-  if (size % 2 == 1) {
-    return quickselect_int16(data, 0, size - 1, size / 2);
-  } else {
-    int mid1_idx = size / 2 - 1;
-    int mid2_idx = size / 2;
-    int16_t mid1 = quickselect_int16(data, 0, size - 1, mid1_idx);
-    int16_t mid2 = quickselect_int16(data, mid1_idx + 1, size - 1, mid2_idx);
+    if (i >= gen_ctx->slot->collected) return -1;
+    if (gen_ctx->slot->codec == PAYLOAD_CODEC_DELTA) {
+        return GenDeltaLine(gen_ctx, i, out, out_sz);
+    }
+    if (gen_ctx->slot->codec == PAYLOAD_CODEC_BIN) {
+        return GenBinRecord(gen_ctx, i, out, out_sz);
+    }
+    // Helt i heltal: mm/s^2 ur Sensor_ConvertBatchMilli, tre decimaler med fmt_milli
+    if (out_sz < BM_LINE_MAX) return -1;
+    int32_t mm[3];
+    BurstSampleMilli(gen_ctx, i, mm);
+    char *o = fmt_str(out, "DATA,");
+    o = fmt_u64(o, Timebase_StampToUs64(BurstStampAt(gen_ctx, i)));
+    *o++ = ','; o = fmt_milli(o, mm[0]);
+    *o++ = ','; o = fmt_milli(o, mm[1]);
+    *o++ = ','; o = fmt_milli(o, mm[2]);
+    o = fmt_str(o, ",0.000,");
+    o = fmt_u32(o, BurstSensorAt(gen_ctx->slot, i));
+    o = fmt_str(o, PROTO_EOL);
+    *o = '\0';
+    return (int)(o - out);
+}
+
+static void Median_Reset(void) {
+    memset(&g_median, 0, sizeof(g_median));
+}
+
+static inline uint16_t median_off(int16_t v) {
+    if (v < -4096) v = -4096; // samma mättning som lagret (pack13)
+    if (v > 4095) v = 4095;
+    return (uint16_t)(v + 4096);
+}
+
+static void Median_Add(int16_t v) {
+    const uint16_t off = median_off(v);
+    const uint8_t b = (uint8_t)(off >> BM_MED_BUCKET_SHIFT);
+    if (g_median.n == 0U) {
+        // Fönstret centreras på första värdet och ligger helt inom området
+        int w = (int)((off + (1u << (BM_MED_BUCKET_SHIFT - 1u))) >> BM_MED_BUCKET_SHIFT) - (int)(BM_MED_FINE_BUCKETS / 2u);
+        if (w < 0) w = 0;
+        if (w > (int)(BM_MED_BUCKETS - BM_MED_FINE_BUCKETS)) w = (int)(BM_MED_BUCKETS - BM_MED_FINE_BUCKETS);
+        g_median.win = (uint8_t)w;
+    }
+    g_median.n++;
+    g_median.sum += v;
+    g_median.coarse[b]++;
+    if (b >= g_median.win && b < g_median.win + BM_MED_FINE_BUCKETS) {
+        g_median.fine[off - ((uint16_t)g_median.win << BM_MED_BUCKET_SHIFT)]++;
+    }
+}
+
+// Värdet med rang r (0-baserat) bland de n insamlade.
+static int16_t Median_Rank(uint16_t r) {
+    uint8_t b = 0;
+    while (r >= g_median.coarse[b]) {
+        r = (uint16_t)(r - g_median.coarse[b]);
+        b++;
+    }
+    const uint16_t *cnt;
+    uint16_t local[1u << BM_MED_BUCKET_SHIFT];
+    if (b >= g_median.win && b < g_median.win + BM_MED_FINE_BUCKETS) {
+        cnt = &g_median.fine[(uint16_t)(b - g_median.win) << BM_MED_BUCKET_SHIFT];
+    } else {
+        // Utanför finfönstret: räkna om just denna hink ur lagret (WEIGHT ligger helt där)
+        memset(local, 0, sizeof(local));
+        for (uint16_t i = 0; i < g_cap->collected; ++i) {
+            const Sample_t s = BurstLoad(g_cap, i);
+            const uint16_t off = median_off(s.x);
+            if (s.sensor == 0U && (off >> BM_MED_BUCKET_SHIFT) == b) {
+                local[off & ((1u << BM_MED_BUCKET_SHIFT) - 1u)]++;
+            }
+        }
+        cnt = local;
+    }
+    uint16_t k = 0;
+    while (r >= cnt[k]) {
+        r = (uint16_t)(r - cnt[k]);
+        k++;
+    }
+    return (int16_t)((int32_t)(((uint16_t)b << BM_MED_BUCKET_SHIFT) + k) - 4096);
+}
+
+static int16_t Median_Get(void) {
+    const uint16_t n = g_median.n;
+    if (n == 0U) return 0;
+    if (n % 2U == 1U) return Median_Rank(n / 2U);
+    const int16_t mid1 = Median_Rank((uint16_t)(n / 2U - 1U));
+    const int16_t mid2 = Median_Rank((uint16_t)(n / 2U));
     return (int16_t)(((int32_t)mid1 + (int32_t)mid2) / 2);
-  }
 }
@@ -0,0 +1,48 @@
+/* filename: Core/Src/burst_stats.c */
+#include "burst_stats.h"
+
+#include <string.h>
+#include <math.h>
+
+static inline void stat_add(BurstStat_t* s, float v)
+{
+    s->n++;
+    const float d = v - s->mean;
+    s->mean += d / (float)s->n;
+    s->m2 += d * (v - s->mean);
+    const float a = fabsf(v);
+    if (a > s->peak) s->peak = a;
+}
+
+void BurstStats_Reset(BurstStats_t* st)
+{
+    memset(st, 0, sizeof(*st));
+}
+
+void BurstStats_Add(BurstStats_t* st, uint8_t sensor, float ax, float ay, float az)
+{
+    BurstStat_t* c = st->ch[(sensor < SENSOR_MAX_DEVICES) ? sensor : 0U];
+    stat_add(&c[BSTAT_X], ax);
+    stat_add(&c[BSTAT_Y], ay);
+    stat_add(&c[BSTAT_Z], az);
+    stat_add(&c[BSTAT_MAG], sqrtf(ax * ax + ay * ay + az * az));
+}
+
+float BurstStat_Std(const BurstStat_t* s)
+{
+    if (s->n == 0U || s->m2 <= 0.0f) return 0.0f;
+    return sqrtf(s->m2 / (float)s->n);
+}
+
+float BurstStat_Rms(const BurstStat_t* s)
+{
+    if (s->n == 0U) return 0.0f;
+    const float var = (s->m2 > 0.0f) ? s->m2 / (float)s->n : 0.0f;
+    return sqrtf(s->mean * s->mean + var);
+}
+
+float BurstStat_Crest(const BurstStat_t* s)
+{
+    const float rms = BurstStat_Rms(s);
+    return (rms > 0.0f) ? s->peak / rms : 0.0f;
+}
@@ -0,0 +1,240 @@
+/* filename: Core/Src/cal_store.c */
+#include "cal_store.h"
+#include "protocol_crc32.h"   // proto_crc32_ref
+#include "sensor_hal.h"
+#include "trigger_logic.h"
+#include "comm.h"
+#include "api_schema.h"
+#include <string.h>
+
+#define CAL_MAGIC 0x4C414352u   // "RCAL" i minnesordning
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t len;      // sizeof(CalStoreData_t) när posten skrevs
+    uint32_t seq;
+    uint32_t erases;
+} CalRecHdr_t;
+
+/* Huvud + data utfyllt till hela ord + CRC-ord. */
+#define CAL_REC_BYTES(len) ((((uint32_t)sizeof(CalRecHdr_t) + (uint32_t)(len) + 3u) & ~3u) + 4u)
+#define CAL_REC_WORDS      (CAL_REC_BYTES(sizeof(CalStoreData_t)) / 4u)
+
+static struct {
+    bool valid;
+    uint32_t rec_off;   // Nyaste giltiga post
+    CalRecHdr_t hdr;
+    uint32_t end;       // Första byte efter sista posten
+    uint32_t seq;       // Senast använda sekvensnummer
+    uint32_t erases;
+    bool dirty;         // Okänt innehåll efter end: nästa sparning raderar
+} s_cs;
+
+static inline const uint8_t* _at(uint32_t off)
+{
+    return (const uint8_t*)(uintptr_t)(CAL_STORE_ADDR + off);
+}
+
+static bool _crc_ok(uint32_t off, uint16_t len)
+{
+    const uint32_t body = CAL_REC_BYTES(len) - 4u;
+    uint32_t crc;
+    memcpy(&crc, _at(off + body), sizeof(crc));
+    return proto_crc32_ref(_at(off), body) == crc;
+}
+
+static bool _blank(uint32_t off, uint32_t bytes)
+{
+    const uint32_t* w = (const uint32_t*)_at(off);
+    for (uint32_t i = 0; i < bytes / 4u; i++) {
+        if (w[i] != 0xFFFFFFFFu) return false;
+    }
+    return true;
+}
+
+/* Data-cachen kan hålla raderade ord som just programmerats. */
+static void _flush_dcache(void)
+{
+    __HAL_FLASH_DATA_CACHE_DISABLE();
+    __HAL_FLASH_DATA_CACHE_RESET();
+    __HAL_FLASH_DATA_CACHE_ENABLE();
+}
+
+void CalStore_Init(void)
+{
+    memset(&s_cs, 0, sizeof(s_cs));
+    uint32_t off = 0;
+    while (off + sizeof(CalRecHdr_t) + 4u <= CAL_STORE_SIZE) {
+        CalRecHdr_t h;
+        memcpy(&h, _at(off), sizeof(h));
+        if (h.magic == 0xFFFFFFFFu) {
+            break;   // Raderad flash: loggens slut
+        }
+        if (h.magic != CAL_MAGIC || h.len == 0xFFFFu || CAL_REC_BYTES(h.len) > CAL_STORE_SIZE - off) {
+            s_cs.dirty = true;   // Avbrutet huvud eller främmande data
+            break;
+        }
+        if (_crc_ok(off, h.len)) {
+            // Äldre versioner hoppas över men behåller sekvens och raderingsräknare
+            if (h.version == CAL_STORE_VERSION && h.len == sizeof(CalStoreData_t)) {
+                s_cs.valid = true;
+                s_cs.rec_off = off;
+                s_cs.hdr = h;
+            }
+            if (h.seq > s_cs.seq) s_cs.seq = h.seq;
+            if (h.erases > s_cs.erases) s_cs.erases = h.erases;
+        }
+        off += CAL_REC_BYTES(h.len);
+    }
+    s_cs.end = off;
+}
+
+bool CalStore_Load(CalStoreData_t* out)
+{
+    if (!s_cs.valid) return false;
+    memcpy(out, _at(s_cs.rec_off + sizeof(CalRecHdr_t)), sizeof(*out));
+    return true;
+}
+
+static HAL_StatusTypeDef _erase(void)
+{
+    FLASH_EraseInitTypeDef er = {0};
+    er.TypeErase = FLASH_TYPEERASE_SECTORS;
+    er.Sector = CAL_STORE_SECTOR;
+    er.NbSectors = 1;
+    er.VoltageRange = FLASH_VOLTAGE_RANGE_3;   // 2.7-3.6 V: ordvis programmering
+    uint32_t bad_sector = 0;
+    return HAL_FLASHEx_Erase(&er, &bad_sector);  // Tömmer även cacharna
+}
+
+static HAL_StatusTypeDef _program(uint32_t off, const uint32_t* w, uint32_t words)
+{
+    // I ordning: magic först och CRC sist
+    for (uint32_t i = 0; i < words; i++) {
+        HAL_StatusTypeDef st = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, CAL_STORE_ADDR + off + 4u * i, w[i]);
+        if (st != HAL_OK) return st;
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef CalStore_Save(const CalStoreData_t* d)
+{
+    uint32_t rec[CAL_REC_WORDS];
+    const uint32_t bytes = CAL_REC_BYTES(sizeof(*d));
+    memset(rec, 0, sizeof(rec));
+    CalRecHdr_t h = { CAL_MAGIC, CAL_STORE_VERSION, (uint16_t)sizeof(*d), s_cs.seq + 1u, s_cs.erases };
+
+    HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+                           FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+    HAL_StatusTypeDef st = HAL_OK;
+    uint32_t off = s_cs.end;
+    if (s_cs.dirty || off + bytes > CAL_STORE_SIZE || !_blank(off, bytes)) {
+        st = _erase();
+        off = 0;
+        h.erases = s_cs.erases + 1u;
+    }
+    if (st == HAL_OK) {
+        memcpy(rec, &h, sizeof(h));
+        memcpy((uint8_t*)rec + sizeof(h), d, sizeof(*d));
+        rec[CAL_REC_WORDS - 1u] = proto_crc32_ref(rec, bytes - 4u);
+        st = _program(off, rec, CAL_REC_WORDS);
+    }
+    HAL_FLASH_Lock();
+    _flush_dcache();
+
+    if (h.erases != s_cs.erases) {
+        // Sektorn är raderad (eller halvraderad): den gamla posten finns inte längre
+        s_cs.erases = h.erases;
+        s_cs.valid = false;
+        s_cs.end = 0;
+        s_cs.dirty = (st != HAL_OK);
+    }
+    if (st == HAL_OK && memcmp(_at(off), rec, bytes) != 0) {
+        st = HAL_ERROR;
+    }
+    if (st != HAL_OK) {
+        s_cs.dirty = true;   // Nästa försök börjar med en radering
+        return HAL_ERROR;
+    }
+    s_cs.valid = true;
+    s_cs.rec_off = off;
+    s_cs.hdr = h;
+    s_cs.seq = h.seq;
+    s_cs.end = off + bytes;
+    s_cs.dirty = false;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef CalStore_Clear(void)
+{
+    HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+                           FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+    HAL_StatusTypeDef st = _erase();
+    HAL_FLASH_Lock();
+    // Sekvens och raderingar börjar om; posterna som bar dem är borta
+    CalStore_Init();
+    if (st != HAL_OK) s_cs.dirty = true;
+    return st;
+}
+
+void CalStore_SendInfo(void)
+{
+    CalStoreData_t d;
+    uint8_t parts = 0;
+    if (CalStore_Load(&d)) parts = d.parts;
+    COMM_Sendf(MSG_CAL_STORE_INFO ",valid=%u,seq=%lu,off=%u,zero=%u,used=%lu,size=%lu,erases=%lu" PROTO_EOL,
+               s_cs.valid ? 1u : 0u, (unsigned long)(s_cs.valid ? s_cs.hdr.seq : 0u),
+               (parts & CAL_STORE_F_OFFSETS) ? 1u : 0u, (parts & CAL_STORE_F_ZERO) ? 1u : 0u,
+               (unsigned long)s_cs.end, (unsigned long)CAL_STORE_SIZE, (unsigned long)s_cs.erases);
+}
+
+bool CalStore_RestoreConfig(AppContext_t* ctx)
+{
+    CalStoreData_t d;
+    if (!CalStore_Load(&d)) return false;
+    ctx->cfg = d.cfg;
+    ctx->cfg.odr_hz = Sensor_SnapODR(d.cfg.odr_hz);   // Sparad efter SET_CFG, men ändå
+    ctx->trigger_settings = d.trg;
+    return true;
+}
+
+bool CalStore_RestoreCalibration(void)
+{
+    CalStoreData_t d;
+    if (!CalStore_Load(&d)) return false;
+    bool off = (d.parts & CAL_STORE_F_OFFSETS) && d.dev_count == Sensor_DeviceCount();
+    if (off) {
+        for (uint8_t i = 0; i < d.dev_count && i < SENSOR_MAX_DEVICES; i++) {
+            Sensor_SetOffsets(i, d.off_ms2[i]);
+        }
+    }
+    const bool zero = (d.parts & CAL_STORE_F_ZERO) != 0u;
+    if (zero) {
+        Trigger_SetZeroProfile(d.zero_mu_raw, d.zero_noise_absmax);
+    }
+    COMM_Sendf(MSG_CAL_INFO ",status=restored,seq=%lu,cfg=1,off=%u,zero=%u" PROTO_EOL,
+               (unsigned long)s_cs.hdr.seq, off ? 1u : 0u, zero ? 1u : 0u);
+    return off;
+}
+
+HAL_StatusTypeDef CalStore_SaveContext(AppContext_t* ctx)
+{
+    CalStoreData_t d;
+    memset(&d, 0, sizeof(d));   // Sensorer som saknas sparas som 0
+    d.cfg = ctx->cfg;
+    d.trg = ctx->trigger_settings;
+    d.dev_count = Sensor_DeviceCount();
+    if (Sensor_OffsetsValid()) {
+        d.parts |= CAL_STORE_F_OFFSETS;
+        for (uint8_t i = 0; i < d.dev_count && i < SENSOR_MAX_DEVICES; i++) {
+            (void)Sensor_GetScaleMps2(i, d.off_ms2[i]);
+        }
+    }
+    if (Trigger_GetZeroProfile(d.zero_mu_raw, d.zero_noise_absmax)) {
+        d.parts |= CAL_STORE_F_ZERO;
+    }
+    return CalStore_Save(&d);
+}
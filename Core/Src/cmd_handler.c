@@ -19,6 +19,14 @@ PATCH SUMMARY:
 #include "streaming.h"
 #include "countdown.h"
 #include "sensor_hal.h"
+#include "timebase.h"
+#include "protocol_crc32.h"
+#include "blocks_cfg.h"
+#include "conditioning.h"
+#include "prof.h"
+#include "trace.h"
+#include "cal_store.h"
+#include "hostclock.h"
 #include "dev_diagnostics.h" // Inkludera den nya diagnostikfilen
 
 #include <string.h>
@@ -33,18 +41,36 @@ static AppContext_t* s_ctx;
 static volatile bool g_is_processing_command = false;
 
 // --- Static Function Prototypes ---
-static void Parse_SetCfg(const char *line);
-static void Parse_SetTrg(const char *line);
-static void Parse_TimeSync(const char *line);
-static void Parse_StreamStart(const char *line);
-static void Parse_StartBurstWeight(const char *line);
-static void Parse_StartBurstDamping(const char *line);
-static void Parse_Mode(const char *line);
-static void Parse_CalReady(const char *line);
-static void Parse_HB(const char *line);
-static void Parse_AdxlSt(const char *line);
-static inline int cmd_exact(const char *line, const char *cmd);
-static void handle_diag_hw_test(AppContext_t* ctx, const char* line); // Ny prototyp
+static void Cmd_Hello(const api_tokens_t *t);
+static void Cmd_GetStatus(const api_tokens_t *t);
+static void Cmd_GetCfg(const api_tokens_t *t);
+static void Cmd_SetCfg(const api_tokens_t *t);
+static void Cmd_HB(const api_tokens_t *t);
+static void Cmd_TimeSync(const api_tokens_t *t);
+static void Cmd_StreamStart(const api_tokens_t *t);
+static void Cmd_StreamStop(const api_tokens_t *t);
+static void Cmd_StreamCredit(const api_tokens_t *t);
+static void Cmd_GetTrg(const api_tokens_t *t);
+static void Cmd_SetTrg(const api_tokens_t *t);
+static void Cmd_Mode(const api_tokens_t *t);
+static void Cmd_CalReady(const api_tokens_t *t);
+static void Cmd_CalStore(const api_tokens_t *t);
+static void Cmd_Arm(const api_tokens_t *t);
+static void Cmd_StartBurstWeight(const api_tokens_t *t);
+static void Cmd_StartBurstDamping(const api_tokens_t *t);
+static void Cmd_GetPreview(const api_tokens_t *t);
+static void Cmd_Stop(const api_tokens_t *t);
+static void Cmd_GetDiag(const api_tokens_t *t);
+static void Cmd_Reboot(const api_tokens_t *t);
+static void Cmd_Zero(const api_tokens_t *t);
+static void Cmd_TestForceTrigger(const api_tokens_t *t);
+static void Cmd_AdxlSt(const api_tokens_t *t);
+static void Cmd_DiagHwTest(const api_tokens_t *t); // Ny prototyp
+static void Cmd_Bench(const api_tokens_t *t);
+static void Cmd_Trace(const api_tokens_t *t);
+static bool Cmd_ParseResult(const api_tokens_t *t, BurstResult_t *out);
+struct CmdEntry;
+static const struct CmdEntry *Cmd_Find(const api_tokens_t *t);
 
 // --- Public Functions ---
 
@@ -68,9 +94,10 @@ void CmdHandler_HandleStop(AppContext_t* ctx) {
 
     if (prev_mode == OP_MODE_BURST || prev_mode == OP_MODE_BURST_SENDING) {
         Sensor_StopSampling(ctx);
+        Sensor_SetConsumer(ctx, SENSOR_CONSUMER_NONE);
 
         if (BM_IsActive()) {
-            BM_EndAborted(0);
+            if (!BM_IsEnding()) BM_EndAborted(0);
             ctx->burst_abort_pending = true;
         } else {
             BurstManager_Reset(ctx);
@@ -84,14 +111,20 @@ void CmdHandler_HandleStop(AppContext_t* ctx) {
     } else {
         Sensor_StopSampling(ctx);
         Streaming_Stop(ctx);
+        Sensor_SetConsumer(ctx, SENSOR_CONSUMER_NONE);
 
         if (prev_mode == OP_MODE_COUNTDOWN) {
             Countdown_Stop();
         }
 
         Trigger_Reset(ctx);
+        // Föregående burst kan fortfarande sändas i bakgrunden: STOP avbryter den också
+        if (BM_IsActive() && !BM_IsEnding()) {
+            BM_EndAborted(0);
+            ctx->burst_abort_pending = true;
+        }
         BurstManager_Reset(ctx);
-        ctx->is_dumping = false;
+        if (!BM_IsActive()) ctx->is_dumping = false;
 
         OpMode_t next_idle_mode = (prev_mode == OP_MODE_ARMED) ? OP_MODE_WAIT_ARM : OP_MODE_IDLE;
         AppContext_SetOpMode(ctx, next_idle_mode);
@@ -100,12 +133,57 @@ void CmdHandler_HandleStop(AppContext_t* ctx) {
 
 // --- Command Processing Logic (moved from main.c) ---
 
+// Command table, sorted by strcmp() for the binary search in Cmd_Find().
+// CMD_F_SENSOR: refused with "busy" while the background self-test owns the sensor.
+#define CMD_F_SENSOR 0x01u
+
+typedef void (*CmdFn_t)(const api_tokens_t *t);
+
+typedef struct CmdEntry {
+    const char *name;
+    CmdFn_t fn;
+    uint8_t flags;
+} CmdEntry_t;
+
+static const CmdEntry_t s_cmds[] = {
+    { "ADXL_ST",               Cmd_AdxlSt,              CMD_F_SENSOR },
+    { CMD_ARM,                 Cmd_Arm,                 CMD_F_SENSOR },
+    { CMD_BENCH,               Cmd_Bench,               CMD_F_SENSOR },
+    { CMD_CAL_READY,           Cmd_CalReady,            0 },
+    { CMD_CAL_STORE,           Cmd_CalStore,            0 },
+    { "DIAG_HW_TEST",          Cmd_DiagHwTest,          CMD_F_SENSOR },
+    { CMD_GET_CFG,             Cmd_GetCfg,              0 },
+    { CMD_GET_DIAG,            Cmd_GetDiag,             0 },
+    { CMD_GET_PREVIEW,         Cmd_GetPreview,          CMD_F_SENSOR },
+    { CMD_GET_STATUS,          Cmd_GetStatus,           0 },
+    { CMD_GET_TRG,             Cmd_GetTrg,              0 },
+    { CMD_HB,                  Cmd_HB,                  0 },
+    { CMD_HELLO,               Cmd_Hello,               0 },
+    { CMD_MODE,                Cmd_Mode,                CMD_F_SENSOR },
+    { CMD_REBOOT,              Cmd_Reboot,              0 },
+    { CMD_SET_CFG,             Cmd_SetCfg,              CMD_F_SENSOR },
+    { CMD_SET_TRG,             Cmd_SetTrg,              0 },
+    { CMD_START_BURST_DAMPING, Cmd_StartBurstDamping,   CMD_F_SENSOR },
+    { CMD_START_BURST_WEIGHT,  Cmd_StartBurstWeight,    CMD_F_SENSOR },
+    { CMD_STOP,                Cmd_Stop,                0 },
+    { CMD_STREAM_CREDIT,       Cmd_StreamCredit,        0 },
+    { CMD_STREAM_START,        Cmd_StreamStart,         CMD_F_SENSOR },
+    { CMD_STREAM_STOP,         Cmd_StreamStop,          0 },
+    { CMD_TIME_SYNC,           Cmd_TimeSync,            0 },
+    { CMD_TRACE,               Cmd_Trace,               0 },
+    { CMD_ZERO,                Cmd_Zero,                CMD_F_SENSOR },
+    { CMD_TEST_FORCE_TRIGGER,  Cmd_TestForceTrigger,    0 },
+};
+#define CMD_COUNT (sizeof(s_cmds) / sizeof(s_cmds[0]))
+
 /**
  * @brief Main command dispatcher.
  * @note This function has global scope to be callable by the existing comm.c module.
  *       It uses a static context pointer `s_ctx` set by `CmdHandler_Init`.
  *       The instruction to make all functions static was overridden for this function
  *       to maintain compatibility with the unmodified comm.c module.
+ *       The line is tokenized once; BLOCKS acknowledgements (ACK_BLK first) are
+ *       tried before the command table.
  */
 void process_command(char *line) {
     g_is_processing_command = true;
@@ -116,160 +194,294 @@ void process_command(char *line) {
     while (*line == ' ')
         line++;
 
-    if (BM_HandleHostLine(line)) {
+    api_tokens_t t;
+    api_tokenize(line, &t);
+
+    if (BM_HandleHostLine(&t)) {
         g_is_processing_command = false;
         return;
     }
 
-    if (cmd_exact(line, CMD_HELLO)) {
-        memset(&s_ctx->diag, 0, sizeof(s_ctx->diag));
-        s_ctx->tsync.has_sync = false;
-        s_ctx->stop_flag = false;
-        COMM_Sendf(MSG_HELLO_ACK ",fw=\"%s\",proto=%s,win=%u,blk_lines=%u" PROTO_EOL,
-                   FW_VERSION, "3.3.3", (unsigned)PROTO_WINDOW_DEFAULT,
-                   (unsigned)PROTO_BLOCK_LINES_DEFAULT);
-        AppContext_SetOpMode(s_ctx, OP_MODE_IDLE);
-    } else if (cmd_exact(line, CMD_GET_STATUS)) {
-        Telemetry_SendStatus(s_ctx);
-    } else if (cmd_exact(line, CMD_GET_CFG)) {
-        Telemetry_SendCfg(s_ctx);
-    } else if (cmd_exact(line, CMD_SET_CFG)) {
-        Parse_SetCfg(line);
-    } else if (cmd_exact(line, CMD_HB)) {
-        Parse_HB(line);
-    } else if (cmd_exact(line, CMD_TIME_SYNC)) {
-        Parse_TimeSync(line);
-    } else if (cmd_exact(line, CMD_STREAM_START)) {
-        Parse_StreamStart(line);
-    } else if (cmd_exact(line, CMD_STREAM_STOP)) {
-        Streaming_Stop(s_ctx);
-        Telemetry_SendACK(CMD_STREAM_STOP);
-    } else if (cmd_exact(line, CMD_GET_TRG)) {
-        Telemetry_SendTrgSettings(s_ctx);
-    } else if (cmd_exact(line, CMD_SET_TRG)) {
-        Parse_SetTrg(line);
-    } else if (cmd_exact(line, CMD_MODE)) {
-        Parse_Mode(line);
-    } else if (cmd_exact(line, CMD_CAL_READY)) {
-        Parse_CalReady(line);
-    } else if (cmd_exact(line, CMD_ARM)) {
-        if (s_ctx->op_mode == OP_MODE_WAIT_ARM) {
-            if (!Trigger_IsZeroCalibrated(s_ctx)) {
-                Telemetry_SendNACK(CMD_ARM, "zero_not_calibrated", 104);
-                g_is_processing_command = false;
-                return;
-            }
-            Telemetry_SendACK(CMD_ARM);
-            Telemetry_Flush();
-            s_ctx->is_dumping = true;
-            s_ctx->diag.hb_pauses++;
+    const CmdEntry_t *e = Cmd_Find(&t);
+    if (!e) {
+        Telemetry_SendNACK("UNKNOWN", "unknown_command", 100);
+    } else if ((e->flags & CMD_F_SENSOR) && Sensor_IsSelfTestRunning()) {
+        // Commands that reconfigure or sample the sensor while the background
+        // self-test has taken it over are refused instead of queued.
+        Telemetry_SendNACK(e->name, "busy", 105);
+    } else {
+        e->fn(&t);
+    }
 
-            Sensor_StartSampling(s_ctx);
-            Trigger_Arm(s_ctx);
-            Sensor_StartSampling(s_ctx); // Ensure sampling is on for monitoring
-            s_ctx->trg_state = TRG_STATE_ARMED;
-            AppContext_SetOpMode(s_ctx, OP_MODE_ARMED);
+    g_is_processing_command = false;
+}
 
-        } else if (s_ctx->op_mode == OP_MODE_ARMED) {
-            Telemetry_SendACK(CMD_ARM);
-        } else {
-            Telemetry_SendNACK(CMD_ARM, "bad_state", 103);
+// --- Static Helper Functions (moved from main.c) ---
+
+// Binary search on the command token; a name that merely starts with the
+// token sorts after it.
+static const CmdEntry_t *Cmd_Find(const api_tokens_t *t) {
+    size_t lo = 0, hi = CMD_COUNT;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const char *name = s_cmds[mid].name;
+        int c = strncmp(t->cmd, name, t->cmd_len);
+        if (c == 0 && name[t->cmd_len] != '\0') c = -1;
+        if (c == 0) return &s_cmds[mid];
+        if (c < 0) hi = mid; else lo = mid + 1;
+    }
+    return NULL;
+}
+
+static void Cmd_Hello(const api_tokens_t *t) {
+    PayloadCodec_t codec = PAYLOAD_CODEC_RAW;
+    if (api_tok_val(t, "codec")) {
+        if (api_tok_val_is(t, "codec", PROTO_CODEC_DELTA)) {
+            codec = PAYLOAD_CODEC_DELTA;
+        } else if (api_tok_val_is(t, "codec", PROTO_CODEC_BIN)) {
+            codec = PAYLOAD_CODEC_BIN;
+        } else if (!api_tok_val_is(t, "codec", PROTO_CODEC_RAW)) {
+            Telemetry_SendNACK(CMD_HELLO, "bad_arg", 101);
+            return;
         }
-    } else if (cmd_exact(line, CMD_START_BURST_WEIGHT)) {
-        if (s_ctx->op_mode == OP_MODE_IDLE)
-            Parse_StartBurstWeight(line);
-        else
-            Telemetry_SendNACK(CMD_START_BURST_WEIGHT, "bad_state", 103);
-    } else if (cmd_exact(line, CMD_START_BURST_DAMPING)) {
-        if (s_ctx->op_mode == OP_MODE_IDLE)
-            Parse_StartBurstDamping(line);
-        else
-            Telemetry_SendNACK(CMD_START_BURST_DAMPING, "bad_state", 103);
-    } else if (cmd_exact(line, CMD_GET_PREVIEW)) {
-        if (s_ctx->op_mode != OP_MODE_IDLE) {
-            Telemetry_SendNACK(CMD_GET_PREVIEW, "bad_state", 103);
-        } else {
-            if (!s_ctx->is_dumping) {
-                s_ctx->is_dumping = true;
-                s_ctx->diag.hb_pauses++;
-            }
-            Telemetry_SendPreview(s_ctx);
+    }
+    // crc32 needs the hardware unit to have passed its boot self-check;
+    // otherwise the ACK reports the crc16 fallback.
+    BlockCrc_t blk_crc = BLOCK_CRC_16;
+    if (api_tok_val(t, "crc")) {
+        if (api_tok_val_is(t, "crc", PROTO_CRC_32)) {
+            blk_crc = proto_crc32_available() ? BLOCK_CRC_32 : BLOCK_CRC_16;
+        } else if (!api_tok_val_is(t, "crc", PROTO_CRC_16)) {
+            Telemetry_SendNACK(CMD_HELLO, "bad_arg", 101);
+            return;
         }
-    } else if (cmd_exact(line, CMD_STOP)) {
-        bool force = (strstr(line, ",FORCE") != NULL);
-        if (s_ctx->op_mode == OP_MODE_ARMED && s_ctx->trg_state == TRG_STATE_ARMED && !force) {
-            Telemetry_SendNACK(CMD_STOP, "blocked_while_armed", 201);
-        } else {
-            s_ctx->stop_flag = true;
+    }
+    // win= and blk_lines= cap the BLOCKS window and block size; the link
+    // controller adapts below them. Omitted values restore the defaults.
+    uint32_t win = PROTO_WINDOW_DEFAULT;
+    uint32_t blk_lines = PROTO_BLOCK_LINES_DEFAULT;
+    const char *q = api_tok_val(t, "win");
+    if (q) {
+        if (!api_parse_u32(q, &win)) {
+            Telemetry_SendNACK(CMD_HELLO, "bad_arg", 101);
+            return;
         }
-    } else if (cmd_exact(line, CMD_GET_DIAG)) {
-        Telemetry_SendDiag(s_ctx);
-    } else if (cmd_exact(line, CMD_REBOOT)) {
-        Telemetry_SendACK(CMD_REBOOT);
-        HAL_Delay(100);
-        HAL_NVIC_SystemReset();
-    } else if (cmd_exact(line, CMD_ZERO)) {
-        if (s_ctx->op_mode == OP_MODE_IDLE) {
-            Telemetry_SendACK(CMD_ZERO);
-            Telemetry_Flush();
-            Sensor_StartSampling(s_ctx);
-            Trigger_PerformQuickZero(s_ctx);
-            Sensor_StopSampling(s_ctx);
-            COMM_Sendf(MSG_CAL_INFO ",status=zero_complete" PROTO_EOL);
-        } else {
-            Telemetry_SendNACK(CMD_ZERO, "bad_state", 103);
+        if (win < 1u || win > TB_MAX_INFLIGHT) {
+            Telemetry_SendNACK(CMD_HELLO, "param_range", 102);
+            return;
         }
-    } else if (cmd_exact(line, CMD_TEST_FORCE_TRIGGER)) {
-        if (s_ctx->op_mode == OP_MODE_ARMED) {
-            Telemetry_SendACK(CMD_TEST_FORCE_TRIGGER);
-            s_ctx->test_trigger_flag = true;
-        } else {
-            Telemetry_SendNACK(CMD_TEST_FORCE_TRIGGER, "bad_state", 103);
+    }
+    q = api_tok_val(t, "blk_lines");
+    if (q) {
+        if (!api_parse_u32(q, &blk_lines)) {
+            Telemetry_SendNACK(CMD_HELLO, "bad_arg", 101);
+            return;
         }
-    } else if (cmd_exact(line, "ADXL_ST")) {
-        if (s_ctx->op_mode == OP_MODE_IDLE) {
-            Parse_AdxlSt(line);
-        } else {
-            Telemetry_SendNACK("ADXL_ST", "bad_state", 103);
+        if (blk_lines < 32u || blk_lines > 512u) {
+            Telemetry_SendNACK(CMD_HELLO, "param_range", 102);
+            return;
         }
-    } else if (cmd_exact(line, "DIAG_HW_TEST")) { // NYTT DIAGNOSTIKKOMMANDO
-        handle_diag_hw_test(s_ctx, line);
+    }
+    (void)BlocksCfg_Set((uint16_t)win, (uint16_t)blk_lines, PROTO_MAX_RETRIES);
+    memset(&s_ctx->diag, 0, sizeof(s_ctx->diag));
+    HostClock_Reset();
+    s_ctx->stop_flag = false;
+    s_ctx->codec = codec;
+    s_ctx->blk_crc = blk_crc;
+    COMM_SendfCtrl(MSG_HELLO_ACK ",fw=\"%s\",proto=%s,win=%u,sack=1,blk_lines=%u,codec=%s,crc=%s" PROTO_EOL,
+               FW_VERSION, "3.3.3", (unsigned)BlocksCfg_Get().window,
+               (unsigned)BlocksCfg_Get().lines,
+               (codec == PAYLOAD_CODEC_DELTA) ? PROTO_CODEC_DELTA :
+               (codec == PAYLOAD_CODEC_BIN) ? PROTO_CODEC_BIN : PROTO_CODEC_RAW,
+               (blk_crc == BLOCK_CRC_32) ? PROTO_CRC_32 : PROTO_CRC_16);
+    AppContext_SetOpMode(s_ctx, OP_MODE_IDLE);
+}
+
+static void Cmd_GetStatus(const api_tokens_t *t) {
+    (void)t;
+    Telemetry_SendStatus(s_ctx);
+}
+
+static void Cmd_GetCfg(const api_tokens_t *t) {
+    (void)t;
+    Telemetry_SendCfg(s_ctx);
+}
+
+static void Cmd_GetTrg(const api_tokens_t *t) {
+    (void)t;
+    Telemetry_SendTrgSettings(s_ctx);
+}
+
+static void Cmd_GetDiag(const api_tokens_t *t) {
+    Telemetry_SendDiag(s_ctx);
+    if (api_tok_flag(t, "RESET")) {
+        Prof_Reset();
+    }
+}
+
+static void Cmd_Trace(const api_tokens_t *t) {
+    Telemetry_SendACK(CMD_TRACE);
+    Trace_SendDump(api_tok_flag(t, "RESET") ? 1u : 0u);
+}
+
+static void Cmd_StreamStop(const api_tokens_t *t) {
+    (void)t;
+    Streaming_Stop(s_ctx);
+    Telemetry_SendACK(CMD_STREAM_STOP);
+}
+
+// result=blocks|summary för nästa DAMP-burst; utan parameter blocks.
+static bool Cmd_ParseResult(const api_tokens_t *t, BurstResult_t *out) {
+    *out = BURST_RESULT_BLOCKS;
+    if (!api_tok_val(t, "result")) return true;
+    if (api_tok_val_is(t, "result", PROTO_RESULT_SUMMARY)) {
+        *out = BURST_RESULT_SUMMARY;
+        return true;
+    }
+    return api_tok_val_is(t, "result", PROTO_RESULT_BLOCKS);
+}
+
+static void Cmd_Arm(const api_tokens_t *t) {
+    if (s_ctx->op_mode == OP_MODE_WAIT_ARM) {
+        BurstResult_t result;
+        if (!Cmd_ParseResult(t, &result)) {
+            Telemetry_SendNACK(CMD_ARM, "bad_arg", 101);
+            return;
+        }
+        if (!Trigger_IsZeroCalibrated(s_ctx)) {
+            Telemetry_SendNACK(CMD_ARM, "zero_not_calibrated", 104);
+            return;
+        }
+        if (!BurstManager_CanCapture(s_ctx)) {
+            Telemetry_SendNACK(CMD_ARM, "slot_busy", 105);
+            return;
+        }
+        s_ctx->burst_result = result;
+        Telemetry_SendACK(CMD_ARM);
+        Telemetry_Flush();
+        s_ctx->is_dumping = true;
+        s_ctx->diag.hb_pauses++;
+
+        Sensor_StartSampling(s_ctx);
+        Trigger_Arm(s_ctx); // μ_arm is captured by Trigger_Pump, then the trigger arms
+        AppContext_SetOpMode(s_ctx, OP_MODE_ARMED);
+
+    } else if (s_ctx->op_mode == OP_MODE_ARMED) {
+        Telemetry_SendACK(CMD_ARM);
     } else {
-        Telemetry_SendNACK("UNKNOWN", "unknown_command", 100);
+        Telemetry_SendNACK(CMD_ARM, "bad_state", 103);
     }
+}
 
-    g_is_processing_command = false;
+static void Cmd_GetPreview(const api_tokens_t *t) {
+    if (s_ctx->op_mode != OP_MODE_IDLE) {
+        Telemetry_SendNACK(CMD_GET_PREVIEW, "bad_state", 103);
+        return;
+    }
+    uint32_t n = SAMPLE_HISTORY_MAX;
+    uint32_t decim = 1;
+    const char *p = api_tok_val(t, "n");
+    if (p && (!api_parse_u32(p, &n) || n < 1 || n > SAMPLE_HISTORY_MAX)) {
+        Telemetry_SendNACK(CMD_GET_PREVIEW, "param_range", 102);
+        return;
+    }
+    p = api_tok_val(t, "decim");
+    if (p && (!api_parse_u32(p, &decim) || decim < 1 || decim > BurstManager_PreviewMaxDecim(s_ctx))) {
+        Telemetry_SendNACK(CMD_GET_PREVIEW, "param_range", 102);
+        return;
+    }
+    if (!BurstManager_StartPreview(s_ctx, (uint16_t)n, (uint16_t)decim)) {
+        Telemetry_SendNACK(CMD_GET_PREVIEW, "slot_busy", 105);
+        return;
+    }
+    Telemetry_SendACK(CMD_GET_PREVIEW);
+    if (!s_ctx->is_dumping) {
+        s_ctx->is_dumping = true;
+        s_ctx->diag.hb_pauses++;
+    }
 }
 
-// --- Static Helper Functions (moved from main.c) ---
+static void Cmd_Stop(const api_tokens_t *t) {
+    bool force = api_tok_flag(t, "FORCE");
+    if (s_ctx->op_mode == OP_MODE_ARMED && s_ctx->trg_state == TRG_STATE_ARMED && !force) {
+        Telemetry_SendNACK(CMD_STOP, "blocked_while_armed", 201);
+    } else {
+        s_ctx->stop_flag = true;
+    }
+}
+
+static void Cmd_Reboot(const api_tokens_t *t) {
+    (void)t;
+    Telemetry_SendACK(CMD_REBOOT);
+    HAL_Delay(100);
+    HAL_NVIC_SystemReset();
+}
 
-static inline int cmd_exact(const char *line, const char *cmd) {
-    size_t n = strlen(cmd);
-    return strncmp(line, cmd, n) == 0 &&
-           (line[n] == '\0' || line[n] == ' ' || line[n] == ',');
+static void Cmd_Zero(const api_tokens_t *t) {
+    (void)t;
+    if (s_ctx->op_mode == OP_MODE_IDLE) {
+        Telemetry_SendACK(CMD_ZERO);
+        Telemetry_Flush();
+        Sensor_StartSampling(s_ctx);
+        Trigger_PerformQuickZero(s_ctx); // Completes with CAL_INFO,status=zero_complete
+    } else {
+        Telemetry_SendNACK(CMD_ZERO, "bad_state", 103);
+    }
+}
+
+static void Cmd_TestForceTrigger(const api_tokens_t *t) {
+    (void)t;
+    if (s_ctx->op_mode == OP_MODE_ARMED) {
+        Telemetry_SendACK(CMD_TEST_FORCE_TRIGGER);
+        s_ctx->test_trigger_flag = true;
+    } else {
+        Telemetry_SendNACK(CMD_TEST_FORCE_TRIGGER, "bad_state", 103);
+    }
 }
 
-static void Parse_SetCfg(const char *line) {
-    const char *p = line;
-    char *q;
+static void Cmd_SetCfg(const api_tokens_t *t) {
     uint32_t req_odr_hz = s_ctx->cfg.odr_hz;
     uint32_t new_burst_ms = s_ctx->cfg.burst_ms;
     uint32_t new_hb_ms = s_ctx->cfg.hb_ms;
     uint32_t new_stream_rate = s_ctx->cfg.stream_rate_hz;
 
     uint32_t tmp32;
-    if ((q = strstr(p, "odr_hz=")) && api_parse_u32(q + 7, &tmp32)) {
+    if (api_parse_u32(api_tok_val(t, "odr_hz"), &tmp32)) {
         req_odr_hz = tmp32;
     }
-    if ((q = strstr(p, "burst_ms=")) && api_parse_u32(q + 9, &tmp32)) {
+    if (api_parse_u32(api_tok_val(t, "burst_ms"), &tmp32)) {
         new_burst_ms = tmp32;
     }
-    if ((q = strstr(p, "hb_ms=")) && api_parse_u32(q + 6, &tmp32)) {
+    if (api_parse_u32(api_tok_val(t, "hb_ms"), &tmp32)) {
         new_hb_ms = tmp32;
     }
-    if ((q = strstr(p, "stream_rate_hz=")) && api_parse_u32(q + 15, &tmp32)) {
+    if (api_parse_u32(api_tok_val(t, "stream_rate_hz"), &tmp32)) {
         new_stream_rate = tmp32;
     }
+    // Conditioning filter (conditioning.h)
+    RuntimeCfg_t nf = s_ctx->cfg;
+    if (api_tok_val(t, "flt")) {
+        if (api_tok_val_is(t, "flt", PROTO_FLT_OFF)) nf.flt = COND_OFF;
+        else if (api_tok_val_is(t, "flt", PROTO_FLT_LP)) nf.flt = COND_LP;
+        else if (api_tok_val_is(t, "flt", PROTO_FLT_HP)) nf.flt = COND_HP;
+        else if (api_tok_val_is(t, "flt", PROTO_FLT_BP)) nf.flt = COND_BP;
+        else {
+            Telemetry_SendNACK(CMD_SET_CFG, "bad_arg", 101);
+            return;
+        }
+    }
+    if (api_parse_u32(api_tok_val(t, "flt_n"), &tmp32)) {
+        nf.flt_n = (tmp32 > 0xFFU) ? 0xFFU : (uint8_t)tmp32;
+    }
+    if (api_parse_u32(api_tok_val(t, "flt_f1"), &tmp32)) {
+        nf.flt_f1_hz = (tmp32 > 0xFFFFU) ? 0xFFFFU : (uint16_t)tmp32;
+    }
+    if (api_parse_u32(api_tok_val(t, "flt_f2"), &tmp32)) {
+        nf.flt_f2_hz = (tmp32 > 0xFFFFU) ? 0xFFFFU : (uint16_t)tmp32;
+    }
+    if (api_parse_u32(api_tok_val(t, "flt_path"), &tmp32)) {
+        nf.flt_path = (tmp32 > 0xFFU) ? 0xFFU : (uint8_t)tmp32;
+    }
 
     uint32_t eff_odr = Sensor_SnapODR(req_odr_hz);
     if (new_burst_ms == 0U || new_burst_ms > 600000U) {
@@ -288,12 +500,28 @@ static void Parse_SetCfg(const char *line) {
         Telemetry_SendNACK(CMD_SET_CFG, "param_range", 102);
         return;
     }
+    // Corners strictly below 0.49 * ODR (the design clamps there)
+    bool flt_ok = (nf.flt_n >= 1U && nf.flt_n <= FILTER_CASCADE_N_MAX);
+    flt_ok = flt_ok && (nf.flt_path <= COND_PATH_ALL);
+    flt_ok = flt_ok && (nf.flt_f1_hz >= 1U) && (100U * nf.flt_f1_hz < 49U * eff_odr);
+    if (nf.flt == COND_BP) {
+        flt_ok = flt_ok && (nf.flt_f2_hz > nf.flt_f1_hz) && (100U * nf.flt_f2_hz < 49U * eff_odr);
+    }
+    if (nf.flt != COND_OFF && !flt_ok) {
+        Telemetry_SendNACK(CMD_SET_CFG, "param_range", 102);
+        return;
+    }
 
     uint32_t old_odr = s_ctx->cfg.odr_hz;
     s_ctx->cfg.burst_ms = new_burst_ms;
     s_ctx->cfg.hb_ms = new_hb_ms;
     s_ctx->cfg.stream_rate_hz = new_stream_rate;
     s_ctx->cfg.odr_hz = eff_odr;
+    s_ctx->cfg.flt = nf.flt;
+    s_ctx->cfg.flt_n = nf.flt_n;
+    s_ctx->cfg.flt_path = nf.flt_path;
+    s_ctx->cfg.flt_f1_hz = nf.flt_f1_hz;
+    s_ctx->cfg.flt_f2_hz = nf.flt_f2_hz;
 
     if (old_odr != eff_odr) {
         bool was_sampling = Sensor_IsSampling(s_ctx);
@@ -311,28 +539,67 @@ static void Parse_SetCfg(const char *line) {
     }
 
     Streaming_UpdateDivider(s_ctx);
+    Cond_Configure(&s_ctx->cfg); // Also redesigns for a new ODR
     Telemetry_SendACK(CMD_SET_CFG);
 }
 
-static void Parse_SetTrg(const char *line) {
-    const char *p = line;
-    char *q;
-
+static void Cmd_SetTrg(const api_tokens_t *t) {
     TriggerSettings_t ns = s_ctx->trigger_settings;
     float ftmp;
     uint32_t utmp;
 
-    if ((q = strstr(p, "k_mult=")) && api_parse_float_fixed3(q + 7, &ftmp)) {
+    const char *q = api_tok_val(t, "k_mult");
+    if (q && api_parse_float_fixed3(q, &ftmp)) {
         ns.k_mult = ftmp;
     }
-    if ((q = strstr(p, "win_ms=")) && api_parse_u32(q + 7, &utmp)) {
+    if (api_parse_u32(api_tok_val(t, "win_ms"), &utmp)) {
         ns.win_ms = utmp;
     }
-    if ((q = strstr(p, "hold_ms=")) && api_parse_u32(q + 8, &utmp)) {
+    if (api_parse_u32(api_tok_val(t, "hold_ms"), &utmp)) {
         ns.hold_ms = utmp;
     }
+    // Activity gate (whole keys, so act_mg and inact_mg cannot collide).
+    if (api_parse_u32(api_tok_val(t, "sleep"), &utmp)) {
+        ns.sleep_en = (utmp != 0U);
+    }
+    if (api_parse_u32(api_tok_val(t, "act_mg"), &utmp)) {
+        ns.act_mg = (utmp > 0xFFFFU) ? 0xFFFFU : (uint16_t)utmp;
+    }
+    if (api_parse_u32(api_tok_val(t, "inact_mg"), &utmp)) {
+        ns.inact_mg = (utmp > 0xFFFFU) ? 0xFFFFU : (uint16_t)utmp;
+    }
+    if (api_parse_u32(api_tok_val(t, "inact_s"), &utmp)) {
+        ns.inact_s = (utmp > 0xFFU) ? 0U : (uint8_t)utmp;
+    }
+    // Pre-trigger window; the sample ring caps what is actually kept (SAMPLE_PRETRIG_MAX).
+    if (api_parse_u32(api_tok_val(t, "pre_ms"), &utmp)) {
+        ns.pre_ms = (utmp > 0xFFFFU) ? 0xFFFFU : (uint16_t)utmp;
+    }
+    bool enum_ok = true;
+    if (api_tok_val(t, "det")) {
+        if (api_tok_val_is(t, "det", PROTO_TRG_DET_PEAK)) ns.det = TRG_DET_PEAK;
+        else if (api_tok_val_is(t, "det", PROTO_TRG_DET_STA)) ns.det = TRG_DET_STA;
+        else enum_ok = false;
+    }
+    if (api_tok_val(t, "ch")) {
+        if (api_tok_val_is(t, "ch", PROTO_TRG_CH_XYZ)) ns.ch = TRG_AXIS_XYZ;
+        else if (api_tok_val_is(t, "ch", PROTO_TRG_CH_MAG)) ns.ch = TRG_AXIS_MAG;
+        else enum_ok = false;
+    }
+    if (!enum_ok) {
+        Telemetry_SendNACK(CMD_SET_TRG, "bad_arg", 101);
+        return;
+    }
 
     bool valid = (ns.hold_ms >= 100U && ns.hold_ms <= 10000U);
+    valid = valid && (ns.win_ms >= 50U && ns.win_ms <= 500U);
+    // 62.5 mg/LSB, 8-bit thresholds; TIME_INACT is 1..255 s.
+    valid = valid && (ns.act_mg >= 63U && ns.act_mg <= 15937U);
+    valid = valid && (ns.inact_mg >= 63U && ns.inact_mg < ns.act_mg);
+    valid = valid && (ns.inact_s >= 1U);
+    valid = valid && (ns.pre_ms <= 1000U);
+    // The magnitude channel exists only for the windowed detector.
+    valid = valid && !(ns.det == TRG_DET_PEAK && ns.ch == TRG_AXIS_MAG);
 
     if (!valid) {
         Telemetry_SendNACK(CMD_SET_TRG, "param_range", 102);
@@ -340,37 +607,99 @@ static void Parse_SetTrg(const char *line) {
     }
 
     s_ctx->trigger_settings = ns;
+    // Takes effect at once if the trigger is armed, otherwise at the next ARM.
+    Trigger_UpdateThresholds(s_ctx);
+    (void)Sensor_UpdateActivityGate(s_ctx);
     Telemetry_SendACK(CMD_SET_TRG);
 }
 
-static void Parse_TimeSync(const char *line) {
-    const char *q = strstr(line, "host_ms=");
+static void Cmd_TimeSync(const api_tokens_t *t) {
+    // Device time first: parsing must not count as link latency
+    const uint64_t dev_us = Timebase_NowUs64();
+    uint64_t host_us = 0;
+    const char *q = api_tok_val(t, "host_us");
     if (q) {
+        if (!api_parse_u64(q, &host_us)) q = NULL;
+    } else if ((q = api_tok_val(t, "host_ms")) != NULL) {
         uint64_t host_ms = 0;
-        if (api_parse_u64(q + 8, &host_ms)) {
-            s_ctx->tsync.has_sync = true;
-            s_ctx->tsync.host_ms_at_sync = host_ms;
-            s_ctx->tsync.tick_at_sync = __HAL_TIM_GET_COUNTER(s_ctx->htim2);
-            Telemetry_SendACK(CMD_TIME_SYNC);
-            return;
+        if (api_parse_u64(q, &host_ms) && host_ms <= UINT64_MAX / 1000u) {
+            host_us = host_ms * 1000u;
+        } else {
+            q = NULL;
         }
     }
-    Telemetry_SendNACK(CMD_TIME_SYNC, "bad_arg", 101);
+    const char *st = api_tok_val(t, "stamp");
+    if (!q || (st && !api_tok_val_is(t, "stamp", "0") && !api_tok_val_is(t, "stamp", "1"))) {
+        Telemetry_SendNACK(CMD_TIME_SYNC, "bad_arg", 101);
+        return;
+    }
+    HostClockFit_t fit;
+    HostClock_AddSync(host_us, dev_us, &fit);
+    if (st) HostClock_SetStamping(api_tok_val_is(t, "stamp", "1"));
+    Telemetry_SendACK(CMD_TIME_SYNC);
+    COMM_Sendf(MSG_TIME_SYNC_INFO ",n=%u,span_ms=%lu,skew_ppb=%ld,resid_us=%ld,restart=%u,stamp=%u" PROTO_EOL,
+               (unsigned)fit.n, (unsigned long)fit.span_ms, (long)fit.skew_ppb, (long)fit.resid_us,
+               fit.restarted ? 1u : 0u, HostClock_IsStamping() ? 1u : 0u);
 }
 
-static void Parse_StreamStart(const char *line) {
+static void Cmd_StreamStart(const api_tokens_t *t) {
     if (s_ctx->op_mode != OP_MODE_IDLE) {
         Telemetry_SendNACK(CMD_STREAM_START, "bad_state", 103);
         return;
     }
-    Streaming_Start(s_ctx);
+    StreamFormat_t fmt = STREAM_FORMAT_TEXT;
+    if (api_tok_val(t, "fmt")) {
+        if (api_tok_val_is(t, "fmt", STREAM_FMT_BIN)) {
+            fmt = STREAM_FORMAT_BIN;
+        } else if (!api_tok_val_is(t, "fmt", STREAM_FMT_TEXT)) {
+            Telemetry_SendNACK(CMD_STREAM_START, "bad_arg", 101);
+            return;
+        }
+    }
+    uint32_t batch = 1;
+    const char *q = api_tok_val(t, "batch");
+    if (q && (!api_parse_u32(q, &batch) || batch < 1U || batch > STREAM_BATCH_MAX)) {
+        Telemetry_SendNACK(CMD_STREAM_START, "param_range", 102);
+        return;
+    }
+    uint32_t credits = 0;
+    q = api_tok_val(t, "credits");
+    if (q && (!api_parse_u32(q, &credits) || credits < 1U || credits > STREAM_CREDIT_MAX)) {
+        Telemetry_SendNACK(CMD_STREAM_START, "param_range", 102);
+        return;
+    }
+    Streaming_Start(s_ctx, fmt, (uint8_t)batch, credits);
     Telemetry_SendStreamStartACK(s_ctx);
 }
 
-static void Parse_StartBurstWeight(const char *line) {
+static void Cmd_StreamCredit(const api_tokens_t *t) {
+    if (!Streaming_IsActive()) {
+        Telemetry_SendNACK(CMD_STREAM_CREDIT, "bad_state", 103);
+        return;
+    }
+    uint32_t n = 0;
+    if (!api_parse_u32(api_tok_val(t, "n"), &n)) {
+        Telemetry_SendNACK(CMD_STREAM_CREDIT, "bad_arg", 101);
+        return;
+    }
+    if (n < 1U || n > STREAM_CREDIT_MAX) {
+        Telemetry_SendNACK(CMD_STREAM_CREDIT, "param_range", 102);
+        return;
+    }
+    Telemetry_SendStreamCreditACK(Streaming_AddCredits(n));
+}
+
+static void Cmd_StartBurstWeight(const api_tokens_t *t) {
+    if (s_ctx->op_mode != OP_MODE_IDLE) {
+        Telemetry_SendNACK(CMD_START_BURST_WEIGHT, "bad_state", 103);
+        return;
+    }
+    if (!BurstManager_CanCapture(s_ctx)) {
+        Telemetry_SendNACK(CMD_START_BURST_WEIGHT, "slot_busy", 105);
+        return;
+    }
     uint32_t cycles = 0;
-    const char *p = strstr(line, "cycles=");
-    if (!p || !api_parse_u32(p + 7, &cycles)) {
+    if (!api_parse_u32(api_tok_val(t, "cycles"), &cycles)) {
         Telemetry_SendNACK(CMD_START_BURST_WEIGHT, "bad_arg", 101);
         return;
     }
@@ -385,10 +714,17 @@ static void Parse_StartBurstWeight(const char *line) {
     Countdown_Start(5); // Using default 5s for now
 }
 
-static void Parse_StartBurstDamping(const char *line) {
+static void Cmd_StartBurstDamping(const api_tokens_t *t) {
+    if (s_ctx->op_mode != OP_MODE_IDLE) {
+        Telemetry_SendNACK(CMD_START_BURST_DAMPING, "bad_state", 103);
+        return;
+    }
+    if (!BurstManager_CanCapture(s_ctx)) {
+        Telemetry_SendNACK(CMD_START_BURST_DAMPING, "slot_busy", 105);
+        return;
+    }
     uint32_t seconds = 0;
-    const char *p = strstr(line, "seconds=");
-    if (!p || !api_parse_u32(p + 8, &seconds)) {
+    if (!api_parse_u32(api_tok_val(t, "seconds"), &seconds)) {
         Telemetry_SendNACK(CMD_START_BURST_DAMPING, "bad_arg", 101);
         return;
     }
@@ -396,6 +732,12 @@ static void Parse_StartBurstDamping(const char *line) {
         Telemetry_SendNACK(CMD_START_BURST_DAMPING, "param_range", 102);
         return;
     }
+    BurstResult_t result;
+    if (!Cmd_ParseResult(t, &result)) {
+        Telemetry_SendNACK(CMD_START_BURST_DAMPING, "bad_arg", 101);
+        return;
+    }
+    s_ctx->burst_result = result;
 
     Telemetry_SendACK(CMD_START_BURST_DAMPING);
     BurstManager_Configure(s_ctx, KIND_DAMP_CD, seconds, 0);
@@ -403,32 +745,49 @@ static void Parse_StartBurstDamping(const char *line) {
     Countdown_Start(5); // Using default 5s for now
 }
 
-static void Parse_Mode(const char *line) {
-    if (strstr(line, "TRIGGER_ON")) {
+static void Cmd_Mode(const api_tokens_t *t) {
+    if (api_tok_flag(t, "TRIGGER_ON")) {
         if (s_ctx->op_mode != OP_MODE_IDLE) {
             Telemetry_SendNACK(CMD_MODE, "bad_state", 103);
             return;
         }
         Streaming_Stop(s_ctx);
 
-        const char *p = strstr(line, "cd_s=");
+        const char *p = api_tok_val(t, "cd_s");
         if (p) {
             uint32_t val = 0;
             // This parameter is parsed but not used, as the countdown is started
-            // in Parse_CalReady with a default value. This maintains API compatibility.
-            if (!api_parse_u32(p + 5, &val) || val < 5 || val > 10) {
+            // in Cmd_CalReady with a default value. This maintains API compatibility.
+            if (!api_parse_u32(p, &val) || val < 5 || val > 10) {
                 Telemetry_SendNACK(CMD_MODE, "param_range", 102);
                 return;
             }
         }
 
+        const char *z = api_tok_val(t, "zero");
+        if (z) {
+            // zero=stored: ZERO-profilen från flash (CAL_STORE) ersätter hold_zero
+            if (!api_tok_val_is(t, "zero", "stored")) {
+                Telemetry_SendNACK(CMD_MODE, "bad_arg", 101);
+                return;
+            }
+            if (!Trigger_IsZeroCalibrated(s_ctx)) {
+                Telemetry_SendNACK(CMD_MODE, "zero_not_calibrated", 104);
+                return;
+            }
+            Telemetry_SendACK(CMD_MODE);
+            COMM_Sendf(MSG_CAL_INFO ",status=hold_zero_done,src=stored" PROTO_EOL);
+            AppContext_SetOpMode(s_ctx, OP_MODE_WAIT_ARM);
+            return;
+        }
+
         Telemetry_SendACK(CMD_MODE);
         Telemetry_SendCalInfo(s_ctx);
         s_ctx->is_dumping = true;
         s_ctx->diag.hb_pauses++;
         Sensor_StartSampling(s_ctx);
         AppContext_SetOpMode(s_ctx, OP_MODE_WAIT_CAL_ZERO);
-    } else if (strstr(line, "TRIGGER_OFF")) {
+    } else if (api_tok_flag(t, "TRIGGER_OFF")) {
         Telemetry_SendACK(CMD_MODE);
         Countdown_Stop();
         BurstManager_Reset(s_ctx);
@@ -441,13 +800,12 @@ static void Parse_Mode(const char *line) {
     }
 }
 
-static void Parse_CalReady(const char *line) {
+static void Cmd_CalReady(const api_tokens_t *t) {
     if (s_ctx->op_mode != OP_MODE_WAIT_CAL_ZERO) {
         Telemetry_SendNACK(CMD_CAL_READY, "bad_state", 103);
         return;
     }
-    const char *p = strstr(line, "phase=");
-    if (!p || strncmp(p + 6, "hold_zero", 9) != 0) {
+    if (!api_tok_val_is(t, "phase", "hold_zero")) {
         Telemetry_SendNACK(CMD_CAL_READY, "bad_arg", 101);
         return;
     }
@@ -461,45 +819,74 @@ static void Parse_CalReady(const char *line) {
     }
 }
 
-static void Parse_HB(const char *line) {
-    if (strstr(line, "OFF")) {
+// Raderingen stoppar CPU:n, så bara när inget samplas eller skickas i bakgrunden.
+static void Cmd_CalStore(const api_tokens_t *t) {
+    const bool save = api_tok_flag(t, "SAVE");
+    const bool clear = api_tok_flag(t, "CLEAR");
+    if (save && clear) {
+        Telemetry_SendNACK(CMD_CAL_STORE, "bad_arg", 101);
+        return;
+    }
+    if (save || clear) {
+        if ((s_ctx->op_mode != OP_MODE_IDLE && s_ctx->op_mode != OP_MODE_WAIT_ARM) ||
+            Sensor_IsSampling(s_ctx)) {
+            Telemetry_SendNACK(CMD_CAL_STORE, "bad_state", 103);
+            return;
+        }
+        if (BM_IsActive() || Sensor_IsOffsetCalibrating() || Sensor_IsSelfTestRunning()) {
+            Telemetry_SendNACK(CMD_CAL_STORE, "busy", 105);
+            return;
+        }
+        const HAL_StatusTypeDef st = save ? CalStore_SaveContext(s_ctx) : CalStore_Clear();
+        if (st != HAL_OK) {
+            Telemetry_SendNACK(CMD_CAL_STORE, "flash_error", 106);
+            return;
+        }
+    }
+    Telemetry_SendACK(CMD_CAL_STORE);
+    CalStore_SendInfo();
+}
+
+static void Cmd_HB(const api_tokens_t *t) {
+    if (api_tok_flag(t, "OFF")) {
         s_ctx->cfg.hb_ms = 0;
         Telemetry_SendACK(CMD_HB);
         return;
     }
-    if (strstr(line, "ON")) {
+    if (api_tok_flag(t, "ON")) {
         if (s_ctx->cfg.hb_ms == 0)
             s_ctx->cfg.hb_ms = 1000;
         Telemetry_SendACK(CMD_HB);
         return;
     }
-    const char *p = strstr(line, "ms=");
-    if (p) {
-        uint32_t v = 0;
-        if (api_parse_u32(p + 3, &v)) {
-            if (v > 0 && v < 100) v = 100;
-            s_ctx->cfg.hb_ms = v;
-            Telemetry_SendACK(CMD_HB);
-            return;
-        }
+    uint32_t v = 0;
+    if (api_parse_u32(api_tok_val(t, "ms"), &v)) {
+        if (v > 0 && v < 100) v = 100;
+        s_ctx->cfg.hb_ms = v;
+        Telemetry_SendACK(CMD_HB);
+        return;
     }
     Telemetry_SendNACK(CMD_HB, "bad_arg", 101);
 }
 
-static void Parse_AdxlSt(const char *line) {
+static void Cmd_AdxlSt(const api_tokens_t *t) {
+    if (s_ctx->op_mode != OP_MODE_IDLE) {
+        Telemetry_SendNACK("ADXL_ST", "bad_state", 103);
+        return;
+    }
     uint32_t avg_count = 16;
     uint32_t settle_count = 4;
     uint32_t force_odr_hz = 0;
-    char* q;
+    uint32_t v;
 
-    if ((q = strstr(line, "avg=")) && api_parse_u32(q + 4, &avg_count)) {
-        // parsed
+    if (api_parse_u32(api_tok_val(t, "avg"), &v)) {
+        avg_count = v;
     }
-    if ((q = strstr(line, "settle=")) && api_parse_u32(q + 7, &settle_count)) {
-        // parsed
+    if (api_parse_u32(api_tok_val(t, "settle"), &v)) {
+        settle_count = v;
     }
-    if ((q = strstr(line, "force_odr_hz=")) && api_parse_u32(q + 13, &force_odr_hz)) {
-        // parsed
+    if (api_parse_u32(api_tok_val(t, "force_odr_hz"), &v)) {
+        force_odr_hz = v;
     }
 
     if (avg_count == 0 || avg_count > 128) {
@@ -511,38 +898,42 @@ static void Parse_AdxlSt(const char *line) {
         return;
     }
 
-    Telemetry_SendACK("ADXL_ST");
-    Telemetry_Flush();
-
-    AdxlSelfTestResult_t results;
-    HAL_StatusTypeDef status = Sensor_PerformSelfTest(s_ctx, (uint8_t)avg_count, (uint8_t)settle_count, force_odr_hz, &results);
-
-    if (status == HAL_OK) {
-        uint32_t test_odr = (force_odr_hz > 0) ? force_odr_hz : 400; // Match default in sensor_hal
-        uint32_t snapped_odr = Sensor_SnapODR(test_odr);
-        uint8_t devid = 0xE5; // Known device ID
-
-        COMM_Sendf("ADXL_ST_CFG,devid=0x%02X,odr_hz=%lu,avg=%lu,settle=%lu" PROTO_EOL,
-                   devid, snapped_odr, avg_count, settle_count);
-
-        COMM_Sendf("ADXL_ST_RAW,x_off=%d,y_off=%d,z_off=%d,x_on=%d,y_on=%d,z_on=%d,x_st=%d,y_st=%d,z_st=%d,health=%s" PROTO_EOL,
-                   results.x_off, results.y_off, results.z_off,
-                   results.x_on, results.y_on, results.z_on,
-                   results.x_st, results.y_st, results.z_st,
-                   results.health_pass ? "PASS" : "FAIL");
-    } else {
-        const char* reason = (status == HAL_TIMEOUT) ? "sensor_timeout" : "i2c_error";
-        COMM_Sendf("ADXL_ST_RAW,health=%s" PROTO_EOL, reason);
+    if (Sensor_IsOffsetCalibrating() ||
+        Sensor_StartSelfTest(s_ctx, (uint8_t)avg_count, (uint8_t)settle_count, force_odr_hz) != HAL_OK) {
+        Telemetry_SendNACK("ADXL_ST", "busy", 105);
+        return;
     }
+    // The result (ADXL_ST_CFG/ADXL_ST_RAW) follows from Sensor_Pump when the test is done.
+    Telemetry_SendACK("ADXL_ST");
 }
 
 // --- NY KOMMANDOHANTERARE ---
-static void handle_diag_hw_test(AppContext_t* ctx, const char* line) {
-    (void)line;
-    if (ctx->op_mode != OP_MODE_IDLE && ctx->op_mode != OP_MODE_WAIT_ARM) {
+static void Cmd_DiagHwTest(const api_tokens_t *t) {
+    (void)t;
+    if (s_ctx->op_mode != OP_MODE_IDLE && s_ctx->op_mode != OP_MODE_WAIT_ARM) {
         Telemetry_SendNACK("DIAG_HW_TEST", "must_be_idle_or_wait_arm", 103);
         return;
     }
     Telemetry_SendACK("DIAG_HW_TEST");
-    DevDiag_RunAllTests(ctx);
-}
\ No newline at end of file
+    DevDiag_RunAllTests(s_ctx);
+}
+
+// BENCH blockerar som DIAG_HW_TEST; en burst i bakgrunden skulle störa TX-mätningarna.
+static void Cmd_Bench(const api_tokens_t *t) {
+    if (s_ctx->op_mode != OP_MODE_IDLE) {
+        Telemetry_SendNACK(CMD_BENCH, "bad_state", 103);
+        return;
+    }
+    if (DevDiag_BenchBusy() || BM_IsActive()) {
+        Telemetry_SendNACK(CMD_BENCH, "busy", 105);
+        return;
+    }
+    const char *name = api_tok_val(t, "test");
+    const uint8_t mask = DevDiag_BenchMask(name);
+    if (mask == 0U) {
+        Telemetry_SendNACK(CMD_BENCH, "bad_arg", 101);
+        return;
+    }
+    Telemetry_SendACK(CMD_BENCH);
+    DevDiag_Bench(s_ctx, mask, name);
+}
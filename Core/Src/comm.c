@@ -29,7 +29,13 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <limits.h>
-#include "dev_telemetry.h" // Inkludera ny debug-header
+#include "sched.h"
+#include "app_rtos.h"   // APP_WAIT_EVENT
+#include "prof.h"
+#include "trace.h"
+#if COMM_USE_USB_CDC
+#include "usbd_cdc_if.h"   // CDC_Transmit_FS
+#endif
 
  // Public function prototypes from main.c
 void process_command(char* line);
@@ -55,9 +61,41 @@ static uint8_t tx_ring_buffer[COMM_TX_RING_SIZE];
 static volatile uint16_t tx_ring_head = 0;
 static volatile uint16_t tx_ring_tail = 0;
 static volatile uint8_t tx_dma_busy = 0;
-static uint8_t tx_dma_buffer[COMM_TX_DMA_SIZE];
+/* DMA läser direkt ur tx_ring_buffer från tail; tail flyttas först i
+ * COMM_TxCpltCallback, så de bytes som DMA:n läser räknas som upptagna och
+ * kan inte skrivas över av Telemetry_Write under tiden. */
 static volatile uint16_t tx_dma_active_len = 0;
 static volatile uint32_t s_tx_drop_count = 0;
+static volatile uint32_t s_tx_sent_bytes = 0;   /* Båda lanes, räknas när spannet är ute */
+static volatile uint16_t tx_resv_len = 0;   /* öppen COMM_TxReserve, 0 = ingen */
+/* Sendf formaterar på plats i ringen; bara när raden hamnar över ringslutet
+ * formateras den här och kopieras. Alla sändare körs i trådkontext. */
+static char tx_fmt_wrap[PROTO_MAX_LINE + 1];
+
+/* Kontroll-lane: egen ring, töms alltid före bulkringen vid en radgräns. */
+static uint8_t tx_ctrl_buffer[COMM_TX_CTRL_SIZE];
+static volatile uint16_t tx_ctrl_head = 0;
+static volatile uint16_t tx_ctrl_tail = 0;
+static volatile uint32_t s_tx_ctrl_drop_count = 0;
+static volatile uint8_t tx_dma_lane = 0;        /* 0 = bulk, 1 = kontroll */
+/* Radgränser i bulkringen: head efter varje skrivning som slutar på '\n' eller
+ * PROTO_BIN_DELIM. DMA-spannen kortas till sista gränsen så att kontroll-lanen
+ * kan ta över utan att dela en rad eller binärram. Full kö: nyaste gränsen
+ * flyttas fram (grövre men fortfarande giltig). */
+static volatile uint16_t tx_mark[COMM_TX_MARKS];
+static volatile uint8_t tx_mark_head = 0;
+static volatile uint8_t tx_mark_tail = 0;
+static volatile uint8_t tx_bulk_at_bound = 1;   /* bulk-tail står på en gräns */
+static volatile uint8_t tx_dma_ends_bound = 0;  /* pågående bulkspann slutar på en gräns */
+
+/* Väntande "meddela när N bytes är lediga" (endast trådkontext) */
+typedef struct {
+    COMM_TxFreeFn fn;
+    void*         arg;
+    uint16_t      len;
+} tx_notify_t;
+static tx_notify_t tx_notify[COMM_TX_NOTIFY_MAX];
+static uint8_t tx_notify_n = 0;
 
 static char line_buffer[LINE_BUFFER_SIZE];
 static uint16_t line_len = 0;
@@ -71,12 +109,16 @@ _Static_assert(LINE_BUFFER_SIZE >= (PROTO_MAX_LINE - PROTO_EOL_LEN + 1),
 _Static_assert(LINE_BUFFER_SIZE >= PROTO_MAX_LINE,
                "line_buffer must be at least PROTO_MAX_LINE when EOL length is unknown");
 #endif
-_Static_assert(COMM_TX_DMA_SIZE <= COMM_TX_RING_SIZE,
-               "COMM_TX_DMA_SIZE must not exceed COMM_TX_RING_SIZE");
+_Static_assert(COMM_TX_DMA_SIZE < COMM_TX_RING_SIZE,
+               "COMM_TX_DMA_SIZE must be smaller than COMM_TX_RING_SIZE");
 _Static_assert(COMM_TX_DMA_SIZE >= PROTO_MAX_LINE,
                "DMA chunk must cover one full protocol line");
 _Static_assert(COMM_TX_RING_SIZE >= (PROTO_MAX_LINE * 4),
                "TX ring should hold at least 4 protocol lines for burst sequences");
+_Static_assert(COMM_TX_CTRL_SIZE > PROTO_MAX_LINE,
+               "Control lane must hold one full protocol line");
+_Static_assert((COMM_TX_MARKS & (COMM_TX_MARKS - 1U)) == 0U && COMM_TX_MARKS <= 128U,
+               "COMM_TX_MARKS must be a power of two <= 128");
 
 
 // --- Private Function Prototypes ---
@@ -84,6 +126,12 @@ static void StartDmaTx(void);
 static inline uint16_t _rb_free(void);
 static inline uint16_t _tx_rb_usage(void);
 static inline uint16_t _rx_rb_usage(void);
+static int comm_vsendf(const char* fmt, va_list args, bool eol, bool blocking);
+static void _count_drop(uint32_t n);
+static void _mark_bound(uint8_t last);
+static void _rx_push(const uint8_t* buf, uint32_t len);
+static void _tx_done(void);
+static void _tx_notify_run(void);
 
 
 // --- Public Functions ---
@@ -98,17 +146,32 @@ void COMM_Init(void)
     s_rx_overflow_count = 0;
     s_tx_drop_count = 0;
     tx_dma_active_len = 0;
+    tx_resv_len = 0;
+    tx_ctrl_head = 0;
+    tx_ctrl_tail = 0;
+    s_tx_ctrl_drop_count = 0;
+    tx_dma_lane = 0;
+    tx_mark_head = 0;
+    tx_mark_tail = 0;
+    tx_bulk_at_bound = 1;
+    tx_dma_ends_bound = 0;
+    tx_notify_n = 0;
     line_len = 0;
     line_truncated = 0;
 }
 
 void COMM_StartRx(void)
 {
+#if COMM_USE_USB_CDC
+    /* CDC-klassen armerar mottagningen själv när värden konfigurerar enheten */
+#else
     HAL_UARTEx_ReceiveToIdle_DMA(&huart2, uart_rx_dma_buffer, UART_RX_DMA_BUFFER_SIZE);
+#endif
 }
 
 void COMM_Process(void)
 {
+    _tx_notify_run();
     while (rx_ring_head != rx_ring_tail)
     {
         char c = rx_ring_buffer[rx_ring_tail];
@@ -123,7 +186,7 @@ void COMM_Process(void)
             }
             else if (line_truncated)
             {
-                COMM_Sendf(MSG_NACK ",SUBJECT=UNKNOWN,reason=line_too_long,code=%u" PROTO_EOL, 300U);
+                COMM_SendfCtrl(MSG_NACK ",SUBJECT=UNKNOWN,reason=line_too_long,code=%u" PROTO_EOL, 300U);
             }
             line_len = 0;
             line_truncated = 0;
@@ -146,6 +209,8 @@ void COMM_Process_Budgeted(void)
     uint32_t start_ms = HAL_GetTick();
     uint32_t lines_processed = 0;
 
+    _tx_notify_run();
+
     while (rx_ring_head != rx_ring_tail)
     {
         char c = rx_ring_buffer[rx_ring_tail];
@@ -161,7 +226,7 @@ void COMM_Process_Budgeted(void)
             }
             else if (line_truncated)
             {
-                COMM_Sendf(MSG_NACK ",SUBJECT=UNKNOWN,reason=line_too_long,code=%u" PROTO_EOL, 300U);
+                COMM_SendfCtrl(MSG_NACK ",SUBJECT=UNKNOWN,reason=line_too_long,code=%u" PROTO_EOL, 300U);
             }
             line_len = 0;
             line_truncated = 0;
@@ -185,6 +250,12 @@ void COMM_Process_Budgeted(void)
             break;
         }
     }
+    if (lines_processed > 0u) {
+        Sched_Post(SCHED_EV_CMD); // a command may have changed mode or settings
+    }
+    if (rx_ring_head != rx_ring_tail) {
+        Sched_Post(SCHED_EV_RX); // budget spent: continue next pass
+    }
 }
 
 void COMM_Send(const char* s)
@@ -198,27 +269,151 @@ void COMM_Send(const char* s)
 
 int COMM_Sendf(const char* fmt, ...)
 {
-    char temp_buf[PROTO_MAX_LINE + 1];
     va_list args;
     va_start(args, fmt);
-    int len = vsnprintf(temp_buf, sizeof(temp_buf), fmt, args);
+    int len = comm_vsendf(fmt, args, false, false);
     va_end(args);
+    return len;
+}
 
-    if (len <= 0) { return 0; }
-    if (len >= (int)sizeof(temp_buf)) {
-        __disable_irq();
-        uint32_t drops = (uint32_t)len;
-        if (s_tx_drop_count <= UINT32_MAX - drops) { s_tx_drop_count += drops; }
-        else { s_tx_drop_count = UINT32_MAX; }
-        __enable_irq();
-        return 0;
+static void _count_drop(uint32_t n)
+{
+    __disable_irq();
+    if (s_tx_drop_count <= UINT32_MAX - n) { s_tx_drop_count += n; }
+    else { s_tx_drop_count = UINT32_MAX; }
+    __enable_irq();
+}
+
+/*
+ * Formaterar direkt in i en reservation. Får raden inte plats i första spannet
+ * (ringslutet) formateras den om i tx_fmt_wrap och kopieras över båda spannen.
+ * Utan plats: släpps och räknas (icke-blockerande) eller väntar tills den ryms.
+ * Längden begränsas till PROTO_MAX_LINE som tidigare; eol lägger till PROTO_EOL.
+ */
+static int comm_vsendf(const char* fmt, va_list args, bool eol, bool blocking)
+{
+    const uint16_t eol_len = eol ? (uint16_t)(sizeof(PROTO_EOL) - 1u) : 0u;
+    for (;;) {
+        COMM_TxSpan sp;
+        uint16_t got = COMM_TxReserveUpTo(PROTO_MAX_LINE + 1u, &sp);
+        va_list ap;
+        va_copy(ap, args);
+        int len = vsnprintf(got ? sp.p[0] : NULL, got ? sp.len[0] : 0u, fmt, ap);
+        va_end(ap);
+        if (len <= 0) { COMM_TxCommit(0); return 0; }
+        const uint32_t total = (uint32_t)len + eol_len;
+        if (total >= PROTO_MAX_LINE + 1u) {
+            COMM_TxCommit(0);
+            _count_drop(total);
+            return 0;
+        }
+        if (total <= got) {
+            if ((uint32_t)len >= sp.len[0] || total > sp.len[0]) {
+                /* Över ringslutet: formatera om och dela upp */
+                va_copy(ap, args);
+                (void)vsnprintf(tx_fmt_wrap, sizeof(tx_fmt_wrap), fmt, ap);
+                va_end(ap);
+                if (eol) memcpy(&tx_fmt_wrap[len], PROTO_EOL, eol_len);
+                uint16_t a = (total < sp.len[0]) ? (uint16_t)total : sp.len[0];
+                memcpy(sp.p[0], tx_fmt_wrap, a);
+                memcpy(sp.p[1], &tx_fmt_wrap[a], total - a);
+            } else if (eol) {
+                memcpy(&sp.p[0][len], PROTO_EOL, eol_len);
+            }
+            COMM_TxCommit((uint16_t)total);
+            return (int)total;
+        }
+        COMM_TxCommit(0);
+        if (!blocking) {
+            _count_drop(total);
+            Trace_Log(TRACE_EV_TX_DROP, (uint16_t)total, got);
+            return 0;
+        }
+        if (COMM_TxWaitFree((uint16_t)total, COMM_TX_BLOCK_TIMEOUT_MS) != HAL_OK) {
+            _count_drop(total);
+            return 0;
+        }
     }
+}
+
+int COMM_TxReserve(uint16_t len, COMM_TxSpan* span)
+{
+    if (len == 0u) return 0;
+    __disable_irq();
+    const int ok = (tx_resv_len == 0u) && (_rb_free() >= len);
+    __enable_irq();
+    return ok ? (COMM_TxReserveUpTo(len, span) == len) : 0;
+}
+
+uint16_t COMM_TxReserveUpTo(uint16_t max_len, COMM_TxSpan* span)
+{
+    __disable_irq();
+    if (tx_resv_len != 0u) { __enable_irq(); return 0; }
+    uint16_t n = _rb_free();
+    if (n > max_len) n = max_len;
+    const uint16_t head = tx_ring_head;
+    uint16_t first = (uint16_t)(COMM_TX_RING_SIZE - head);
+    if (first > n) first = n;
+    span->p[0] = (char*)&tx_ring_buffer[head];
+    span->len[0] = first;
+    span->p[1] = (char*)&tx_ring_buffer[0];
+    span->len[1] = (uint16_t)(n - first);
+    tx_resv_len = n;
+    __enable_irq();
+    return n;
+}
 
-    if (Telemetry_Write(temp_buf, (size_t)len) == (size_t)len) {
-        return len;
+void COMM_TxCommit(uint16_t n)
+{
+    uint8_t start_tx = 0;
+    __disable_irq();
+    if (n > tx_resv_len) n = tx_resv_len;
+    if (n > 0u) {
+        const uint16_t last = (uint16_t)((tx_ring_head + n - 1u) % COMM_TX_RING_SIZE);
+        tx_ring_head = (uint16_t)((tx_ring_head + n) % COMM_TX_RING_SIZE);
+        _mark_bound(tx_ring_buffer[last]);
+        if (!tx_dma_busy) { start_tx = 1; }
     }
+    tx_resv_len = 0;
+    __enable_irq();
+    if (start_tx) { StartDmaTx(); }
+}
+
+/*
+ * Radbyggare för fmt.h: skriver direkt i ringen när hela PROTO_MAX_LINE ryms
+ * före ringslutet, annars i tx_fmt_wrap som delas upp vid COMM_LineEnd.
+ */
+static COMM_TxSpan s_line_span;
+static uint16_t    s_line_got;
+static char*       s_line_begin;
 
-    return 0;
+char* COMM_LineBegin(void)
+{
+    s_line_got = COMM_TxReserveUpTo(PROTO_MAX_LINE, &s_line_span);
+    s_line_begin = (s_line_got == PROTO_MAX_LINE && s_line_span.len[0] == PROTO_MAX_LINE)
+        ? s_line_span.p[0] : tx_fmt_wrap;
+    return s_line_begin;
+}
+
+int COMM_LineEnd(const char* end)
+{
+    const char* begin = s_line_begin;
+    const uint16_t total = (uint16_t)(end - begin);
+    if (total == 0u || total > s_line_got) {
+        COMM_TxCommit(0);
+        if (total > 0u) {
+            _count_drop(total);
+            Trace_Log(TRACE_EV_TX_DROP, total, s_line_got);
+        }
+        return 0;
+    }
+    if (begin == tx_fmt_wrap) {
+        uint16_t a = (total < s_line_span.len[0]) ? total : s_line_span.len[0];
+        memcpy(s_line_span.p[0], tx_fmt_wrap, a);
+        memcpy(s_line_span.p[1], &tx_fmt_wrap[a], total - a);
+    }
+    COMM_TxCommit(total);
+    return (int)total;
 }
 
 /* PATCH RC-201: Hela funktionen är omstrukturerad för att flytta
@@ -231,7 +426,8 @@ size_t Telemetry_Write(const char* data, size_t len)
     bool dropped = false;
 
     __disable_irq();
-    uint16_t free_space = _rb_free(); // Kontrollera utrymme under lås
+    // Kontrollera utrymme under lås; en öppen reservation äger ringhuvudet
+    uint16_t free_space = (tx_resv_len == 0u) ? _rb_free() : 0u;
 
     if (len > free_space) {
         // Räkna tappade bytes och släpp låset
@@ -242,6 +438,7 @@ size_t Telemetry_Write(const char* data, size_t len)
         }
         __enable_irq();
         dropped = true;
+        Trace_Log(TRACE_EV_TX_DROP, (uint16_t)len, free_space);
     } else {
         // Det finns plats, fortsätt under lås
         uint16_t head = tx_ring_head;
@@ -258,15 +455,11 @@ size_t Telemetry_Write(const char* data, size_t len)
             head = (head + remaining_len);
         }
         tx_ring_head = head;
+        _mark_bound((uint8_t)data[len - 1u]);
         if (!tx_dma_busy) { start_tx = 1; }
         __enable_irq(); // Släpp låset
     }
 
-    #if RXTX_DEBUG > 0
-    // Anropa debug-telemetri utanför låset
-    DevTel_TxEnqueue(len, free_space, dropped);
-    #endif
-
     if (dropped) {
         return 0;
     }
@@ -278,20 +471,51 @@ size_t Telemetry_Write(const char* data, size_t len)
     return len;
 }
 
+HAL_StatusTypeDef COMM_TxWaitFree(uint16_t len, uint32_t timeout_ms)
+{
+    if (len > COMM_TX_RING_SIZE - 1u || tx_resv_len != 0u) return HAL_ERROR;
+    const uint32_t t0 = HAL_GetTick();
+    for (;;) {
+        /* Utan lås: head/tail läses atomärt och ISR:en kan bara öka utrymmet */
+        if (_rb_free() >= len) return HAL_OK;
+        if (timeout_ms != COMM_WAIT_FOREVER && (HAL_GetTick() - t0) >= timeout_ms) return HAL_TIMEOUT;
+        /* Data utan pågående DMA (t.ex. USB upptagen vid start): sparka igång */
+        if (!tx_dma_busy) { StartDmaTx(); }
+        /* _tx_done gör SEV, så en klar-signal mellan kontroll och WFE går inte förlorad;
+         * SysTick väcker senast efter 1 ms för timeouten. RTOS: ett tick utan mutexet. */
+        APP_WAIT_EVENT();
+    }
+}
+
+int COMM_TxNotifyFree(uint16_t len, COMM_TxFreeFn fn, void* arg)
+{
+    if (!fn || len > COMM_TX_RING_SIZE - 1u || tx_notify_n >= COMM_TX_NOTIFY_MAX) return 0;
+    tx_notify[tx_notify_n].fn = fn;
+    tx_notify[tx_notify_n].arg = arg;
+    tx_notify[tx_notify_n].len = len;
+    tx_notify_n++;
+    return 1;
+}
+
 /* PATCH RC-201: Implementerar en säker blockerande väntan som inte
- * håller låset medan den väntar. */
+ * håller låset medan den väntar. Väntan sover nu i COMM_TxWaitFree. */
 size_t Telemetry_WriteBlocking(const char* data, size_t len)
 {
     if (!data || !len) return 0;
     uint8_t start_tx = 0;
 
     for (;;) {
+        if (len > COMM_TX_RING_SIZE - 1u ||
+            COMM_TxWaitFree((uint16_t)len, COMM_TX_BLOCK_TIMEOUT_MS) != HAL_OK) {
+            _count_drop((uint32_t)len);
+            Trace_Log(TRACE_EV_TX_DROP, (uint16_t)len, COMM_TxFree());
+            return 0;
+        }
         __disable_irq();
-        if (_rb_free() >= len) {
+        if (tx_resv_len == 0u && _rb_free() >= len) {
             // Det finns plats, låset är aktivt, bryt loopen för att skriva
             break;
         }
-        // Släpp låset och loopa igen för att låta ISR:er köra
         __enable_irq();
     }
 
@@ -308,6 +532,7 @@ size_t Telemetry_WriteBlocking(const char* data, size_t len)
         head = (uint16_t)(remaining_len);
     }
     tx_ring_head = head;
+    _mark_bound((uint8_t)data[len - 1u]);
     if (!tx_dma_busy) { start_tx = 1; }
     __enable_irq(); // Släpp låset
 
@@ -318,19 +543,100 @@ size_t Telemetry_WriteBlocking(const char* data, size_t len)
 
 int COMM_SendfBlocking(const char* fmt, ...)
 {
-    char temp_buf[PROTO_MAX_LINE + 1];
     va_list args;
     va_start(args, fmt);
-    int len = vsnprintf(temp_buf, sizeof(temp_buf), fmt, args);
+    int len = comm_vsendf(fmt, args, false, true);
     va_end(args);
-    if (len <= 0 || len >= (int)sizeof(temp_buf)) return 0;
-    
-    return (int)Telemetry_WriteBlocking(temp_buf, (size_t)len);
+    return len;
+}
+
+size_t COMM_WriteCtrl(const char* data, size_t len)
+{
+    if (!data || !len) return 0;
+    uint8_t start_tx = 0;
+
+    __disable_irq();
+    const uint16_t head = tx_ctrl_head;
+    const uint16_t tail = tx_ctrl_tail;
+    const uint16_t free_space = (head >= tail) ? (uint16_t)((COMM_TX_CTRL_SIZE - 1u) - (head - tail))
+                                               : (uint16_t)(tail - head - 1u);
+    if (len > free_space) {
+        if (s_tx_ctrl_drop_count <= UINT32_MAX - (uint32_t)len) {
+            s_tx_ctrl_drop_count += (uint32_t)len;
+        } else {
+            s_tx_ctrl_drop_count = UINT32_MAX;
+        }
+        __enable_irq();
+        Trace_Log(TRACE_EV_TX_DROP, (uint16_t)len, free_space);
+        return 0;
+    }
+    size_t first = (size_t)(COMM_TX_CTRL_SIZE - head);
+    if (len < first) { first = len; }
+    memcpy(&tx_ctrl_buffer[head], data, first);
+    memcpy(&tx_ctrl_buffer[0], data + first, len - first);
+    tx_ctrl_head = (uint16_t)((head + len) % COMM_TX_CTRL_SIZE);
+    if (!tx_dma_busy) { start_tx = 1; }
+    __enable_irq();
+
+    if (start_tx) { StartDmaTx(); }
+    return len;
+}
+
+int COMM_SendfCtrl(const char* fmt, ...)
+{
+    /* Kontrollrader är få och korta; formateras på stacken och kopieras. */
+    char buf[PROTO_MAX_LINE + 1];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (len <= 0) return 0;
+    if (len >= PROTO_MAX_LINE + 1) {
+        __disable_irq();
+        if (s_tx_ctrl_drop_count <= UINT32_MAX - (uint32_t)len) { s_tx_ctrl_drop_count += (uint32_t)len; }
+        __enable_irq();
+        return 0;
+    }
+    return (int)COMM_WriteCtrl(buf, (size_t)len);
 }
 
 
 // --- Private Functions ---
 
+/* Kör de notifieringar vars utrymme finns; fn kan skriva och registrera igen
+ * (högst COMM_TX_NOTIFY_MAX anrop per varv, så en omregistrering inte loopar). */
+static void _tx_notify_run(void)
+{
+    uint8_t i = 0;
+    uint8_t calls = 0;
+    while (i < tx_notify_n && calls < COMM_TX_NOTIFY_MAX) {
+        if (_rb_free() < tx_notify[i].len) { i++; continue; }
+        const tx_notify_t n = tx_notify[i];
+        tx_notify[i] = tx_notify[--tx_notify_n];
+        calls++;
+        n.fn(n.arg);
+    }
+}
+
+/* Anropas under lås efter att bulk-head flyttats; last är skrivningens sista byte. */
+static void _mark_bound(uint8_t last)
+{
+    if (last != (uint8_t)'\n' && last != PROTO_BIN_DELIM) return;
+    const uint8_t n = (uint8_t)(tx_mark_head - tx_mark_tail);
+    if (n >= COMM_TX_MARKS) {
+        tx_mark[(uint8_t)(tx_mark_head - 1u) & (COMM_TX_MARKS - 1u)] = tx_ring_head;
+    } else {
+        tx_mark[tx_mark_head & (COMM_TX_MARKS - 1u)] = tx_ring_head;
+        tx_mark_head++;
+    }
+}
+
+/* Avstånd från bulk-tail fram till gräns m i ringen. */
+static inline uint16_t _mark_dist(uint16_t from, uint16_t m)
+{
+    return (uint16_t)((m + COMM_TX_RING_SIZE - from) % COMM_TX_RING_SIZE);
+}
+
 static inline uint16_t _rb_free(void)
 {
     uint16_t head = tx_ring_head;
@@ -350,32 +656,65 @@ static void StartDmaTx(void)
         return;
     }
 
-    if (tx_ring_head == tx_ring_tail) {
+    const uint8_t bulk_empty = (tx_ring_head == tx_ring_tail);
+    uint16_t len;
+    uint8_t* span;
+
+    if (tx_ctrl_head != tx_ctrl_tail && (bulk_empty || tx_bulk_at_bound)) {
+        // Kontroll-lanen först, men bara mellan två bulkrader
+        len = (tx_ctrl_head > tx_ctrl_tail) ? (uint16_t)(tx_ctrl_head - tx_ctrl_tail)
+                                            : (uint16_t)(COMM_TX_CTRL_SIZE - tx_ctrl_tail);
+        if (len > COMM_TX_DMA_SIZE) {
+            len = COMM_TX_DMA_SIZE;
+        }
+        span = &tx_ctrl_buffer[tx_ctrl_tail];
+        tx_dma_lane = 1;
+    } else if (!bulk_empty) {
+        if (tx_ring_head > tx_ring_tail) {
+            len = tx_ring_head - tx_ring_tail;
+        }
+        else {
+            len = COMM_TX_RING_SIZE - tx_ring_tail;
+        }
+
+        if (len > COMM_TX_DMA_SIZE) {
+            len = COMM_TX_DMA_SIZE;
+        }
+
+        // Korta spannet till sista radgränsen inom det, så att kontroll-lanen
+        // kan gå nästa gång. Utan gräns (lång rad, ringslut) fortsätter bulk.
+        uint16_t cut = 0;
+        for (uint8_t i = tx_mark_tail; i != tx_mark_head; i++) {
+            const uint16_t d = _mark_dist(tx_ring_tail, tx_mark[i & (COMM_TX_MARKS - 1u)]);
+            if (d == 0u || d > len) break;
+            cut = d;
+        }
+        if (cut != 0u) {
+            len = cut;
+        }
+        tx_dma_ends_bound = (cut != 0u);
+
+        // Sammanhängande spann fram till head eller ringslutet; resten tas i nästa start
+        span = &tx_ring_buffer[tx_ring_tail];
+        tx_dma_lane = 0;
+    } else {
         tx_dma_active_len = 0;
         __enable_irq();
         return;
     }
 
     tx_dma_busy = 1;
-
-    uint16_t len;
-    if (tx_ring_head > tx_ring_tail) {
-        len = tx_ring_head - tx_ring_tail;
-    }
-    else {
-        len = COMM_TX_RING_SIZE - tx_ring_tail;
-    }
-
-    if (len > COMM_TX_DMA_SIZE) {
-        len = COMM_TX_DMA_SIZE;
-    }
-
-    memcpy(tx_dma_buffer, &tx_ring_buffer[tx_ring_tail], len);
     tx_dma_active_len = len;
+    Trace_Log(tx_dma_lane ? TRACE_EV_TX_CTRL : TRACE_EV_TX_DMA, len, _tx_rb_usage());
 
     __enable_irq();
-        
-    HAL_StatusTypeDef st = HAL_UART_Transmit_DMA(&huart2, tx_dma_buffer, len);
+
+#if COMM_USE_USB_CDC
+    /* Ej konfigurerad eller upptagen: datat ligger kvar i ringen till nästa start */
+    HAL_StatusTypeDef st = (CDC_Transmit_FS(span, len) == USBD_OK) ? HAL_OK : HAL_BUSY;
+#else
+    HAL_StatusTypeDef st = HAL_UART_Transmit_DMA(&huart2, span, len);
+#endif
     if (st != HAL_OK) {
         __disable_irq();
         tx_dma_busy = 0;
@@ -390,47 +729,89 @@ void COMM_OnRxEvent(UART_HandleTypeDef* huart, uint16_t Size)
 {
     if (huart->Instance == USART2)
     {
-        uint16_t local_head = rx_ring_head;
-        uint16_t local_tail;
-        __disable_irq();
-        local_tail = rx_ring_tail;
-        __enable_irq();
+        _rx_push(uart_rx_dma_buffer, Size);
+        HAL_UARTEx_ReceiveToIdle_DMA(&huart2, uart_rx_dma_buffer, UART_RX_DMA_BUFFER_SIZE);
+        Sched_Post(SCHED_EV_RX);
+    }
+}
+
+/* Lägger mottagna bytes i RX-ringen (ISR-kontext, UART eller USB). */
+static void _rx_push(const uint8_t* buf, uint32_t len)
+{
+    uint16_t local_head = rx_ring_head;
+    uint16_t local_tail;
+    __disable_irq();
+    local_tail = rx_ring_tail;
+    __enable_irq();
 
-        for (uint16_t i = 0; i < Size; i++)
+    for (uint32_t i = 0; i < len; i++)
+    {
+        uint16_t next_head = (local_head + 1) % RX_RING_BUFFER_SIZE;
+        if (next_head != local_tail)
         {
-            uint16_t next_head = (local_head + 1) % RX_RING_BUFFER_SIZE;
-            if (next_head != local_tail)
-            {
-                rx_ring_buffer[local_head] = uart_rx_dma_buffer[i];
-                local_head = next_head;
-            }
-            else
-            {
-                s_rx_overflow_count++;
-            }
+            rx_ring_buffer[local_head] = buf[i];
+            local_head = next_head;
+        }
+        else
+        {
+            s_rx_overflow_count++;
         }
-        rx_ring_head = local_head;
-        
-        HAL_UARTEx_ReceiveToIdle_DMA(&huart2, uart_rx_dma_buffer, UART_RX_DMA_BUFFER_SIZE);
     }
+    rx_ring_head = local_head;
+    Trace_Log(TRACE_EV_RX, (uint16_t)len, s_rx_overflow_count);
 }
 
 void COMM_TxCpltCallback(UART_HandleTypeDef* huart)
 {
     if (huart->Instance != USART2) { return; }
-    
+#if !COMM_USE_USB_CDC
+    _tx_done();
+#endif
+}
+
+#if COMM_USE_USB_CDC
+void COMM_UsbRxCallback(const uint8_t* buf, uint32_t len)
+{
+    _rx_push(buf, len);
+    Sched_Post(SCHED_EV_RX);
+}
+
+void COMM_UsbTxCpltCallback(void)
+{
+    _tx_done();
+}
+#endif
+
+/* Det pågående spannet är ute: flytta tail i dess lane och starta nästa. */
+static void _tx_done(void)
+{
     uint16_t done;
     __disable_irq();
+    // Fyllnaden sjunker bara här, så max över dessa värden är högvattnet
+    Prof_Record(PROF_TX_OCC, _tx_rb_usage());
     done = tx_dma_active_len;
-    if (done) {
+    Trace_Log(TRACE_EV_TX_DONE, done, _tx_rb_usage());
+    s_tx_sent_bytes += done;
+    if (done && tx_dma_lane) {
+        tx_ctrl_tail = (uint16_t)((tx_ctrl_tail + done) % COMM_TX_CTRL_SIZE);
+    } else if (done) {
+        // Släpp de gränser som spannet passerade
+        while (tx_mark_tail != tx_mark_head) {
+            const uint16_t d = _mark_dist(tx_ring_tail, tx_mark[tx_mark_tail & (COMM_TX_MARKS - 1u)]);
+            if (d == 0u || d > done) break;
+            tx_mark_tail++;
+        }
         tx_ring_tail = (uint16_t)((tx_ring_tail + done) % COMM_TX_RING_SIZE);
+        tx_bulk_at_bound = tx_dma_ends_bound;
     }
     tx_dma_active_len = 0;
     
     tx_dma_busy = 0;
 
     __enable_irq();
-    
+
+    __SEV(); /* väck COMM_TxWaitFree */
+    Sched_Post(SCHED_EV_TX);
     StartDmaTx();
 }
 
@@ -448,7 +829,7 @@ uint8_t COMM_TxIsIdle(void)
 {
     uint8_t idle;
     __disable_irq();
-    idle = (tx_dma_busy == 0) && (tx_ring_head == tx_ring_tail);
+    idle = (tx_dma_busy == 0) && (tx_ring_head == tx_ring_tail) && (tx_ctrl_head == tx_ctrl_tail);
     __enable_irq();
     return idle;
 }
@@ -493,6 +874,8 @@ uint16_t COMM_RxRingUsage(void) {
 }
 
 uint32_t COMM_TxDropCount(void) { return s_tx_drop_count; }
+uint32_t COMM_TxSentBytes(void) { return s_tx_sent_bytes; }
+uint32_t COMM_TxCtrlDropCount(void) { return s_tx_ctrl_drop_count; }
 uint32_t COMM_RxOverflowCount(void) { return s_rx_overflow_count; }
 
 void COMM_SendLine(const char* s)
@@ -503,11 +886,9 @@ void COMM_SendLine(const char* s)
 
 int COMM_SendfLine(const char* fmt, ...)
 {
-    char buf[PROTO_MAX_LINE];
     va_list args;
     va_start(args, fmt);
-    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    int n = comm_vsendf(fmt, args, true, false);
     va_end(args);
-    if (n <= 0) return 0;
-    return COMM_Sendf("%s" PROTO_EOL, buf);
+    return n;
 }
@@ -0,0 +1,88 @@
+/* filename: Core/Src/conditioning.c */
+#include "conditioning.h"
+
+#include <string.h>
+
+typedef struct {
+    filter_xyz_state_t f;
+    volatile bool primed;
+} CondState_t;
+
+enum { COND_IDX_BURST = 0, COND_IDX_LIVE, COND_IDX_TRG, COND_N_PATHS };
+
+static filter_cascade_t g_casc;
+static CondState_t g_state[COND_N_PATHS][SENSOR_MAX_DEVICES];
+static volatile uint8_t g_on = 0;   /* COND_PATH_*-mask, 0 när flt=off */
+
+static inline uint8_t path_idx(uint8_t path)
+{
+    return (path == COND_PATH_BURST) ? COND_IDX_BURST
+         : (path == COND_PATH_LIVE)  ? COND_IDX_LIVE : COND_IDX_TRG;
+}
+
+static inline int16_t to_i16(float v)
+{
+    if (v >= 32767.0f) return 32767;
+    if (v <= -32768.0f) return -32768;
+    return (int16_t)((v >= 0.0f) ? (v + 0.5f) : (v - 0.5f));
+}
+
+void Cond_Configure(const RuntimeCfg_t* cfg)
+{
+    /* Designen (tanf) utanför det kritiska avsnittet; LIVE-vägen körs i PendSV */
+    filter_cascade_t c;
+    const filter_type_t type = (cfg->flt == COND_LP) ? FILTER_LOWPASS
+                             : (cfg->flt == COND_HP) ? FILTER_HIGHPASS : FILTER_BANDPASS;
+    Filter_CascadeDesign(&c, type, (float)cfg->flt_f1_hz, (float)cfg->flt_f2_hz,
+                         cfg->flt_n, (float)cfg->odr_hz);
+    const uint8_t on = (cfg->flt != COND_OFF && c.n_stages > 0u) ? (cfg->flt_path & COND_PATH_ALL) : 0u;
+
+    __disable_irq();
+    g_on = 0;
+    g_casc = c;
+    for (uint8_t p = 0; p < COND_N_PATHS; ++p) {
+        for (uint8_t i = 0; i < SENSOR_MAX_DEVICES; ++i) g_state[p][i].primed = false;
+    }
+    g_on = on;
+    __enable_irq();
+}
+
+bool Cond_IsOn(uint8_t path)
+{
+    return (g_on & path) != 0u;
+}
+
+void Cond_Reset(uint8_t path)
+{
+    const uint8_t p = path_idx(path);
+    for (uint8_t i = 0; i < SENSOR_MAX_DEVICES; ++i) g_state[p][i].primed = false;
+}
+
+void Cond_Apply(uint8_t path, Sample_t* s, uint16_t n)
+{
+    if ((g_on & path) == 0u || n == 0u) return;
+    const uint8_t dev = (s[0].sensor < SENSOR_MAX_DEVICES) ? s[0].sensor : 0u;
+    CondState_t* st = &g_state[path_idx(path)][dev];
+    float buf[3u * FILTER_BLOCK_MAX];
+
+    while (n > 0u) {
+        const uint16_t m = (n > FILTER_BLOCK_MAX) ? (uint16_t)FILTER_BLOCK_MAX : n;
+        for (uint16_t i = 0; i < m; ++i) {
+            buf[3u * i + 0u] = (float)s[i].x;
+            buf[3u * i + 1u] = (float)s[i].y;
+            buf[3u * i + 2u] = (float)s[i].z;
+        }
+        if (!st->primed) {
+            Filter_CascadeSeed(&g_casc, &st->f, buf);
+            st->primed = true;
+        }
+        Filter_CascadeRun(&g_casc, &st->f, buf, m);
+        for (uint16_t i = 0; i < m; ++i) {
+            s[i].x = to_i16(buf[3u * i + 0u]);
+            s[i].y = to_i16(buf[3u * i + 1u]);
+            s[i].z = to_i16(buf[3u * i + 2u]);
+        }
+        s += m;
+        n = (uint16_t)(n - m);
+    }
+}
@@ -3,6 +3,7 @@
 #include "countdown.h"
 #include "comm.h"
 #include "api_schema.h"
+#include "sched.h"
 #include <stdbool.h>
 #include <string.h>
 
@@ -25,6 +26,7 @@ void Countdown_Start(uint8_t seconds) {
     g_cd.step    = seconds;
     g_cd.last_ms = HAL_GetTick();
     COMM_Sendf(MSG_COUNTDOWN_ID ",id=%u" PROTO_EOL, g_cd.step);
+    Sched_ArmTimeout(1000U);
 }
 
 void Countdown_Stop(void) {
@@ -47,7 +49,10 @@ void Countdown_Tick(void) {
         } else {
             /* Normal completion: inget id=0 */
             g_cd.active = false;
+            Sched_Post(SCHED_EV_CMD); /* burst eller ZERO som väntar går vidare */
+            return;
         }
     }
+    Sched_ArmTimeout(1000U - (now - g_cd.last_ms));
 }
 /* Core/Src/countdown.c */
\ No newline at end of file
@@ -0,0 +1,197 @@
+/* filename: Core/Src/damp_analysis.c */
+#include "damp_analysis.h"
+
+#include <string.h>
+#include <math.h>
+
+#ifndef DAMP_USE_CMSIS_DSP
+#define DAMP_USE_CMSIS_DSP 0
+#endif
+
+#if DAMP_USE_CMSIS_DSP
+#include "arm_math.h"
+#endif
+
+_Static_assert((DAMP_FFT_N & (DAMP_FFT_N - 1U)) == 0U && DAMP_FFT_N >= 64U && DAMP_FFT_N <= 4096U,
+               "DAMP_FFT_N must be a power of two in 64..4096");
+
+#define DAMP_PI 3.14159265358979f
+
+/* Reellt indata in, packat spektrum ut (som arm_rfft_fast_f32): [0] = X0, [1] = X(N/2),
+ * därefter re/im för X1..X(N/2-1). */
+static float s_fft[DAMP_FFT_N];
+
+#if DAMP_USE_CMSIS_DSP
+
+static void rfft_packed(float* x)
+{
+    static arm_rfft_fast_instance_f32 inst;
+    static bool init = false;
+    static float out[DAMP_FFT_N];
+    if (!init) {
+        (void)arm_rfft_fast_init_f32(&inst, DAMP_FFT_N);
+        init = true;
+    }
+    arm_rfft_fast_f32(&inst, x, out, 0);
+    memcpy(x, out, sizeof(out));
+}
+
+#else
+
+/* Komplex radix-2 in-place, m punkter som re/im-par. Twiddles per steg med rekursion. */
+static void cfft(float* d, uint16_t m)
+{
+    for (uint16_t i = 1, j = 0; i < m; ++i) {
+        uint16_t bit = (uint16_t)(m >> 1);
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            float t = d[2u * i]; d[2u * i] = d[2u * j]; d[2u * j] = t;
+            t = d[2u * i + 1u]; d[2u * i + 1u] = d[2u * j + 1u]; d[2u * j + 1u] = t;
+        }
+    }
+    for (uint16_t len = 2; len <= m; len = (uint16_t)(len << 1)) {
+        const uint16_t h = (uint16_t)(len >> 1);
+        const float wr = cosf(2.0f * DAMP_PI / (float)len);
+        const float wi = -sinf(2.0f * DAMP_PI / (float)len);
+        for (uint16_t i = 0; i < m; i = (uint16_t)(i + len)) {
+            float cr = 1.0f, ci = 0.0f;
+            for (uint16_t k = 0; k < h; ++k) {
+                float* u = &d[2u * (i + k)];
+                float* v = &d[2u * (i + k + h)];
+                const float vr = v[0] * cr - v[1] * ci;
+                const float vi = v[0] * ci + v[1] * cr;
+                v[0] = u[0] - vr; v[1] = u[1] - vi;
+                u[0] += vr;       u[1] += vi;
+                const float t = cr * wr - ci * wi;
+                ci = cr * wi + ci * wr;
+                cr = t;
+            }
+        }
+    }
+}
+
+/* N reella värden som N/2 komplexa (jämna + i udda), sedan uppdelning. */
+static void rfft_packed(float* x)
+{
+    const uint16_t m = DAMP_FFT_N / 2U;
+    cfft(x, m);
+    const float z0r = x[0], z0i = x[1];
+    x[0] = z0r + z0i;
+    x[1] = z0r - z0i;
+    for (uint16_t k = 1; k <= m / 2U; ++k) {
+        const uint16_t j = (uint16_t)(m - k);
+        const float ar = x[2u * k], ai = x[2u * k + 1u];
+        const float br = x[2u * j], bi = x[2u * j + 1u];
+        const float er = 0.5f * (ar + br), ei = 0.5f * (ai - bi);   /* jämna */
+        const float orr = 0.5f * (ai + bi), oi = -0.5f * (ar - br); /* udda */
+        const float wr = cosf(2.0f * DAMP_PI * (float)k / (float)DAMP_FFT_N);
+        const float wi = -sinf(2.0f * DAMP_PI * (float)k / (float)DAMP_FFT_N);
+        x[2u * k]      = er + wr * orr - wi * oi;
+        x[2u * k + 1u] = ei + wr * oi + wi * orr;
+        x[2u * j]      = er - wr * orr + wi * oi;
+        x[2u * j + 1u] = -ei + wr * oi + wi * orr;
+    }
+}
+
+#endif /* DAMP_USE_CMSIS_DSP */
+
+static inline float bin_pow(const float* x, uint16_t k)
+{
+    return x[2u * k] * x[2u * k] + x[2u * k + 1u] * x[2u * k + 1u];
+}
+
+bool Damp_Analyze(DampSampleFn get, void* user, uint16_t count, float fs_hz, DampResult_t* out)
+{
+    memset(out, 0, sizeof(*out));
+    float v;
+
+    /* Pass 1: medel (statisk del, t.ex. gravitationen) */
+    float sum = 0.0f;
+    uint16_t n = 0;
+    for (uint16_t i = 0; i < count; ++i) {
+        if (get(i, &v, user)) { sum += v; n++; }
+    }
+    out->n = n;
+    if (n < 64U || fs_hz <= 0.0f) return false;
+    const float mean = sum / (float)n;
+
+    /* Pass 2: största avvikelse = insvängningen; analysen börjar där */
+    uint16_t ord = 0, ord_pk = 0;
+    float a_pk = 0.0f;
+    for (uint16_t i = 0; i < count; ++i) {
+        if (!get(i, &v, user)) continue;
+        const float a = fabsf(v - mean);
+        if (a > a_pk) { a_pk = a; ord_pk = ord; }
+        ord++;
+    }
+    if (a_pk <= 0.0f) return false;
+
+    /* Pass 3: Hann-fönstrat FFT-fönster från toppen, nollutfyllt */
+    uint16_t len = (uint16_t)(n - ord_pk);
+    if (len > DAMP_FFT_N) len = DAMP_FFT_N;
+    if (len < 64U) return false;
+    memset(s_fft, 0, sizeof(s_fft));
+    ord = 0;
+    for (uint16_t i = 0, j = 0; i < count && j < len; ++i) {
+        if (!get(i, &v, user)) continue;
+        if (ord++ < ord_pk) continue;
+        const float w = 0.5f - 0.5f * cosf(2.0f * DAMP_PI * (float)j / (float)(len - 1U));
+        s_fft[j++] = (v - mean) * w;
+    }
+    rfft_packed(s_fft);
+
+    /* Toppbin (utan DC-läckaget i bin 0..1), gaussisk interpolation med grannarna */
+    uint16_t kpk = 2;
+    float ppk = bin_pow(s_fft, 2);
+    for (uint16_t k = 3; k < DAMP_FFT_N / 2U - 1U; ++k) {
+        const float p = bin_pow(s_fft, k);
+        if (p > ppk) { ppk = p; kpk = k; }
+    }
+    if (ppk <= 0.0f) return false;
+    float frac = 0.0f;
+    const float la = logf(fmaxf(bin_pow(s_fft, (uint16_t)(kpk - 1U)), 1e-30f));
+    const float lb = logf(ppk);
+    const float lc = logf(fmaxf(bin_pow(s_fft, (uint16_t)(kpk + 1U)), 1e-30f));
+    const float den = la - 2.0f * lb + lc;
+    if (den < 0.0f) {
+        frac = 0.5f * (la - lc) / den;
+        if (frac > 0.5f) frac = 0.5f;
+        if (frac < -0.5f) frac = -0.5f;
+    }
+    out->f_hz = ((float)kpk + frac) * fs_hz / (float)DAMP_FFT_N;
+
+    /* Pass 4: envelope, största |avvikelse| i varje period kring de väntade
+     * topparna (period 0 är halva, från toppen). En ofullständig sista period tas inte med. */
+    const float period = fs_hz / out->f_hz;
+    float sx = 0.0f, sy = 0.0f, sxx = 0.0f, sxy = 0.0f;
+    float a0 = 0.0f, a_max = 0.0f;
+    uint16_t cyc = 0;
+    uint16_t m = 0;
+    ord = 0;
+    for (uint16_t i = 0; i < count && m < DAMP_MAX_CYCLES; ++i) {
+        if (!get(i, &v, user)) continue;
+        if (ord++ < ord_pk) continue;
+        const uint16_t c = (uint16_t)(((float)(ord - 1U - ord_pk) + 0.5f * period) / period);
+        if (c != cyc) {
+            if (cyc == 0U) a0 = a_max;
+            if (a_max < a0 * DAMP_ENV_FLOOR || a_max <= 0.0f) break;
+            const float x = (float)cyc, y = logf(a_max);
+            sx += x; sy += y; sxx += x * x; sxy += x * y;
+            m++;
+            cyc = c;
+            a_max = 0.0f;
+        }
+        const float a = fabsf(v - mean);
+        if (a > a_max) a_max = a;
+    }
+    out->amp0 = a0;
+    out->cycles = m;
+    if (m < DAMP_MIN_CYCLES) return false;
+    const float dd = (float)m * sxx - sx * sx;
+    out->delta = (dd > 0.0f) ? -((float)m * sxy - sx * sy) / dd : 0.0f;
+    const float d = fmaxf(out->delta, 0.0f);
+    out->zeta = d / sqrtf(4.0f * DAMP_PI * DAMP_PI + d * d);
+    out->ok = true;
+    return true;
+}
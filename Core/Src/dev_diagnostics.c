@@ -3,17 +3,25 @@
 #include "comm.h"
 #include "telemetry.h"
 #include "api_schema.h"
-#include "sensor_hal.h" // För Sensor_StartSampling, Sensor_StopSampling, sample_ring_head/tail, OCH I2CState_t
+#include "sensor_hal.h" // För Sensor_StartSampling, Sensor_StopSampling, Sensor_RingCount, OCH I2CState_t
+#include "sensor_bus.h" // Registeråtkomst oberoende av I2C/SPI-backend
 #include "gpio.h"       // För ADXL345_INT1_GPIO_Port, ADXL345_INT1_Pin
 #include "tim.h"        // För TIM3_IRQn
 #include "usart.h"      // För USART2_IRQn, DMA1_Stream6_IRQn
+#include "timebase.h"   // För Timebase_NowUs64 i FMT-benchmarken
+#include "fmt.h"
+#include "prof.h"             // Prof_Cycles, PROF_DRAIN
+#include "protocol_crc16.h"
+#include "burst_mgr.h"        // BurstManager_BenchLines, BurstManager_StartBench
+#include "transport_blocks.h" // TB_GetBlockLines
+#include "app_rtos.h"         // APP_WAIT_EVENT
+#include "sched.h"            // Sched_ArmTimeout
 // #include "i2c.h"     // FIX: Borttagen, felaktig include. Definitionen finns i sensor_hal.h
 
 #include <stdio.h>
 #include <string.h>
 
 // --- ADXL345 Register Constants (för felsökning) ---
-#define ACCEL_SENSOR_ADDR (0x53 << 1)
 #define ACCEL_REG_DEVID 0x00
 #define ACCEL_REG_DATA_FORMAT 0x31
 #define ACCEL_REG_INT_ENABLE  0x2E
@@ -31,6 +39,7 @@ static void Test_EXTI_State(AppContext_t* ctx);
 static void Test_DMA_State(AppContext_t* ctx);
 static void Test_Sampling_Integrity(AppContext_t* ctx);
 static void Test_NVIC_Priorities(AppContext_t* ctx); // NYTT
+static void Test_Fmt(AppContext_t* ctx);
 static void Diagnostics_Callback_Chain(AppContext_t* ctx); // NYTT (DEBUG)
 
 // --- Public Main Test Runner ---\n
@@ -43,6 +52,7 @@ void DevDiag_RunAllTests(AppContext_t* ctx) {
     Test_DMA_State(ctx);
     Test_NVIC_Priorities(ctx); // NYTT TEST
     Test_Sampling_Integrity(ctx);
+    Test_Fmt(ctx);
     Diagnostics_Callback_Chain(ctx); // NYTT (DEBUG)
 
     COMM_SendLine("DIAG_END,msg=\"Diagnostics complete\"");
@@ -53,7 +63,7 @@ void DevDiag_RunAllTests(AppContext_t* ctx) {
 static void Test_I2C_DevID(AppContext_t* ctx) {
     uint8_t devid = 0;
     char val_str[16];
-    HAL_StatusTypeDef status = HAL_I2C_Mem_Read(ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_DEVID, I2C_MEMADD_SIZE_8BIT, &devid, 1, 100);
+    HAL_StatusTypeDef status = SensorBus_ReadRegs(0, ACCEL_REG_DEVID, &devid, 1, 100);
     
     snprintf(val_str, sizeof(val_str), "0x%02X", devid);
     bool pass = (status == HAL_OK) && (devid == 0xE5);
@@ -61,7 +71,7 @@ static void Test_I2C_DevID(AppContext_t* ctx) {
     DIAG_SEND_RESULT("I2C_DEVID", "ADXL345 Device ID (0xE5)", val_str, pass);
     
     snprintf(val_str, sizeof(val_str), "%u", status);
-    DIAG_SEND_RESULT("I2C_STATUS", "HAL_I2C_Mem_Read Status", val_str, status == HAL_OK);
+    DIAG_SEND_RESULT("I2C_STATUS", "SensorBus_ReadRegs Status", val_str, status == HAL_OK);
 }
 
 static void Test_ADXL_Configuration(AppContext_t* ctx) {
@@ -70,31 +80,31 @@ static void Test_ADXL_Configuration(AppContext_t* ctx) {
     HAL_StatusTypeDef status;
     
     // 1. DATA_FORMAT (0x31) - Förväntas vara 0x0B (FULL_RES=1, INT_INVERT=1, Range=16g)
-    status = HAL_I2C_Mem_Read(ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_DATA_FORMAT, I2C_MEMADD_SIZE_8BIT, &reg_val[0], 1, 100);
+    status = SensorBus_ReadRegs(0, ACCEL_REG_DATA_FORMAT, &reg_val[0], 1, 100);
     snprintf(val_str, sizeof(val_str), "0x%02X", reg_val[0]);
     bool pass_df = (status == HAL_OK) && (reg_val[0] == 0x0B);
     DIAG_SEND_RESULT("ADXL_DF", "DATA_FORMAT (0x0B expected)", val_str, pass_df);
 
     // 2. BW_RATE (0x2C) - Förväntas vara 0x0D (800 Hz)
-    status = HAL_I2C_Mem_Read(ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_BW_RATE, I2C_MEMADD_SIZE_8BIT, &reg_val[1], 1, 100);
+    status = SensorBus_ReadRegs(0, ACCEL_REG_BW_RATE, &reg_val[1], 1, 100);
     snprintf(val_str, sizeof(val_str), "0x%02X", reg_val[1]);
     bool pass_br = (status == HAL_OK) && (reg_val[1] == 0x0D);
     DIAG_SEND_RESULT("ADXL_BR", "BW_RATE (0x0D for 800Hz expected)", val_str, pass_br);
 
     // 3. INT_ENABLE (0x2E) - Förväntas vara 0x02 (WATERMARK enabled)
-    status = HAL_I2C_Mem_Read(ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_INT_ENABLE, I2C_MEMADD_SIZE_8BIT, &reg_val[2], 1, 100);
+    status = SensorBus_ReadRegs(0, ACCEL_REG_INT_ENABLE, &reg_val[2], 1, 100);
     snprintf(val_str, sizeof(val_str), "0x%02X", reg_val[2]);
     bool pass_ie = (status == HAL_OK) && (reg_val[2] == 0x02);
     DIAG_SEND_RESULT("ADXL_IE", "INT_ENABLE (0x02 for WATERMARK expected)", val_str, pass_ie);
 
     // 4. FIFO_CTL (0x38) - Förväntas vara 0x9F (Stream Mode, Watermark=31)
-    status = HAL_I2C_Mem_Read(ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_FIFO_CTL, I2C_MEMADD_SIZE_8BIT, &reg_val[3], 1, 100);
+    status = SensorBus_ReadRegs(0, ACCEL_REG_FIFO_CTL, &reg_val[3], 1, 100);
     snprintf(val_str, sizeof(val_str), "0x%02X", reg_val[3]);
     bool pass_fc = (status == HAL_OK) && (reg_val[3] == 0x9F);
     DIAG_SEND_RESULT("ADXL_FC", "FIFO_CTL (0x9F for Stream/WM=31 expected)", val_str, pass_fc);
     
     // 5. POWER_CTL (0x2D) - Förväntas vara 0x08 (Measure=1)
-    status = HAL_I2C_Mem_Read(ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_POWER_CTL, I2C_MEMADD_SIZE_8BIT, &reg_val[4], 1, 100);
+    status = SensorBus_ReadRegs(0, ACCEL_REG_POWER_CTL, &reg_val[4], 1, 100);
     snprintf(val_str, sizeof(val_str), "0x%02X", reg_val[4]);
     bool pass_pc = (status == HAL_OK) && ((reg_val[4] & 0x08) == 0x08);
     DIAG_SEND_RESULT("ADXL_PC", "POWER_CTL (Measure=1 expected)", val_str, pass_pc);
@@ -124,15 +134,14 @@ static void Test_EXTI_State(AppContext_t* ctx) {
 static void Test_DMA_State(AppContext_t* ctx) {
     char val_str[32];
     
-    // Kontrollera I2C DMA RX-tillstånd (Stream 2/3)
-    // Antar att hi2c1->hdmarx är det korrekta handtaget
-    // OBS: hi2c1->hdmarx är inte definierad i i2c.h/i2c.c, men vi antar att det är länkat i HAL_I2C_MspInit
-    if (ctx->hi2c1->hdmarx == NULL) {
-        DIAG_SEND_RESULT("I2C_DMA_RX", "I2C DMA RX Handle", "NULL", false);
+    // Kontrollera sensorbussens DMA RX-tillstånd (I2C1: DMA1 Stream0, SPI2: DMA1 Stream3)
+    DMA_HandleTypeDef* hdma_rx = SensorBus_GetRxDma();
+    if (hdma_rx == NULL) {
+        DIAG_SEND_RESULT("I2C_DMA_RX", "Sensor bus DMA RX Handle", "NULL", false);
         return;
     }
     
-    HAL_DMA_StateTypeDef dma_state = HAL_DMA_GetState(ctx->hi2c1->hdmarx);
+    HAL_DMA_StateTypeDef dma_state = HAL_DMA_GetState(hdma_rx);
     
     switch (dma_state) {
         case HAL_DMA_STATE_READY: snprintf(val_str, sizeof(val_str), "READY"); break;
@@ -143,7 +152,7 @@ static void Test_DMA_State(AppContext_t* ctx) {
     
     // Förväntas vara READY i IDLE-läge
     bool pass = (dma_state == HAL_DMA_STATE_READY);
-    DIAG_SEND_RESULT("I2C_DMA_RX", "I2C DMA RX State (READY expected)", val_str, pass);
+    DIAG_SEND_RESULT("I2C_DMA_RX", "Sensor bus DMA RX State (READY expected)", val_str, pass);
 }
 
 
@@ -160,18 +169,9 @@ static void Test_Sampling_Integrity(AppContext_t* ctx) {
     Sensor_StopSampling(ctx);
     
     // 4. Kontrollera ringbufferten
-    uint16_t samples_in_rb = 0;
-    __disable_irq();
-    // sample_ring_head och sample_ring_tail är nu globala (ej static)
-    if (sample_ring_head >= sample_ring_tail) {
-        samples_in_rb = sample_ring_head - sample_ring_tail;
-    } else {
-        samples_in_rb = SAMPLE_RING_BUFFER_SIZE - (sample_ring_tail - sample_ring_head);
-    }
+    uint16_t samples_in_rb = Sensor_RingCount();
     // Återställ ringbuffert
-    sample_ring_head = 0;
-    sample_ring_tail = 0;
-    __enable_irq();
+    Sensor_FlushSamples();
     
     char val_str[32];
     snprintf(val_str, sizeof(val_str), "%u", samples_in_rb);
@@ -181,6 +181,50 @@ static void Test_Sampling_Integrity(AppContext_t* ctx) {
     DIAG_SEND_RESULT("RB_SAMPLES", "Samples in RingBuffer (Expected > 10)", val_str, pass);
 }
 
+// fmt.h mot snprintf: byte-identiskt över självtestets svep, och tidsåtgång
+// för samma DATA-rader (µs för FMT_BENCH_LINES rader, fmt:snprintf).
+#define FMT_BENCH_LINES 256u
+
+static void Test_Fmt(AppContext_t* ctx) {
+    (void)ctx;
+    char val_str[32];
+    const uint32_t bad = fmt_selftest();
+    snprintf(val_str, sizeof(val_str), "%lu", (unsigned long)bad);
+    DIAG_SEND_RESULT("FMT_EXACT", "fmt vs snprintf mismatches (0 expected)", val_str, bad == 0u);
+
+    char a[PROTO_MAX_LINE];
+    char b[PROTO_MAX_LINE];
+    uint32_t diff = 0;
+    uint64_t t_fmt = 0, t_printf = 0;
+    for (uint32_t i = 0; i < FMT_BENCH_LINES; i++) {
+        const uint64_t ts = 123456789ULL + i * 1250ULL;
+        const float ax = (float)((int32_t)(i * 37u % 1024u) - 512) * 0.0383f;
+        const float ay = -ax * 0.5f + 0.001f * (float)i;
+        const float az = 9.80665f + ax * 0.01f;
+
+        uint64_t t0 = Timebase_NowUs64();
+        char* p = fmt_str(a, "DATA,");
+        p = fmt_u64(p, ts);
+        *p++ = ','; p = fmt_f3(p, ax);
+        *p++ = ','; p = fmt_f3(p, ay);
+        *p++ = ','; p = fmt_f3(p, az);
+        p = fmt_str(p, ",0.000,");
+        p = fmt_u32(p, i & 1u);
+        p = fmt_str(p, PROTO_EOL);
+        uint64_t t1 = Timebase_NowUs64();
+        int n = snprintf(b, sizeof(b), "DATA,%llu,%.3f,%.3f,%.3f,%.3f,%u" PROTO_EOL,
+                         (unsigned long long)ts, ax, ay, az, 0.0f, (unsigned)(i & 1u));
+        uint64_t t2 = Timebase_NowUs64();
+
+        t_fmt += t1 - t0;
+        t_printf += t2 - t1;
+        if (n != (int)(p - a) || memcmp(a, b, (size_t)(p - a)) != 0) diff++;
+    }
+    snprintf(val_str, sizeof(val_str), "%lu:%lu", (unsigned long)t_fmt, (unsigned long)t_printf);
+    DIAG_SEND_RESULT("FMT_BENCH", "DATA lines us fmt:snprintf (fmt faster expected)", val_str,
+                     diff == 0u && t_fmt < t_printf);
+}
+
 static void Test_NVIC_Priorities(AppContext_t* ctx) {
     (void)ctx;
     char val_str[32];
@@ -224,7 +268,12 @@ static void Test_NVIC_Priorities(AppContext_t* ctx) {
     // CRITICAL: Verify ISR-001 deployment
     
     // 5. I2C1_EV_IRQn (I2C Event) - Förväntad prioritet: 3
+#if SENSOR_BUS_USE_SPI
+    // SPI-backend: SPI2 global IRQ ersätter I2C1_EV, SPI2 TX DMA ersätter I2C1_ER
+    HAL_NVIC_GetPriority(SPI2_IRQn, priority_group, &preempt_prio, &sub_prio);
+#else
     HAL_NVIC_GetPriority(I2C1_EV_IRQn, priority_group, &preempt_prio, &sub_prio);
+#endif
     uint32_t prio_i2c_ev = preempt_prio;
     snprintf(val_str, sizeof(val_str), "%lu", (unsigned long)prio_i2c_ev);
     bool pass_i2c_ev = (prio_i2c_ev == 3);
@@ -232,7 +281,11 @@ static void Test_NVIC_Priorities(AppContext_t* ctx) {
     //if (!pass_i2c_ev) overall_pass = false;
 
     // 6. I2C1_ER_IRQn (I2C Error) - Förväntad prioritet: 3
+#if SENSOR_BUS_USE_SPI
+    HAL_NVIC_GetPriority(DMA1_Stream4_IRQn, priority_group, &preempt_prio, &sub_prio);
+#else
     HAL_NVIC_GetPriority(I2C1_ER_IRQn, priority_group, &preempt_prio, &sub_prio);
+#endif
     uint32_t prio_i2c_er = preempt_prio;
     snprintf(val_str, sizeof(val_str), "%lu", (unsigned long)prio_i2c_er);
     bool pass_i2c_er = (prio_i2c_er == 3);
@@ -240,7 +293,11 @@ static void Test_NVIC_Priorities(AppContext_t* ctx) {
     //if (!pass_i2c_er) overall_pass = false;
 
     // 7. DMA1_Stream0_IRQn (I2C RX DMA) - Förväntad prioritet: 3
+#if SENSOR_BUS_USE_SPI
+    HAL_NVIC_GetPriority(DMA1_Stream3_IRQn, priority_group, &preempt_prio, &sub_prio);
+#else
     HAL_NVIC_GetPriority(DMA1_Stream0_IRQn, priority_group, &preempt_prio, &sub_prio);
+#endif
     uint32_t prio_dma_rx = preempt_prio;
     snprintf(val_str, sizeof(val_str), "%lu", (unsigned long)prio_dma_rx);
     bool pass_dma_rx = (prio_dma_rx == 3);
@@ -271,7 +328,7 @@ static void Diagnostics_Callback_Chain(AppContext_t* ctx) {
     char val_str[32]; // FIX: Buffer för att formatera numeriska värden
     
     // FIX: Rensat bort lokala extern-deklarationer.
-    // Alla variabler (g_debug_..., g_i2c_state, g_sampling_active)
+    // Alla variabler (g_debug_..., drain-tillstånd, g_sampling_active)
     // inkluderas nu korrekt via sensor_hal.h.
     
     // EXTI callback diagnostics
@@ -335,22 +392,28 @@ static void Diagnostics_Callback_Chain(AppContext_t* ctx) {
                            val_str,
                            (g_debug_samples_processed > 0) ? "PASS" : "FAIL");
     
-    // State machine diagnostic
-    const char* state_str;
-    switch(g_i2c_state) {
-        case I2C_STATE_IDLE: state_str = "IDLE"; break;
-        case I2C_STATE_WAIT_FIFO_DATA: state_str = "WAIT_FIFO"; break;
-        case I2C_STATE_DRAIN_STATUS: state_str = "DRAIN_STATUS"; break;
-        case I2C_STATE_CLEAR_INT_SOURCE: state_str = "CLEAR_INT"; break;
-        default: state_str = "UNKNOWN"; break;
+    // State machine diagnostic, en rad per sensor
+    for (uint8_t i = 0; i < Sensor_DeviceCount(); i++) {
+        I2CState_t state = Sensor_GetDrainState(i);
+        const char* state_str;
+        switch(state) {
+            case I2C_STATE_IDLE: state_str = "IDLE"; break;
+            case I2C_STATE_WAIT_FIFO_DATA: state_str = "WAIT_FIFO"; break;
+            case I2C_STATE_DRAIN_STATUS: state_str = "DRAIN_STATUS"; break;
+            case I2C_STATE_PARKED: state_str = "PARKED"; break;
+            case I2C_STATE_INT_SOURCE: state_str = "INT_SOURCE"; break;
+            case I2C_STATE_GATE_DROP: state_str = "GATE_DROP"; break;
+            default: state_str = "UNKNOWN"; break;
+        }
+
+        COMM_SendfLine("DIAG_RES,test=%s,desc=\"%s\",val=%s,sensor=%u,pass=%s",
+                               "DEBUG_I2C_STATE",
+                               "I2C State Machine",
+                               state_str,
+                               (unsigned)i,
+                               (state == I2C_STATE_IDLE) ? "PASS" : "WARN");
     }
     
-    COMM_SendfLine("DIAG_RES,test=%s,desc=\"%s\",val=%s,pass=%s", 
-                           "DEBUG_I2C_STATE", 
-                           "I2C State Machine", 
-                           state_str,
-                           (g_i2c_state == I2C_STATE_IDLE) ? "PASS" : "WARN");
-    
     COMM_SendfLine("DIAG_RES,test=%s,desc=\"%s\",val=%s,pass=%s", 
                            "DEBUG_SAMPLING_ACTIVE", 
                            "Sampling Active Flag", 
@@ -371,4 +434,244 @@ static void Diagnostics_Callback_Chain(AppContext_t* ctx) {
                            "Ring Buffer Overflow Count", 
                            val_str,
                            (ctx->diag.ring_ovf == 0) ? "PASS" : "WARN");
-}
\ No newline at end of file
+}
+
+// ============================================================================
+// BENCH
+// ============================================================================
+// Samma mätning på samma sätt varje gång, så att värdena kan jämföras mellan
+// firmwareversioner på riktig hårdvara. Mikrotesterna räknar CYCCNT-cykler med
+// avbrotten påslagna (sensorn står still i IDLE); TX- och dräneringstesterna
+// mäter mot klockan.
+
+#define BENCH_CRC_BYTES      4096u
+#define BENCH_CRC_REPS       16u
+#define BENCH_SENDF_LINES    32u
+#define BENCH_TX_BYTES       16384u
+#define BENCH_TX_LINE        64u
+#define BENCH_DRAIN_BATCHES  16u
+#define BENCH_DRAIN_MIN_MS   100u
+#define BENCH_DRAIN_MAX_MS   2000u
+
+static const struct {
+    const char* name;
+    uint8_t bit;
+} s_bench_tests[] = {
+    { "crc16",    DEVDIAG_BENCH_CRC16 },
+    { "dataline", DEVDIAG_BENCH_DATALINE },
+    { "sendf",    DEVDIAG_BENCH_SENDF },
+    { "txdrain",  DEVDIAG_BENCH_TXDRAIN },
+    { "drain",    DEVDIAG_BENCH_DRAIN },
+    { "burst",    DEVDIAG_BENCH_BURST },
+    { "all",      DEVDIAG_BENCH_ALL },
+};
+
+static const uint16_t s_bench_odr[] = { 100, 200, 400, 800, 1600, 3200 };
+
+static uint8_t s_bench_buf[BENCH_CRC_BYTES];
+static volatile uint32_t s_bench_sink;   // håller kvar resultaten så att loopen inte optimeras bort
+
+static struct {
+    bool active;
+    bool captured;
+    char name[12];
+    uint32_t t0_ms;
+    uint32_t capture_ms;
+    uint32_t bytes0;
+} s_bench_burst;
+
+uint8_t DevDiag_BenchMask(const char* name) {
+    if (name == NULL) return DEVDIAG_BENCH_ALL;
+    for (size_t i = 0; i < sizeof(s_bench_tests) / sizeof(s_bench_tests[0]); i++) {
+        if (strcmp(name, s_bench_tests[i].name) == 0) return s_bench_tests[i].bit;
+    }
+    return 0;
+}
+
+bool DevDiag_BenchBusy(void) {
+    return s_bench_burst.active;
+}
+
+static uint32_t Bench_PerSecond(uint64_t amount, uint64_t per, uint64_t unit_hz) {
+    return (per > 0u) ? (uint32_t)((amount * unit_hz) / per) : 0u;
+}
+
+static void Bench_Crc16(uint32_t cpu_hz) {
+    uint32_t x = 0x12345678u;
+    for (uint32_t i = 0; i < BENCH_CRC_BYTES; i++) {
+        x = x * 1664525u + 1013904223u;
+        s_bench_buf[i] = (uint8_t)(x >> 24);
+    }
+    uint32_t acc = 0;
+    const uint32_t t0 = Prof_Cycles();
+    for (uint32_t r = 0; r < BENCH_CRC_REPS; r++) {
+        acc += proto_crc16_buf(s_bench_buf, BENCH_CRC_BYTES);
+    }
+    const uint32_t cyc = (Prof_Cycles() - t0) / BENCH_CRC_REPS;
+    s_bench_sink = acc;
+    COMM_SendfLine(MSG_BENCH_RES ",test=crc16,bytes=%u,reps=%u,cyc=%lu,Bps=%lu",
+                   (unsigned)BENCH_CRC_BYTES, (unsigned)BENCH_CRC_REPS, (unsigned long)cyc,
+                   (unsigned long)Bench_PerSecond(BENCH_CRC_BYTES, cyc, cpu_hz));
+}
+
+// Ett block med TB:s aktuella blockstorlek, som i en riktig DATA-dump.
+static void Bench_DataLine(void) {
+    const uint16_t lines = TB_GetBlockLines();
+    const uint32_t t0 = Prof_Cycles();
+    const int32_t bytes = BurstManager_BenchLines(lines);
+    const uint32_t cyc = Prof_Cycles() - t0;
+    if (bytes < 0 || lines == 0u) {
+        COMM_SendfLine(MSG_BENCH_RES ",test=dataline,lines=0,bytes=0,cyc=0");
+        return;
+    }
+    COMM_SendfLine(MSG_BENCH_RES ",test=dataline,lines=%u,bytes=%lu,cyc=%lu",
+                   (unsigned)lines, (unsigned long)bytes, (unsigned long)(cyc / lines));
+}
+
+// Formatering och köning i ringen; väntan på plats ligger före mätningen.
+static void Bench_Sendf(void) {
+    (void)COMM_TxWaitFree(BENCH_SENDF_LINES * BENCH_TX_LINE, COMM_TX_BLOCK_TIMEOUT_MS);
+    const uint32_t t0 = Prof_Cycles();
+    for (uint32_t i = 0; i < BENCH_SENDF_LINES; i++) {
+        COMM_Sendf(MSG_BENCH_FILL ",i=%lu,ts=%lu,q=%u,name=%s" PROTO_EOL,
+                   (unsigned long)i, (unsigned long)(t0 + i * 1250u), (unsigned)(i & 7u), "sendf");
+    }
+    const uint32_t cyc = (Prof_Cycles() - t0) / BENCH_SENDF_LINES;
+    COMM_SendfLine(MSG_BENCH_RES ",test=sendf,lines=%u,cyc=%lu",
+                   (unsigned)BENCH_SENDF_LINES, (unsigned long)cyc);
+}
+
+static bool Bench_WaitTxIdle(uint32_t timeout_ms) {
+    const uint32_t t0 = HAL_GetTick();
+    while (!COMM_TxIsIdle()) {
+        if ((HAL_GetTick() - t0) >= timeout_ms) return false;
+        APP_WAIT_EVENT();
+    }
+    return true;
+}
+
+// Ringen hålls full med BENCH_FILL-rader tills BENCH_TX_BYTES är köade; tiden
+// räknas till sista spannet är ute, och bytes är det som faktiskt gick iväg.
+static void Bench_TxDrain(void) {
+    char line[BENCH_TX_LINE];
+    memset(line, 'x', sizeof(line));
+    memcpy(line, MSG_BENCH_FILL ",", sizeof(MSG_BENCH_FILL));
+    memcpy(&line[BENCH_TX_LINE - PROTO_EOL_LEN], PROTO_EOL, PROTO_EOL_LEN);
+
+    (void)Bench_WaitTxIdle(COMM_TX_BLOCK_TIMEOUT_MS);
+    const uint32_t bytes0 = COMM_TxSentBytes();
+    const uint64_t t0 = Timebase_NowUs64();
+    for (uint32_t n = 0; n < BENCH_TX_BYTES; n += BENCH_TX_LINE) {
+        if (Telemetry_WriteBlocking(line, sizeof(line)) == 0u) break;
+    }
+    (void)Bench_WaitTxIdle(COMM_TX_BLOCK_TIMEOUT_MS);
+    const uint32_t us = (uint32_t)(Timebase_NowUs64() - t0);
+    const uint32_t bytes = COMM_TxSentBytes() - bytes0;
+#if COMM_USE_USB_CDC
+    const uint32_t expect = 0u;
+#else
+    const uint32_t expect = huart2.Init.BaudRate / 10u;   // 8N1
+#endif
+    COMM_SendfLine(MSG_BENCH_RES ",test=txdrain,bytes=%lu,us=%lu,Bps=%lu,expect_Bps=%lu",
+                   (unsigned long)bytes, (unsigned long)us,
+                   (unsigned long)Bench_PerSecond(bytes, us, 1000000u), (unsigned long)expect);
+}
+
+// FIFO-dränering per vattenmärkesbatch (PROF_DRAIN) vid varje ODR med burstens
+// vattenmärke. Samplen kastas efter hand så att ringarna inte svämmar över.
+static void Bench_Drain(AppContext_t* ctx, uint32_t cpu_hz) {
+    const uint32_t odr_before = ctx->cfg.odr_hz;
+    for (size_t k = 0; k < sizeof(s_bench_odr) / sizeof(s_bench_odr[0]); k++) {
+        const uint32_t odr = s_bench_odr[k];
+        ctx->cfg.odr_hz = odr;
+        Sensor_SetODR(ctx, odr);
+        Sensor_ReconfigureTimer(ctx, odr);
+        Sensor_SetConsumer(ctx, SENSOR_CONSUMER_BURST);
+        const uint32_t wm = Sensor_GetWatermark();
+        uint32_t ms = (BENCH_DRAIN_BATCHES * wm * 1000u) / odr;
+        if (ms < BENCH_DRAIN_MIN_MS) ms = BENCH_DRAIN_MIN_MS;
+        if (ms > BENCH_DRAIN_MAX_MS) ms = BENCH_DRAIN_MAX_MS;
+
+        Prof_ResetProbe(PROF_DRAIN);
+        Sensor_StartSampling(ctx);
+        const uint32_t t0 = HAL_GetTick();
+        while ((HAL_GetTick() - t0) < ms) {
+            HAL_Delay(1);
+            Sensor_FlushSamples();
+        }
+        Sensor_StopSampling(ctx);
+        Sensor_FlushSamples();
+
+        ProfStat_t st;
+        Prof_Get(PROF_DRAIN, &st);
+        const uint32_t mean = (st.n > 0u) ? (uint32_t)(st.sum / st.n) : 0u;
+        // Batchperioden är wm/odr sekunder, dvs. cpu_hz * wm / odr cykler
+        const uint64_t period = ((uint64_t)cpu_hz * wm) / odr;
+        const uint32_t load_pm = (period > 0u) ? (uint32_t)(((uint64_t)mean * 1000u) / period) : 0u;
+        COMM_SendfLine(MSG_BENCH_RES ",test=drain,odr_hz=%lu,wm=%lu,batches=%lu,cyc=%lu,cyc_max=%lu,load_pm=%lu",
+                       (unsigned long)odr, (unsigned long)wm, (unsigned long)st.n, (unsigned long)mean,
+                       (unsigned long)st.max, (unsigned long)load_pm);
+    }
+    ctx->cfg.odr_hz = odr_before;
+    Sensor_SetODR(ctx, odr_before);
+    Sensor_ReconfigureTimer(ctx, odr_before);
+    Sensor_SetConsumer(ctx, SENSOR_CONSUMER_NONE);
+    Prof_ResetProbe(PROF_DRAIN);
+}
+
+void DevDiag_Bench(AppContext_t* ctx, uint8_t mask, const char* name) {
+    const uint32_t cpu_hz = HAL_RCC_GetHCLKFreq();
+    if (name == NULL) name = "all";
+#if COMM_USE_USB_CDC
+    const uint32_t baud = 0u;
+#else
+    const uint32_t baud = huart2.Init.BaudRate;
+#endif
+    COMM_SendfLine(MSG_BENCH_START ",tests=%s,cpu_hz=%lu,baud=%lu", name,
+                   (unsigned long)cpu_hz, (unsigned long)baud);
+
+    if (mask & DEVDIAG_BENCH_CRC16)    Bench_Crc16(cpu_hz);
+    if (mask & DEVDIAG_BENCH_DATALINE) Bench_DataLine();
+    if (mask & DEVDIAG_BENCH_SENDF)    Bench_Sendf();
+    if (mask & DEVDIAG_BENCH_TXDRAIN)  Bench_TxDrain();
+    if (mask & DEVDIAG_BENCH_DRAIN)    Bench_Drain(ctx, cpu_hz);
+
+    if ((mask & DEVDIAG_BENCH_BURST) && BurstManager_StartBench(ctx, PROTO_BENCH_BURST_SAMPLES)) {
+        s_bench_burst.active = true;
+        s_bench_burst.captured = false;
+        snprintf(s_bench_burst.name, sizeof(s_bench_burst.name), "%s", name);
+        s_bench_burst.t0_ms = HAL_GetTick();
+        s_bench_burst.bytes0 = COMM_TxSentBytes();
+        return;   // BENCH_END kommer från DevDiag_BenchPump
+    }
+    COMM_SendfLine(MSG_BENCH_END ",tests=%s", name);
+}
+
+static void Bench_BurstDone(bool ok) {
+    const uint32_t now = HAL_GetTick();
+    const uint32_t total = now - s_bench_burst.t0_ms;
+    const uint32_t capture = s_bench_burst.captured ? s_bench_burst.capture_ms : total;
+    const uint32_t bytes = COMM_TxSentBytes() - s_bench_burst.bytes0;
+    s_bench_burst.active = false;
+    COMM_SendfLine(MSG_BENCH_RES ",test=burst,samples=%u,capture_ms=%lu,total_ms=%lu,bytes=%lu,Bps=%lu,ok=%u",
+                   (unsigned)PROTO_BENCH_BURST_SAMPLES, (unsigned long)capture, (unsigned long)total,
+                   (unsigned long)bytes, (unsigned long)Bench_PerSecond(bytes, total, 1000u),
+                   ok ? 1u : 0u);
+    COMM_SendfLine(MSG_BENCH_END ",tests=%s", s_bench_burst.name);
+}
+
+void DevDiag_BenchPump(AppContext_t* ctx) {
+    if (!s_bench_burst.active) return;
+    const uint32_t elapsed = HAL_GetTick() - s_bench_burst.t0_ms;
+    if (!s_bench_burst.captured && ctx->op_mode != OP_MODE_BURST) {
+        s_bench_burst.captured = true;
+        s_bench_burst.capture_ms = elapsed;
+    }
+    if (s_bench_burst.captured && ctx->op_mode == OP_MODE_IDLE && !BM_IsActive()) {
+        Bench_BurstDone(true);
+    } else if (elapsed >= PROTO_BENCH_BURST_TIMEOUT_MS) {
+        Bench_BurstDone(false);
+    } else {
+        Sched_ArmTimeout(PROTO_BENCH_BURST_TIMEOUT_MS - elapsed); // annars väcker ACK_COMPLETE (CMD)
+    }
+}
@@ -2,6 +2,7 @@
 #include "filter.h"
 #include <math.h>
 #include <string.h>
+#include <stdbool.h>
 
 /*
  * 2nd-order Butterworth low-pass biquad implemented with bilinear transform.
@@ -81,4 +82,121 @@ float Filter_Update(iir_filter_t* f, float input)
     return y;
 }
 
+/* --- Tre-axlig kaskad --- */
+
+#ifndef FILTER_USE_CMSIS_DSP
+#define FILTER_USE_CMSIS_DSP 0
+#endif
+
+#if FILTER_USE_CMSIS_DSP
+#include "arm_math.h"
+#endif
+
+/* En Butterworth-sektion (Q = 1/sqrt(2)); c = b0, b1, b2, -a1, -a2. */
+static void _section(float* c, bool highpass, float fc_hz, float fs_hz)
+{
+    if (fc_hz > 0.49f * fs_hz) fc_hz = 0.49f * fs_hz;
+    if (fc_hz < 0.001f * fs_hz) fc_hz = 0.001f * fs_hz;
+    const float PI = 3.14159265358979323846f;
+    const float k = tanf(PI * fc_hz / fs_hz);
+    const float k2 = k * k;
+    const float sqrt2 = 1.4142135623730951f;
+    const float norm = 1.0f / (1.0f + sqrt2 * k + k2);
+    const float g = highpass ? norm : k2 * norm;
+    c[0] = g;
+    c[1] = highpass ? -2.0f * g : 2.0f * g;
+    c[2] = g;
+    c[3] = -2.0f * (k2 - 1.0f) * norm;
+    c[4] = -(1.0f - sqrt2 * k + k2) * norm;
+}
+
+void Filter_CascadeDesign(filter_cascade_t* c, filter_type_t type, float f1_hz, float f2_hz,
+                          uint8_t n, float fs_hz)
+{
+    if (!c) return;
+    if (n < 1u) n = 1u;
+    if (n > FILTER_CASCADE_N_MAX) n = FILTER_CASCADE_N_MAX;
+    uint8_t k = 0;
+    if (fs_hz > 0.0f) {
+        for (uint8_t i = 0; i < n; ++i, ++k) {
+            const bool hp = (type != FILTER_LOWPASS);
+            _section(c->coef[k], hp, f1_hz, fs_hz);
+            c->dc_gain[k] = hp ? 0.0f : 1.0f;
+        }
+        for (uint8_t i = 0; type == FILTER_BANDPASS && i < n; ++i, ++k) {
+            _section(c->coef[k], false, f2_hz, fs_hz);
+            c->dc_gain[k] = 1.0f;
+        }
+    }
+    c->n_stages = k;
+}
+
+void Filter_CascadeSeed(const filter_cascade_t* c, filter_xyz_state_t* s, const float v0[3])
+{
+    if (!c || !s) return;
+    float in[3] = { v0[0], v0[1], v0[2] };
+    for (uint8_t k = 0; k < c->n_stages; ++k) {
+        for (uint8_t a = 0; a < 3u; ++a) {
+            const float out = in[a] * c->dc_gain[k];
+            s->h[k][0][a] = in[a];
+            s->h[k][1][a] = in[a];
+            s->h[k][2][a] = out;
+            s->h[k][3][a] = out;
+            in[a] = out;
+        }
+    }
+}
+
+#if FILTER_USE_CMSIS_DSP
+
+/* Per axel genom arm_biquad_cascade_df1_f32. pState är {x1, x2, y1, y2} per
+ * sektion, samma historik som h[][][a]; den kopieras in och ut per anrop så att
+ * seed och tillstånd förblir gemensamma med in-tree-vägen. */
+void Filter_CascadeRun(const filter_cascade_t* c, filter_xyz_state_t* s, float* xyz, uint16_t n)
+{
+    if (!c || !s || !xyz || c->n_stages == 0u) return;
+    if (n > FILTER_BLOCK_MAX) n = FILTER_BLOCK_MAX;
+    float buf_in[FILTER_BLOCK_MAX];
+    float buf_out[FILTER_BLOCK_MAX];
+    float st[4u * FILTER_CASCADE_STAGES];
+    arm_biquad_casd_df1_inst_f32 inst;
+    for (uint8_t a = 0; a < 3u; ++a) {
+        for (uint8_t k = 0; k < c->n_stages; ++k) {
+            for (uint8_t j = 0; j < 4u; ++j) st[4u * k + j] = s->h[k][j][a];
+        }
+        arm_biquad_cascade_df1_init_f32(&inst, c->n_stages, (float32_t*)&c->coef[0][0], st);
+        for (uint16_t i = 0; i < n; ++i) buf_in[i] = xyz[3u * i + a];
+        arm_biquad_cascade_df1_f32(&inst, buf_in, buf_out, n);
+        for (uint16_t i = 0; i < n; ++i) xyz[3u * i + a] = buf_out[i];
+        for (uint8_t k = 0; k < c->n_stages; ++k) {
+            for (uint8_t j = 0; j < 4u; ++j) s->h[k][j][a] = st[4u * k + j];
+        }
+    }
+}
+
+#else
+
+void Filter_CascadeRun(const filter_cascade_t* c, filter_xyz_state_t* s, float* xyz, uint16_t n)
+{
+    if (!c || !s || !xyz) return;
+    if (n > FILTER_BLOCK_MAX) n = FILTER_BLOCK_MAX;
+    for (uint16_t i = 0; i < n; ++i) {
+        float* v = &xyz[3u * i];
+        for (uint8_t k = 0; k < c->n_stages; ++k) {
+            const float* q = c->coef[k];
+            float (*h)[3] = s->h[k];
+            /* Tre oberoende rekursioner per sektion: FPU:n överlappar dem */
+            for (uint8_t a = 0; a < 3u; ++a) {
+                float y = q[0] * v[a] + q[1] * h[0][a] + q[2] * h[1][a] + q[3] * h[2][a] + q[4] * h[3][a];
+                if (_fabsf(y) < 1e-30f) y = 0.0f;
+                h[1][a] = h[0][a]; h[0][a] = v[a];
+                h[3][a] = h[2][a]; h[2][a] = y;
+                v[a] = y;
+            }
+        }
+    }
+}
+
+#endif /* FILTER_USE_CMSIS_DSP */
+
 /* filename: Core/Src/filter.c */
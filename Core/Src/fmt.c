@@ -0,0 +1,174 @@
+/* filename: Core/Src/fmt.c */
+#include "fmt.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+char* fmt_u32(char* p, uint32_t v)
+{
+    char tmp[FMT_U32_MAX];
+    int n = 0;
+    do {
+        tmp[n++] = (char)('0' + (v % 10u));
+        v /= 10u;
+    } while (v != 0u);
+    while (n > 0) *p++ = tmp[--n];
+    return p;
+}
+
+char* fmt_i32(char* p, int32_t v)
+{
+    if (v < 0) {
+        *p++ = '-';
+        return fmt_u32(p, 0u - (uint32_t)v);   /* även INT32_MIN */
+    }
+    return fmt_u32(p, (uint32_t)v);
+}
+
+char* fmt_u64(char* p, uint64_t v)
+{
+    if (v <= UINT32_MAX) return fmt_u32(p, (uint32_t)v);
+    /* En 64-bitars division per nio siffror, resten i 32 bitar. */
+    uint32_t part[3];
+    int k = 0;
+    while (v > UINT32_MAX) {
+        part[k++] = (uint32_t)(v % 1000000000u);
+        v /= 1000000000u;
+    }
+    p = fmt_u32(p, (uint32_t)v);
+    while (k > 0) {
+        uint32_t r = part[--k];
+        for (int i = 8; i >= 0; --i) {
+            p[i] = (char)('0' + (r % 10u));
+            r /= 10u;
+        }
+        p += 9;
+    }
+    return p;
+}
+
+/* n tusendelar som "i.fff". */
+static char* _put_milli(char* p, uint64_t n)
+{
+    p = fmt_u64(p, n / 1000u);
+    uint32_t f = (uint32_t)(n % 1000u);
+    p[0] = '.';
+    p[1] = (char)('0' + f / 100u);
+    p[2] = (char)('0' + (f / 10u) % 10u);
+    p[3] = (char)('0' + f % 10u);
+    return p + 4;
+}
+
+char* fmt_milli(char* p, int64_t milli)
+{
+    if (milli < 0) {
+        *p++ = '-';
+        return _put_milli(p, 0u - (uint64_t)milli);
+    }
+    return _put_milli(p, (uint64_t)milli);
+}
+
+char* fmt_f3(char* p, float v)
+{
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    const uint32_t bexp = (bits >> 23) & 0xFFu;
+    const uint32_t frac = bits & 0x7FFFFFu;
+    /* v = m * 2^e; utanför 2^32 eller NaN/Inf: låt printf göra jobbet */
+    if (bexp >= 127u + 32u) {
+        char tmp[FMT_F3_MAX + 1u];
+        int n = snprintf(tmp, sizeof(tmp), "%.3f", (double)v);
+        if (n <= 0) return p;
+        if (n > (int)FMT_F3_MAX) n = (int)FMT_F3_MAX;
+        memcpy(p, tmp, (size_t)n);
+        return p + n;
+    }
+    const uint32_t m = (bexp != 0u) ? (frac | 0x800000u) : frac;
+    const int e = (bexp != 0u) ? (int)bexp - 150 : -149;
+    const uint64_t q = (uint64_t)m * 1000u;   /* < 2^34, exakt */
+    uint64_t n;
+    if (e >= 0) {
+        n = q << e;                            /* e <= 8 här */
+    } else if (e <= -64) {
+        n = 0u;                                /* q < 2^34 < halva steget */
+    } else {
+        const unsigned s = (unsigned)-e;
+        n = q >> s;
+        const uint64_t r = q & ((1ull << s) - 1u);
+        const uint64_t half = 1ull << (s - 1u);
+        if (r > half || (r == half && (n & 1u))) n++;
+    }
+    if (bits & 0x80000000u) *p++ = '-';        /* printf skriver "-0.000" */
+    return _put_milli(p, n);
+}
+
+char* fmt_str(char* p, const char* s)
+{
+    while (*s) *p++ = *s++;
+    return p;
+}
+
+/* --- Självtest mot snprintf --- */
+
+static uint32_t _check(const char* ref, int ref_len, const char* got_begin, const char* got_end)
+{
+    const int n = (int)(got_end - got_begin);
+    return (ref_len != n || memcmp(ref, got_begin, (size_t)n) != 0) ? 1u : 0u;
+}
+
+static uint32_t _check_f3(float v)
+{
+    char ref[FMT_F3_MAX + 1u];
+    char got[FMT_F3_MAX];
+    int rn = snprintf(ref, sizeof(ref), "%.3f", (double)v);
+    return _check(ref, rn, got, fmt_f3(got, v));
+}
+
+uint32_t fmt_selftest(void)
+{
+    uint32_t bad = 0;
+    char ref[32];
+    char got[32];
+
+    /* Heltal: gränsvärden och ett svep över alla längder */
+    static const uint32_t u32s[] = { 0u, 1u, 9u, 10u, 99u, 100u, 65535u, 999999999u,
+                                     1000000000u, 4294967295u };
+    for (size_t i = 0; i < sizeof(u32s) / sizeof(u32s[0]); ++i) {
+        int rn = snprintf(ref, sizeof(ref), "%" PRIu32, u32s[i]);
+        bad += _check(ref, rn, got, fmt_u32(got, u32s[i]));
+        int32_t s = (int32_t)u32s[i];
+        rn = snprintf(ref, sizeof(ref), "%" PRId32, s);
+        bad += _check(ref, rn, got, fmt_i32(got, s));
+    }
+    uint64_t u = 1u;
+    for (int i = 0; i < 64; ++i, u = (u << 1) | (u & 1u)) {
+        const uint64_t vals[3] = { u, u - 1u, u * 10u + 7u };
+        for (int k = 0; k < 3; ++k) {
+            int rn = snprintf(ref, sizeof(ref), "%" PRIu64, vals[k]);
+            bad += _check(ref, rn, got, fmt_u64(got, vals[k]));
+        }
+    }
+
+    /* Typiska m/s^2-värden runt varje tusendel, och exakta "halvor" */
+    for (int32_t k = -20000; k <= 20000; ++k) {
+        const float v = (float)k / 1000.0f;
+        bad += _check_f3(v);
+        bad += _check_f3(v + 0.0005f);
+        bad += _check_f3((float)k / 2048.0f);   /* binära bråk: lika avstånd */
+    }
+
+    /* Slumpade bitmönster över alla exponenter, inklusive subnormala och NaN/Inf */
+    uint32_t x = 0x12345678u;
+    for (int i = 0; i < 20000; ++i) {
+        x = x * 1664525u + 1013904223u;
+        float v;
+        memcpy(&v, &x, sizeof(v));
+        bad += _check_f3(v);
+    }
+    bad += _check_f3(-0.0f);
+    bad += _check_f3(-0.0004f);
+    bad += _check_f3(4294967040.0f);   /* största float under 2^32 */
+    bad += _check_f3(4294967296.0f);
+    return bad;
+}
@@ -72,6 +72,20 @@ void MX_GPIO_Init(void)
   GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
   HAL_GPIO_Init(LED2_GPIO_Port, &GPIO_InitStruct);
 
+  /* ADXL345_CS_Pin (PB12): idle high so the sensor stays in I2C mode unless
+   * the SPI backend drives it. A low CS at power-up would select SPI. */
+  HAL_GPIO_WritePin(ADXL345_CS_GPIO_Port, ADXL345_CS_Pin, GPIO_PIN_SET);
+  GPIO_InitStruct.Pin = ADXL345_CS_Pin;
+  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+  HAL_GPIO_Init(ADXL345_CS_GPIO_Port, &GPIO_InitStruct);
+
+  /* ADXL345_2_CS_Pin (PC7): same idle-high rule for the second sensor. */
+  HAL_GPIO_WritePin(ADXL345_2_CS_GPIO_Port, ADXL345_2_CS_Pin, GPIO_PIN_SET);
+  GPIO_InitStruct.Pin = ADXL345_2_CS_Pin;
+  HAL_GPIO_Init(ADXL345_2_CS_GPIO_Port, &GPIO_InitStruct);
+
   /* Configure ADXL345_INT1_Pin (PA7) as EXTI on falling edge for active-low interrupt. */
   GPIO_InitStruct.Pin  = ADXL345_INT1_Pin;
   GPIO_InitStruct.Mode = GPIO_MODE_IT_FALLING;
@@ -79,7 +93,14 @@ void MX_GPIO_Init(void)
 
   HAL_GPIO_Init(ADXL345_INT1_GPIO_Port, &GPIO_InitStruct);
 
-  /* EXTI interrupt init: disable B1's EXTI15_10, enable EXTI9_5 for PA7 */
+  /* ADXL345_2_INT1_Pin (PA6): second sensor, shares EXTI9_5. Pull-up keeps the
+   * line quiet when the sensor is not fitted. */
+  GPIO_InitStruct.Pin  = ADXL345_2_INT1_Pin;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_FALLING;
+  GPIO_InitStruct.Pull = GPIO_PULLUP;
+  HAL_GPIO_Init(ADXL345_2_INT1_GPIO_Port, &GPIO_InitStruct);
+
+  /* EXTI interrupt init: disable B1's EXTI15_10, enable EXTI9_5 for PA7/PA6 */
   HAL_NVIC_DisableIRQ(EXTI15_10_IRQn);
   
   /*
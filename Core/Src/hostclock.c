@@ -0,0 +1,201 @@
+/*
+ * Host clock model (see hostclock.h). The fit runs in the command context on
+ * each TIME_SYNC; readers only evaluate the published model.
+ */
+/* filename: Core/Src/hostclock.c */
+#include "hostclock.h"
+#include "main.h"
+#include "fmt.h"
+
+typedef struct {
+    uint64_t x0;     // Device us of the newest pair
+    uint64_t y0;     // Host us of the newest pair
+    int64_t  mx;     // Mean (x - x0) over the window
+    int64_t  off;    // Mean residual (y - y0) - (x - x0)
+    int32_t  skew;   // Q32
+    bool     fitted; // skew is fitted, not the nominal rate
+} HostClockModel_t;
+
+static uint64_t s_x[HOSTCLOCK_WINDOW];
+static uint64_t s_y[HOSTCLOCK_WINDOW];
+static uint8_t s_n = 0;
+static uint8_t s_head = 0;            // Next slot to write
+static HostClockModel_t s_model;
+static volatile bool s_valid = false;
+static volatile bool s_stamp = false;
+
+static void HostClock_Publish(const HostClockModel_t* m) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_model = *m;
+    s_valid = true;
+    __set_PRIMASK(primask);
+}
+
+static bool HostClock_Snapshot(HostClockModel_t* m) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    const bool valid = s_valid;
+    *m = s_model;
+    __set_PRIMASK(primask);
+    return valid;
+}
+
+// (u * s) >> 32 without a 128-bit product; any u, |s| < 2^30 (the fit is clamped far below).
+static int64_t mul_q32(int64_t u, int32_t s) {
+    const bool neg = (u < 0);
+    const uint64_t a = neg ? (0U - (uint64_t)u) : (uint64_t)u;
+    const int64_t hi = (int64_t)(a >> 32) * s;
+    const int64_t lo = ((int64_t)(a & 0xFFFFFFFFu) * s) / (int64_t)(1LL << 32);
+    const int64_t r = hi + lo;
+    return neg ? -r : r;
+}
+
+static uint64_t HostClock_Eval(const HostClockModel_t* m, uint64_t dev_us) {
+    const int64_t dx = (int64_t)(dev_us - m->x0);
+    return m->y0 + (uint64_t)(dx + m->off + mul_q32(dx - m->mx, m->skew));
+}
+
+// Slope of r against x in Q32 from the centred sums N = Σ dx·dr and D = Σ dx².
+static int32_t HostClock_Slope(int64_t num, int64_t den) {
+    if (den <= 0) return 0;
+    const uint64_t an = (num < 0) ? (0U - (uint64_t)num) : (uint64_t)num;
+    int a = 32;
+    while (a > 0 && an > ((uint64_t)INT64_MAX >> a)) a--;
+    const int64_t d = den >> (32 - a);
+    if (d == 0) return 0;
+    const int64_t q = (num * (int64_t)(1LL << a)) / d;
+    if (q > INT32_MAX) return INT32_MAX;
+    if (q < INT32_MIN) return INT32_MIN;
+    return (int32_t)q;
+}
+
+static void HostClock_Fit(HostClockFit_t* fit) {
+    const uint8_t newest = (uint8_t)((s_head + HOSTCLOCK_WINDOW - 1u) % HOSTCLOCK_WINDOW);
+    const uint8_t oldest = (uint8_t)((s_head + HOSTCLOCK_WINDOW - s_n) % HOSTCLOCK_WINDOW);
+    HostClockModel_t m = {0};
+    m.x0 = s_x[newest];
+    m.y0 = s_y[newest];
+
+    int64_t dx[HOSTCLOCK_WINDOW], dr[HOSTCLOCK_WINDOW];
+    int64_t sx = 0, sr = 0;
+    for (uint8_t k = 0; k < s_n; k++) {
+        const uint8_t i = (uint8_t)((oldest + k) % HOSTCLOCK_WINDOW);
+        dx[k] = (int64_t)(s_x[i] - m.x0);
+        dr[k] = (int64_t)(s_y[i] - m.y0) - dx[k];
+        sx += dx[k];
+        sr += dr[k];
+    }
+    m.mx = sx / s_n;
+    m.off = sr / s_n;
+
+    const uint64_t span = s_x[newest] - s_x[oldest];
+    if (s_n >= 2u && span >= HOSTCLOCK_MIN_SPAN_US) {
+        // Centre, then scale x and r alike so every square stays below 2^56
+        int64_t amax = 0;
+        for (uint8_t k = 0; k < s_n; k++) {
+            dx[k] -= m.mx;
+            dr[k] -= m.off;
+            const int64_t ax = (dx[k] < 0) ? -dx[k] : dx[k];
+            if (ax > amax) amax = ax;
+        }
+        int sh = 0;
+        while ((amax >> sh) >= (1LL << 28)) sh++;
+        int64_t num = 0, den = 0;
+        for (uint8_t k = 0; k < s_n; k++) {
+            const int64_t x = dx[k] / (int64_t)(1LL << sh);
+            const int64_t r = dr[k] / (int64_t)(1LL << sh);
+            num += x * r;
+            den += x * x;
+        }
+        m.skew = HostClock_Slope(num, den);
+        m.fitted = true;
+    }
+
+    const int64_t max_skew = (int64_t)((((uint64_t)HOSTCLOCK_MAX_SKEW_PPM) << 32) / 1000000u);
+    if (m.skew > max_skew || m.skew < -max_skew) {
+        // No crystal drifts that far: keep only the newest pair
+        s_n = 1;
+        m.mx = 0;
+        m.off = 0;
+        m.skew = 0;
+        m.fitted = false;
+        fit->restarted = true;
+    }
+    HostClock_Publish(&m);
+
+    fit->n = s_n;
+    fit->skew_ppb = (int32_t)(((int64_t)m.skew * 1000000000LL) / (int64_t)(1LL << 32));
+    fit->span_ms = (uint32_t)((s_n > 1u) ? (span / 1000u) : 0u);
+}
+
+void HostClock_Reset(void) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_valid = false;
+    s_stamp = false;
+    s_n = 0;
+    s_head = 0;
+    __set_PRIMASK(primask);
+}
+
+void HostClock_AddSync(uint64_t host_us, uint64_t dev_us, HostClockFit_t* fit) {
+    HostClockFit_t local;
+    if (fit == NULL) fit = &local;
+    fit->restarted = false;
+    fit->resid_us = 0;
+
+    HostClockModel_t m;
+    if (HostClock_Snapshot(&m) && s_n > 0u) {
+        const int64_t r = (int64_t)(host_us - HostClock_Eval(&m, dev_us));
+        fit->resid_us = (r > INT32_MAX) ? INT32_MAX : ((r < INT32_MIN) ? INT32_MIN : (int32_t)r);
+        // The prediction error grows with the time since the newest pair: by the
+        // full HSI tolerance on the nominal rate, far less once skew is fitted
+        const uint64_t dt = (dev_us > m.x0) ? (dev_us - m.x0) : 0u;
+        const uint64_t ppm = m.fitted ? HOSTCLOCK_FIT_TOL_PPM : HOSTCLOCK_MAX_SKEW_PPM;
+        const int64_t thr = (int64_t)(HOSTCLOCK_STEP_US + (dt / 1000000u) * ppm + ((dt % 1000000u) * ppm) / 1000000u);
+        if (r > thr || r < -thr) {
+            s_n = 0;
+            fit->restarted = true;
+        }
+    }
+    if (s_n > 0u && dev_us <= s_x[(s_head + HOSTCLOCK_WINDOW - 1u) % HOSTCLOCK_WINDOW]) {
+        s_n = 0;   // Device time cannot go backwards; treat as a new session
+        fit->restarted = true;
+    }
+
+    s_x[s_head] = dev_us;
+    s_y[s_head] = host_us;
+    s_head = (uint8_t)((s_head + 1u) % HOSTCLOCK_WINDOW);
+    if (s_n < HOSTCLOCK_WINDOW) s_n++;
+    HostClock_Fit(fit);
+}
+
+bool HostClock_HasSync(void) {
+    return s_valid;
+}
+
+bool HostClock_ToHostUs(uint64_t dev_us, uint64_t* host_us) {
+    HostClockModel_t m;
+    if (!HostClock_Snapshot(&m)) {
+        *host_us = 0;
+        return false;
+    }
+    *host_us = HostClock_Eval(&m, dev_us);
+    return true;
+}
+
+void HostClock_SetStamping(bool on) {
+    s_stamp = on;
+}
+
+bool HostClock_IsStamping(void) {
+    return s_stamp && s_valid;
+}
+
+char* HostClock_FmtField(char* p, uint64_t dev_us) {
+    uint64_t host_us;
+    if (!s_stamp || !HostClock_ToHostUs(dev_us, &host_us)) return p;
+    p = fmt_str(p, ",host_us=");
+    return fmt_u64(p, host_us);
+}
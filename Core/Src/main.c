@@ -4,6 +4,7 @@
 /* filename: Core/Src/main.c */
 #include "main.h"
 #include "i2c.h"
+#include "spi.h"
 #include "tim.h"
 #include "usart.h"
 #include "gpio.h"
@@ -13,13 +14,27 @@
 #include "comm.h"
 #include "command_handler.h"
 #include "sensor_hal.h"
+#include "sensor_bus.h"
+#include "timebase.h"
 #include "trigger_logic.h"
 #include "burst_mgr.h"
 #include "streaming.h"
 #include "telemetry.h"
 #include "countdown.h"
 #include "transport_blocks.h" // For BM_Init dependency
+#include "blocks_cfg.h"
+#include "conditioning.h"
+#include "protocol_crc16.h"
+#include "protocol_crc32.h"
 #include "dev_diagnostics.h"  // NY: Inkludera diagnostikmodulen
+#include "sched.h"
+#include "app_rtos.h"
+#include "prof.h"
+#include "trace.h"
+#include "cal_store.h"
+#if COMM_USE_USB_CDC
+#include "usb_device.h"       // MX_USB_DEVICE_Init (CubeMX USB_DEVICE)
+#endif
 
 // The single global application context
 static AppContext_t g_app_context;
@@ -27,13 +42,35 @@ static AppContext_t g_app_context;
 // Prototypes for auto-generated functions
 void SystemClock_Config(void);
 
+static void Task_Countdown(AppContext_t* ctx) { (void)ctx; Countdown_Tick(); }
+static void Task_Trace(AppContext_t* ctx) { (void)ctx; Trace_Pump(); }
+static void Task_Housekeeping(AppContext_t* ctx);
+
+// Pumparna, de händelser som väcker dem och tråden som äger dem i RTOS-bygget.
+// Tabellordningen är körordningen inom ett pass. TICK har bara pumpar som
+// begär frister (Sched_ArmTimeout): HB och LED, TB-omsändning och burststall,
+// triggerns holdoff och referensfönster, självtest/kalibrering, nedräkning,
+// BENCH-timeout och ITM-strömning. Övriga kör bara på sina egna händelser.
+static const SchedTask_t k_tasks[] = {
+    { CmdHandler_ProcessInput, SCHED_EV_RX | SCHED_EV_TX,                                     SCHED_THREAD_CMD,   PROF_PUMP_INPUT },
+    { Telemetry_Pump,          SCHED_EV_TICK | SCHED_EV_TX | SCHED_EV_CMD,                    SCHED_THREAD_CMD,   PROF_PUMP_TELEMETRY },
+    { BurstManager_Pump,       SCHED_EV_SAMPLES | SCHED_EV_TX | SCHED_EV_TICK | SCHED_EV_CMD, SCHED_THREAD_XPORT, PROF_PUMP_BURST },
+    { Trigger_Pump,            SCHED_EV_SAMPLES | SCHED_EV_TICK | SCHED_EV_CMD,               SCHED_THREAD_ACQ,   PROF_PUMP_TRIGGER },
+    { Streaming_Pump,          SCHED_EV_SAMPLES | SCHED_EV_TX | SCHED_EV_CMD,                 SCHED_THREAD_XPORT, PROF_PUMP_STREAM },
+    { Sensor_Pump,             SCHED_EV_SAMPLES | SCHED_EV_TICK | SCHED_EV_CMD,               SCHED_THREAD_ACQ,   PROF_PUMP_SENSOR },
+    { Task_Countdown,          SCHED_EV_TICK,                                                 SCHED_THREAD_CMD,   PROF_PUMP_COUNTDOWN },
+    { DevDiag_BenchPump,       SCHED_EV_TICK | SCHED_EV_CMD,                                  SCHED_THREAD_CMD,   PROF_NONE },
+    { Task_Trace,              SCHED_EV_ALL,                                                  SCHED_THREAD_CMD,   PROF_NONE },
+    { Task_Housekeeping,       SCHED_EV_ALL,                                                  SCHED_THREAD_CMD,   PROF_PUMP_HOUSEKEEPING },
+};
+#define MAIN_TASK_COUNT (sizeof(k_tasks) / sizeof(k_tasks[0]))
+
 // --- main.h compatibility ---
 // Define globals that were previously in main.c but are now in app_context.
 // These are for linking with auto-generated headers that might extern them.
 // The new modules should not use these.
 RuntimeCfg_t g_cfg;
 DiagCounters_t g_diag;
-TimeSync_t g_tsync;
 TriggerSettings_t g_trigger_settings;
 
 // --- Retarget stdout to UART ---
@@ -60,26 +97,58 @@ int main(void) {
     // Peripheral Initialization
     MX_GPIO_Init();
     MX_USART2_UART_Init();
+#if COMM_USE_USB_CDC
+    MX_USB_DEVICE_Init();   // Värdlänken går över USB CDC (comm.h)
+#endif
     MX_TIM2_Init();
     MX_I2C1_Init();
+#if SENSOR_BUS_USE_SPI
+    MX_SPI2_Init();
+#endif
     MX_TIM3_Init();
 
-    // Start microsecond timer
-    HAL_TIM_Base_Start(&htim2);
+    // Start microsecond timer (64-bit extended through the wrap interrupt)
+    Timebase_Init(&htim2);
+    Prof_Init();   // DWT cycle counter for the DIAG_PROF probes
+    Trace_Init();  // event trace ring, timestamps from the same counter
+#if SENSOR_TS_EDGE_CAPTURE
+    HAL_TIM_IC_Start(&htim2, TIM_CHANNEL_3); // INT1 edge capture for sample timestamps
+#endif
 
     // Initialize all software modules, passing the context and HAL handles
-    AppContext_Init(&g_app_context, &htim2, &htim3, &hi2c1);
+    AppContext_Init(&g_app_context, &htim2, &htim3, &hi2c1, &hspi2);
+    // A saved SET_CFG/SET_TRG replaces the defaults before the sensor is set up
+    CalStore_Init();
+    (void)CalStore_RestoreConfig(&g_app_context);
     
     // Copy context defaults to legacy globals for compatibility
     g_cfg = g_app_context.cfg;
     g_trigger_settings = g_app_context.trigger_settings;
+    Cond_Configure(&g_app_context.cfg);
 
     COMM_Init();
     BM_Init(PROTO_WINDOW_DEFAULT, PROTO_BLOCK_LINES_DEFAULT, PROTO_MAX_RETRIES);
+    BlocksCfg_Init(PROTO_WINDOW_DEFAULT, PROTO_BLOCK_LINES_DEFAULT, PROTO_MAX_RETRIES);
     Telemetry_Init(&g_app_context); // Must be initialized before Sensor_Init to report errors
 
+    // The table-driven CRC16 must match the bit-serial reference, or every
+    // block and binary frame would fail on the host.
+    if (!proto_crc16_selftest()) {
+        Telemetry_SendERROR("CRC16", 999, "selftest failed");
+        HAL_Delay(100);
+        Error_Handler();
+    }
+    // A failed hardware CRC check only disables HELLO,crc=crc32.
+    if (!proto_crc32_selftest()) {
+        Telemetry_SendERROR("CRC32", 999, "selftest failed");
+    }
+
     if (Sensor_Init(&g_app_context) != HAL_OK) {
+#if SENSOR_BUS_USE_SPI
+        Telemetry_SendERROR("SENSOR_INIT", 999, "SPI init failed");
+#else
         Telemetry_SendERROR("SENSOR_INIT", 999, "I2C init failed");
+#endif
         HAL_Delay(100); // Give UART a chance to send before halting
         Error_Handler();
     }
@@ -91,48 +160,55 @@ int main(void) {
     
     // Start listening for commands
     COMM_StartRx();
-    HAL_Delay(250); // Sensor settle time
 
-    // Perform initial calibration
-    Sensor_PerformOffsetCalibration(&g_app_context);
+    // Initial offset calibration runs in the background (settle time included);
+    // the command loop is live right away and CAL_INFO reports completion.
+    // Offsets restored from flash (CAL_STORE,SAVE) skip it.
+    if (!CalStore_RestoreCalibration()) {
+        Sensor_StartOffsetCalibration(&g_app_context);
+    }
     AppContext_SetOpMode(&g_app_context, OP_MODE_IDLE);
 
-    // Main application loop
+#if APP_USE_RTOS
+    // The same task table, split over the acquisition, transport and
+    // command threads (app_rtos.h). Does not return.
+    App_RtosStart(&g_app_context, k_tasks, MAIN_TASK_COUNT);
+#else
+    // Main application loop. ISRs post event bits (sched.h); each pass runs
+    // only the pumps whose events are pending and sleeps when none are.
+    // Data acquisition is interrupt driven; PendSV posts SCHED_EV_SAMPLES.
+    Sched_Post(SCHED_EV_ALL);
+    uint32_t pass_cyc = Prof_Now();
     while (1) {
-        // 1. Handle incoming communication
-        CmdHandler_ProcessInput(&g_app_context);
-
-        // 2. Data acquisition is now fully interrupt driven. No polling needed.
-
-        // 3. Pump the state machines of each active module
-        Telemetry_Pump(&g_app_context);
-        BurstManager_Pump(&g_app_context);
-        Trigger_Pump(&g_app_context);
-        Streaming_Pump(&g_app_context);
-        Countdown_Tick();
-
-        // 4. Handle global flags (like STOP)
-        if (g_app_context.stop_flag) {
-            CmdHandler_HandleStop(&g_app_context); // Delegate stop logic
-            g_app_context.stop_flag = false;
-        }
+        const uint32_t now_cyc = Prof_Now();
+        Prof_Record(PROF_LOOP, now_cyc - pass_cyc);
+        pass_cyc = now_cyc;
+        Sched_RunTasks(&g_app_context, k_tasks, MAIN_TASK_COUNT, Sched_Take());
 
-        // 5. Handle is_dumping flag reset
-        if (g_app_context.is_dumping) {
-            const bool is_busy = (g_app_context.op_mode == OP_MODE_BURST || g_app_context.op_mode == OP_MODE_BURST_SENDING);
-            if (!is_busy && COMM_TxIsIdle() && !BM_IsActive()) {
-                g_app_context.is_dumping = false;
-            }
-        }
+        // Sleep until the next interrupt if nothing was posted meanwhile
+        Sched_Idle();
+    }
+#endif
+}
 
-        // 6. Update UI
-        Telemetry_UpdateLED(&g_app_context);
+// Global flags and UI, last in every pass.
+static void Task_Housekeeping(AppContext_t* ctx) {
+    // 1. Handle global flags (like STOP)
+    if (ctx->stop_flag) {
+        CmdHandler_HandleStop(ctx); // Delegate stop logic
+        ctx->stop_flag = false;
+    }
 
-        // 7. Yield if idle
-        if (g_app_context.op_mode == OP_MODE_IDLE && !g_app_context.is_dumping) {
-            HAL_Delay(5);
+    // 2. Handle is_dumping flag reset
+    if (ctx->is_dumping) {
+        const bool is_busy = (ctx->op_mode == OP_MODE_BURST || ctx->op_mode == OP_MODE_BURST_SENDING);
+        if (!is_busy && COMM_TxIsIdle() && !BM_IsActive()) {
+            ctx->is_dumping = false;
         }
     }
+
+    // 3. Update UI
+    Telemetry_UpdateLED(ctx);
 }
 
 // SystemClock_Config, Error_Handler, etc. remain here...
@@ -148,12 +224,21 @@ void SystemClock_Config(void) {
   __HAL_RCC_PWR_CLK_ENABLE();
   __HAL_PWR_VOLTAGESCALING_CONFIG(PWR_REGULATOR_VOLTAGE_SCALE1);
 
+#if COMM_USE_USB_CDC
+  // USB FS kräver +-0.25 %; HSI räcker inte. ST-LINK:s 8 MHz MCO som HSE bypass.
+  RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSE;
+  RCC_OscInitStruct.HSEState = RCC_HSE_BYPASS;
+  RCC_OscInitStruct.PLL.PLLState = RCC_PLL_ON;
+  RCC_OscInitStruct.PLL.PLLSource = RCC_PLLSOURCE_HSE;
+  RCC_OscInitStruct.PLL.PLLM = 4;     // 2 MHz PLL-ingång som med HSI
+#else
   RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSI;
   RCC_OscInitStruct.HSIState = RCC_HSI_ON;
   RCC_OscInitStruct.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
   RCC_OscInitStruct.PLL.PLLState = RCC_PLL_ON;
   RCC_OscInitStruct.PLL.PLLSource = RCC_PLLSOURCE_HSI;
   RCC_OscInitStruct.PLL.PLLM = 8;
+#endif
   RCC_OscInitStruct.PLL.PLLN = 180;
   RCC_OscInitStruct.PLL.PLLP = RCC_PLLP_DIV2;
   RCC_OscInitStruct.PLL.PLLQ = 2;
@@ -177,6 +262,21 @@ void SystemClock_Config(void) {
   if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_5) != HAL_OK) {
     Error_Handler();
   }
+
+#if COMM_USE_USB_CDC
+  // CLK48 för OTG FS från PLLSAI: 8 MHz / 4 * 96 / 4 = 48 MHz (PLLQ ger 180 MHz)
+  RCC_PeriphCLKInitTypeDef PeriphClkInitStruct = {0};
+  PeriphClkInitStruct.PeriphClockSelection = RCC_PERIPHCLK_CLK48;
+  PeriphClkInitStruct.PLLSAI.PLLSAIM = 4;
+  PeriphClkInitStruct.PLLSAI.PLLSAIN = 96;
+  PeriphClkInitStruct.PLLSAI.PLLSAIQ = 2;
+  PeriphClkInitStruct.PLLSAI.PLLSAIP = RCC_PLLSAIP_DIV4;
+  PeriphClkInitStruct.PLLSAIDivQ = 1;
+  PeriphClkInitStruct.Clk48ClockSelection = RCC_CLK48CLKSOURCE_PLLSAIP;
+  if (HAL_RCCEx_PeriphCLKConfig(&PeriphClkInitStruct) != HAL_OK) {
+    Error_Handler();
+  }
+#endif
 }
 
 /**
@@ -0,0 +1,133 @@
+/* filename: Core/Src/prof.c */
+#include "prof.h"
+#include "comm.h"
+#include "fmt.h"
+#include "api_schema.h"
+#include <string.h>
+
+typedef struct {
+    const char* name;
+    const char* unit;
+} ProfInfo_t;
+
+static const ProfInfo_t k_info[PROF_COUNT] = {
+    [PROF_EXTI_DMA]          = { "exti_dma",   "cyc" },
+    [PROF_DRAIN]             = { "drain",      "cyc" },
+    [PROF_ISR_EXTI]          = { "isr_exti",   "cyc" },
+    [PROF_ISR_BUS]           = { "isr_bus",    "cyc" },
+    [PROF_ISR_UART]          = { "isr_uart",   "cyc" },
+    [PROF_ISR_TIM2]          = { "isr_tim2",   "cyc" },
+    [PROF_ISR_PENDSV]        = { "isr_pendsv", "cyc" },
+    [PROF_LOOP]              = { "loop",       "cyc" },
+    [PROF_PUMP_INPUT]        = { "pump_cmd",   "cyc" },
+    [PROF_PUMP_TELEMETRY]    = { "pump_tel",   "cyc" },
+    [PROF_PUMP_BURST]        = { "pump_burst", "cyc" },
+    [PROF_PUMP_TRIGGER]      = { "pump_trg",   "cyc" },
+    [PROF_PUMP_STREAM]       = { "pump_live",  "cyc" },
+    [PROF_PUMP_SENSOR]       = { "pump_sensor","cyc" },
+    [PROF_PUMP_COUNTDOWN]    = { "pump_cd",    "cyc" },
+    [PROF_PUMP_HOUSEKEEPING] = { "pump_hk",    "cyc" },
+    [PROF_TX_OCC]            = { "tx_occ",     "B" },
+    [PROF_BLK_RTT]           = { "blk_rtt",    "ms" },
+};
+
+static ProfStat_t s_stat[PROF_COUNT];
+
+void Prof_Reset(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memset(s_stat, 0, sizeof(s_stat));
+    for (uint32_t i = 0; i < PROF_COUNT; i++) {
+        s_stat[i].min = UINT32_MAX;
+    }
+    __set_PRIMASK(primask);
+}
+
+void Prof_ResetProbe(ProfProbe_t p)
+{
+    if ((uint32_t)p >= PROF_COUNT) return;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memset(&s_stat[p], 0, sizeof(s_stat[p]));
+    s_stat[p].min = UINT32_MAX;
+    __set_PRIMASK(primask);
+}
+
+void Prof_Get(ProfProbe_t p, ProfStat_t* out)
+{
+    if ((uint32_t)p >= PROF_COUNT) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *out = s_stat[p];
+    __set_PRIMASK(primask);
+}
+
+void Prof_Init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    Prof_Reset();
+}
+
+void Prof_Record(ProfProbe_t p, uint32_t v)
+{
+#if PROF_ENABLE
+    if ((uint32_t)p >= PROF_COUNT) return;
+    ProfStat_t* s = &s_stat[p];
+    s->n++;
+    s->sum += v;
+    if (v < s->min) s->min = v;
+    if (v > s->max) s->max = v;
+    s->hist[32u - __CLZ(v)]++;   // __CLZ(0) = 32 -> fack 0
+#else
+    (void)p; (void)v;
+#endif
+}
+
+// DIAG_PROF-rad för en ögonblicksbild; histogrammet från första till sista
+// icke-tomma facket, så länge raden räcker.
+static void Prof_SendOne(ProfProbe_t p, const ProfStat_t* s)
+{
+    char line[PROTO_MAX_LINE];
+    char* const lim = line + sizeof(line) - (FMT_U32_MAX + 4u);
+    char* q = line;
+    q = fmt_str(q, MSG_DIAG_PROF ",name="); q = fmt_str(q, k_info[p].name);
+    q = fmt_str(q, ",unit=");  q = fmt_str(q, k_info[p].unit);
+    q = fmt_str(q, ",n=");     q = fmt_u32(q, s->n);
+    q = fmt_str(q, ",min=");   q = fmt_u32(q, s->n ? s->min : 0u);
+    q = fmt_str(q, ",max=");   q = fmt_u32(q, s->max);
+    q = fmt_str(q, ",mean=");  q = fmt_u32(q, s->n ? (uint32_t)(s->sum / s->n) : 0u);
+
+    uint32_t lo = PROF_HIST_BINS, hi = 0;
+    for (uint32_t k = 0; k < PROF_HIST_BINS; k++) {
+        if (s->hist[k] != 0u) {
+            if (lo == PROF_HIST_BINS) lo = k;
+            hi = k + 1u;
+        }
+    }
+    if (lo == PROF_HIST_BINS) lo = 0;
+    q = fmt_str(q, ",lo=");    q = fmt_u32(q, lo);
+    q = fmt_str(q, ",hist=");
+    for (uint32_t k = lo; k < hi && q < lim; k++) {
+        if (k != lo) *q++ = '/';
+        q = fmt_u32(q, s->hist[k]);
+    }
+    q = fmt_str(q, PROTO_EOL);
+    Telemetry_WriteBlocking(line, (size_t)(q - line));
+}
+
+void Prof_SendDiag(void)
+{
+    COMM_SendfBlocking(MSG_DIAG_PROF_INFO ",cpu_hz=%lu,probes=%u,enabled=%u" PROTO_EOL,
+                       (unsigned long)HAL_RCC_GetHCLKFreq(), (unsigned)PROF_COUNT, (unsigned)PROF_ENABLE);
+    for (uint32_t i = 0; i < PROF_COUNT; i++) {
+        ProfStat_t snap;
+        Prof_Get((ProfProbe_t)i, &snap);
+        Prof_SendOne((ProfProbe_t)i, &snap);
+    }
+}
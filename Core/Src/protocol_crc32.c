@@ -0,0 +1,53 @@
+/* filename: Core/Src/protocol_crc32.c */
+#include "protocol_crc32.h"
+#include "stm32f4xx_hal.h"
+#include <string.h>
+
+static int s_crc32_ok = 0;
+
+uint32_t proto_crc32_hw(const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    CRC->CR = CRC_CR_RESET;
+    size_t i = 0;
+    for (; i + 4u <= len; i += 4u) {
+        uint32_t w;
+        memcpy(&w, &p[i], 4u); /* En LDR på Cortex-M4 */
+        CRC->DR = __REV(w);
+    }
+    if (i < len) {
+        uint8_t tail[4] = { 0u, 0u, 0u, 0u };
+        memcpy(tail, &p[i], len - i);
+        uint32_t w;
+        memcpy(&w, tail, 4u);
+        CRC->DR = __REV(w);
+    }
+    return CRC->DR;
+}
+
+uint32_t proto_crc32_ref(const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    const size_t padded = (len + 3u) & ~(size_t)3u;
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < padded; ++i) {
+        crc ^= (uint32_t)((i < len) ? p[i] : 0u) << 24;
+        for (uint8_t b = 0; b < 8u; ++b) {
+            crc = (crc & 0x80000000u) ? ((crc << 1) ^ 0x04C11DB7u) : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+int proto_crc32_selftest(void) {
+    __HAL_RCC_CRC_CLK_ENABLE();
+    /* "123456789" + 3 nollbytes; jämförs även mot referensen för alla längder 0..9. */
+    static const char check[] = "123456789";
+    s_crc32_ok = (proto_crc32_ref(check, 9u) == 0xAE24E09Du);
+    for (size_t n = 0; s_crc32_ok && n <= 9u; ++n) {
+        s_crc32_ok = (proto_crc32_hw(check, n) == proto_crc32_ref(check, n));
+    }
+    return s_crc32_ok;
+}
+
+int proto_crc32_available(void) {
+    return s_crc32_ok;
+}
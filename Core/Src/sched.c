@@ -0,0 +1,92 @@
+/* filename: Core/Src/sched.c */
+#include "sched.h"
+#include "main.h"
+#include "app_rtos.h"
+#include "prof.h"
+
+static volatile uint32_t s_pending = 0;
+static volatile bool s_tmo_armed = false;
+static volatile uint32_t s_tmo_at = 0;     // HAL_GetTick() då TICK postas
+static uint32_t s_passes = 0;
+static uint32_t s_sleeps = 0;
+
+void Sched_Post(uint32_t ev)
+{
+#if APP_USE_RTOS
+    App_RtosNotify(ev);
+#else
+    // PRIMASK sparas: anropas även inifrån maskade sektioner
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_pending |= ev;
+    __set_PRIMASK(primask);
+#endif
+}
+
+uint32_t Sched_Take(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t ev = s_pending;
+    s_pending = 0;
+    __set_PRIMASK(primask);
+    if (ev != 0u) s_passes++;
+    return ev;
+}
+
+void Sched_ArmTimeout(uint32_t ms)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    const uint32_t at = HAL_GetTick() + ms;
+    if (!s_tmo_armed || (int32_t)(at - s_tmo_at) < 0) {
+        s_tmo_at = at;
+        s_tmo_armed = true;
+    }
+    __set_PRIMASK(primask);
+}
+
+void Sched_SysTick(void)
+{
+    // Maskat: i RTOS-bygget har SysTick lägst prio och kan avbrytas av en ISR som begär en frist
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    const bool due = s_tmo_armed && (int32_t)(HAL_GetTick() - s_tmo_at) >= 0;
+    if (due) s_tmo_armed = false;
+    __set_PRIMASK(primask);
+    if (due) Sched_Post(SCHED_EV_TICK);
+}
+
+void Sched_RunTasks(AppContext_t* ctx, const SchedTask_t* tasks, size_t n, uint32_t ev)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (ev & tasks[i].events) {
+            const uint32_t t0 = Prof_Now();
+            tasks[i].run(ctx);
+            Prof_Since((ProfProbe_t)tasks[i].probe, t0);
+        }
+    }
+}
+
+void Sched_Idle(void)
+{
+    // Med PRIMASK satt väcker ett väntande avbrott ändå WFI; det körs först
+    // när masken släpps, så en post efter kontrollen går inte förlorad.
+    __disable_irq();
+    if (s_pending == 0u) {
+        s_sleeps++;
+        __DSB();
+        __WFI();
+    }
+    __enable_irq();
+}
+
+uint32_t Sched_Passes(void)
+{
+    return s_passes;
+}
+
+uint32_t Sched_Sleeps(void)
+{
+    return s_sleeps;
+}
@@ -0,0 +1,230 @@
+/*
+ * Register transport for the ADXL345s (I2C1 or SPI2 + DMA).
+ * The SPI backend runs the sensor in 4-wire mode 3 with a software chip
+ * select, so one FIFO drain costs a fraction of the I2C bus time and the
+ * 3200 Hz ODR leaves headroom for interrupt latency.
+ */
+/* filename: Core/Src/sensor_bus.c */
+#include "sensor_bus.h"
+#include "timebase.h"
+#include <string.h>
+
+// 8-bit HAL addresses: sensor 0 SDO=GND (0x53), sensor 1 SDO=VDDIO (0x1D)
+static const uint16_t k_i2c_addr[SENSOR_MAX_DEVICES] = {
+    (0x53 << 1),
+#if SENSOR_MAX_DEVICES > 1
+    (0x1D << 1),
+#endif
+};
+
+// ADXL345 SPI command byte: bit7 = read, bit6 = multi-byte
+#define ADXL_SPI_READ  0x80u
+#define ADXL_SPI_MB    0x40u
+
+static AppContext_t* s_ctx = NULL;
+static volatile uint8_t s_async_sensor = 0; // Sensor of the transfer in flight
+
+#if SENSOR_BUS_USE_SPI
+// Staging buffers: byte 0 carries the command/address, the rest is payload.
+static uint8_t s_spi_tx[SENSOR_BUS_MAX_XFER + 1] __attribute__ ((aligned (4)));
+static uint8_t s_spi_rx[SENSOR_BUS_MAX_XFER + 1] __attribute__ ((aligned (4)));
+static uint8_t* volatile s_async_dst = NULL;
+static volatile uint16_t s_async_len = 0;
+
+// Datasheet: at SPI rates > 1.6 MHz, CS must stay high >= 5 us after a data
+// register read before the next FIFO/FIFO_STATUS read, or the pop is incomplete.
+#define SENSOR_BUS_SPI_POP_GAP_US 5U
+static volatile uint32_t s_cs_release_tick = 0;
+static uint32_t s_pop_gap_ticks = SENSOR_BUS_SPI_POP_GAP_US;
+static uint32_t s_pop_gap_spins = 0;         // Loop bound if TIM2 stops counting
+
+static GPIO_TypeDef* const k_cs_port[SENSOR_MAX_DEVICES] = {
+    ADXL345_CS_GPIO_Port,
+#if SENSOR_MAX_DEVICES > 1
+    ADXL345_2_CS_GPIO_Port,
+#endif
+};
+static const uint16_t k_cs_pin[SENSOR_MAX_DEVICES] = {
+    ADXL345_CS_Pin,
+#if SENSOR_MAX_DEVICES > 1
+    ADXL345_2_CS_Pin,
+#endif
+};
+
+static inline void cs_low(uint8_t sensor)  { HAL_GPIO_WritePin(k_cs_port[sensor], k_cs_pin[sensor], GPIO_PIN_RESET); }
+static inline void cs_high(uint8_t sensor) { HAL_GPIO_WritePin(k_cs_port[sensor], k_cs_pin[sensor], GPIO_PIN_SET); }
+static inline void cs_high_all(void) {
+    for (uint8_t i = 0; i < SENSOR_MAX_DEVICES; i++) cs_high(i);
+}
+#endif
+
+HAL_StatusTypeDef SensorBus_Init(AppContext_t* ctx) {
+    s_ctx = ctx;
+#if SENSOR_BUS_USE_SPI
+    if (ctx->hspi2 == NULL) return HAL_ERROR;
+    cs_high_all();
+    // Timebase_Init() has cached the TIM2 rate; round the gap up to whole ticks.
+    s_pop_gap_ticks = (uint32_t)(((uint64_t)SENSOR_BUS_SPI_POP_GAP_US * Timebase_TickHz() + 999999U) / 1000000U);
+    // Each poll takes several core cycles, so one spin per cycle of the gap is a safe upper bound.
+    s_pop_gap_spins = (uint32_t)(((uint64_t)SENSOR_BUS_SPI_POP_GAP_US * HAL_RCC_GetHCLKFreq()) / 1000000U);
+#else
+    if (ctx->hi2c1 == NULL) return HAL_ERROR;
+#endif
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef SensorBus_ReadRegs(uint8_t sensor, uint8_t reg, uint8_t* buf, uint16_t len, uint32_t timeout_ms) {
+    if (!s_ctx || len == 0 || sensor >= SENSOR_MAX_DEVICES) return HAL_ERROR;
+#if SENSOR_BUS_USE_SPI
+    if (len > SENSOR_BUS_MAX_XFER) return HAL_ERROR;
+    uint8_t tx[SENSOR_BUS_MAX_XFER + 1];
+    uint8_t rx[SENSOR_BUS_MAX_XFER + 1];
+    memset(tx, 0, (size_t)len + 1U);
+    tx[0] = (uint8_t)(ADXL_SPI_READ | ((len > 1U) ? ADXL_SPI_MB : 0U) | (reg & 0x3Fu));
+    cs_low(sensor);
+    HAL_StatusTypeDef st = HAL_SPI_TransmitReceive(s_ctx->hspi2, tx, rx, (uint16_t)(len + 1U), timeout_ms);
+    cs_high(sensor);
+    if (st == HAL_OK) {
+        memcpy(buf, &rx[1], len);
+    }
+    return st;
+#else
+    return HAL_I2C_Mem_Read(s_ctx->hi2c1, k_i2c_addr[sensor], reg, I2C_MEMADD_SIZE_8BIT, buf, len, timeout_ms);
+#endif
+}
+
+HAL_StatusTypeDef SensorBus_WriteReg(uint8_t sensor, uint8_t reg, uint8_t value, uint32_t timeout_ms) {
+    if (!s_ctx || sensor >= SENSOR_MAX_DEVICES) return HAL_ERROR;
+#if SENSOR_BUS_USE_SPI
+    uint8_t tx[2] = { (uint8_t)(reg & 0x3Fu), value };
+    uint8_t rx[2];
+    cs_low(sensor);
+    HAL_StatusTypeDef st = HAL_SPI_TransmitReceive(s_ctx->hspi2, tx, rx, 2, timeout_ms);
+    cs_high(sensor);
+    return st;
+#else
+    return HAL_I2C_Mem_Write(s_ctx->hi2c1, k_i2c_addr[sensor], reg, I2C_MEMADD_SIZE_8BIT, &value, 1, timeout_ms);
+#endif
+}
+
+HAL_StatusTypeDef SensorBus_ReadRegsAsync(uint8_t sensor, uint8_t reg, uint8_t* buf, uint16_t len) {
+    if (!s_ctx || len == 0 || len > SENSOR_BUS_MAX_XFER || sensor >= SENSOR_MAX_DEVICES) return HAL_ERROR;
+    s_async_sensor = sensor;
+#if SENSOR_BUS_USE_SPI
+    // Only byte 0 is meaningful on MOSI; the payload bytes are don't-care.
+    s_spi_tx[0] = (uint8_t)(ADXL_SPI_READ | ((len > 1U) ? ADXL_SPI_MB : 0U) | (reg & 0x3Fu));
+    s_async_dst = buf;
+    s_async_len = len;
+    // Chained drain reads come back within a few us of the previous CS release.
+    for (uint32_t n = 0; n < s_pop_gap_spins; n++) {
+        if ((__HAL_TIM_GET_COUNTER(s_ctx->htim2) - s_cs_release_tick) >= s_pop_gap_ticks) break;
+    }
+    cs_low(sensor);
+    HAL_StatusTypeDef st = HAL_SPI_TransmitReceive_DMA(s_ctx->hspi2, s_spi_tx, s_spi_rx, (uint16_t)(len + 1U));
+    if (st != HAL_OK) {
+        cs_high(sensor);
+        s_async_dst = NULL;
+    }
+    return st;
+#else
+    // Single-byte status reads are cheaper in IT mode than setting up a DMA stream.
+    if (len == 1U) {
+        return HAL_I2C_Mem_Read_IT(s_ctx->hi2c1, k_i2c_addr[sensor], reg, I2C_MEMADD_SIZE_8BIT, buf, 1);
+    }
+    return HAL_I2C_Mem_Read_DMA(s_ctx->hi2c1, k_i2c_addr[sensor], reg, I2C_MEMADD_SIZE_8BIT, buf, len);
+#endif
+}
+
+bool SensorBus_IsReady(void) {
+    if (!s_ctx) return false;
+#if SENSOR_BUS_USE_SPI
+    return HAL_SPI_GetState(s_ctx->hspi2) == HAL_SPI_STATE_READY;
+#else
+    return HAL_I2C_GetState(s_ctx->hi2c1) == HAL_I2C_STATE_READY;
+#endif
+}
+
+void SensorBus_WaitReady(uint32_t to_ms) {
+    if (!s_ctx) return;
+    uint32_t t0 = HAL_GetTick();
+    while (!SensorBus_IsReady()) {
+        if ((HAL_GetTick() - t0) >= to_ms) {
+            break;
+        }
+    }
+}
+
+void SensorBus_AbortIfBusy(uint32_t to_ms) {
+    if (!s_ctx) return;
+    uint32_t t0 = HAL_GetTick();
+    while (!SensorBus_IsReady()) {
+#if SENSOR_BUS_USE_SPI
+        (void)HAL_SPI_Abort(s_ctx->hspi2);
+        cs_high_all();
+#else
+        #if defined(HAL_I2C_Master_Abort_IT)
+        (void)HAL_I2C_Master_Abort_IT(s_ctx->hi2c1, k_i2c_addr[s_async_sensor]);
+        #endif
+#endif
+        if ((HAL_GetTick() - t0) >= to_ms) {
+            break;
+        }
+    }
+}
+
+DMA_HandleTypeDef* SensorBus_GetRxDma(void) {
+    if (!s_ctx) return NULL;
+#if SENSOR_BUS_USE_SPI
+    return s_ctx->hspi2->hdmarx;
+#else
+    return s_ctx->hi2c1->hdmarx;
+#endif
+}
+
+const char* SensorBus_Name(void) {
+#if SENSOR_BUS_USE_SPI
+    return "SPI";
+#else
+    return "I2C";
+#endif
+}
+
+// --- HAL Callback Implementations ---
+
+#if SENSOR_BUS_USE_SPI
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi) {
+    if (hspi->Instance != SPI2) {
+        return;
+    }
+    cs_high(s_async_sensor);
+    s_cs_release_tick = __HAL_TIM_GET_COUNTER(s_ctx->htim2);
+    if (s_async_dst) {
+        memcpy(s_async_dst, &s_spi_rx[1], s_async_len);
+        s_async_dst = NULL;
+    }
+    SensorBus_RxCpltCallback(s_async_sensor);
+}
+
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi) {
+    if (hspi->Instance != SPI2) {
+        return;
+    }
+    cs_high(s_async_sensor);
+    s_async_dst = NULL;
+    SensorBus_ErrorCallback(s_async_sensor);
+}
+#else
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c) {
+    if (hi2c->Instance != I2C1) {
+        return;
+    }
+    SensorBus_RxCpltCallback(s_async_sensor);
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
+    if (hi2c->Instance != I2C1) {
+        return;
+    }
+    SensorBus_ErrorCallback(s_async_sensor);
+}
+#endif
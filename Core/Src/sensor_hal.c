@@ -1,18 +1,26 @@
 /*
- * Manages the ADXL345 sensor via I2C.
+ * Manages the ADXL345 sensors via I2C or SPI (see sensor_bus.h).
  * Implements a non-blocking, DMA-driven state machine for data acquisition,
- * triggered by FIFO watermark interrupts.
+ * triggered by FIFO watermark interrupts. Each sensor has its own ring, raw
+ * banks and drain engine; the engines share the bus one transfer at a time.
  */
 /* filename: Core/Src/sensor_hal.c */
 #include "main.h"
 #include "sensor_hal.h"
+#include "sensor_bus.h"
 #include "app_context.h"
 #include "streaming.h"
 #include "telemetry.h"
+#include "timebase.h"
+#include "comm.h"
+#include "api_schema.h"
+#include "sched.h"
+#include "app_rtos.h"
+#include "prof.h"
 #include <string.h>
+#include <math.h>   // llround (fixed-point offsets)
 
 // --- Private Defines ---
-#define ACCEL_SENSOR_ADDR (0x53 << 1) // 8-bit HAL address (0xA6/0xA7), SDO=GND
 #define ACCEL_REG_DEVID 0x00
 #define ACCEL_REG_POWER_CTL 0x2D
 #define ACCEL_REG_DATA_FORMAT 0x31
@@ -23,43 +31,219 @@
 #define ACCEL_REG_INT_SOURCE  0x30
 #define ACCEL_REG_FIFO_CTL    0x38
 #define ACCEL_REG_FIFO_STATUS 0x39
+#define ACCEL_REG_THRESH_ACT    0x24
+#define ACCEL_REG_THRESH_INACT  0x25
+#define ACCEL_REG_TIME_INACT    0x26
+#define ACCEL_REG_ACT_INACT_CTL 0x27
+
+// INT_ENABLE / INT_SOURCE bits
+#define ADXL_INT_ACTIVITY   0x10
+#define ADXL_INT_INACTIVITY 0x08
+#define ADXL_INT_WATERMARK  0x02
+
+// POWER_CTL bits
+#define ADXL_PWR_LINK       0x20
+#define ADXL_PWR_AUTO_SLEEP 0x10
+#define ADXL_PWR_MEASURE    0x08
+
+#define ADXL_ACT_INACT_ALL_AC 0xFF // AC-coupled activity and inactivity on x, y, z
+#define ADXL_THRESH_MG_X2_PER_LSB 125U // 62.5 mg/LSB
 
 // Per datasheet, FULL_RES mode has a fixed sensitivity of ~3.9mg/LSB regardless of G-range.
 // 1 LSB = 0.00390625 g * 9.80665 m/s^2/g = 0.038245935 m/s^2
 #define ADXL_LSB_TO_MS2 0.038245935f
+// Sensor_ConvertBatchMilli: mm/s^2 = (raw * K - off_q + half) >> Q, K = scale * 1000 * 2^Q
+#define SENSOR_MILLI_Q 24
+#define SENSOR_MILLI_K ((int64_t)((double)ADXL_LSB_TO_MS2 * 1000.0 * (double)(1L << SENSOR_MILLI_Q) + 0.5))
+#define SENSOR_MILLI_HALF ((int64_t)1 << (SENSOR_MILLI_Q - 1))
 
-#define OFFSET_CAL_SAMPLES ((DEFAULT_ODR_HZ / 4 > 100) ? (DEFAULT_ODR_HZ / 4) : 100)
+#define OFFSET_CAL_SAMPLES(odr) (((odr) / 4U > 100U) ? ((odr) / 4U) : 100U)
+#define OFFSET_CAL_SETTLE_MS 250 // Samples in this window after start are discarded
 #define OFFSET_CAL_MAX_DURATION_MS 5000
 
 #define SENSOR_WRITE_VERIFY_RETRIES 3
 #define SENSOR_WRITE_VERIFY_DELAY_MS 1
 
-#define DMA_RX_BUF_SAMPLES 32 // Must be >= FIFO watermark level
-#define DMA_RX_BUF_SIZE (DMA_RX_BUF_SAMPLES * 6)
+// FIFO: stream mode, watermark interrupt after fifo_watermark entries.
+#define ACCEL_FIFO_MODE_STREAM 0x80
+#define SENSOR_FIFO_WATERMARK 16       // No latency-sensitive consumer
+// Watermark policy (see Sensor_WatermarkFor). LIVE and TRIGGER aim for a batch
+// age of at most SENSOR_WM_LATENCY_MS; BURST batches as much as the 32-entry
+// FIFO allows while leaving room for the drain latency.
+#define SENSOR_WM_LATENCY_MS 10
+#define SENSOR_WM_LOW_LATENCY_MAX 16
+#define SENSOR_WM_BURST 24
+#define SENSOR_WM_IDLE_WAIT_MS 10      // Max wait for the drain before FIFO_CTL is rewritten
+// One DATAX0..DATAZ1 read pops exactly one FIFO entry.
+#define ADXL_FIFO_ENTRY_BYTES 6
+// Raw receive banks: the drain DMAs entries into one bank while PendSV
+// unpacks the other. One bank holds a full sensor FIFO.
+#define SENSOR_RAW_BANKS 2
+#define SENSOR_RAW_BANK_ENTRIES 32
+
+// Timestamp reconstruction. The watermark edge marks the moment the FIFO held
+// fifo_watermark entries, so entry k of a batch was sampled at
+// edge - (wm - 1 - k) * T. T is kept in Q16 TIM2 ticks.
+#define SENSOR_TS_Q 16
+// A capture latch older than this (TIM2 ticks) belongs to an earlier edge.
+#define SENSOR_TS_CAPTURE_MAX_AGE 2000U
+// Drift estimator: measure T between consecutive captured edges and track it
+// with an EMA. Measurements outside +-1/SENSOR_TS_DRIFT_TOL_DIV of nominal are
+// discarded (missed edge, bus error).
+#ifndef SENSOR_TS_DRIFT_EST
+#define SENSOR_TS_DRIFT_EST 1
+#endif
+#define SENSOR_TS_DRIFT_TOL_DIV 20
+#define SENSOR_TS_DRIFT_EMA_SHIFT 4
+
+// No drain engine owns the bus
+#define SENSOR_BUS_FREE 0xFFu
 
 // --- Static variables ---
 // Static context pointer for use in ISR callbacks
 static AppContext_t* s_ctx = NULL;
 
-// Sensor data buffers and state
-static Sample_t sample_ring_buffer[SAMPLE_RING_BUFFER_SIZE];
-volatile uint16_t sample_ring_head = 0;
-volatile uint16_t sample_ring_tail = 0;
-
-// State flags
+typedef enum {
+    BANK_FREE = 0,
+    BANK_FILLING,   // Owned by the drain ISR
+    BANK_READY      // Handed to PendSV for unpacking
+} RawBankState_t;
+
+typedef struct {
+    uint8_t raw[SENSOR_RAW_BANK_ENTRIES][ADXL_FIFO_ENTRY_BYTES] __attribute__ ((aligned (4))); // Align for DMA
+    volatile uint8_t state;   // RawBankState_t
+    uint8_t count;            // Entries received
+    uint32_t ts_base;         // Batch timestamp base when the bank was opened
+    uint32_t first_index;     // Batch index of raw[0]
+    uint32_t period_q16;
+} RawBank_t;
+
+// One ADXL345: wiring, sample ring, drain engine and timestamp state.
+typedef struct {
+    uint8_t index;
+    GPIO_TypeDef* int_port;       // Watermark INT1 line
+    uint16_t int_pin;
+    uint32_t cap_channel;         // TIM2 input capture channel of the INT1 jumper
+    uint32_t cap_flag;            // Its CCxIF flag, 0 if the sensor has no capture
+    uint32_t cap_of_flag;
+
+    // Sample ring (SPSC). head is written only by PendSV, tail only by the
+    // main loop. Each side publishes its index after a DMB, so the other side
+    // never sees an index before the slot contents it covers.
+    Sample_t ring[SAMPLE_RING_BUFFER_SIZE];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t last_ts;    // Stamp of the newest published sample (merge bound)
+    volatile bool last_valid;     // last_ts belongs to the current sampling run
+
+    // Drain engine
+    volatile I2CState_t state;
+    uint8_t fifo_status_buf[1];
+    RawBank_t banks[SENSOR_RAW_BANKS];
+    uint8_t bank_fill;            // Bank the drain writes into (ISR side)
+    uint8_t bank_unpack;          // Next bank to unpack (PendSV side)
+    volatile uint8_t entries_left; // Entries known to be in the FIFO, not yet read
+    uint8_t fifo_watermark;
+    uint32_t prof_edge;           // CYCCNT at the watermark edge (PROF_EXTI_DMA, PROF_DRAIN)
+    bool prof_first;              // First entry of this drain not yet complete
+    bool prof_drain;              // Drain started from an edge, FIFO not yet empty
+
+    // Read waiting for the shared bus (see Bus_ReadAsync)
+    volatile bool req_pending;
+    uint8_t req_reg;
+    uint8_t* req_buf;
+    uint8_t req_len;
+
+    // Activity gate (see Sensor_UpdateActivityGate)
+    volatile bool gate_on;           // INT1 edges go through INT_SOURCE first
+    volatile bool gate_asleep;       // Last event was inactivity: sensor auto-sleeps
+    volatile bool gate_int_stale;    // INT_ENABLE must follow gate_asleep (main loop)
+    bool gate_edge_valid;            // gate_edge belongs to the INT_SOURCE read in flight
+    bool gate_edge_captured;
+    uint32_t gate_edge;
+    uint8_t int_source_buf[1];
+    bool gate_wake_drop;             // Next FIFO_STATUS counts sleep-rate entries to discard
+    uint8_t gate_drop_left;          // Sleep-rate entries still to pop and discard
+    uint8_t gate_drop_buf[ADXL_FIFO_ENTRY_BYTES];
+
+    // Timestamp state (ISR context only, except Ts_SetOdr/Ts_Invalidate)
+    uint32_t ts_period_nom_q16;      // Nominal ODR period
+    volatile uint32_t ts_period_q16; // Period in use (nominal or drift-corrected)
+    uint32_t ts_base;                // TIM2 tick of entry 0 in the open batch
+    uint32_t ts_index;               // Entries stamped in the open batch
+    bool ts_batch_open;
+    bool ts_batch_from_edge;         // Batch started from a captured edge
+    uint32_t ts_batch_edge;
+    bool ts_prev_valid;              // Previous batch usable for drift measurement
+    uint32_t ts_prev_edge;
+    uint32_t ts_prev_count;
+
+    // Calibration data
+    float off_ms2[3];
+    int64_t off_q[3];                // off_ms2 * 1000 * 2^SENSOR_MILLI_Q (Sensor_ConvertBatchMilli)
+    bool off_valid;                  // Measured by the offset job or restored from flash
+    volatile uint32_t cal_skip;      // Settle samples still to discard
+    volatile uint32_t cal_n;
+    int32_t cal_sum[3];
+} SensorDev_t;
+
+static SensorDev_t g_dev[SENSOR_MAX_DEVICES];
+static uint8_t g_dev_count = 0;           // Sensors found at init: indices 0..g_dev_count-1
+static volatile uint8_t g_bus_owner = SENSOR_BUS_FREE; // Engine with a transfer in flight
+static uint8_t g_peek_dev = 0;            // Ring behind the last Sensor_PeekSamples() span
+
+// State flags. Sampling is switched for all sensors at once, so their
+// streams start at the same TIM2 instant.
 volatile bool g_sampling_active = false;
-volatile I2CState_t g_i2c_state = I2C_STATE_IDLE;
 
-// Non-blocking I2C buffers
-static uint8_t g_fifo_status_buf[1];
-static uint8_t g_dma_rx_buf[DMA_RX_BUF_SIZE] __attribute__ ((aligned (4))); // Align for DMA
-static volatile uint8_t g_samples_to_read = 0;
-
-// Calibration and preview data
-static float offX_ms2 = 0.0f, offY_ms2 = 0.0f, offZ_ms2 = 0.0f;
-static PreviewSnap_t g_preview;
-
-// Diagnostic counters
+static SensorConsumer_t g_consumer = SENSOR_CONSUMER_NONE;
+static bool g_fifo_policy_live = false; // FIFO_CTL is in stream mode and owned by the policy
+static bool g_gate_active = false;      // Activity gate programmed into every sensor
+
+// Offset calibration job. PendSV accumulates raw counts from the drain; the
+// main loop (Sensor_Pump) finishes the job once every sensor has enough samples.
+static volatile bool g_cal_running = false;
+static uint32_t g_cal_target = 0;          // Samples per sensor
+static uint32_t g_cal_start_ms = 0;
+static bool g_cal_owns_sampling = false;   // Job started sampling and must stop it
+
+// Self-test job, pumped from Sensor_Pump. Each step does a handful of short
+// register transfers at most; waits are timed, never delayed.
+#define SELFTEST_STABLE_MS 20          // After entering measurement mode
+#define SELFTEST_SAMPLE_TIMEOUT_MS 100 // Max wait for DATA_READY per sample
+#define SELFTEST_BUS_WAIT_MS 50        // Max wait for a running FIFO drain
+
+typedef enum {
+    ST_IDLE = 0,
+    ST_WAIT_BUS,
+    ST_SAVE_REGS,
+    ST_CONFIGURE,
+    ST_WAIT_STABLE,
+    ST_SAMPLE_OFF,
+    ST_ENABLE_ST,
+    ST_SETTLE_ON,
+    ST_SAMPLE_ON,
+    ST_RESTORE,
+    ST_REPORT
+} SelfTestStep_t;
+
+static struct {
+    SelfTestStep_t step;
+    HAL_StatusTypeDef status;
+    uint8_t avg_count;
+    uint8_t settle_count;
+    uint32_t test_odr_hz;
+    bool was_sampling;
+    bool registers_saved;
+    uint8_t old_power_ctl, old_data_format, old_bw_rate, old_fifo_ctl, old_int_enable;
+    uint8_t test_data_format;
+    uint8_t n;              // Samples taken in the current step
+    int32_t sum[3];
+    uint32_t step_start_ms;
+    AdxlSelfTestResult_t results;
+} g_st;
+
+// Diagnostic counters (summed over all sensors)
 volatile uint32_t g_debug_exti_callback_count = 0;
 volatile uint32_t g_debug_exti_rejected_sampling = 0;
 volatile uint32_t g_debug_exti_rejected_context = 0;
@@ -68,104 +252,213 @@ volatile uint32_t g_debug_dma_start_ok = 0;
 volatile uint32_t g_debug_dma_start_fail = 0;
 volatile uint32_t g_debug_dma_complete_count = 0;
 volatile uint32_t g_debug_samples_processed = 0;
+volatile uint32_t g_debug_ts_edge_captured = 0;
+volatile uint32_t g_debug_ts_edge_fallback = 0;
+volatile uint32_t g_debug_ts_drift_rejected = 0;
+volatile uint32_t g_debug_bank_parked = 0;
+volatile uint32_t g_debug_gate_wakeups = 0;
+volatile uint32_t g_debug_gate_sleeps = 0;
+volatile uint32_t g_debug_gate_wake_dropped = 0;
+volatile uint32_t g_debug_merge_unordered = 0;
 
 
 // --- Private Function Prototypes ---
-static HAL_StatusTypeDef Sensor_WriteVerifyReg(AppContext_t* ctx, uint8_t reg, uint8_t value_to_write);
-static void I2C1_WaitReady(uint32_t to_ms);
-static void I2C1_AbortIfBusy(uint32_t to_ms);
-static HAL_StatusTypeDef Sensor_ReadRawSampleBlocking(AppContext_t* ctx, int16_t* x, int16_t* y, int16_t* z);
+static HAL_StatusTypeDef Dev_Configure(SensorDev_t* d, uint32_t odr_hz, uint8_t wm);
+static HAL_StatusTypeDef Sensor_WriteVerifyReg(SensorDev_t* d, uint8_t reg, uint8_t value_to_write);
+static HAL_StatusTypeDef Sensor_PollRawSample(SensorDev_t* d, int16_t* x, int16_t* y, int16_t* z);
+static uint8_t Sensor_RateCode(uint32_t odr_hz);
+static bool Bus_ReadAsync(SensorDev_t* d, uint8_t reg, uint8_t* buf, uint8_t len);
+static void Bus_Release(void);
+static void Drain_ReadNextEntry(SensorDev_t* d);
+static void Drain_ReadStatus(SensorDev_t* d);
+static void Drain_OnReadComplete(SensorDev_t* d);
+static void Drain_StoreEntry(SensorDev_t* d, const uint8_t* p, uint32_t ts);
+static bool Drain_IntAsserted(const SensorDev_t* d);
+static bool Drain_AllIdle(void);
+static void Drain_Kick(SensorDev_t* d);
+static bool Drain_Quiesce(void);
+static void Drain_Resume(void);
+static HAL_StatusTypeDef Sensor_ApplyWatermark(uint8_t wm);
+static uint8_t Gate_ThreshCode(uint16_t mg);
+static void Gate_ReadIntSource(SensorDev_t* d, bool from_edge);
+static void Gate_OnIntSource(SensorDev_t* d);
+static void Gate_DropNextEntry(SensorDev_t* d);
+static HAL_StatusTypeDef Gate_Program(SensorDev_t* d, const TriggerSettings_t* ts);
+static HAL_StatusTypeDef Gate_Remove(SensorDev_t* d);
+static void Gate_Pump(void);
+static void Dev_SetOffset(SensorDev_t* d, int a, float off_ms2);
+static void Cal_Pump(AppContext_t* ctx);
+static void SelfTest_Enter(SelfTestStep_t step);
+static void SelfTest_Pump(AppContext_t* ctx);
+static bool Bank_Acquire(SensorDev_t* d);
+static void Bank_Submit(SensorDev_t* d);
+static void Ts_SetOdr(SensorDev_t* d, uint8_t rate_code);
+static void Ts_Invalidate(SensorDev_t* d);
+static uint32_t Ts_LatchEdgeTick(SensorDev_t* d, bool* captured);
+static void Ts_BeginBatch(SensorDev_t* d, uint32_t ref_tick, uint32_t entries, bool from_edge);
+static void Ts_EndBatch(SensorDev_t* d);
 
 // --- Public Functions ---
 
 HAL_StatusTypeDef Sensor_Init(AppContext_t* ctx) {
     s_ctx = ctx; // Store context for ISRs
 
-    // 1. Check device ID
-    uint8_t devid = 0;
-    if (HAL_I2C_Mem_Read(ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_DEVID, I2C_MEMADD_SIZE_8BIT, &devid, 1, 100) != HAL_OK || devid != 0xE5) {
+    if (SensorBus_Init(ctx) != HAL_OK) {
         return HAL_ERROR;
     }
 
-    // --- Normative Initialization Sequence ---
-
-    // 2. Place sensor in STANDBY mode to allow configuration.
-    if (Sensor_WriteVerifyReg(ctx, ACCEL_REG_POWER_CTL, 0x00) != HAL_OK) {
-        return HAL_ERROR;
+    memset(g_dev, 0, sizeof(g_dev));
+    g_dev[0].int_port = ADXL345_INT1_GPIO_Port;
+    g_dev[0].int_pin = ADXL345_INT1_Pin;
+    g_dev[0].cap_channel = TIM_CHANNEL_3; // PB10 jumper
+    g_dev[0].cap_flag = TIM_FLAG_CC3;
+    g_dev[0].cap_of_flag = TIM_FLAG_CC3OF;
+#if SENSOR_MAX_DEVICES > 1
+    g_dev[1].int_port = ADXL345_2_INT1_GPIO_Port;
+    g_dev[1].int_pin = ADXL345_2_INT1_Pin;
+    // No free TIM2 channel on the Arduino header: stamped from EXTI entry time.
+#endif
+
+    uint8_t wm = Sensor_WatermarkFor(ctx->cfg.odr_hz, g_consumer);
+    g_dev_count = 0;
+    for (uint8_t i = 0; i < SENSOR_MAX_DEVICES; i++) {
+        SensorDev_t* d = &g_dev[i];
+        d->index = i;
+        d->fifo_watermark = SENSOR_FIFO_WATERMARK;
+
+        // 1. Check device ID. The primary sensor is required; a missing
+        // secondary sensor just leaves a single-sensor system.
+        uint8_t devid = 0;
+        if (SensorBus_ReadRegs(i, ACCEL_REG_DEVID, &devid, 1, 100) != HAL_OK || devid != 0xE5) {
+            if (i == 0U) {
+                return HAL_ERROR;
+            }
+            break;
+        }
+        if (Dev_Configure(d, ctx->cfg.odr_hz, wm) != HAL_OK) {
+            return HAL_ERROR;
+        }
+        g_dev_count++;
     }
+    g_fifo_policy_live = true;
 
-    // 3. Set Output Data Rate.
-    if (Sensor_SetODR(ctx, ctx->cfg.odr_hz) != HAL_OK) {
-        return HAL_ERROR;
-    }
+    HAL_Delay(20); // Wait for sensor to stabilize.
+    return HAL_OK;
+}
 
-    // 4. Set data format: INT_INVERT=1 (Active-LOW), FULL_RES=1, Range=±2g.
-    if (Sensor_WriteVerifyReg(ctx, ACCEL_REG_DATA_FORMAT, 0x28) != HAL_OK) {
-        return HAL_ERROR;
+uint8_t Sensor_DeviceCount(void) {
+    return g_dev_count;
+}
+
+void Sensor_StartOffsetCalibration(AppContext_t* ctx) {
+    uint32_t odr = (ctx->cfg.odr_hz > 0U) ? ctx->cfg.odr_hz : DEFAULT_ODR_HZ;
+    bool was_sampling = Sensor_IsSampling(ctx);
+
+    __disable_irq();
+    for (uint8_t i = 0; i < g_dev_count; i++) {
+        SensorDev_t* d = &g_dev[i];
+        d->cal_sum[0] = d->cal_sum[1] = d->cal_sum[2] = 0;
+        d->cal_n = 0;
+        d->cal_skip = (odr * OFFSET_CAL_SETTLE_MS) / 1000U;
     }
+    g_cal_target = OFFSET_CAL_SAMPLES(odr);
+    g_cal_running = true;
+    __enable_irq();
+    g_cal_start_ms = HAL_GetTick();
 
-    // 5. Set FIFO to Stream mode with 16-sample watermark.
-    if (Sensor_WriteVerifyReg(ctx, ACCEL_REG_FIFO_CTL, 0x90) != HAL_OK) {
-        return HAL_ERROR;
+    if (!was_sampling) {
+        Sensor_StartSampling(ctx);
+        g_cal_owns_sampling = true;
     }
+}
 
-    // 6. Map all interrupts to INT1 pin.
-    if (Sensor_WriteVerifyReg(ctx, ACCEL_REG_INT_MAP, 0x00) != HAL_OK) {
-        return HAL_ERROR;
+bool Sensor_IsOffsetCalibrating(void) {
+    return g_cal_running;
+}
+
+void Sensor_Pump(AppContext_t* ctx) {
+    Cal_Pump(ctx);
+    SelfTest_Pump(ctx);
+    if (g_st.step != ST_IDLE) {
+        Sched_ArmTimeout(1U); // The self-test polls DATA_READY with the FIFO bypassed
     }
+    Gate_Pump();
+}
 
-    // 7. Enable the WATERMARK interrupt source.
-    if (Sensor_WriteVerifyReg(ctx, ACCEL_REG_INT_ENABLE, 0x02) != HAL_OK) {
-        return HAL_ERROR;
+static void Dev_SetOffset(SensorDev_t* d, int a, float off_ms2) {
+    d->off_ms2[a] = off_ms2;
+    d->off_q[a] = llround((double)off_ms2 * 1000.0 * (double)(1L << SENSOR_MILLI_Q));
+}
+
+static void Cal_Pump(AppContext_t* ctx) {
+    if (!g_cal_running) return;
+
+    // While the job owns sampling nobody else reads the ring; keep it from overflowing.
+    if (g_cal_owns_sampling) {
+        Sensor_FlushSamples();
     }
 
-    // 8. Activate Measurement Mode.
-    if (Sensor_WriteVerifyReg(ctx, ACCEL_REG_POWER_CTL, (1 << 3)) != HAL_OK) { // 0x08 = Measure
-        return HAL_ERROR;
+    bool done = true;
+    for (uint8_t i = 0; i < g_dev_count; i++) {
+        if (g_dev[i].cal_n < g_cal_target) done = false;
+    }
+    const uint32_t elapsed = HAL_GetTick() - g_cal_start_ms;
+    bool timed_out = elapsed >= OFFSET_CAL_MAX_DURATION_MS;
+    if (!done && !timed_out) {
+        Sched_ArmTimeout(OFFSET_CAL_MAX_DURATION_MS - elapsed);
+        return;
     }
 
-    // 9. Clear any latched interrupts from the initial power-on/measurement sequence.
-    // This is done by reading the INT_SOURCE register, preventing a missed initial interrupt.
-    uint8_t int_source;
-    if (HAL_I2C_Mem_Read(ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_INT_SOURCE, I2C_MEMADD_SIZE_8BIT, &int_source, 1, 100) != HAL_OK) {
-        return HAL_ERROR;
+    g_cal_running = false; // PendSV stops accumulating
+    __DMB();
+    if (g_cal_owns_sampling) {
+        Sensor_StopSampling(ctx);
+        g_cal_owns_sampling = false;
     }
-    
-    HAL_Delay(20); // Wait for sensor to stabilize.
-    return HAL_OK;
-}
 
-void Sensor_PerformOffsetCalibration(AppContext_t* ctx) {
-    float sum_x = 0.0f, sum_y = 0.0f, sum_z = 0.0f;
-    int n = 0;
-    uint32_t start_time = HAL_GetTick();
-    uint8_t i2c_buf[6];
-    while (n < OFFSET_CAL_SAMPLES && (HAL_GetTick() - start_time < OFFSET_CAL_MAX_DURATION_MS)) {
-        if (HAL_I2C_Mem_Read(ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_DATAX0, I2C_MEMADD_SIZE_8BIT, i2c_buf, 6, 10) == HAL_OK) {
-            sum_x += (float)((int16_t)((i2c_buf[1] << 8) | i2c_buf[0]));
-            sum_y += (float)((int16_t)((i2c_buf[3] << 8) | i2c_buf[2]));
-            sum_z += (float)((int16_t)((i2c_buf[5] << 8) | i2c_buf[4]));
-            n++;
+    for (uint8_t i = 0; i < g_dev_count; i++) {
+        SensorDev_t* d = &g_dev[i];
+        uint32_t n = d->cal_n;
+        if (n >= g_cal_target) {
+            for (int a = 0; a < 3; a++) {
+                Dev_SetOffset(d, a, ((float)d->cal_sum[a] / (float)n) * ADXL_LSB_TO_MS2);
+            }
+            d->off_valid = true;
+            COMM_Sendf(MSG_CAL_INFO ",status=offset_done,n=%lu,ox=%.3f,oy=%.3f,oz=%.3f,sensor=%u" PROTO_EOL,
+                       (unsigned long)n, d->off_ms2[0], d->off_ms2[1], d->off_ms2[2], i);
+        } else {
+            // Keep the previous offsets.
+            COMM_Sendf(MSG_CAL_INFO ",status=offset_failed,n=%lu,reason=timeout,sensor=%u" PROTO_EOL,
+                       (unsigned long)n, i);
         }
-        HAL_Delay(1);
-    }
-    if (n > 0) {
-        offX_ms2 = (sum_x / n) * ADXL_LSB_TO_MS2;
-        offY_ms2 = (sum_y / n) * ADXL_LSB_TO_MS2;
-        offZ_ms2 = (sum_z / n) * ADXL_LSB_TO_MS2;
     }
 }
 
 void Sensor_StartSampling(AppContext_t* ctx) {
+    (void)ctx;
+    // An explicit start hands sampling over from a running offset calibration.
+    g_cal_owns_sampling = false;
     __disable_irq();
-    sample_ring_head = 0;
-    sample_ring_tail = 0;
-    g_i2c_state = I2C_STATE_IDLE;
+    for (uint8_t i = 0; i < g_dev_count; i++) {
+        SensorDev_t* d = &g_dev[i];
+        d->tail = d->head; // Drop stale samples
+        d->last_valid = false;
+        Ts_Invalidate(d);
+    }
     g_sampling_active = true;
+    // If a FIFO passed the watermark while sampling was off, INT1 is already
+    // low and no new falling edge will come. Drain it with an explicit FIFO_STATUS read.
+    for (uint8_t i = 0; i < g_dev_count; i++) {
+        SensorDev_t* d = &g_dev[i];
+        if (d->state == I2C_STATE_IDLE && Drain_IntAsserted(d)) {
+            Drain_Kick(d);
+        }
+    }
     __enable_irq();
 }
 
 void Sensor_StopSampling(AppContext_t* ctx) {
+    (void)ctx;
     __disable_irq();
     g_sampling_active = false;
     __enable_irq();
@@ -181,23 +474,100 @@ bool Sensor_IsSampling(AppContext_t* ctx) {
 }
 
 HAL_StatusTypeDef Sensor_SetODR(AppContext_t* ctx, uint32_t odr_hz) {
-    uint8_t rate_code;
-    if (odr_hz >= 3200) rate_code = 0x0F;
-    else if (odr_hz >= 1600) rate_code = 0x0E;
-    else if (odr_hz >= 800) rate_code = 0x0D;
-    else if (odr_hz >= 400) rate_code = 0x0C;
-    else if (odr_hz >= 200) rate_code = 0x0B;
-    else rate_code = 0x0A; // Default 100Hz
-
-    I2C1_AbortIfBusy(10);
-    I2C1_WaitReady(10);
-    HAL_StatusTypeDef status = Sensor_WriteVerifyReg(ctx, ACCEL_REG_BW_RATE, rate_code);
+    (void)ctx;
+    uint8_t rate_code = Sensor_RateCode(odr_hz);
+
+    SensorBus_AbortIfBusy(10);
+    SensorBus_WaitReady(10);
+    HAL_StatusTypeDef status = HAL_OK;
+    for (uint8_t i = 0; i < g_dev_count; i++) {
+        HAL_StatusTypeDef st = Sensor_WriteVerifyReg(&g_dev[i], ACCEL_REG_BW_RATE, rate_code);
+        if (st == HAL_OK) {
+            Ts_SetOdr(&g_dev[i], rate_code);
+        } else {
+            status = st;
+        }
+    }
+    if (status != HAL_OK) {
+        Telemetry_SendERROR(SensorBus_Name(), 10, "set_odr_busy");
+    } else if (g_fifo_policy_live) {
+        (void)Sensor_ApplyWatermark(Sensor_WatermarkFor(odr_hz, g_consumer));
+    }
+    return status;
+}
+
+uint8_t Sensor_WatermarkFor(uint32_t odr_hz, SensorConsumer_t consumer) {
+    uint32_t wm;
+    switch (consumer) {
+    case SENSOR_CONSUMER_BURST:
+        wm = SENSOR_WM_BURST;
+        break;
+    case SENSOR_CONSUMER_LIVE:
+    case SENSOR_CONSUMER_TRIGGER:
+        wm = (Sensor_SnapODR(odr_hz) * SENSOR_WM_LATENCY_MS) / 1000U;
+        if (wm > SENSOR_WM_LOW_LATENCY_MAX) wm = SENSOR_WM_LOW_LATENCY_MAX;
+        break;
+    case SENSOR_CONSUMER_NONE:
+    default:
+        wm = SENSOR_FIFO_WATERMARK;
+        break;
+    }
+    if (wm < 1U) wm = 1U;
+    return (uint8_t)wm;
+}
+
+HAL_StatusTypeDef Sensor_SetConsumer(AppContext_t* ctx, SensorConsumer_t consumer) {
+    g_consumer = consumer;
+    if (!g_fifo_policy_live) {
+        return HAL_OK; // Applied when the FIFO is (re)configured
+    }
+    HAL_StatusTypeDef status = Sensor_ApplyWatermark(Sensor_WatermarkFor(ctx->cfg.odr_hz, consumer));
+    HAL_StatusTypeDef gate = Sensor_UpdateActivityGate(ctx);
+    return (status != HAL_OK) ? status : gate;
+}
+
+HAL_StatusTypeDef Sensor_UpdateActivityGate(AppContext_t* ctx) {
+    const TriggerSettings_t* ts = &ctx->trigger_settings;
+    bool want = ts->sleep_en && (g_consumer == SENSOR_CONSUMER_TRIGGER);
+    if ((!want && !g_gate_active) || !g_fifo_policy_live) {
+        return HAL_OK;
+    }
+
+    HAL_StatusTypeDef status = HAL_BUSY;
+    if (Drain_Quiesce()) {
+        status = HAL_OK;
+        for (uint8_t i = 0; i < g_dev_count; i++) {
+            HAL_StatusTypeDef st = want ? Gate_Program(&g_dev[i], ts) : Gate_Remove(&g_dev[i]);
+            if (st != HAL_OK) status = st;
+        }
+        if (want && status != HAL_OK) {
+            // Never leave a sensor asleep that the rest of the system believes is awake.
+            for (uint8_t i = 0; i < g_dev_count; i++) {
+                (void)Gate_Remove(&g_dev[i]);
+            }
+        }
+        g_gate_active = want && (status == HAL_OK);
+    }
+    Drain_Resume();
+
     if (status != HAL_OK) {
-        Telemetry_SendERROR("I2C", 10, "set_odr_busy");
+        Telemetry_SendERROR(SensorBus_Name(), 12, "act_gate_busy");
     }
     return status;
 }
 
+bool Sensor_IsActivityGateAsleep(void) {
+    if (!g_gate_active) return false;
+    for (uint8_t i = 0; i < g_dev_count; i++) {
+        if (!g_dev[i].gate_asleep || g_dev[i].gate_int_stale) return false;
+    }
+    return true;
+}
+
+uint8_t Sensor_GetWatermark(void) {
+    return g_dev[0].fifo_watermark;
+}
+
 uint32_t Sensor_SnapODR(uint32_t req) {
     if (req >= 3200) return 3200;
     if (req >= 1600) return 1600;
@@ -209,7 +579,7 @@ uint32_t Sensor_SnapODR(uint32_t req) {
 
 void Sensor_ReconfigureTimer(AppContext_t* ctx, uint32_t odr_hz) {
     if (odr_hz == 0) odr_hz = 1;
-    
+
     HAL_TIM_Base_Stop_IT(ctx->htim3);
     ctx->htim3->Init.Prescaler = 899;
     uint32_t period = 100000U / odr_hz;
@@ -221,325 +591,1168 @@ void Sensor_ReconfigureTimer(AppContext_t* ctx, uint32_t odr_hz) {
 }
 
 bool Sensor_GetSample(Sample_t* sample) {
-    bool has_data;
-    __disable_irq();
-    if (sample_ring_head != sample_ring_tail) {
-        *sample = sample_ring_buffer[sample_ring_tail];
-        sample_ring_tail = (sample_ring_tail + 1U) % SAMPLE_RING_BUFFER_SIZE;
-        has_data = true;
-    } else {
-        has_data = false;
-    }
-    __enable_irq();
-    return has_data;
+    return Sensor_GetSamples(sample, 1) == 1U;
 }
 
-uint32_t Sensor_TicksToUs(AppContext_t* ctx, uint32_t ticks) {
-    uint32_t pclk1 = HAL_RCC_GetPCLK1Freq();
-    uint32_t timclk = pclk1;
-    if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1) {
-        timclk *= 2U;
+uint16_t Sensor_GetSamples(Sample_t* out, uint16_t max) {
+    uint16_t copied = 0;
+    while (copied < max) {
+        const Sample_t* span;
+        uint16_t n = Sensor_PeekSamples(&span);
+        if (n == 0U) break;
+        if (n > (uint16_t)(max - copied)) n = (uint16_t)(max - copied);
+        memcpy(&out[copied], span, (size_t)n * sizeof(Sample_t));
+        Sensor_CommitSamples(n);
+        copied = (uint16_t)(copied + n);
     }
-    uint32_t tick_hz = timclk / (ctx->htim2->Init.Prescaler + 1U);
-    if (tick_hz == 0U) return 0U;
-    uint64_t us = ((uint64_t)ticks * 1000000ULL) / tick_hz;
-    return (us > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)us;
+    return copied;
 }
 
-const PreviewSnap_t* Sensor_GetPreviewSnapshot(AppContext_t* ctx) {
-    bool was_running = Sensor_IsSampling(ctx);
-    if (was_running) {
-        Sensor_StopSampling(ctx);
+uint16_t Sensor_PeekSamples(const Sample_t** span) {
+    // Merge the per-sensor rings in time order: serve the ring whose oldest
+    // unread sample is oldest, and end the span before it passes the oldest
+    // unread sample of any other ring. A sampling sensor with an empty ring
+    // has its next samples still in the FIFO; they are newer than the last
+    // one it published, so the span also ends there.
+    SensorDev_t* best = &g_dev[0];
+    uint32_t best_avail = 0;
+    uint32_t best_ts = 0;
+    uint32_t next_ts = 0;
+    bool have_next = false;
+    uint32_t live_ts = 0;
+    bool have_live = false;
+    bool live_unknown = false;    // A sensor that has published nothing yet this run
+    const bool sampling = g_sampling_active;
+    for (uint8_t i = 0; i < g_dev_count; i++) {
+        SensorDev_t* d = &g_dev[i];
+        uint32_t tail = d->tail;
+        uint32_t avail = d->head - tail;
+        __DMB(); // Acquire: slot contents up to head are visible
+        if (avail == 0U) {
+            // Asleep behind the activity gate it may not publish for seconds
+            if (!sampling || d->gate_asleep) continue;
+            if (!d->last_valid) {
+                live_unknown = true;
+            } else if (!have_live || (int32_t)(d->last_ts - live_ts) < 0) {
+                live_ts = d->last_ts;
+                have_live = true;
+            }
+            continue;
+        }
+        uint32_t ts = d->ring[tail & SAMPLE_RING_MASK].timestamp;
+        if (best_avail == 0U || (int32_t)(ts - best_ts) < 0) {
+            if (best_avail > 0U) {
+                next_ts = best_ts; // Previous best is now the runner-up
+                have_next = true;
+            }
+            best = d;
+            best_avail = avail;
+            best_ts = ts;
+        } else if (!have_next || (int32_t)(ts - next_ts) < 0) {
+            next_ts = ts;
+            have_next = true;
+        }
     }
 
-    __disable_irq();
-    uint16_t head = sample_ring_head;
-    uint16_t tail = sample_ring_tail;
-    __enable_irq();
+    uint32_t idx = best->tail & SAMPLE_RING_MASK;
+    uint32_t to_end = SAMPLE_RING_BUFFER_SIZE - idx;
+    uint32_t n = (best_avail < to_end) ? best_avail : to_end;
+    *span = &best->ring[idx];
+    g_peek_dev = best->index;
+    if (have_next) {
+        uint32_t k = 1; // The first sample is the oldest by construction
+        while (k < n && (int32_t)(best->ring[idx + k].timestamp - next_ts) <= 0) {
+            k++;
+        }
+        n = k;
+    }
+    if ((have_live || live_unknown) && n > 0U) {
+        uint32_t k = 0;
+        if (!live_unknown) {
+            while (k < n && (int32_t)(best->ring[idx + k].timestamp - live_ts) <= 0) {
+                k++;
+            }
+        }
+        // A sensor that has stopped delivering must not overflow this ring:
+        // past half full, serve what there is (out of order with that sensor).
+        if (k > 0U || best_avail < SAMPLE_RING_BUFFER_SIZE / 2U) {
+            n = k;
+        } else {
+            g_debug_merge_unordered++;
+        }
+    }
+    return (uint16_t)n;
+}
+
+void Sensor_CommitSamples(uint16_t n) {
+    SensorDev_t* d = &g_dev[g_peek_dev];
+    __DMB(); // Release: finish reading the slots before handing them back
+    d->tail = d->tail + n;
+}
 
-    uint16_t n = 0;
-    while (tail != head && n < SAMPLE_RING_BUFFER_SIZE) {
-        g_preview.buf[n++] = sample_ring_buffer[tail];
-        tail = (tail + 1) % SAMPLE_RING_BUFFER_SIZE;
+uint16_t Sensor_RewindTo(uint32_t ts_from) {
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < g_dev_count; i++) {
+        SensorDev_t* d = &g_dev[i];
+        const uint32_t head = d->head;
+        __DMB(); // Acquire: slot contents up to head are visible
+        const uint32_t tail = d->tail;
+        // Slots older than head - SAMPLE_HISTORY_MAX may be rewritten before the
+        // new tail is published; the margin covers the drains in between.
+        uint32_t lim = (head > SAMPLE_HISTORY_MAX) ? head - SAMPLE_HISTORY_MAX : 0U;
+        if (tail > SAMPLE_PRETRIG_MAX && tail - SAMPLE_PRETRIG_MAX > lim) lim = tail - SAMPLE_PRETRIG_MAX;
+        uint32_t t = tail;
+        while (t > lim && (int32_t)(d->ring[(t - 1U) & SAMPLE_RING_MASK].timestamp - ts_from) >= 0) {
+            t--;
+        }
+        __DMB(); // Release: reads done before the slots are claimed again
+        d->tail = t;
+        total += tail - t;
     }
-    g_preview.count = n;
+    return (uint16_t)total;
+}
 
-    if (was_running) {
-        Sensor_StartSampling(ctx);
+uint16_t Sensor_RingCount(void) {
+    uint32_t n = 0;
+    for (uint8_t i = 0; i < g_dev_count; i++) {
+        n += g_dev[i].head - g_dev[i].tail;
+    }
+    return (uint16_t)n;
+}
+
+void Sensor_FlushSamples(void) {
+    for (uint8_t i = 0; i < g_dev_count; i++) {
+        g_dev[i].tail = g_dev[i].head;
     }
-    return &g_preview;
+}
+
+I2CState_t Sensor_GetDrainState(uint8_t sensor) {
+    return (sensor < SENSOR_MAX_DEVICES) ? g_dev[sensor].state : I2C_STATE_IDLE;
+}
+
+float Sensor_GetMeasuredOdrHz(void) {
+    uint32_t t_q16 = g_dev[0].ts_period_q16;
+    if (t_q16 == 0U) return 0.0f;
+    return (1000000.0f * (float)(1UL << SENSOR_TS_Q)) / (float)t_q16;
+}
+
+uint32_t Sensor_HistoryOpen(uint16_t max_count, uint16_t* count) {
+    uint32_t head = g_dev[0].head;
+    __DMB(); // Acquire: slot contents up to head are visible
+    uint32_t n = (head < SAMPLE_HISTORY_MAX) ? head : SAMPLE_HISTORY_MAX;
+    if (n > max_count) n = max_count;
+    *count = (uint16_t)n;
+    return head - n;
+}
+
+bool Sensor_HistoryRead(uint32_t index, Sample_t* out) {
+    *out = g_dev[0].ring[index & SAMPLE_RING_MASK];
+    __DMB(); // Finish the copy before checking the epoch
+    // The producer writes index `head` into the slot of index `head - SIZE`.
+    // If it has got that far, the copy may be torn.
+    return (g_dev[0].head - index) < SAMPLE_RING_BUFFER_SIZE;
 }
 
 void Sensor_ConvertToMps2(AppContext_t* ctx, const Sample_t* raw, float* ax, float* ay, float* az) {
     (void)ctx;
-    *ax = (float)raw->x * ADXL_LSB_TO_MS2 - offX_ms2;
-    *ay = (float)raw->y * ADXL_LSB_TO_MS2 - offY_ms2;
-    *az = (float)raw->z * ADXL_LSB_TO_MS2 - offZ_ms2;
+    const float* off = g_dev[(raw->sensor < SENSOR_MAX_DEVICES) ? raw->sensor : 0U].off_ms2;
+    *ax = (float)raw->x * ADXL_LSB_TO_MS2 - off[0];
+    *ay = (float)raw->y * ADXL_LSB_TO_MS2 - off[1];
+    *az = (float)raw->z * ADXL_LSB_TO_MS2 - off[2];
 }
 
-HAL_StatusTypeDef Sensor_PerformSelfTest(AppContext_t* ctx, uint8_t avg_count, uint8_t settle_count, uint32_t force_odr_hz, AdxlSelfTestResult_t* results) {
-    HAL_StatusTypeDef status = HAL_OK;
-    bool was_sampling = Sensor_IsSampling(ctx);
+void Sensor_ConvertBatch(const int16_t* x, const int16_t* y, const int16_t* z, const uint8_t* sensor,
+                         uint16_t n, float* ax, float* ay, float* az) {
+    if (sensor == NULL) {
+        // One sensor: scale and offsets are loop constants, one VFMA per value
+        const float* off = g_dev[0].off_ms2;
+        const float o0 = -off[0], o1 = -off[1], o2 = -off[2];
+        for (uint16_t i = 0; i < n; i++) {
+            ax[i] = (float)x[i] * ADXL_LSB_TO_MS2 + o0;
+            ay[i] = (float)y[i] * ADXL_LSB_TO_MS2 + o1;
+            az[i] = (float)z[i] * ADXL_LSB_TO_MS2 + o2;
+        }
+        return;
+    }
+    for (uint16_t i = 0; i < n; i++) {
+        const float* off = g_dev[(sensor[i] < SENSOR_MAX_DEVICES) ? sensor[i] : 0U].off_ms2;
+        ax[i] = (float)x[i] * ADXL_LSB_TO_MS2 - off[0];
+        ay[i] = (float)y[i] * ADXL_LSB_TO_MS2 - off[1];
+        az[i] = (float)z[i] * ADXL_LSB_TO_MS2 - off[2];
+    }
+}
 
-    uint8_t old_power_ctl = 0, old_data_format = 0, old_bw_rate = 0, old_fifo_ctl = 0, old_int_enable = 0;
-    bool registers_saved = false;
+void Sensor_ConvertBatchMilli(const int16_t* x, const int16_t* y, const int16_t* z, const uint8_t* sensor,
+                              uint16_t n, int32_t* mx, int32_t* my, int32_t* mz) {
+    for (uint16_t i = 0; i < n; i++) {
+        const uint8_t k = (sensor == NULL) ? 0U : ((sensor[i] < SENSOR_MAX_DEVICES) ? sensor[i] : 0U);
+        const int64_t* oq = g_dev[k].off_q;
+        // SMLAL-sized products; the arithmetic shift rounds half up
+        mx[i] = (int32_t)(((int64_t)x[i] * SENSOR_MILLI_K - oq[0] + SENSOR_MILLI_HALF) >> SENSOR_MILLI_Q);
+        my[i] = (int32_t)(((int64_t)y[i] * SENSOR_MILLI_K - oq[1] + SENSOR_MILLI_HALF) >> SENSOR_MILLI_Q);
+        mz[i] = (int32_t)(((int64_t)z[i] * SENSOR_MILLI_K - oq[2] + SENSOR_MILLI_HALF) >> SENSOR_MILLI_Q);
+    }
+}
 
-    memset(results, 0, sizeof(AdxlSelfTestResult_t));
-    if (avg_count == 0) avg_count = 16;
+float Sensor_GetScaleMps2(uint8_t sensor, float off_ms2[3]) {
+    memcpy(off_ms2, g_dev[(sensor < SENSOR_MAX_DEVICES) ? sensor : 0U].off_ms2, 3 * sizeof(float));
+    return ADXL_LSB_TO_MS2;
+}
 
-    if (was_sampling) {
-        Sensor_StopSampling(ctx);
+void Sensor_SetOffsets(uint8_t sensor, const float off_ms2[3]) {
+    if (sensor >= g_dev_count) return;
+    SensorDev_t* d = &g_dev[sensor];
+    for (int a = 0; a < 3; a++) {
+        Dev_SetOffset(d, a, off_ms2[a]);
     }
-    
-    // Save registers that will be modified
-    status = HAL_I2C_Mem_Read(ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_POWER_CTL, I2C_MEMADD_SIZE_8BIT, &old_power_ctl, 1, 100);
-    if (status != HAL_OK) goto cleanup;
-    status = HAL_I2C_Mem_Read(ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_DATA_FORMAT, I2C_MEMADD_SIZE_8BIT, &old_data_format, 1, 100);
-    if (status != HAL_OK) goto cleanup;
-    status = HAL_I2C_Mem_Read(ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_BW_RATE, I2C_MEMADD_SIZE_8BIT, &old_bw_rate, 1, 100);
-    if (status != HAL_OK) goto cleanup;
-    status = HAL_I2C_Mem_Read(ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_FIFO_CTL, I2C_MEMADD_SIZE_8BIT, &old_fifo_ctl, 1, 100);
-    if (status != HAL_OK) goto cleanup;
-    status = HAL_I2C_Mem_Read(ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_INT_ENABLE, I2C_MEMADD_SIZE_8BIT, &old_int_enable, 1, 100);
-    if (status != HAL_OK) goto cleanup;
-    registers_saved = true;
-    
-    // Put sensor in standby and bypass FIFO for single-sample polling
-    if (Sensor_WriteVerifyReg(ctx, ACCEL_REG_POWER_CTL, 0x00) != HAL_OK) goto cleanup_error;
-    if (Sensor_WriteVerifyReg(ctx, ACCEL_REG_FIFO_CTL, 0x00) != HAL_OK) goto cleanup_error;
-
-    uint32_t test_odr = (force_odr_hz > 0) ? force_odr_hz : 400;
-    status = Sensor_SetODR(ctx, test_odr);
-    if (status != HAL_OK) goto cleanup;
-
-    uint8_t test_data_format = (1 << 3) | 0x03; // FULL_RES, +/-16g
-    status = Sensor_WriteVerifyReg(ctx, ACCEL_REG_DATA_FORMAT, test_data_format);
-    if (status != HAL_OK) goto cleanup;
-
-    status = Sensor_WriteVerifyReg(ctx, ACCEL_REG_POWER_CTL, (1 << 3)); // Measurement mode
-    if (status != HAL_OK) goto cleanup;
-    
-    HAL_Delay(20); 
-
-    int32_t sum_x_off = 0, sum_y_off = 0, sum_z_off = 0;
-    for (uint8_t i = 0; i < avg_count; i++) {
-        int16_t x, y, z;
-        status = Sensor_ReadRawSampleBlocking(ctx, &x, &y, &z);
-        if (status != HAL_OK) goto cleanup;
-        sum_x_off += x; sum_y_off += y; sum_z_off += z;
-    }
-    results->x_off = sum_x_off / avg_count;
-    results->y_off = sum_y_off / avg_count;
-    results->z_off = sum_z_off / avg_count;
-    
-    uint8_t st_on_data_format = test_data_format | (1 << 7);
-    status = Sensor_WriteVerifyReg(ctx, ACCEL_REG_DATA_FORMAT, st_on_data_format);
-    if (status != HAL_OK) goto cleanup;
-
-    for (uint8_t i = 0; i < settle_count; i++) {
-        int16_t x, y, z;
-        if ((status = Sensor_ReadRawSampleBlocking(ctx, &x, &y, &z)) != HAL_OK) goto cleanup;
-    }
-
-    int32_t sum_x_on = 0, sum_y_on = 0, sum_z_on = 0;
-    for (uint8_t i = 0; i < avg_count; i++) {
-        int16_t x, y, z;
-        status = Sensor_ReadRawSampleBlocking(ctx, &x, &y, &z);
-        if (status != HAL_OK) goto cleanup;
-        sum_x_on += x; sum_y_on += y; sum_z_on += z;
-    }
-    results->x_on = sum_x_on / avg_count;
-    results->y_on = sum_y_on / avg_count;
-    results->z_on = sum_z_on / avg_count;
-
-    results->x_st = results->x_on - results->x_off;
-    results->y_st = results->y_on - results->y_off;
-    results->z_st = results->z_on - results->z_off;
-
-    // Datasheet Table 12 (LSB), full-resolution mode.
-    // Valid for all VS per datasheet.
-    bool x_ok = (results->x_st >= 50  && results->x_st <= 540);
-    bool y_ok = (results->y_st >= -540 && results->y_st <= -50);
-    bool z_ok = (results->z_st >= 75  && results->z_st <= 875);
-    results->health_pass = (x_ok && y_ok && z_ok);
-
-
-    goto cleanup; // Normal exit
-
-cleanup_error:
-    status = HAL_ERROR;
-
-cleanup:
-    if (registers_saved) {
-        Sensor_WriteVerifyReg(ctx, ACCEL_REG_DATA_FORMAT, old_data_format);
-        Sensor_WriteVerifyReg(ctx, ACCEL_REG_BW_RATE, old_bw_rate);
-        Sensor_WriteVerifyReg(ctx, ACCEL_REG_FIFO_CTL, old_fifo_ctl);
-        Sensor_WriteVerifyReg(ctx, ACCEL_REG_INT_ENABLE, old_int_enable);
-        Sensor_WriteVerifyReg(ctx, ACCEL_REG_POWER_CTL, old_power_ctl);
-    }
-    
-    if (was_sampling) {
-        Sensor_StartSampling(ctx);
+    d->off_valid = true;
+}
+
+bool Sensor_OffsetsValid(void) {
+    for (uint8_t i = 0; i < g_dev_count; i++) {
+        if (!g_dev[i].off_valid) return false;
     }
-    return status;
+    return g_dev_count > 0U;
+}
+
+HAL_StatusTypeDef Sensor_StartSelfTest(AppContext_t* ctx, uint8_t avg_count, uint8_t settle_count, uint32_t force_odr_hz) {
+    if (g_st.step != ST_IDLE) {
+        return HAL_BUSY;
+    }
+    memset(&g_st, 0, sizeof(g_st));
+    g_st.avg_count = (avg_count == 0) ? 16 : avg_count;
+    g_st.settle_count = settle_count;
+    g_st.test_odr_hz = (force_odr_hz > 0) ? force_odr_hz : 400;
+    g_st.status = HAL_OK;
+    g_st.was_sampling = Sensor_IsSampling(ctx);
+
+    if (g_st.was_sampling) {
+        Sensor_StopSampling(ctx);
+    }
+    SelfTest_Enter(ST_WAIT_BUS);
+    return HAL_OK;
+}
+
+bool Sensor_IsSelfTestRunning(void) {
+    return g_st.step != ST_IDLE;
 }
 
 
 // --- HAL Callback Implementations ---
+// HAL_TIM_PeriodElapsedCallback lives in timebase.c (TIM2 wrap count).
+
+void SensorBus_RxCpltCallback(uint8_t sensor) {
+    if (sensor >= g_dev_count) {
+        return;
+    }
+    // Pass the bus to a waiting engine before this one queues its next read,
+    // so the sensors alternate transfer by transfer.
+    Bus_Release();
+    Drain_OnReadComplete(&g_dev[sensor]);
+}
 
-void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim) {
-    // This timer is not used for sensor data acquisition in FIFO watermark interrupt mode.
+void SensorBus_ErrorCallback(uint8_t sensor) {
+    if (sensor >= g_dev_count) {
+        return;
+    }
+    Bus_Release();
+    if (s_ctx) {
+        s_ctx->diag.i2c_fail++;
+    }
+    SensorDev_t* d = &g_dev[sensor];
+    Bank_Submit(d); // Entries already received are still valid
+    Ts_Invalidate(d);
+    d->gate_wake_drop = false;
+    d->state = I2C_STATE_IDLE; // Reset state machine on error
 }
 
-void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c) {
-    if (hi2c->Instance != I2C1) {
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
+    SensorDev_t* d = NULL;
+    for (uint8_t i = 0; i < g_dev_count; i++) {
+        if (g_dev[i].int_pin == GPIO_Pin) {
+            d = &g_dev[i];
+            break;
+        }
+    }
+    if (d == NULL) {
         return;
     }
+    g_debug_exti_callback_count++;
 
-    switch (g_i2c_state) {
-    case I2C_STATE_WAIT_FIFO_DATA: {
-        g_debug_dma_complete_count++;
-        
-        // DMA transfer of FIFO data is complete. Process the received samples.
-        uint8_t samples_to_process = DMA_RX_BUF_SAMPLES;
-        
-        for (uint8_t i = 0; i < samples_to_process; i++) {
-            uint16_t next_head = (sample_ring_head + 1) % SAMPLE_RING_BUFFER_SIZE;
-            if (next_head == sample_ring_tail) {
-                if(s_ctx) s_ctx->diag.ring_ovf++;
-                break; // Stop processing if buffer is full
-            } else {
-                Sample_t* s = &sample_ring_buffer[sample_ring_head];
-                uint8_t* p_sample_data = &g_dma_rx_buf[i * 6];
-                s->x = (int16_t)((p_sample_data[1] << 8) | p_sample_data[0]);
-                s->y = (int16_t)((p_sample_data[3] << 8) | p_sample_data[2]);
-                s->z = (int16_t)((p_sample_data[5] << 8) | p_sample_data[4]);
-                s->timestamp = __HAL_TIM_GET_COUNTER(s_ctx->htim2);
-
-                Streaming_ProcessSampleFromISR(s_ctx, s);
-                
-                g_debug_samples_processed++;
-                sample_ring_head = next_head;
-            }
+    if (!g_sampling_active) {
+        g_debug_exti_rejected_sampling++;
+        d->ts_prev_valid = false;
+        return;
+    }
+
+    if (!s_ctx) {
+        g_debug_exti_rejected_context++;
+        return;
+    }
+
+    if (d->state != I2C_STATE_IDLE) {
+        // The edge is lost for the drift estimate; the ongoing drain picks up the entries.
+        g_debug_exti_rejected_state++;
+        d->ts_prev_valid = false;
+        return;
+    }
+
+    bool captured = false;
+    uint32_t edge = Ts_LatchEdgeTick(d, &captured);
+    if (d->gate_on) {
+        // Activity, inactivity and watermark share INT1; INT_SOURCE tells
+        // which one fired before the edge is used as a watermark stamp.
+        d->gate_edge = edge;
+        d->gate_edge_captured = captured;
+        Gate_ReadIntSource(d, true);
+        return;
+    }
+    Ts_BeginBatch(d, edge, d->fifo_watermark, captured);
+    d->prof_edge = Prof_Now();
+    d->prof_first = true;
+    d->prof_drain = true;
+
+    // Start the non-blocking FIFO drain. The watermark edge guarantees at
+    // least fifo_watermark entries, so skip the initial FIFO_STATUS read.
+    d->entries_left = d->fifo_watermark;
+    Drain_ReadNextEntry(d);
+}
+
+// --- Private Helper Functions ---
+
+// Normative init sequence for one sensor (steps 2-9). Main loop context.
+static HAL_StatusTypeDef Dev_Configure(SensorDev_t* d, uint32_t odr_hz, uint8_t wm) {
+    // 2. Place sensor in STANDBY mode to allow configuration.
+    if (Sensor_WriteVerifyReg(d, ACCEL_REG_POWER_CTL, 0x00) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    // 3. Set Output Data Rate.
+    uint8_t rate_code = Sensor_RateCode(odr_hz);
+    if (Sensor_WriteVerifyReg(d, ACCEL_REG_BW_RATE, rate_code) != HAL_OK) {
+        Telemetry_SendERROR(SensorBus_Name(), 10, "set_odr_busy");
+        return HAL_ERROR;
+    }
+    Ts_SetOdr(d, rate_code);
+
+    // 4. Set data format: INT_INVERT=1 (Active-LOW), FULL_RES=1, Range=±2g.
+    if (Sensor_WriteVerifyReg(d, ACCEL_REG_DATA_FORMAT, 0x28) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    // 5. Set FIFO to Stream mode with the policy watermark for the current ODR.
+    if (Sensor_WriteVerifyReg(d, ACCEL_REG_FIFO_CTL, ACCEL_FIFO_MODE_STREAM | wm) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    d->fifo_watermark = wm;
+
+    // 6. Map all interrupts to INT1 pin.
+    if (Sensor_WriteVerifyReg(d, ACCEL_REG_INT_MAP, 0x00) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    // 7. Enable the WATERMARK interrupt source.
+    if (Sensor_WriteVerifyReg(d, ACCEL_REG_INT_ENABLE, 0x02) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    // 8. Activate Measurement Mode.
+    if (Sensor_WriteVerifyReg(d, ACCEL_REG_POWER_CTL, (1 << 3)) != HAL_OK) { // 0x08 = Measure
+        return HAL_ERROR;
+    }
+
+    // 9. Clear any latched interrupts from the initial power-on/measurement sequence.
+    // This is done by reading the INT_SOURCE register, preventing a missed initial interrupt.
+    uint8_t int_source;
+    if (SensorBus_ReadRegs(d->index, ACCEL_REG_INT_SOURCE, &int_source, 1, 100) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    return HAL_OK;
+}
+
+static uint8_t Sensor_RateCode(uint32_t odr_hz) {
+    if (odr_hz >= 3200) return 0x0F;
+    if (odr_hz >= 1600) return 0x0E;
+    if (odr_hz >= 800) return 0x0D;
+    if (odr_hz >= 400) return 0x0C;
+    if (odr_hz >= 200) return 0x0B;
+    return 0x0A; // Default 100Hz
+}
+
+// --- Self-test state machine (main loop) ---
+
+static void SelfTest_Enter(SelfTestStep_t step) {
+    g_st.step = step;
+    g_st.step_start_ms = HAL_GetTick();
+    g_st.n = 0;
+    g_st.sum[0] = g_st.sum[1] = g_st.sum[2] = 0;
+}
+
+static void SelfTest_Fail(HAL_StatusTypeDef status) {
+    g_st.status = status;
+    SelfTest_Enter(ST_RESTORE);
+}
+
+// Takes at most one sample per call (the FIFO is bypassed, so DATA_READY
+// marks exactly one new sample). Returns true when `count` samples are in.
+static bool SelfTest_Collect(SensorDev_t* d, uint8_t count, bool accumulate) {
+    int16_t x, y, z;
+    HAL_StatusTypeDef status = Sensor_PollRawSample(d, &x, &y, &z);
+    if (status == HAL_OK) {
+        if (accumulate) {
+            g_st.sum[0] += x; g_st.sum[1] += y; g_st.sum[2] += z;
+        }
+        g_st.n++;
+        g_st.step_start_ms = HAL_GetTick(); // Timeout is per sample
+    } else if (status == HAL_BUSY) {
+        if ((HAL_GetTick() - g_st.step_start_ms) >= SELFTEST_SAMPLE_TIMEOUT_MS) {
+            SelfTest_Fail(HAL_TIMEOUT);
+            return false;
         }
+    } else {
+        SelfTest_Fail(status);
+        return false;
+    }
+    return g_st.n >= count;
+}
+
+// Runs on the primary sensor; the others keep their configuration and are
+// drained again once sampling resumes.
+static void SelfTest_Pump(AppContext_t* ctx) {
+    AdxlSelfTestResult_t* r = &g_st.results;
+    SensorDev_t* d = &g_dev[0];
 
-        // After processing, check FIFO_STATUS to see if more samples need to be drained.
-        g_i2c_state = I2C_STATE_DRAIN_STATUS;
-        if (HAL_I2C_Mem_Read_IT(s_ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_FIFO_STATUS, I2C_MEMADD_SIZE_8BIT, g_fifo_status_buf, 1) != HAL_OK) {
-            g_i2c_state = I2C_STATE_IDLE;
-            if (s_ctx) s_ctx->diag.i2c_fail++;
+    switch (g_st.step) {
+    case ST_IDLE:
+        return;
+
+    case ST_WAIT_BUS:
+        // Sampling is off; let in-flight FIFO drains finish before taking the bus.
+        if (!Drain_AllIdle() && (HAL_GetTick() - g_st.step_start_ms) < SELFTEST_BUS_WAIT_MS) {
+            return;
         }
+        SelfTest_Enter(ST_SAVE_REGS);
+        break;
+
+    case ST_SAVE_REGS:
+        if ((g_st.status = SensorBus_ReadRegs(d->index, ACCEL_REG_POWER_CTL, &g_st.old_power_ctl, 1, 100)) != HAL_OK ||
+            (g_st.status = SensorBus_ReadRegs(d->index, ACCEL_REG_DATA_FORMAT, &g_st.old_data_format, 1, 100)) != HAL_OK ||
+            (g_st.status = SensorBus_ReadRegs(d->index, ACCEL_REG_BW_RATE, &g_st.old_bw_rate, 1, 100)) != HAL_OK ||
+            (g_st.status = SensorBus_ReadRegs(d->index, ACCEL_REG_FIFO_CTL, &g_st.old_fifo_ctl, 1, 100)) != HAL_OK ||
+            (g_st.status = SensorBus_ReadRegs(d->index, ACCEL_REG_INT_ENABLE, &g_st.old_int_enable, 1, 100)) != HAL_OK) {
+            SelfTest_Fail(g_st.status);
+            break;
+        }
+        g_st.registers_saved = true;
+        g_fifo_policy_live = false; // FIFO is bypassed during the test
+        SelfTest_Enter(ST_CONFIGURE);
+        break;
+
+    case ST_CONFIGURE: {
+        // Put sensor in standby and bypass FIFO for single-sample polling
+        if (Sensor_WriteVerifyReg(d, ACCEL_REG_POWER_CTL, 0x00) != HAL_OK ||
+            Sensor_WriteVerifyReg(d, ACCEL_REG_FIFO_CTL, 0x00) != HAL_OK) {
+            SelfTest_Fail(HAL_ERROR);
+            break;
+        }
+        HAL_StatusTypeDef status = Sensor_WriteVerifyReg(d, ACCEL_REG_BW_RATE, Sensor_RateCode(g_st.test_odr_hz));
+        if (status == HAL_OK) {
+            g_st.test_data_format = (1 << 3) | 0x03; // FULL_RES, +/-16g
+            status = Sensor_WriteVerifyReg(d, ACCEL_REG_DATA_FORMAT, g_st.test_data_format);
+        }
+        if (status == HAL_OK) {
+            status = Sensor_WriteVerifyReg(d, ACCEL_REG_POWER_CTL, (1 << 3)); // Measurement mode
+        }
+        if (status != HAL_OK) {
+            SelfTest_Fail(status);
+            break;
+        }
+        SelfTest_Enter(ST_WAIT_STABLE);
         break;
     }
 
-    case I2C_STATE_DRAIN_STATUS: {
-        uint8_t total_samples_in_fifo = g_fifo_status_buf[0] & 0x3F;
+    case ST_WAIT_STABLE:
+        if ((HAL_GetTick() - g_st.step_start_ms) >= SELFTEST_STABLE_MS) {
+            SelfTest_Enter(ST_SAMPLE_OFF);
+        }
+        break;
+
+    case ST_SAMPLE_OFF:
+        if (SelfTest_Collect(d, g_st.avg_count, true)) {
+            r->x_off = g_st.sum[0] / g_st.avg_count;
+            r->y_off = g_st.sum[1] / g_st.avg_count;
+            r->z_off = g_st.sum[2] / g_st.avg_count;
+            SelfTest_Enter(ST_ENABLE_ST);
+        }
+        break;
 
-        if (total_samples_in_fifo > 0) {
-            // Samples are present. Start a new DMA read to drain another batch.
-            g_samples_to_read = total_samples_in_fifo;
-            if (g_samples_to_read > DMA_RX_BUF_SAMPLES) {
-                g_samples_to_read = DMA_RX_BUF_SAMPLES;
+    case ST_ENABLE_ST: {
+        uint8_t st_on_data_format = g_st.test_data_format | (1 << 7);
+        HAL_StatusTypeDef status = Sensor_WriteVerifyReg(d, ACCEL_REG_DATA_FORMAT, st_on_data_format);
+        if (status != HAL_OK) {
+            SelfTest_Fail(status);
+            break;
+        }
+        SelfTest_Enter((g_st.settle_count > 0) ? ST_SETTLE_ON : ST_SAMPLE_ON);
+        break;
+    }
+
+    case ST_SETTLE_ON:
+        if (SelfTest_Collect(d, g_st.settle_count, false)) {
+            SelfTest_Enter(ST_SAMPLE_ON);
+        }
+        break;
+
+    case ST_SAMPLE_ON:
+        if (SelfTest_Collect(d, g_st.avg_count, true)) {
+            r->x_on = g_st.sum[0] / g_st.avg_count;
+            r->y_on = g_st.sum[1] / g_st.avg_count;
+            r->z_on = g_st.sum[2] / g_st.avg_count;
+
+            r->x_st = r->x_on - r->x_off;
+            r->y_st = r->y_on - r->y_off;
+            r->z_st = r->z_on - r->z_off;
+
+            // Datasheet Table 12 (LSB), full-resolution mode.
+            // Valid for all VS per datasheet.
+            bool x_ok = (r->x_st >= 50  && r->x_st <= 540);
+            bool y_ok = (r->y_st >= -540 && r->y_st <= -50);
+            bool z_ok = (r->z_st >= 75  && r->z_st <= 875);
+            r->health_pass = (x_ok && y_ok && z_ok);
+            g_st.status = HAL_OK;
+            SelfTest_Enter(ST_RESTORE);
+        }
+        break;
+
+    case ST_RESTORE:
+        if (g_st.registers_saved) {
+            Sensor_WriteVerifyReg(d, ACCEL_REG_DATA_FORMAT, g_st.old_data_format);
+            if (Sensor_WriteVerifyReg(d, ACCEL_REG_BW_RATE, g_st.old_bw_rate) == HAL_OK) {
+                Ts_SetOdr(d, g_st.old_bw_rate & 0x0F);
             }
-            
-            g_i2c_state = I2C_STATE_WAIT_FIFO_DATA;
-            HAL_StatusTypeDef status = HAL_I2C_Mem_Read_DMA(s_ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_DATAX0, I2C_MEMADD_SIZE_8BIT, g_dma_rx_buf, g_samples_to_read * 6);
-            if (status != HAL_OK) {
-                g_debug_dma_start_fail++;
-                g_i2c_state = I2C_STATE_IDLE;
-                if (s_ctx) s_ctx->diag.i2c_fail++;
-            } else {
-                g_debug_dma_start_ok++;
+            if (Sensor_WriteVerifyReg(d, ACCEL_REG_FIFO_CTL, g_st.old_fifo_ctl) == HAL_OK) {
+                d->fifo_watermark = g_st.old_fifo_ctl & 0x1F;
             }
+            g_fifo_policy_live = true;
+            Sensor_WriteVerifyReg(d, ACCEL_REG_INT_ENABLE, g_st.old_int_enable);
+            Sensor_WriteVerifyReg(d, ACCEL_REG_POWER_CTL, g_st.old_power_ctl);
+        }
+        if (g_st.was_sampling) {
+            Sensor_StartSampling(ctx);
+        }
+        SelfTest_Enter(ST_REPORT);
+        break;
+
+    case ST_REPORT:
+        g_st.step = ST_IDLE;
+        Telemetry_SendSelfTestResult(g_st.status, &g_st.results, Sensor_SnapODR(g_st.test_odr_hz),
+                                     g_st.avg_count, g_st.settle_count);
+        break;
+
+    default:
+        g_st.step = ST_IDLE;
+        break;
+    }
+}
+
+
+// --- Shared bus (DMA/EXTI context, or masked) ---
+
+// Starts an asynchronous read for d, or queues it while another engine owns
+// the bus. Returns false only if the transfer could not be started.
+static bool Bus_ReadAsync(SensorDev_t* d, uint8_t reg, uint8_t* buf, uint8_t len) {
+    // The EXTI (prio 4) and the completion ISR (prio 3) both get here; mask so
+    // a release cannot slip between the ownership check and the queueing.
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    bool ok = true;
+    if (g_bus_owner != SENSOR_BUS_FREE) {
+        d->req_reg = reg;
+        d->req_buf = buf;
+        d->req_len = len;
+        d->req_pending = true;
+    } else {
+        g_bus_owner = d->index;
+        if (SensorBus_ReadRegsAsync(d->index, reg, buf, len) != HAL_OK) {
+            g_bus_owner = SENSOR_BUS_FREE;
+            ok = false;
+        }
+    }
+    __set_PRIMASK(primask);
+    return ok;
+}
+
+// Frees the bus after a completed transfer and starts the next queued read,
+// searching round-robin from the engine after the one that just finished.
+static void Bus_Release(void) {
+    uint8_t last = g_bus_owner;
+    g_bus_owner = SENSOR_BUS_FREE;
+    if (last >= g_dev_count) last = 0;
+    for (uint8_t k = 1; k <= g_dev_count; k++) {
+        SensorDev_t* e = &g_dev[(last + k) % g_dev_count];
+        if (!e->req_pending) continue;
+        e->req_pending = false;
+        g_bus_owner = e->index;
+        if (SensorBus_ReadRegsAsync(e->index, e->req_reg, e->req_buf, e->req_len) == HAL_OK) {
+            return;
+        }
+        g_bus_owner = SENSOR_BUS_FREE;
+        SensorBus_ErrorCallback(e->index);
+        return;
+    }
+}
+
+// --- FIFO drain engine (one per sensor) ---
+
+static void Drain_OnReadComplete(SensorDev_t* d) {
+    switch (d->state) {
+    case I2C_STATE_WAIT_FIFO_DATA:
+        g_debug_dma_complete_count++;
+        if (d->prof_first) {
+            Prof_Since(PROF_EXTI_DMA, d->prof_edge);
+            d->prof_first = false;
+        }
+        d->banks[d->bank_fill].count++;
+        d->ts_index++;
+
+        if (d->entries_left > 0U) {
+            d->entries_left--;
+        }
+        if (d->entries_left > 0U) {
+            Drain_ReadNextEntry(d);
+        } else {
+            // Known entries consumed; hand the bank to PendSV and check whether
+            // more arrived during the drain while it is unpacked.
+            Bank_Submit(d);
+            Drain_ReadStatus(d);
+        }
+        break;
+
+    case I2C_STATE_DRAIN_STATUS: {
+        uint8_t entries = d->fifo_status_buf[0] & 0x3F;
+        if (d->gate_wake_drop) {
+            // First status after a wake: everything buffered so far was
+            // sampled at 8 Hz and has no period the stamping could use.
+            d->gate_wake_drop = false;
+            if (entries > 0U) {
+                d->gate_drop_left = entries;
+                Gate_DropNextEntry(d);
+                break;
+            }
+        }
+        if (entries > 0U) {
+            if (!d->ts_batch_open) {
+                // Status-led drain (no edge): the newest entry is roughly "now".
+                Ts_BeginBatch(d, __HAL_TIM_GET_COUNTER(s_ctx->htim2), entries, false);
+            }
+            d->entries_left = entries;
+            Drain_ReadNextEntry(d);
         } else {
-            // FIFO is empty. Read INT_SOURCE to clear the sensor's internal interrupt latch.
-            g_i2c_state = I2C_STATE_CLEAR_INT_SOURCE;
-            if (HAL_I2C_Mem_Read_IT(s_ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_INT_SOURCE, I2C_MEMADD_SIZE_8BIT, g_fifo_status_buf, 1) != HAL_OK) {
-                g_i2c_state = I2C_STATE_IDLE;
-                if (s_ctx) s_ctx->diag.i2c_fail++;
+            // FIFO empty: the watermark bit self-clears once the FIFO drops below
+            // the watermark, so no INT_SOURCE read is needed before the next edge.
+            if (d->prof_drain) {
+                Prof_Since(PROF_DRAIN, d->prof_edge);
+                d->prof_drain = false;
+            }
+            Ts_EndBatch(d);
+            d->state = I2C_STATE_IDLE;
+            // Under the gate a latched activity/inactivity event keeps INT1
+            // low after the FIFO empties and no edge will follow.
+            if (d->gate_on && Drain_IntAsserted(d)) {
+                Gate_ReadIntSource(d, false);
             }
         }
         break;
     }
 
-    case I2C_STATE_CLEAR_INT_SOURCE:
-        // The read of INT_SOURCE is complete. The state machine can return to idle for the next EXTI.
-        g_i2c_state = I2C_STATE_IDLE;
+    case I2C_STATE_INT_SOURCE:
+        Gate_OnIntSource(d);
+        break;
+
+    case I2C_STATE_GATE_DROP:
+        g_debug_gate_wake_dropped++;
+        if (d->gate_drop_left > 0U) {
+            d->gate_drop_left--;
+        }
+        if (d->gate_drop_left > 0U) {
+            Gate_DropNextEntry(d);
+        } else {
+            // Whatever arrived since is at the full ODR again.
+            Drain_ReadStatus(d);
+        }
         break;
 
     default:
-        g_i2c_state = I2C_STATE_IDLE;
+        d->state = I2C_STATE_IDLE;
         break;
     }
 }
 
-void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
-    if (hi2c->Instance == I2C1) {
-        if (s_ctx) {
-            s_ctx->diag.i2c_fail++;
+static void Drain_ReadNextEntry(SensorDev_t* d) {
+    if (!Bank_Acquire(d)) {
+        // Both banks wait for PendSV; it resumes the drain once one is free.
+        g_debug_bank_parked++;
+        d->state = I2C_STATE_PARKED;
+        return;
+    }
+    RawBank_t* b = &d->banks[d->bank_fill];
+    d->state = I2C_STATE_WAIT_FIFO_DATA;
+    if (Bus_ReadAsync(d, ACCEL_REG_DATAX0, b->raw[b->count], ADXL_FIFO_ENTRY_BYTES)) {
+        g_debug_dma_start_ok++;
+    } else {
+        g_debug_dma_start_fail++;
+        Bank_Submit(d);
+        Ts_Invalidate(d);
+        d->state = I2C_STATE_IDLE;
+        if (s_ctx) s_ctx->diag.i2c_fail++;
+    }
+}
+
+static void Drain_ReadStatus(SensorDev_t* d) {
+    d->state = I2C_STATE_DRAIN_STATUS;
+    if (!Bus_ReadAsync(d, ACCEL_REG_FIFO_STATUS, d->fifo_status_buf, 1)) {
+        Ts_Invalidate(d);
+        d->state = I2C_STATE_IDLE;
+        if (s_ctx) s_ctx->diag.i2c_fail++;
+    }
+}
+
+static bool Drain_IntAsserted(const SensorDev_t* d) {
+    return HAL_GPIO_ReadPin(d->int_port, d->int_pin) == GPIO_PIN_RESET;
+}
+
+static bool Drain_AllIdle(void) {
+    for (uint8_t i = 0; i < g_dev_count; i++) {
+        if (g_dev[i].state != I2C_STATE_IDLE) return false;
+    }
+    return true;
+}
+
+// Restarts an idle engine whose INT1 is already asserted (no edge will come).
+static void Drain_Kick(SensorDev_t* d) {
+    if (d->gate_on) {
+        Gate_ReadIntSource(d, false);
+    } else {
+        Drain_ReadStatus(d);
+    }
+}
+
+// Masks the INT1 EXTIs and lets running drains finish, so the main loop can
+// use the bus for blocking register writes. Always pair with Drain_Resume().
+// Returns true once every engine is idle.
+static bool Drain_Quiesce(void) {
+    HAL_NVIC_DisableIRQ(EXTI9_5_IRQn); // INT1 lines of all sensors
+    uint32_t t0 = HAL_GetTick();
+    while (!Drain_AllIdle() && (HAL_GetTick() - t0) < SENSOR_WM_IDLE_WAIT_MS) {
+    }
+    if (!Drain_AllIdle() && SensorBus_IsReady()) {
+        // Bus is idle but an engine never saw a completion (e.g. after an abort).
+        __disable_irq();
+        for (uint8_t i = 0; i < g_dev_count; i++) {
+            SensorDev_t* d = &g_dev[i];
+            Bank_Submit(d);
+            Ts_Invalidate(d);
+            d->req_pending = false;
+            d->state = I2C_STATE_IDLE;
         }
-        g_i2c_state = I2C_STATE_IDLE; // Reset state machine on error
+        g_bus_owner = SENSOR_BUS_FREE;
+        __enable_irq();
     }
+    return Drain_AllIdle();
 }
 
-void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
-    if (GPIO_Pin == ADXL345_INT1_Pin) {
-        g_debug_exti_callback_count++;
-        
-        if (!g_sampling_active) {
-            g_debug_exti_rejected_sampling++;
-            return;
+// Unmasks the INT1 EXTIs. A line that went low while masked (or while the
+// registers were rewritten) produced no edge, so those engines are kicked.
+static void Drain_Resume(void) {
+    __disable_irq();
+    for (uint8_t i = 0; i < g_dev_count; i++) {
+        SensorDev_t* d = &g_dev[i];
+        if (g_sampling_active && d->state == I2C_STATE_IDLE && Drain_IntAsserted(d)) {
+            Drain_Kick(d);
         }
-        
-        if (!s_ctx) {
-            g_debug_exti_rejected_context++;
-            return;
+    }
+    __enable_irq();
+    HAL_NVIC_EnableIRQ(EXTI9_5_IRQn);
+}
+
+// Opens (or keeps) the fill bank. Returns false if the next bank is still
+// waiting to be unpacked. ISR context.
+static bool Bank_Acquire(SensorDev_t* d) {
+    RawBank_t* b = &d->banks[d->bank_fill];
+    if (b->state == BANK_FILLING) {
+        if (b->count < SENSOR_RAW_BANK_ENTRIES) {
+            return true;
         }
-        
-        if (g_i2c_state != I2C_STATE_IDLE) {
-            g_debug_exti_rejected_state++;
-            return;
+        Bank_Submit(d);
+        b = &d->banks[d->bank_fill];
+    }
+    if (b->state != BANK_FREE) {
+        return false;
+    }
+    b->count = 0;
+    b->ts_base = d->ts_base;
+    b->first_index = d->ts_index;
+    b->period_q16 = d->ts_period_q16;
+    b->state = BANK_FILLING;
+    return true;
+}
+
+// Hands the fill bank to PendSV and switches to the other one. ISR context.
+static void Bank_Submit(SensorDev_t* d) {
+    RawBank_t* b = &d->banks[d->bank_fill];
+    if (b->state != BANK_FILLING) {
+        return;
+    }
+    if (b->count == 0U) {
+        b->state = BANK_FREE;
+        return;
+    }
+    b->state = BANK_READY;
+    d->bank_fill = (uint8_t)((d->bank_fill + 1U) % SENSOR_RAW_BANKS);
+#if APP_USE_RTOS
+    Sched_Post(SCHED_EV_BANK); // PendSV belongs to the kernel; the acquisition thread unpacks
+#else
+    SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+#endif
+}
+
+void Sensor_ServiceRawBanks(void) {
+    bool stored = false;
+    for (uint8_t i = 0; i < g_dev_count; i++) {
+        SensorDev_t* d = &g_dev[i];
+        while (d->banks[d->bank_unpack].state == BANK_READY) {
+            stored = true;
+            RawBank_t* b = &d->banks[d->bank_unpack];
+            for (uint8_t e = 0; e < b->count; e++) {
+                uint32_t k = b->first_index + e;
+                uint32_t ts = b->ts_base + (uint32_t)(((uint64_t)k * b->period_q16) >> SENSOR_TS_Q);
+                Drain_StoreEntry(d, b->raw[e], ts);
+            }
+            __DMB();
+            b->state = BANK_FREE;
+            d->bank_unpack = (uint8_t)((d->bank_unpack + 1U) % SENSOR_RAW_BANKS);
+
+            // Resume a drain that parked on this bank. Masked so the drain ISRs
+            // cannot change the state between the check and the restart.
+            __disable_irq();
+            if (d->state == I2C_STATE_PARKED) {
+                Drain_ReadNextEntry(d);
+            }
+            __enable_irq();
         }
-        
-        if (g_sampling_active && s_ctx && g_i2c_state == I2C_STATE_IDLE) {
-             // Start the non-blocking FIFO drain sequence.
-             g_samples_to_read = DMA_RX_BUF_SAMPLES;
-             g_i2c_state = I2C_STATE_WAIT_FIFO_DATA;
-             
-             HAL_StatusTypeDef status = HAL_I2C_Mem_Read_DMA(s_ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_DATAX0, I2C_MEMADD_SIZE_8BIT, g_dma_rx_buf, g_samples_to_read * 6);
-             
-             if (status == HAL_OK) {
-                 g_debug_dma_start_ok++;
-             } else {
-                 g_debug_dma_start_fail++;
-                 g_i2c_state = I2C_STATE_IDLE;
-                 s_ctx->diag.i2c_fail++;
-             }
+    }
+    if (stored) {
+        Sched_Post(SCHED_EV_SAMPLES); // wake the ring consumers
+    }
+}
+
+// Unpacks one entry into the sensor's ring. PendSV context (sole ring producer).
+static void Drain_StoreEntry(SensorDev_t* d, const uint8_t* p, uint32_t ts) {
+    int16_t x = (int16_t)((p[1] << 8) | p[0]);
+    int16_t y = (int16_t)((p[3] << 8) | p[2]);
+    int16_t z = (int16_t)((p[5] << 8) | p[4]);
+
+    if (g_cal_running) {
+        if (d->cal_skip > 0U) {
+            d->cal_skip--;
+        } else if (d->cal_n < g_cal_target) {
+            d->cal_sum[0] += x;
+            d->cal_sum[1] += y;
+            d->cal_sum[2] += z;
+            d->cal_n++;
         }
     }
+
+    // The entry is popped from the sensor FIFO either way; if the ring is full it is dropped.
+    uint32_t head = d->head;
+    if ((head - d->tail) >= SAMPLE_RING_BUFFER_SIZE) {
+        if (s_ctx) s_ctx->diag.ring_ovf++;
+        return;
+    }
+    __DMB(); // Acquire: the consumer is done with the slot
+    Sample_t* s = &d->ring[head & SAMPLE_RING_MASK];
+    s->x = x;
+    s->y = y;
+    s->z = z;
+    s->sensor = d->index;
+    s->timestamp = ts;
+
+    Streaming_ProcessSampleFromISR(s_ctx, s);
+
+    g_debug_samples_processed++;
+    __DMB(); // Release: publish the slot before the new head
+    d->head = head + 1U;
+    d->last_ts = ts;
+    d->last_valid = true;
 }
 
-// --- Private Helper Functions ---
+static void Ts_SetOdr(SensorDev_t* d, uint8_t rate_code) {
+    // BW_RATE 0x0F = 3200 Hz, each step down halves the rate.
+    if (rate_code > 0x0F) rate_code = 0x0F;
+    uint32_t hz = 3200U >> (0x0F - rate_code);
+    if (hz == 0U) hz = 1U;
+    uint32_t tick_hz = Timebase_TickHz();
+    __disable_irq();
+    d->ts_period_nom_q16 = (uint32_t)(((uint64_t)tick_hz << SENSOR_TS_Q) / hz);
+    d->ts_period_q16 = d->ts_period_nom_q16;
+    d->ts_prev_valid = false;
+    __enable_irq();
+}
+
+static void Ts_Invalidate(SensorDev_t* d) {
+    d->ts_batch_open = false;
+    d->ts_prev_valid = false;
+}
+
+static uint32_t Ts_LatchEdgeTick(SensorDev_t* d, bool* captured) {
+    uint32_t now = __HAL_TIM_GET_COUNTER(s_ctx->htim2);
+#if SENSOR_TS_EDGE_CAPTURE
+    if (d->cap_flag != 0U && __HAL_TIM_GET_FLAG(s_ctx->htim2, d->cap_flag)) {
+        // Reading CCRx clears CCxIF. CCxOF only means an older edge was overwritten.
+        uint32_t cap = HAL_TIM_ReadCapturedValue(s_ctx->htim2, d->cap_channel);
+        __HAL_TIM_CLEAR_FLAG(s_ctx->htim2, d->cap_of_flag);
+        if ((now - cap) <= SENSOR_TS_CAPTURE_MAX_AGE) {
+            g_debug_ts_edge_captured++;
+            *captured = true;
+            return cap;
+        }
+    }
+#else
+    (void)d;
+#endif
+    // No jumper or stale latch: EXTI entry time, late by the interrupt latency.
+    g_debug_ts_edge_fallback++;
+    *captured = false;
+    return now;
+}
+
+static void Ts_BeginBatch(SensorDev_t* d, uint32_t ref_tick, uint32_t entries, bool from_edge) {
+#if SENSOR_TS_DRIFT_EST
+    // Every entry drained since the previous edge was produced between the two
+    // edges, so the interval divided by the count is the sensor's real period.
+    if (from_edge && d->ts_prev_valid && d->ts_prev_count > 0U && d->ts_period_nom_q16 > 0U) {
+        uint32_t meas_q16 = (uint32_t)(((uint64_t)(ref_tick - d->ts_prev_edge) << SENSOR_TS_Q) / d->ts_prev_count);
+        uint32_t tol = d->ts_period_nom_q16 / SENSOR_TS_DRIFT_TOL_DIV;
+        if (meas_q16 >= d->ts_period_nom_q16 - tol && meas_q16 <= d->ts_period_nom_q16 + tol) {
+            int32_t err = (int32_t)(meas_q16 - d->ts_period_q16);
+            d->ts_period_q16 = (uint32_t)((int32_t)d->ts_period_q16 + (err >> SENSOR_TS_DRIFT_EMA_SHIFT));
+        } else {
+            g_debug_ts_drift_rejected++;
+        }
+    }
+#endif
+    if (entries == 0U) entries = 1U;
+    d->ts_base = ref_tick - (uint32_t)(((uint64_t)(entries - 1U) * d->ts_period_q16) >> SENSOR_TS_Q);
+    d->ts_index = 0;
+    d->ts_batch_open = true;
+    d->ts_batch_from_edge = from_edge;
+    d->ts_batch_edge = ref_tick;
+}
+
+static void Ts_EndBatch(SensorDev_t* d) {
+    // Only a batch that started on a captured edge and drained the FIFO to
+    // empty gives a usable interval to the next edge.
+    d->ts_prev_valid = d->ts_batch_open && d->ts_batch_from_edge;
+    d->ts_prev_edge = d->ts_batch_edge;
+    d->ts_prev_count = d->ts_index;
+    d->ts_batch_open = false;
+}
+
+// Rewrites FIFO_CTL on every sensor with a new watermark. The watermark EXTIs
+// are masked and the drains are allowed to finish first, so no engine sees a
+// half-applied watermark. Main loop context.
+static HAL_StatusTypeDef Sensor_ApplyWatermark(uint8_t wm) {
+    bool changed = false;
+    for (uint8_t i = 0; i < g_dev_count; i++) {
+        if (g_dev[i].fifo_watermark != wm) changed = true;
+    }
+    if (!changed) {
+        return HAL_OK;
+    }
+
+    HAL_StatusTypeDef status = HAL_BUSY;
+    if (Drain_Quiesce()) {
+        status = HAL_OK;
+        for (uint8_t i = 0; i < g_dev_count; i++) {
+            SensorDev_t* d = &g_dev[i];
+            if (d->fifo_watermark == wm) continue;
+            HAL_StatusTypeDef st = Sensor_WriteVerifyReg(d, ACCEL_REG_FIFO_CTL, (uint8_t)(ACCEL_FIFO_MODE_STREAM | wm));
+            if (st == HAL_OK) {
+                d->fifo_watermark = wm;
+            } else {
+                status = st;
+            }
+        }
+    }
+
+    // A lower watermark may already be exceeded: INT1 is low and no edge will
+    // follow, so Drain_Resume() starts the drain from FIFO_STATUS.
+    Drain_Resume();
+
+    if (status != HAL_OK) {
+        Telemetry_SendERROR(SensorBus_Name(), 11, "set_wm_busy");
+    }
+    return status;
+}
+
+// --- Activity gate ---
+
+static uint8_t Gate_ThreshCode(uint16_t mg) {
+    uint32_t code = ((uint32_t)mg * 2U + ADXL_THRESH_MG_X2_PER_LSB / 2U) / ADXL_THRESH_MG_X2_PER_LSB;
+    if (code < 1U) code = 1U;
+    if (code > 0xFFU) code = 0xFFU;
+    return (uint8_t)code;
+}
+
+// Starts the INT_SOURCE read that classifies an INT1 assertion. ISR context or masked.
+static void Gate_ReadIntSource(SensorDev_t* d, bool from_edge) {
+    d->gate_edge_valid = from_edge; // Set first: the completion may preempt the EXTI
+    d->state = I2C_STATE_INT_SOURCE;
+    if (!Bus_ReadAsync(d, ACCEL_REG_INT_SOURCE, d->int_source_buf, 1)) {
+        Ts_Invalidate(d);
+        d->state = I2C_STATE_IDLE;
+        if (s_ctx) s_ctx->diag.i2c_fail++;
+    }
+}
+
+// Pops one sleep-rate FIFO entry into scratch; it is counted, not stored.
+static void Gate_DropNextEntry(SensorDev_t* d) {
+    d->state = I2C_STATE_GATE_DROP;
+    if (!Bus_ReadAsync(d, ACCEL_REG_DATAX0, d->gate_drop_buf, ADXL_FIFO_ENTRY_BYTES)) {
+        d->state = I2C_STATE_IDLE;
+        if (s_ctx) s_ctx->diag.i2c_fail++;
+    }
+}
+
+// INT_SOURCE arrived (reading it cleared the activity/inactivity latches).
+// Tracks the sleep state and continues into the FIFO drain if it is due.
+static void Gate_OnIntSource(SensorDev_t* d) {
+    uint8_t src = d->int_source_buf[0];
+    bool edge_valid = d->gate_edge_valid;
+    d->gate_edge_valid = false;
+
+    if (src & (ADXL_INT_ACTIVITY | ADXL_INT_INACTIVITY)) {
+        // The rate changes between 8 Hz and the ODR here; the FIFO holds
+        // entries of both, so the period model starts over.
+        Ts_Invalidate(d);
+        edge_valid = false;
+        bool asleep = (src & ADXL_INT_ACTIVITY) == 0U;
+        if (asleep) {
+            g_debug_gate_sleeps++;
+        } else if (d->gate_asleep) {
+            g_debug_gate_wakeups++;
+            d->gate_wake_drop = true;
+        }
+        if (asleep != d->gate_asleep) {
+            d->gate_asleep = asleep;
+            d->gate_int_stale = true; // Gate_Pump swaps the INT_ENABLE set
+            Sched_ArmTimeout(0U);
+        }
+    }
+
+    if (d->gate_wake_drop) {
+        // Wake: discard the 8 Hz backlog before draining at the ODR.
+        Drain_ReadStatus(d);
+    } else if (src & ADXL_INT_WATERMARK) {
+        if (edge_valid) {
+            // Plain watermark edge: same fast path as without the gate.
+            Ts_BeginBatch(d, d->gate_edge, d->fifo_watermark, d->gate_edge_captured);
+            d->entries_left = d->fifo_watermark;
+            Drain_ReadNextEntry(d);
+        } else {
+            Drain_ReadStatus(d);
+        }
+    } else {
+        d->state = I2C_STATE_IDLE;
+    }
+}
+
+// Programs thresholds and LINK/AUTO_SLEEP. The device stays in measurement
+// mode throughout, so the stream keeps running. Main loop, drains quiesced.
+static HAL_StatusTypeDef Gate_Program(SensorDev_t* d, const TriggerSettings_t* ts) {
+    uint8_t t_inact = (ts->inact_s > 0U) ? ts->inact_s : 1U;
+    if (Sensor_WriteVerifyReg(d, ACCEL_REG_THRESH_ACT, Gate_ThreshCode(ts->act_mg)) != HAL_OK ||
+        Sensor_WriteVerifyReg(d, ACCEL_REG_THRESH_INACT, Gate_ThreshCode(ts->inact_mg)) != HAL_OK ||
+        Sensor_WriteVerifyReg(d, ACCEL_REG_TIME_INACT, t_inact) != HAL_OK ||
+        Sensor_WriteVerifyReg(d, ACCEL_REG_ACT_INACT_CTL, ADXL_ACT_INACT_ALL_AC) != HAL_OK ||
+        Sensor_WriteVerifyReg(d, ACCEL_REG_INT_ENABLE, ADXL_INT_WATERMARK | ADXL_INT_INACTIVITY) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    // Wakeup bits 00: 8 Hz sampling while asleep, the fastest wake-up.
+    if (Sensor_WriteVerifyReg(d, ACCEL_REG_POWER_CTL,
+                              ADXL_PWR_LINK | ADXL_PWR_AUTO_SLEEP | ADXL_PWR_MEASURE) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    uint8_t int_source;
+    if (SensorBus_ReadRegs(d->index, ACCEL_REG_INT_SOURCE, &int_source, 1, 100) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    d->gate_asleep = false;
+    d->gate_int_stale = false;
+    d->gate_wake_drop = false;
+    d->gate_on = true;
+    return HAL_OK;
+}
+
+// Back to plain watermark operation at the full ODR. POWER_CTL is written
+// without a pass through standby so a burst starting now loses no samples.
+static HAL_StatusTypeDef Gate_Remove(SensorDev_t* d) {
+    d->gate_on = false;
+    d->gate_asleep = false;
+    d->gate_int_stale = false;
+    d->gate_wake_drop = false;
+    Ts_Invalidate(d);
+    if (Sensor_WriteVerifyReg(d, ACCEL_REG_INT_ENABLE, ADXL_INT_WATERMARK) != HAL_OK ||
+        Sensor_WriteVerifyReg(d, ACCEL_REG_POWER_CTL, ADXL_PWR_MEASURE) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    uint8_t int_source;
+    return SensorBus_ReadRegs(d->index, ACCEL_REG_INT_SOURCE, &int_source, 1, 100);
+}
+
+// Applies sleep/wake transitions seen by the drain: asleep, only activity may
+// assert INT1; awake, the watermark and inactivity. Main loop context.
+static void Gate_Pump(void) {
+    bool stale = false;
+    for (uint8_t i = 0; i < g_dev_count; i++) {
+        if (g_dev[i].gate_int_stale) stale = true;
+    }
+    if (!stale) return;
+    Sched_ArmTimeout(1U); // Next pass: a retry, or a busy bus that has gone idle
+
+    if (Drain_Quiesce()) {
+        for (uint8_t i = 0; i < g_dev_count; i++) {
+            SensorDev_t* d = &g_dev[i];
+            if (!d->gate_on || !d->gate_int_stale) continue;
+            d->gate_int_stale = false;
+            uint8_t ie = d->gate_asleep ? ADXL_INT_ACTIVITY : (ADXL_INT_WATERMARK | ADXL_INT_INACTIVITY);
+            if (Sensor_WriteVerifyReg(d, ACCEL_REG_INT_ENABLE, ie) != HAL_OK) {
+                d->gate_int_stale = true; // Retried on the next pass
+            }
+        }
+    }
+    Drain_Resume(); // An activity event may already be latched
+}
 
-static HAL_StatusTypeDef Sensor_WriteVerifyReg(AppContext_t* ctx, uint8_t reg, uint8_t value_to_write) {
+static HAL_StatusTypeDef Sensor_WriteVerifyReg(SensorDev_t* d, uint8_t reg, uint8_t value_to_write) {
     uint8_t read_value = 0;
     HAL_StatusTypeDef status;
 
     for (int i = 0; i < SENSOR_WRITE_VERIFY_RETRIES; i++) {
         // Attempt to write the value
-        status = HAL_I2C_Mem_Write(ctx->hi2c1, ACCEL_SENSOR_ADDR, reg, I2C_MEMADD_SIZE_8BIT, &value_to_write, 1, 100);
+        status = SensorBus_WriteReg(d->index, reg, value_to_write, 100);
         if (status != HAL_OK) {
             HAL_Delay(SENSOR_WRITE_VERIFY_DELAY_MS);
             continue; // Retry write
         }
 
         // Attempt to read it back
-        status = HAL_I2C_Mem_Read(ctx->hi2c1, ACCEL_SENSOR_ADDR, reg, I2C_MEMADD_SIZE_8BIT, &read_value, 1, 100);
+        status = SensorBus_ReadRegs(d->index, reg, &read_value, 1, 100);
         if (status != HAL_OK) {
             HAL_Delay(SENSOR_WRITE_VERIFY_DELAY_MS);
             continue; // Retry read
         }
-        
+
         // Compare
         if (read_value == value_to_write) {
             return HAL_OK; // Success
@@ -548,56 +1761,29 @@ static HAL_StatusTypeDef Sensor_WriteVerifyReg(AppContext_t* ctx, uint8_t reg, u
         // Mismatch, delay before next retry
         HAL_Delay(SENSOR_WRITE_VERIFY_DELAY_MS);
     }
-    
+
     // If we exit the loop, it means all retries have failed
     return HAL_ERROR;
 }
 
-static void I2C1_WaitReady(uint32_t to_ms) {
-    if (!s_ctx) return;
-    uint32_t t0 = HAL_GetTick();
-    while (HAL_I2C_GetState(s_ctx->hi2c1) != HAL_I2C_STATE_READY) {
-        if ((HAL_GetTick() - t0) >= to_ms) {
-            break;
-        }
-    }
-}
-
-static void I2C1_AbortIfBusy(uint32_t to_ms) {
-    if (!s_ctx) return;
-    uint32_t t0 = HAL_GetTick();
-    while (HAL_I2C_GetState(s_ctx->hi2c1) != HAL_I2C_STATE_READY) {
-        #if defined(HAL_I2C_Master_Abort_IT)
-        (void)HAL_I2C_Master_Abort_IT(s_ctx->hi2c1, ACCEL_SENSOR_ADDR);
-        #endif
-        if ((HAL_GetTick() - t0) >= to_ms) {
-            break;
-        }
-    }
-}
-
-static HAL_StatusTypeDef Sensor_ReadRawSampleBlocking(AppContext_t* ctx, int16_t* x, int16_t* y, int16_t* z) {
-    uint32_t start_tick = HAL_GetTick();
-    const uint32_t timeout_ms = 100; // Timeout for waiting for a sample
+static HAL_StatusTypeDef Sensor_PollRawSample(SensorDev_t* d, int16_t* x, int16_t* y, int16_t* z) {
     uint8_t int_source;
-    HAL_StatusTypeDef status;
 
-    // Wait for DATA_READY bit by polling the register. Used for self-test only.
-    while (HAL_GetTick() - start_tick < timeout_ms) {
-        status = HAL_I2C_Mem_Read(ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_INT_SOURCE, I2C_MEMADD_SIZE_8BIT, &int_source, 1, 10);
-        if (status == HAL_OK && (int_source & (1 << 7))) {
-            // Data is ready, now read it. The previous read cleared the INT_SOURCE register.
-            uint8_t data_buf[6];
-            status = HAL_I2C_Mem_Read(ctx->hi2c1, ACCEL_SENSOR_ADDR, ACCEL_REG_DATAX0, I2C_MEMADD_SIZE_8BIT, data_buf, 6, 50);
-            if (status == HAL_OK) {
-                *x = (int16_t)((data_buf[1] << 8) | data_buf[0]);
-                *y = (int16_t)((data_buf[3] << 8) | data_buf[2]);
-                *z = (int16_t)((data_buf[5] << 8) | data_buf[4]);
-            }
-            return status;
-        }
-        HAL_Delay(1); // Don't busy-spin too hard
+    // Check the DATA_READY bit once. Used for self-test only.
+    HAL_StatusTypeDef status = SensorBus_ReadRegs(d->index, ACCEL_REG_INT_SOURCE, &int_source, 1, 10);
+    if (status != HAL_OK) {
+        return status;
     }
-
-    return HAL_TIMEOUT; // Timed out waiting for data ready
-}
\ No newline at end of file
+    if ((int_source & (1 << 7)) == 0) {
+        return HAL_BUSY; // No new sample yet
+    }
+    // Data is ready, now read it. The previous read cleared the INT_SOURCE register.
+    uint8_t data_buf[6];
+    status = SensorBus_ReadRegs(d->index, ACCEL_REG_DATAX0, data_buf, 6, 50);
+    if (status == HAL_OK) {
+        *x = (int16_t)((data_buf[1] << 8) | data_buf[0]);
+        *y = (int16_t)((data_buf[3] << 8) | data_buf[2]);
+        *z = (int16_t)((data_buf[5] << 8) | data_buf[4]);
+    }
+    return status;
+}
@@ -92,7 +92,8 @@ void HAL_MspInit(void)
   /* System interrupt init*/
 
   /* USER CODE BEGIN MspInit 1 */
-
+  /* PendSV runs the sensor bank unpack below every peripheral ISR. */
+  HAL_NVIC_SetPriority(PendSV_IRQn, 15, 0);
   /* USER CODE END MspInit 1 */
 }
 
@@ -30,6 +30,16 @@
 #include "stm32f4xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "sensor_hal.h"
+#include "comm.h"       // COMM_USE_USB_CDC
+#include "sched.h"
+#include "app_rtos.h"
+#include "prof.h"
+#if APP_USE_RTOS
+#include "FreeRTOS.h"
+#include "task.h"
+extern void xPortSysTickHandler(void);
+#endif
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -64,11 +74,18 @@
 
 /* External variables --------------------------------------------------------*/
 extern DMA_HandleTypeDef hdma_usart2_tx;
+extern TIM_HandleTypeDef htim2;
 extern TIM_HandleTypeDef htim3;
 extern UART_HandleTypeDef huart2;
 /* USER CODE BEGIN EV */
 extern I2C_HandleTypeDef hi2c1;
 extern DMA_HandleTypeDef hdma_i2c1_rx;
+extern SPI_HandleTypeDef hspi2;
+extern DMA_HandleTypeDef hdma_spi2_rx;
+extern DMA_HandleTypeDef hdma_spi2_tx;
+#if COMM_USE_USB_CDC
+extern PCD_HandleTypeDef hpcd_USB_OTG_FS;
+#endif
 /* USER CODE END EV */
 
 /******************************************************************************/
@@ -149,6 +166,7 @@ void UsageFault_Handler(void)
   }
 }
 
+#if !APP_USE_RTOS /* SVC and PendSV belong to the FreeRTOS port */
 /**
   * @brief This function handles System service call via SWI instruction.
   */
@@ -161,6 +179,7 @@ void SVC_Handler(void)
 
   /* USER CODE END SVCall_IRQn 1 */
 }
+#endif /* !APP_USE_RTOS */
 
 /**
   * @brief This function handles Debug monitor.
@@ -175,18 +194,22 @@ void DebugMon_Handler(void)
   /* USER CODE END DebugMonitor_IRQn 1 */
 }
 
+#if !APP_USE_RTOS
 /**
   * @brief This function handles Pendable request for system service.
   */
 void PendSV_Handler(void)
 {
   /* USER CODE BEGIN PendSV_IRQn 0 */
-
+  const uint32_t prof_t0 = Prof_Now();
+  Sensor_ServiceRawBanks(); // Unpack FIFO entries received by the drain ISR
+  Prof_Since(PROF_ISR_PENDSV, prof_t0);
   /* USER CODE END PendSV_IRQn 0 */
   /* USER CODE BEGIN PendSV_IRQn 1 */
 
   /* USER CODE END PendSV_IRQn 1 */
 }
+#endif /* !APP_USE_RTOS */
 
 /**
   * @brief This function handles System tick timer.
@@ -198,6 +221,12 @@ void SysTick_Handler(void)
   /* USER CODE END SysTick_IRQn 0 */
   HAL_IncTick();
   /* USER CODE BEGIN SysTick_IRQn 1 */
+  Sched_SysTick(); // TICK only when a pump's deadline has expired
+#if APP_USE_RTOS
+  if (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED) {
+    xPortSysTickHandler();
+  }
+#endif
 
   /* USER CODE END SysTick_IRQn 1 */
 }
@@ -215,25 +244,67 @@ void SysTick_Handler(void)
 void DMA1_Stream0_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Stream0_IRQn 0 */
-
+  const uint32_t prof_t0 = Prof_Now();
   /* USER CODE END DMA1_Stream0_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_i2c1_rx);
   /* USER CODE BEGIN DMA1_Stream0_IRQn 1 */
-
+  Prof_Since(PROF_ISR_BUS, prof_t0);
   /* USER CODE END DMA1_Stream0_IRQn 1 */
 }
 
+/**
+  * @brief This function handles DMA1 stream3 global interrupt.
+  */
+void DMA1_Stream3_IRQHandler(void)
+{
+  /* USER CODE BEGIN DMA1_Stream3_IRQn 0 */
+  const uint32_t prof_t0 = Prof_Now();
+  /* USER CODE END DMA1_Stream3_IRQn 0 */
+  HAL_DMA_IRQHandler(&hdma_spi2_rx);
+  /* USER CODE BEGIN DMA1_Stream3_IRQn 1 */
+  Prof_Since(PROF_ISR_BUS, prof_t0);
+  /* USER CODE END DMA1_Stream3_IRQn 1 */
+}
+
+/**
+  * @brief This function handles DMA1 stream4 global interrupt.
+  */
+void DMA1_Stream4_IRQHandler(void)
+{
+  /* USER CODE BEGIN DMA1_Stream4_IRQn 0 */
+  const uint32_t prof_t0 = Prof_Now();
+  /* USER CODE END DMA1_Stream4_IRQn 0 */
+  HAL_DMA_IRQHandler(&hdma_spi2_tx);
+  /* USER CODE BEGIN DMA1_Stream4_IRQn 1 */
+  Prof_Since(PROF_ISR_BUS, prof_t0);
+  /* USER CODE END DMA1_Stream4_IRQn 1 */
+}
+
+/**
+  * @brief This function handles SPI2 global interrupt.
+  */
+void SPI2_IRQHandler(void)
+{
+  /* USER CODE BEGIN SPI2_IRQn 0 */
+  const uint32_t prof_t0 = Prof_Now();
+  /* USER CODE END SPI2_IRQn 0 */
+  HAL_SPI_IRQHandler(&hspi2);
+  /* USER CODE BEGIN SPI2_IRQn 1 */
+  Prof_Since(PROF_ISR_BUS, prof_t0);
+  /* USER CODE END SPI2_IRQn 1 */
+}
+
 /**
   * @brief This function handles I2C1 event interrupt.
   */
 void I2C1_EV_IRQHandler(void)
 {
   /* USER CODE BEGIN I2C1_EV_IRQn 0 */
-
+  const uint32_t prof_t0 = Prof_Now();
   /* USER CODE END I2C1_EV_IRQn 0 */
   HAL_I2C_EV_IRQHandler(&hi2c1);
   /* USER CODE BEGIN I2C1_EV_IRQn 1 */
-
+  Prof_Since(PROF_ISR_BUS, prof_t0);
   /* USER CODE END I2C1_EV_IRQn 1 */
 }
 
@@ -257,11 +328,12 @@ void I2C1_ER_IRQHandler(void)
 void EXTI9_5_IRQHandler(void)
 {
   /* USER CODE BEGIN EXTI9_5_IRQn 0 */
-
+  const uint32_t prof_t0 = Prof_Now();
   /* USER CODE END EXTI9_5_IRQn 0 */
   HAL_GPIO_EXTI_IRQHandler(ADXL345_INT1_Pin);
+  HAL_GPIO_EXTI_IRQHandler(ADXL345_2_INT1_Pin);
   /* USER CODE BEGIN EXTI9_5_IRQn 1 */
-
+  Prof_Since(PROF_ISR_EXTI, prof_t0);
   /* USER CODE END EXTI9_5_IRQn 1 */
 }
 
@@ -279,6 +351,20 @@ void EXTI15_10_IRQHandler(void)
   /* USER CODE END EXTI15_10_IRQn 1 */
 }
 
+/**
+  * @brief This function handles TIM2 global interrupt.
+  */
+void TIM2_IRQHandler(void)
+{
+  /* USER CODE BEGIN TIM2_IRQn 0 */
+  const uint32_t prof_t0 = Prof_Now();
+  /* USER CODE END TIM2_IRQn 0 */
+  HAL_TIM_IRQHandler(&htim2);
+  /* USER CODE BEGIN TIM2_IRQn 1 */
+  Prof_Since(PROF_ISR_TIM2, prof_t0);
+  /* USER CODE END TIM2_IRQn 1 */
+}
+
 /**
   * @brief This function handles TIM3 global interrupt.
   */
@@ -299,11 +385,11 @@ void TIM3_IRQHandler(void)
 void USART2_IRQHandler(void)
 {
   /* USER CODE BEGIN USART2_IRQn 0 */
-
+  const uint32_t prof_t0 = Prof_Now();
   /* USER CODE END USART2_IRQn 0 */
   HAL_UART_IRQHandler(&huart2);
   /* USER CODE BEGIN USART2_IRQn 1 */
-
+  Prof_Since(PROF_ISR_UART, prof_t0);
   /* USER CODE END USART2_IRQn 1 */
 }
 
@@ -313,14 +399,26 @@ void USART2_IRQHandler(void)
 void DMA1_Stream6_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Stream6_IRQn 0 */
-
+  const uint32_t prof_t0 = Prof_Now();
   /* USER CODE END DMA1_Stream6_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_usart2_tx);
   /* USER CODE BEGIN DMA1_Stream6_IRQn 1 */
-
+  Prof_Since(PROF_ISR_UART, prof_t0);
   /* USER CODE END DMA1_Stream6_IRQn 1 */
 }
 
 /* USER CODE BEGIN 1 */
-
+#if COMM_USE_USB_CDC
+/**
+  * @brief This function handles USB On The Go FS global interrupt.
+  * @note  Prio sätts i usbd_conf.c (HAL_PCD_MspInit); använd 6 som USART2 så
+  *        att RX/TX-callbacks i comm.c körs på samma nivå som med UART.
+  */
+void OTG_FS_IRQHandler(void)
+{
+  const uint32_t prof_t0 = Prof_Now();
+  HAL_PCD_IRQHandler(&hpcd_USB_OTG_FS);
+  Prof_Since(PROF_ISR_UART, prof_t0);
+}
+#endif
 /* USER CODE END 1 */
@@ -3,22 +3,109 @@
 #include "sensor_hal.h"
 #include "comm.h"
 #include "api_schema.h"
+#include "api_parse.h"
+#include "timebase.h"
+#include "protocol_cobs.h"
+#include "protocol_crc16.h"
+#include "protocol_delta.h"
+#include "filter.h"
+#include "conditioning.h"
+#include "fmt.h"
+#include "hostclock.h"
+#include <stdio.h>
+#include <string.h>
 
 // --- Streaming State (private to this module) ---
 static volatile bool g_stream_enabled = false;
-static volatile uint32_t g_stream_div = 8;
-static volatile uint32_t g_stream_decim = 0;
-static volatile uint32_t g_stream_seq = 0;
+static volatile uint32_t g_stream_div = 8; // Effective: requested divider << governor shift
+static uint32_t g_stream_base_div = 8;      // From stream_rate_hz (text) or 1 (binary)
+static uint32_t g_stream_odr_hz = DEFAULT_ODR_HZ;
+// Decimation and sequence run per sensor so every sensor streams at stream_rate_hz
+static volatile uint32_t g_stream_decim[SENSOR_MAX_DEVICES];
+static volatile uint32_t g_stream_seq[SENSOR_MAX_DEVICES];
 static bool g_stream_suspended = false;
 static bool g_stream_owns_timer = false;
+static volatile StreamFormat_t g_stream_fmt = STREAM_FORMAT_TEXT;
 
-// --- Handoff buffer from ISR to main loop ---
-static volatile bool g_live_ready = false;
-static struct {
-  uint32_t seq;
-  int16_t  x, y, z;
-  uint32_t ts_us;
-} g_live_buf;
+// --- SPSC queue from PendSV to the main loop ---
+// Holds every sample in the binary format and every decimated sample in the
+// text format. Streaming_Pump formats them while the TX ring has room; a
+// full queue drops (live_drops) and the seq gap shows it to the host.
+#define STREAM_QUEUE 64U // Power of two; 40 ms at 800 Hz with two sensors
+#define STREAM_QUEUE_MASK (STREAM_QUEUE - 1U)
+#define STREAM_BIN_FRAME_MAX (PROTO_COBS_MAX(PROTO_BIN_REC_MAX) + 2U)
+#define STREAM_BIN_ABS_EVERY 256U // Absolute stamp interval (records per sensor)
+#define STREAM_BATCH_DT_MAX 65535U // Larger gaps start a new LIVE_BATCH line
+
+typedef struct {
+    Sample_t s;
+    uint32_t seq;
+} StreamItem_t;
+
+static StreamItem_t g_live_q[STREAM_QUEUE];
+static volatile uint32_t g_live_head = 0; // Written by PendSV only
+static volatile uint32_t g_live_tail = 0; // Written by the main loop only
+static uint8_t g_stream_batch = 1;        // Text: samples per line, 1 = plain LIVE
+static Sample_t g_bin_prev[SENSOR_MAX_DEVICES]; // Last record sent (dt and delta base)
+static bool g_bin_prev_valid[SENSOR_MAX_DEVICES];
+static PayloadCodec_t g_stream_codec = PAYLOAD_CODEC_RAW; // Latched at STREAM_START
+
+// --- Anti-alias stage in front of the text divider ---
+// STREAM_AA_STAGES cascaded Butterworth biquads per sensor and axis, run on
+// every sample at the full ODR. Corner at STREAM_AA_FC_DIV below the output
+// rate, i.e. half the output Nyquist: two stages give ~-24 dB at the output
+// Nyquist and more for everything that folds down from above it.
+// Runs in PendSV (the unpack), never in the I2C DMA ISR: 6 biquads per sample
+// is well under 1 % of the core at 3200 Hz with two sensors.
+#define STREAM_AA_STAGES 2U
+#define STREAM_AA_FC_DIV 4U
+static iir_filter_t g_aa[SENSOR_MAX_DEVICES][3][STREAM_AA_STAGES];
+static bool g_aa_primed[SENSOR_MAX_DEVICES]; // State seeded with the first sample
+static volatile bool g_aa_enabled = false;   // Only when g_stream_div > 1
+static uint32_t g_aa_fc_hz = 0;
+
+// --- Flow control ---
+// Credits (STREAM_START,credits= / STREAM_CREDIT,n=): when granted, each
+// sample sent costs one and the pump stalls at zero; the queue then fills and
+// the governor below sees it. The governor doubles the effective divider when
+// a window had queue drops or the TX ring never drained below 3/4, and steps
+// back after STREAM_GOV_CALM_WINDOWS windows below 1/4 without drops.
+#define STREAM_GOV_WINDOW_MS 500U
+#define STREAM_GOV_SHIFT_MAX 4U      // Down to 1/16 of the requested rate
+#define STREAM_GOV_CALM_WINDOWS 4U   // Hysteresis before stepping back up
+#define STREAM_GOV_TX_HIGH ((COMM_TX_RING_SIZE * 3U) / 4U)
+#define STREAM_GOV_TX_LOW (COMM_TX_RING_SIZE / 4U)
+#define STREAM_STATUS_MS 1000U       // STREAM_STATUS period (plus one per governor step)
+static bool g_credit_mode = false;
+static uint32_t g_credits = 0;
+static uint8_t g_gov_shift = 0;
+static uint8_t g_gov_calm = 0;
+static uint32_t g_gov_t0 = 0;
+static uint16_t g_gov_tx_min = 0;
+static uint16_t g_gov_tx_max = 0;
+static uint32_t g_gov_drops0 = 0;
+static uint32_t g_status_t0 = 0;
+static bool g_status_due = false;
+
+static void Streaming_PumpBin(AppContext_t* ctx);
+static void Streaming_PumpText(AppContext_t* ctx);
+static uint32_t Streaming_SendBatch(uint32_t tail, uint32_t head, uint32_t max);
+static size_t Streaming_BuildBinRecord(const StreamItem_t* it, uint8_t* rec);
+static void Streaming_AntiAlias(uint8_t i, Sample_t* s);
+static void Streaming_ApplyDivider(void);
+static void Streaming_Govern(AppContext_t* ctx);
+static bool Streaming_SendStatus(AppContext_t* ctx);
+
+static void Streaming_ResetCounters(void) {
+    for (uint8_t i = 0; i < SENSOR_MAX_DEVICES; i++) {
+        g_stream_seq[i] = 0;
+        g_stream_decim[i] = 0;
+        g_bin_prev_valid[i] = false;
+        g_aa_primed[i] = false;
+    }
+    Cond_Reset(COND_PATH_LIVE);
+    g_live_tail = g_live_head;
+}
 
 
 // --- Public Functions ---
@@ -28,19 +115,35 @@ void Streaming_Init(AppContext_t* ctx) {
     g_stream_enabled = false;
     g_stream_suspended = false;
     g_stream_owns_timer = false;
-    g_stream_seq = 0;
-    g_stream_decim = 0;
-    g_live_ready = false;
+    Streaming_ResetCounters();
+    g_stream_batch = 1;
     g_stream_div = (DEFAULT_ODR_HZ / DEFAULT_STREAM_HZ > 1) ? (DEFAULT_ODR_HZ / DEFAULT_STREAM_HZ) : 1;
+    g_stream_base_div = g_stream_div;
 }
 
-void Streaming_Start(AppContext_t* ctx) {
+void Streaming_Start(AppContext_t* ctx, StreamFormat_t fmt, uint8_t batch, uint32_t credits) {
+    if (batch < 1U) batch = 1U;
+    if (batch > STREAM_BATCH_MAX) batch = STREAM_BATCH_MAX;
     __disable_irq();
-    g_stream_seq = 0;
-    g_stream_decim = 0;
+    Streaming_ResetCounters();
+    g_stream_fmt = fmt;
+    g_stream_batch = (fmt == STREAM_FORMAT_TEXT) ? batch : 1U;
+    g_stream_codec = ctx->codec;
     __enable_irq();
 
+    g_credit_mode = (credits > 0U);
+    g_credits = (credits > STREAM_CREDIT_MAX) ? STREAM_CREDIT_MAX : credits;
+    g_gov_shift = 0;
+    g_gov_calm = 0;
+    g_gov_t0 = HAL_GetTick();
+    g_gov_tx_min = 0xFFFFU;
+    g_gov_tx_max = 0;
+    g_gov_drops0 = ctx->diag.live_drops;
+    g_status_t0 = g_gov_t0;
+    g_status_due = false;
+
     Streaming_UpdateDivider(ctx);
+    Sensor_SetConsumer(ctx, SENSOR_CONSUMER_LIVE);
 
     if (ctx->op_mode == OP_MODE_IDLE) {
         Sensor_StartSampling(ctx);
@@ -55,38 +158,48 @@ void Streaming_Start(AppContext_t* ctx) {
 
 void Streaming_Stop(AppContext_t* ctx) {
     g_stream_enabled = false;
+    g_gov_shift = 0; // SET_CFG between streams sees the requested divider
     if (ctx->op_mode == OP_MODE_IDLE && g_stream_owns_timer) {
         Sensor_StopSampling(ctx);
         g_stream_owns_timer = false;
     }
+    if (ctx->op_mode == OP_MODE_IDLE) {
+        Sensor_SetConsumer(ctx, SENSOR_CONSUMER_NONE);
+    }
     // Set is_dumping to true to allow any final messages to clear
     // before heartbeats resume. It will be cleared by the main loop logic.
     ctx->is_dumping = true; 
 }
 
+StreamFormat_t Streaming_GetFormat(void) {
+    return g_stream_fmt;
+}
+
+uint8_t Streaming_GetBatch(void) {
+    return g_stream_batch;
+}
+
+bool Streaming_IsActive(void) {
+    return g_stream_enabled;
+}
+
+uint32_t Streaming_AddCredits(uint32_t n) {
+    g_credit_mode = true;
+    g_credits = (n >= STREAM_CREDIT_MAX - g_credits) ? STREAM_CREDIT_MAX : (g_credits + n);
+    return g_credits;
+}
+
 void Streaming_Pump(AppContext_t* ctx) {
-    if (!g_live_ready) return;
     if (!g_stream_enabled) {
-        __disable_irq();
-        g_live_ready = false;
-        __enable_irq();
+        g_live_tail = g_live_head; // Discard what the ISR queued before the stop
         return;
     }
-
-    // Check if there is enough space in the TX buffer to avoid blocking.
-    if (COMM_TxFree() > 128U) {
-        // Atomically copy the data from the handoff buffer
-        __disable_irq();
-        uint32_t seq = g_live_buf.seq;
-        uint32_t ts = g_live_buf.ts_us;
-        int16_t x = g_live_buf.x, y = g_live_buf.y, z = g_live_buf.z;
-        g_live_ready = false;
-        __enable_irq();
-
-        // Send the formatted message
-        COMM_Sendf(MSG_LIVE ",seq=%lu,ax=%d,ay=%d,az=%d,ts_us=%lu" PROTO_EOL,
-                   seq, (int)x, (int)y, (int)z, (unsigned long)ts);
+    if (g_stream_fmt == STREAM_FORMAT_BIN) {
+        Streaming_PumpBin(ctx);
+    } else {
+        Streaming_PumpText(ctx);
     }
+    Streaming_Govern(ctx);
 }
 
 void Streaming_ProcessSampleFromISR(AppContext_t* ctx, const Sample_t* s) {
@@ -94,23 +207,31 @@ void Streaming_ProcessSampleFromISR(AppContext_t* ctx, const Sample_t* s) {
         return;
     }
 
-    g_stream_decim++;
-    if (g_stream_decim >= g_stream_div) {
-        g_stream_decim = 0;
+    uint8_t i = (s->sensor < SENSOR_MAX_DEVICES) ? s->sensor : 0U;
+    Sample_t out = *s;
+    // The filter sees every sample; only the divider output is queued. The
+    // binary format runs at div 1 unless the governor has stepped in.
+    Cond_Apply(COND_PATH_LIVE, &out, 1U); // SET_CFG flt_path conditioning, before the anti-alias stage
+    if (g_aa_enabled) {
+        Streaming_AntiAlias(i, &out);
+    }
+    g_stream_decim[i]++;
+    if (g_stream_decim[i] < g_stream_div) {
+        return;
+    }
+    g_stream_decim[i] = 0;
 
-        // Produce a new LIVE line only if the previous one has been consumed
-        // and there's ample TX buffer space to prevent ISR-level churn.
-        if (!g_live_ready && COMM_TxFree() > 128U) {
-            g_live_buf.seq   = g_stream_seq++;
-            g_live_buf.x     = s->x;
-            g_live_buf.y     = s->y;
-            g_live_buf.z     = s->z;
-            g_live_buf.ts_us = Sensor_TicksToUs(ctx, s->timestamp);
-            g_live_ready = true;
-        } else {
-            ctx->diag.live_drops++;
-        }
+    // seq advances for dropped samples too, so the host sees the gap.
+    uint32_t seq = g_stream_seq[i]++;
+    uint32_t head = g_live_head;
+    if ((head - g_live_tail) >= STREAM_QUEUE) {
+        ctx->diag.live_drops++;
+        return;
     }
+    g_live_q[head & STREAM_QUEUE_MASK].s = out;
+    g_live_q[head & STREAM_QUEUE_MASK].seq = seq;
+    __DMB();
+    g_live_head = head + 1U;
 }
 
 void Streaming_Reconfigure(AppContext_t* ctx) {
@@ -121,22 +242,330 @@ void Streaming_Reconfigure(AppContext_t* ctx) {
         g_stream_enabled = false;
         g_stream_owns_timer = false;
         g_stream_suspended = true;
+        g_gov_shift = 0;
         __disable_irq();
-        g_stream_decim = 0;
+        for (uint8_t i = 0; i < SENSOR_MAX_DEVICES; i++) {
+            g_stream_decim[i] = 0;
+        }
         __enable_irq();
     }
 }
 
 void Streaming_UpdateDivider(AppContext_t* ctx) {
-    g_stream_div = (ctx->cfg.stream_rate_hz > 0U)
+    uint32_t div = (ctx->cfg.stream_rate_hz > 0U)
                      ? (ctx->cfg.odr_hz / ctx->cfg.stream_rate_hz)
                      : 1U;
-    if (g_stream_div == 0U) {
-        g_stream_div = 1U;
+    if (div == 0U || g_stream_fmt == STREAM_FORMAT_BIN) {
+        div = 1U;
+    }
+    g_stream_base_div = div;
+    g_stream_odr_hz = ctx->cfg.odr_hz;
+    Streaming_ApplyDivider();
+}
+
+// Sets the effective divider (requested << governor shift) and redesigns the
+// anti-alias stage for it. The template is computed outside the critical
+// section (tanf); only the copy is guarded.
+static void Streaming_ApplyDivider(void) {
+    uint32_t div = g_stream_base_div << g_gov_shift;
+    iir_filter_t tmpl;
+    uint32_t fc_hz = 0;
+    if (div > 1U) {
+        fc_hz = (g_stream_odr_hz / div) / STREAM_AA_FC_DIV;
+        if (fc_hz == 0U) fc_hz = 1U;
+        Filter_Init(&tmpl, (float)fc_hz, (float)g_stream_odr_hz);
+    }
+    __disable_irq();
+    g_stream_div = div;
+    g_aa_enabled = false;
+    if (fc_hz > 0U) {
+        for (uint8_t i = 0; i < SENSOR_MAX_DEVICES; i++) {
+            for (uint8_t a = 0; a < 3U; a++) {
+                for (uint8_t k = 0; k < STREAM_AA_STAGES; k++) {
+                    g_aa[i][a][k] = tmpl;
+                }
+            }
+            g_aa_primed[i] = false;
+        }
+        g_aa_enabled = true;
     }
+    g_aa_fc_hz = fc_hz;
+    __enable_irq();
+}
+
+uint32_t Streaming_GetAntiAliasHz(void) {
+    return g_aa_fc_hz;
+}
+
+static int16_t aa_to_i16(float v) {
+    if (v >= 32767.0f) return 32767;
+    if (v <= -32768.0f) return -32768;
+    return (int16_t)((v >= 0.0f) ? (v + 0.5f) : (v - 0.5f));
+}
+
+// Runs the cascade on one sample in place. The first sample after a start or
+// a redesign seeds every stage at its DC steady state (unity DC gain), so the
+// 1 g offset does not ring through the first LIVE lines.
+static void Streaming_AntiAlias(uint8_t i, Sample_t* s) {
+    float in[3] = { (float)s->x, (float)s->y, (float)s->z };
+    if (!g_aa_primed[i]) {
+        for (uint8_t a = 0; a < 3U; a++) {
+            for (uint8_t k = 0; k < STREAM_AA_STAGES; k++) {
+                iir_filter_t* f = &g_aa[i][a][k];
+                f->x1 = f->x2 = f->y1 = f->y2 = in[a];
+            }
+        }
+        g_aa_primed[i] = true;
+    }
+    for (uint8_t a = 0; a < 3U; a++) {
+        float v = in[a];
+        for (uint8_t k = 0; k < STREAM_AA_STAGES; k++) {
+            v = Filter_Update(&g_aa[i][a][k], v);
+        }
+        in[a] = v;
+    }
+    s->x = aa_to_i16(in[0]);
+    s->y = aa_to_i16(in[1]);
+    s->z = aa_to_i16(in[2]);
 }
 
 uint32_t Streaming_GetDivider(AppContext_t* ctx) {
     (void)ctx;
     return g_stream_div;
+}
+
+// --- Flow control ---
+
+// Runs once per pump: tracks the TX ring fill over a window, steps the
+// governor at the window end and sends STREAM_STATUS when due.
+static void Streaming_Govern(AppContext_t* ctx) {
+    uint16_t used = COMM_TxRingUsage();
+    if (used < g_gov_tx_min) g_gov_tx_min = used;
+    if (used > g_gov_tx_max) g_gov_tx_max = used;
+
+    uint32_t now = HAL_GetTick();
+    if ((now - g_gov_t0) >= STREAM_GOV_WINDOW_MS) {
+        bool dropped = (ctx->diag.live_drops != g_gov_drops0);
+        if (dropped || g_gov_tx_min >= STREAM_GOV_TX_HIGH) {
+            g_gov_calm = 0;
+            if (g_gov_shift < STREAM_GOV_SHIFT_MAX) {
+                g_gov_shift++;
+                Streaming_ApplyDivider();
+                g_status_due = true;
+            }
+        } else if (g_gov_tx_max < STREAM_GOV_TX_LOW && g_gov_shift > 0U) {
+            if (++g_gov_calm >= STREAM_GOV_CALM_WINDOWS) {
+                g_gov_calm = 0;
+                g_gov_shift--;
+                Streaming_ApplyDivider();
+                g_status_due = true;
+            }
+        } else {
+            g_gov_calm = 0;
+        }
+        g_gov_t0 = now;
+        g_gov_tx_min = 0xFFFFU;
+        g_gov_tx_max = 0;
+        g_gov_drops0 = ctx->diag.live_drops;
+    }
+
+    if ((now - g_status_t0) >= STREAM_STATUS_MS) {
+        g_status_due = true;
+    }
+    // Retried on every pump while the TX ring is too full to take it.
+    if (g_status_due && Streaming_SendStatus(ctx)) {
+        g_status_due = false;
+        g_status_t0 = now;
+    }
+}
+
+static bool Streaming_SendStatus(AppContext_t* ctx) {
+    uint32_t head = g_live_head;
+    return COMM_Sendf(MSG_STREAM_STATUS ",rate_hz=%lu,div=%lu,gov=%u,aa_hz=%lu,q=%lu,tx_free=%u,"
+                      "drops=%lu,credit=%u,credits=%lu" PROTO_EOL,
+                      g_stream_odr_hz / g_stream_div, g_stream_div, (unsigned)g_gov_shift,
+                      g_aa_fc_hz, head - g_live_tail, (unsigned)COMM_TxFree(),
+                      ctx->diag.live_drops, g_credit_mode ? 1U : 0U, g_credits) > 0;
+}
+
+// --- Text format ---
+
+static void Streaming_PumpText(AppContext_t* ctx) {
+    (void)ctx;
+    uint32_t tail = g_live_tail;
+    uint32_t head = g_live_head;
+    // Check if there is enough space in the TX buffer to avoid blocking.
+    while (tail != head && COMM_TxFree() > PROTO_MAX_LINE &&
+           (!g_credit_mode || g_credits > 0U)) {
+        __DMB(); // Slot contents are valid once head covers them
+        if (g_stream_batch > 1U) {
+            uint32_t max = g_stream_batch;
+            if (g_credit_mode && g_credits < max) max = g_credits;
+            uint32_t next = Streaming_SendBatch(tail, head, max);
+            if (g_credit_mode) g_credits -= (next - tail);
+            tail = next;
+        } else {
+            const StreamItem_t* it = &g_live_q[tail & STREAM_QUEUE_MASK];
+            char* p = COMM_LineBegin();
+            p = fmt_str(p, MSG_LIVE ",seq=");  p = fmt_u32(p, it->seq);
+            p = fmt_str(p, ",ax=");            p = fmt_i32(p, it->s.x);
+            p = fmt_str(p, ",ay=");            p = fmt_i32(p, it->s.y);
+            p = fmt_str(p, ",az=");            p = fmt_i32(p, it->s.z);
+            const uint64_t ts_us = Timebase_StampToUs64(it->s.timestamp);
+            p = fmt_str(p, ",ts_us=");         p = fmt_u64(p, ts_us);
+            p = fmt_str(p, ",sensor=");        p = fmt_u32(p, it->s.sensor);
+            p = HostClock_FmtField(p, ts_us);
+            p = fmt_str(p, PROTO_EOL);
+            (void)COMM_LineEnd(p);
+            if (g_credit_mode) g_credits--;
+            tail++;
+        }
+        __DMB(); // Slots are read before they are handed back
+        g_live_tail = tail;
+    }
+}
+
+// Sends one LIVE_BATCH line from the queue, starting at tail: consecutive
+// samples of one sensor with no seq gap, as many as fit the line and max
+// (batch size or remaining credits). Returns the new tail.
+static uint32_t Streaming_SendBatch(uint32_t tail, uint32_t head, uint32_t max) {
+    const StreamItem_t* first = &g_live_q[tail & STREAM_QUEUE_MASK];
+    // The header is split around n, which is known only after the body.
+    char pre[32];
+    char post[48 + HOSTCLOCK_FIELD_MAX];
+    char n_max[FMT_U32_MAX];
+    const size_t pre_len = (size_t)(fmt_u32(fmt_str(pre, MSG_LIVE_BATCH ",seq="), first->seq) - pre);
+    char* q = fmt_str(post, ",sensor=");
+    q = fmt_u32(q, first->s.sensor);
+    const uint64_t ts_us = Timebase_StampToUs64(first->s.timestamp);
+    q = fmt_str(q, ",ts_us=");
+    q = fmt_u64(q, ts_us);
+    q = HostClock_FmtField(q, ts_us);
+    q = fmt_str(q, ",s=");
+    const size_t post_len = (size_t)(q - post);
+    // Header length with the widest n bounds the room for samples.
+    const size_t hdr_max = pre_len + (sizeof(",n=") - 1U)
+                         + (size_t)(fmt_u32(n_max, STREAM_BATCH_MAX) - n_max)
+                         + post_len + (sizeof(PROTO_EOL) - 1U);
+    const size_t room = (size_t)PROTO_MAX_LINE - hdr_max;
+
+    // One item is at most ";" + dt + 3 x ":-32768"; the slack keeps the last
+    // one in bounds before it is measured against room.
+    char body[PROTO_MAX_LINE + 32];
+    size_t blen = 0;
+    uint32_t n = 0;
+    uint32_t prev_ts = first->s.timestamp;
+    while (tail != head && n < max) {
+        const StreamItem_t* it = &g_live_q[tail & STREAM_QUEUE_MASK];
+        if (n > 0U && (it->s.sensor != first->s.sensor || it->seq != first->seq + n)) break;
+        uint32_t dt_us = Timebase_TicksToUs(it->s.timestamp - prev_ts);
+        if (dt_us > STREAM_BATCH_DT_MAX) break;
+        char* b = &body[blen];
+        if (n > 0U) *b++ = ';';
+        b = fmt_u32(b, dt_us);
+        *b++ = ':';
+        b = fmt_i32(b, it->s.x);
+        *b++ = ':';
+        b = fmt_i32(b, it->s.y);
+        *b++ = ':';
+        b = fmt_i32(b, it->s.z);
+        if ((size_t)(b - body) > room) break;
+        blen = (size_t)(b - body);
+        prev_ts = it->s.timestamp;
+        n++;
+        tail++;
+    }
+
+    char* p = COMM_LineBegin();
+    memcpy(p, pre, pre_len);
+    p = fmt_u32(fmt_str(p + pre_len, ",n="), n);
+    memcpy(p, post, post_len);
+    memcpy(p + post_len, body, blen);
+    p = fmt_str(p + post_len + blen, PROTO_EOL);
+    (void)COMM_LineEnd(p);
+    return tail;
+}
+
+// --- Binary format ---
+
+static void Streaming_PumpBin(AppContext_t* ctx) {
+    (void)ctx;
+    uint32_t tail = g_live_tail;
+    while (tail != g_live_head) {
+        if (g_credit_mode && g_credits == 0U) break;
+        __DMB(); // Slot contents are valid once head covers them
+
+        // The frame is COBS-encoded straight into the TX ring; only a frame
+        // that would straddle the ring end goes through the stack copy.
+        COMM_TxSpan sp;
+        if (!COMM_TxReserve(STREAM_BIN_FRAME_MAX, &sp)) break;
+        uint8_t rec[PROTO_BIN_REC_MAX];
+        size_t n = Streaming_BuildBinRecord(&g_live_q[tail & STREAM_QUEUE_MASK], rec);
+        if (sp.len[0] >= STREAM_BIN_FRAME_MAX) {
+            uint8_t* frame = (uint8_t*)sp.p[0];
+            frame[0] = PROTO_BIN_DELIM;
+            size_t m = proto_cobs_encode(rec, n, &frame[1]);
+            frame[1U + m] = PROTO_BIN_DELIM;
+            COMM_TxCommit((uint16_t)(m + 2U));
+        } else {
+            uint8_t frame[STREAM_BIN_FRAME_MAX];
+            frame[0] = PROTO_BIN_DELIM;
+            size_t m = proto_cobs_encode(rec, n, &frame[1]);
+            frame[1U + m] = PROTO_BIN_DELIM;
+            uint16_t a = ((m + 2U) < sp.len[0]) ? (uint16_t)(m + 2U) : sp.len[0];
+            memcpy(sp.p[0], frame, a);
+            memcpy(sp.p[1], &frame[a], (m + 2U) - a);
+            COMM_TxCommit((uint16_t)(m + 2U));
+        }
+        if (g_credit_mode) g_credits--;
+
+        tail++;
+        __DMB(); // Slot is read before it is handed back
+        g_live_tail = tail;
+    }
+}
+
+static void put_u16le(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static size_t Streaming_BuildBinRecord(const StreamItem_t* it, uint8_t* rec) {
+    uint8_t i = (it->s.sensor < SENSOR_MAX_DEVICES) ? it->s.sensor : 0U;
+    const Sample_t prev = g_bin_prev[i];
+    uint32_t dt_us = Timebase_TicksToUs(it->s.timestamp - prev.timestamp);
+    bool abs_ts = !g_bin_prev_valid[i] || dt_us > 0xFFFFU ||
+                  (it->seq % STREAM_BIN_ABS_EVERY) == 0U;
+    g_bin_prev[i] = it->s;
+    g_bin_prev_valid[i] = true;
+
+    size_t n = 0;
+    if (!abs_ts && g_stream_codec == PAYLOAD_CODEC_DELTA) {
+        rec[n++] = PROTO_BIN_LIVE_ZZ;
+        rec[n++] = i;
+        put_u16le(&rec[n], (uint16_t)it->seq); n += 2;
+        n += proto_varint_put(&rec[n], proto_zigzag32((int32_t)it->s.x - prev.x));
+        n += proto_varint_put(&rec[n], proto_zigzag32((int32_t)it->s.y - prev.y));
+        n += proto_varint_put(&rec[n], proto_zigzag32((int32_t)it->s.z - prev.z));
+        n += proto_varint_put(&rec[n], dt_us);
+        put_u16le(&rec[n], proto_crc16_buf(rec, n)); n += 2;
+        return n;
+    }
+
+    rec[n++] = abs_ts ? PROTO_BIN_LIVE_ABS : PROTO_BIN_LIVE_DT;
+    rec[n++] = i;
+    put_u16le(&rec[n], (uint16_t)it->seq); n += 2;
+    put_u16le(&rec[n], (uint16_t)it->s.x); n += 2;
+    put_u16le(&rec[n], (uint16_t)it->s.y); n += 2;
+    put_u16le(&rec[n], (uint16_t)it->s.z); n += 2;
+    if (abs_ts) {
+        uint64_t ts_us = Timebase_StampToUs64(it->s.timestamp);
+        for (int b = 0; b < 8; b++) {
+            rec[n++] = (uint8_t)(ts_us >> (8 * b));
+        }
+    } else {
+        put_u16le(&rec[n], (uint16_t)dt_us); n += 2;
+    }
+    put_u16le(&rec[n], proto_crc16_buf(rec, n)); n += 2;
+    return n;
 }
\ No newline at end of file
@@ -13,13 +13,20 @@ PATCH SUMMARY:
 #include "telemetry.h"
 #include "comm.h"
 #include "api_schema.h"
-#include "sensor_hal.h" // For Sensor_TicksToUs and preview data
+#include "sensor_hal.h" // For preview data
+#include "timebase.h"   // For Timebase_NowUs64
+#include "hostclock.h"  // HB host time
+#include "api_parse.h"  // For api_format_u64
 #include "streaming.h"  // For Streaming_GetDivider
 #include "burst_mgr.h"  // For BM_IsActive
 #include "transport_blocks.h" // For TB_GetQueueCount, etc.
+#include "trigger_logic.h" // For Trigger_IsCapturingRef
+#include "app_rtos.h"      // APP_WAIT_EVENT, App_RtosSendDiag
+#include "prof.h"          // Prof_SendDiag
+#include "dev_telemetry.h" // RXTX_DEBUG
+#include "sched.h"         // Sched_ArmTimeout
 
 #include <stdio.h>
-#include <math.h> // For atan2f in preview calculation
 
 // --- Static variables ---
 static uint32_t g_hb_last_ms = 0;
@@ -27,7 +34,6 @@ static uint32_t g_hb_last_ms = 0;
 // --- Static Function Prototypes ---
 static const char *op_mode_to_str(OpMode_t mode);
 static const char *trg_state_to_str(TrgState_t state);
-static float theta_deg_from_ms2(float ax_ms2, float ay_ms2);
 
 // --- Public Functions ---
 
@@ -42,23 +48,26 @@ void Telemetry_Pump(AppContext_t* ctx) {
     // Per API v12.1 §4.1, HB is gated (paused) only during active BLOCKS transfers.
     if (!BM_IsActive() && ctx->cfg.hb_ms > 0 && (current_tick_ms - g_hb_last_ms) >= ctx->cfg.hb_ms) {
         g_hb_last_ms = current_tick_ms;
-        uint64_t host_ms = 0;
-        if (ctx->tsync.has_sync) {
-            uint32_t now_ticks = __HAL_TIM_GET_COUNTER(ctx->htim2);
-            uint32_t dt_ticks = now_ticks - ctx->tsync.tick_at_sync;
-            uint32_t delta_us = Sensor_TicksToUs(ctx, dt_ticks);
-            host_ms = ctx->tsync.host_ms_at_sync + (uint64_t)(delta_us / 1000u);
+        uint64_t host_us = 0;
+        if (HostClock_ToHostUs(Timebase_NowUs64(), &host_us)) {
+            const uint64_t host_ms = host_us / 1000u;
             uint32_t host_hi = (uint32_t)(host_ms >> 32);
             uint32_t host_lo = (uint32_t)(host_ms & 0xFFFFFFFFu);
-            COMM_Sendf(MSG_HB ",tick=%lu,host_hi=%lu,host_lo=%lu,tx_free=%u,tx_drop=%lu" PROTO_EOL,
+            COMM_Sendf(MSG_HB ",tick=%lu,host_hi=%lu,host_lo=%lu,tx_free=%u,tx_drop=%lu,ctrl_drop=%lu" PROTO_EOL,
                        (unsigned long)current_tick_ms, host_hi, host_lo,
-                       (unsigned)COMM_TxFree(), (unsigned long)COMM_TxDropCount());
+                       (unsigned)COMM_TxFree(), (unsigned long)COMM_TxDropCount(),
+                       (unsigned long)COMM_TxCtrlDropCount());
         } else {
-            COMM_Sendf(MSG_HB ",tick=%lu,tx_free=%u,tx_drop=%lu" PROTO_EOL,
+            COMM_Sendf(MSG_HB ",tick=%lu,tx_free=%u,tx_drop=%lu,ctrl_drop=%lu" PROTO_EOL,
                        (unsigned long)current_tick_ms, (unsigned)COMM_TxFree(),
-                       (unsigned long)COMM_TxDropCount());
+                       (unsigned long)COMM_TxDropCount(), (unsigned long)COMM_TxCtrlDropCount());
         }
     }
+    // Under BLOCKS väcker ACK_COMPLETE (CMD) pumpen igen
+    if (!BM_IsActive() && ctx->cfg.hb_ms > 0) {
+        const uint32_t since = current_tick_ms - g_hb_last_ms;
+        Sched_ArmTimeout((since >= ctx->cfg.hb_ms) ? 0U : (ctx->cfg.hb_ms - since));
+    }
 }
 
 void Telemetry_SendStatus(AppContext_t* ctx) {
@@ -66,36 +75,58 @@ void Telemetry_SendStatus(AppContext_t* ctx) {
     if (ctx->op_mode == OP_MODE_BURST_SENDING && BM_IsActive()) {
         return;
     }
-    COMM_Sendf(MSG_STATUS ",op=%s,trg=%s,axis=MAG" PROTO_EOL,
-               op_mode_to_str(ctx->op_mode), trg_state_to_str(ctx->trg_state));
+    COMM_Sendf(MSG_STATUS ",op=%s,trg=%s,axis=MAG,ref=%u" PROTO_EOL,
+               op_mode_to_str(ctx->op_mode), trg_state_to_str(ctx->trg_state),
+               (unsigned)Trigger_IsCapturingRef());
 }
 
 void Telemetry_SendCfg(AppContext_t* ctx) {
-    COMM_Sendf(MSG_CFG ",odr_hz=%lu,burst_ms=%lu,hb_ms=%lu,stream_rate_hz=%lu" PROTO_EOL,
-               ctx->cfg.odr_hz, ctx->cfg.burst_ms, ctx->cfg.hb_ms, ctx->cfg.stream_rate_hz);
+    static const char *const k_flt[4] = { PROTO_FLT_OFF, PROTO_FLT_LP, PROTO_FLT_HP, PROTO_FLT_BP };
+    COMM_Sendf(MSG_CFG ",odr_hz=%lu,burst_ms=%lu,hb_ms=%lu,stream_rate_hz=%lu,wm=%u"
+               ",flt=%s,flt_n=%u,flt_f1=%u,flt_f2=%u,flt_path=%u" PROTO_EOL,
+               ctx->cfg.odr_hz, ctx->cfg.burst_ms, ctx->cfg.hb_ms, ctx->cfg.stream_rate_hz,
+               (unsigned)Sensor_GetWatermark(),
+               k_flt[ctx->cfg.flt & 3u], (unsigned)ctx->cfg.flt_n, (unsigned)ctx->cfg.flt_f1_hz,
+               (unsigned)ctx->cfg.flt_f2_hz, (unsigned)ctx->cfg.flt_path);
 }
 
 void Telemetry_SendTrgSettings(AppContext_t* ctx) {
-    COMM_Sendf(MSG_TRG_SETTINGS ",k_mult=%.3f,hold_ms=%lu" PROTO_EOL,
+    COMM_Sendf(MSG_TRG_SETTINGS ",k_mult=%.3f,hold_ms=%lu,sleep=%u,act_mg=%u,inact_mg=%u,inact_s=%u,pre_ms=%u"
+               ",win_ms=%lu,det=%s,ch=%s" PROTO_EOL,
                ctx->trigger_settings.k_mult,
-               (unsigned long)ctx->trigger_settings.hold_ms);
+               (unsigned long)ctx->trigger_settings.hold_ms,
+               ctx->trigger_settings.sleep_en ? 1u : 0u,
+               (unsigned)ctx->trigger_settings.act_mg,
+               (unsigned)ctx->trigger_settings.inact_mg,
+               (unsigned)ctx->trigger_settings.inact_s,
+               (unsigned)ctx->trigger_settings.pre_ms,
+               (unsigned long)ctx->trigger_settings.win_ms,
+               (ctx->trigger_settings.det == TRG_DET_STA) ? PROTO_TRG_DET_STA : PROTO_TRG_DET_PEAK,
+               (ctx->trigger_settings.ch == TRG_AXIS_MAG) ? PROTO_TRG_CH_MAG : PROTO_TRG_CH_XYZ);
 }
 
 void Telemetry_SendACK(const char* subject) {
-    COMM_Sendf(MSG_ACK ",SUBJECT=%s" PROTO_EOL, subject);
+    COMM_SendfCtrl(MSG_ACK ",SUBJECT=%s" PROTO_EOL, subject);
 }
 
 void Telemetry_SendNACK(const char* subject, const char* reason, uint32_t code) {
-    COMM_Sendf(MSG_NACK ",SUBJECT=%s,reason=%s,code=%lu" PROTO_EOL, subject, reason, code);
+    COMM_SendfCtrl(MSG_NACK ",SUBJECT=%s,reason=%s,code=%lu" PROTO_EOL, subject, reason, code);
 }
 
 void Telemetry_SendERROR(const char* src, uint32_t code, const char* msg) {
-    COMM_Sendf(MSG_ERROR ",src=%s,code=%lu,msg=\"%s\"" PROTO_EOL, src, code, msg);
+    COMM_SendfCtrl(MSG_ERROR ",src=%s,code=%lu,msg=\"%s\"" PROTO_EOL, src, code, msg);
 }
 
 void Telemetry_SendStreamStartACK(AppContext_t* ctx) {
-    COMM_Sendf(MSG_ACK ",SUBJECT=" CMD_STREAM_START ",rate_hz=%lu,div=%lu" PROTO_EOL,
-               ctx->cfg.stream_rate_hz, Streaming_GetDivider(ctx));
+    bool bin = (Streaming_GetFormat() == STREAM_FORMAT_BIN);
+    COMM_SendfCtrl(MSG_ACK ",SUBJECT=" CMD_STREAM_START ",rate_hz=%lu,div=%lu,fmt=%s,batch=%u,aa_hz=%lu" PROTO_EOL,
+               bin ? ctx->cfg.odr_hz : ctx->cfg.stream_rate_hz, Streaming_GetDivider(ctx),
+               bin ? STREAM_FMT_BIN : STREAM_FMT_TEXT, (unsigned)Streaming_GetBatch(),
+               Streaming_GetAntiAliasHz());
+}
+
+void Telemetry_SendStreamCreditACK(uint32_t credits) {
+    COMM_SendfCtrl(MSG_ACK ",SUBJECT=" CMD_STREAM_CREDIT ",credits=%lu" PROTO_EOL, credits);
 }
 
 void Telemetry_SendCalInfo(AppContext_t* ctx) {
@@ -105,9 +136,9 @@ void Telemetry_SendCalInfo(AppContext_t* ctx) {
 }
 
 void Telemetry_SendDiag(AppContext_t* ctx) {
-#if defined(RXTX_DEBUG) && RXTX_DEBUG > 0
     (void)ctx;
     Telemetry_SendACK(CMD_GET_DIAG);
+#if defined(RXTX_DEBUG) && RXTX_DEBUG > 0
     COMM_SendfBlocking("[DEBUG] DIAG_STATS: tx_drops=%lu, rx_ovf=%lu\r\n",
                        COMM_TxDropCount(), COMM_RxOverflowCount());
     COMM_SendfBlocking("[DEBUG] DIAG_BUFS: rx_ring=%u/%u, tx_ring=%u/%u\r\n",
@@ -117,32 +148,46 @@ void Telemetry_SendDiag(AppContext_t* ctx) {
     uint8_t inflight_count = TB_GetInflightCount();
     COMM_SendfBlocking("[DEBUG] DIAG_BLOCKS: queue=%u, inflight=%u\r\n",
                        q_count, inflight_count);
-#else
-    (void)ctx;
-    Telemetry_SendNACK(CMD_GET_DIAG, "not_supported", 900);
+    TB_LinkStats ls;
+    TB_GetLinkStats(&ls);
+    COMM_SendfBlocking("[DEBUG] DIAG_LINK: lines=%u, win=%u, rto_ms=%lu, srtt_ms=%lu, rttvar_ms=%lu, nacks=%lu, timeouts=%lu\r\n",
+                       ls.lines, ls.window, ls.rto_ms, ls.srtt_ms, ls.rttvar_ms, ls.nacks, ls.timeouts);
+    COMM_SendfBlocking("[DEBUG] DIAG_TS: edge_cap=%lu, edge_fallback=%lu, drift_rej=%lu, odr_meas=%.3f\r\n",
+                       g_debug_ts_edge_captured, g_debug_ts_edge_fallback,
+                       g_debug_ts_drift_rejected, Sensor_GetMeasuredOdrHz());
+    COMM_SendfBlocking("[DEBUG] DIAG_GATE: wakeups=%lu, sleeps=%lu, wake_dropped=%lu, asleep=%u\r\n",
+                       g_debug_gate_wakeups, g_debug_gate_sleeps, g_debug_gate_wake_dropped,
+                       Sensor_IsActivityGateAsleep() ? 1u : 0u);
+    COMM_SendfBlocking("[DEBUG] DIAG_MERGE: unordered=%lu\r\n", g_debug_merge_unordered);
+#endif
+#if APP_USE_RTOS
+    App_RtosSendDiag();
 #endif
+    Prof_SendDiag(); // Probes are part of every build
 }
 
-void Telemetry_SendPreview(AppContext_t* ctx) {
-    const PreviewSnap_t* preview = Sensor_GetPreviewSnapshot(ctx);
-    if (!preview) return;
-
-    COMM_Sendf(MSG_PREVIEW_HEADER ",samples=%u" PROTO_EOL, preview->count);
-    for (uint16_t i = 0; i < preview->count; i++) {
-        float ax_mps2, ay_mps2, az_mps2;
-        Sensor_ConvertToMps2(ctx, &preview->buf[i], &ax_mps2, &ay_mps2, &az_mps2);
-        
-        float theta_deg = theta_deg_from_ms2(ax_mps2, ay_mps2);
-        
-        COMM_Sendf(MSG_PREVIEW ",ts_us=%lu,ax=%.3f,ay=%.3f,az=%.3f,theta=%.3f" PROTO_EOL,
-                   (unsigned long)Sensor_TicksToUs(ctx, preview->buf[i].timestamp),
-                   ax_mps2, ay_mps2, az_mps2, theta_deg);
+void Telemetry_SendSelfTestResult(HAL_StatusTypeDef status, const AdxlSelfTestResult_t* results,
+                                  uint32_t odr_hz, uint8_t avg_count, uint8_t settle_count) {
+    if (status == HAL_OK) {
+        uint8_t devid = 0xE5; // Known device ID
+
+        COMM_Sendf("ADXL_ST_CFG,devid=0x%02X,odr_hz=%lu,avg=%u,settle=%u" PROTO_EOL,
+                   devid, (unsigned long)odr_hz, avg_count, settle_count);
+
+        COMM_Sendf("ADXL_ST_RAW,x_off=%d,y_off=%d,z_off=%d,x_on=%d,y_on=%d,z_on=%d,x_st=%d,y_st=%d,z_st=%d,health=%s" PROTO_EOL,
+                   results->x_off, results->y_off, results->z_off,
+                   results->x_on, results->y_on, results->z_on,
+                   results->x_st, results->y_st, results->z_st,
+                   results->health_pass ? "PASS" : "FAIL");
+    } else {
+        const char* reason = (status == HAL_TIMEOUT) ? "sensor_timeout" : "i2c_error";
+        COMM_Sendf("ADXL_ST_RAW,health=%s" PROTO_EOL, reason);
     }
-    COMM_Send(MSG_PREVIEW_END PROTO_EOL);
 }
 
 void Telemetry_UpdateLED(AppContext_t* ctx) {
     uint32_t tick = HAL_GetTick();
+    // Blinkande lägen begär en frist till nästa flank
     switch (ctx->op_mode) {
     case OP_MODE_INIT:
         HAL_GPIO_WritePin(LED2_GPIO_Port, LED2_Pin, GPIO_PIN_SET);
@@ -152,18 +197,22 @@ void Telemetry_UpdateLED(AppContext_t* ctx) {
         break;
     case OP_MODE_TRG_CAL_ZERO:
         HAL_GPIO_WritePin(LED2_GPIO_Port, LED2_Pin, (tick / 500) % 2);
+        Sched_ArmTimeout(500 - tick % 500);
         break;
     case OP_MODE_BURST:
     case OP_MODE_BURST_SENDING:
     case OP_MODE_COUNTDOWN:
         HAL_GPIO_WritePin(LED2_GPIO_Port, LED2_Pin, (tick / 100) % 2);
+        Sched_ArmTimeout(100 - tick % 100);
         break;
     case OP_MODE_ARMED:
         HAL_GPIO_WritePin(LED2_GPIO_Port, LED2_Pin, (tick / 2000) % 2);
+        Sched_ArmTimeout(2000 - tick % 2000);
         break;
     case OP_MODE_WAIT_ARM:
     case OP_MODE_WAIT_CAL_ZERO:
         HAL_GPIO_WritePin(LED2_GPIO_Port, LED2_Pin, (tick % 2000) < 100);
+        Sched_ArmTimeout(((tick % 2000) < 100) ? (100 - tick % 2000) : (2000 - tick % 2000));
         break;
     default:
         HAL_GPIO_WritePin(LED2_GPIO_Port, LED2_Pin, GPIO_PIN_RESET);
@@ -174,7 +223,7 @@ void Telemetry_UpdateLED(AppContext_t* ctx) {
 void Telemetry_Flush(void) {
     uint32_t t0 = HAL_GetTick();
     while (!COMM_TxIsIdle() && (HAL_GetTick() - t0) < 50) {
-        HAL_Delay(1);
+        APP_WAIT_EVENT(); /* varje klar DMA-span gör SEV; SysTick väcker för timeouten */
     }
 }
 
@@ -205,9 +254,3 @@ static const char *trg_state_to_str(TrgState_t s) {
     default: return "idle";
     }
 }
-
-static float theta_deg_from_ms2(float ax_ms2, float ay_ms2) {
-    const float RAD2DEG = 57.29577951308232f;
-    float theta = atan2f(ay_ms2, ax_ms2) * RAD2DEG;
-    return (theta >= 0.0f) ? theta : -theta;
-}
\ No newline at end of file
@@ -87,7 +87,23 @@ void MX_TIM2_Init(void)
     Error_Handler();
   }
   /* USER CODE BEGIN TIM2_Init 2 */
-
+#if SENSOR_TS_EDGE_CAPTURE
+  /* CH3 (PB10) latches the ADXL345 INT1 falling edge. Polled from the EXTI
+   * callback, so no capture interrupt is enabled. */
+  TIM_IC_InitTypeDef sConfigIC = {0};
+  if (HAL_TIM_IC_Init(&htim2) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sConfigIC.ICPolarity = TIM_ICPOLARITY_FALLING;
+  sConfigIC.ICSelection = TIM_ICSELECTION_DIRECTTI;
+  sConfigIC.ICPrescaler = TIM_ICPSC_DIV1;
+  sConfigIC.ICFilter = 0;
+  if (HAL_TIM_IC_ConfigChannel(&htim2, &sConfigIC, TIM_CHANNEL_3) != HAL_OK)
+  {
+    Error_Handler();
+  }
+#endif
   /* USER CODE END 2 */
 
 }
@@ -148,6 +164,22 @@ void HAL_TIM_Base_MspInit(TIM_HandleTypeDef* tim_baseHandle)
     /* TIM2 clock enable */
     __HAL_RCC_TIM2_CLK_ENABLE();
   /* USER CODE BEGIN TIM2_MspInit 1 */
+    /* TIM2 update (wrap) interrupt extends the timebase to 64 bits. */
+    HAL_NVIC_SetPriority(TIM2_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(TIM2_IRQn);
+#if SENSOR_TS_EDGE_CAPTURE
+    /**TIM2 GPIO Configuration
+    PB10     ------> TIM2_CH3 (ADXL345 INT1 edge capture)
+    */
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    __HAL_RCC_GPIOB_CLK_ENABLE();
+    GPIO_InitStruct.Pin = ADXL345_INT1_CAP_Pin;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+    GPIO_InitStruct.Alternate = GPIO_AF1_TIM2;
+    HAL_GPIO_Init(ADXL345_INT1_CAP_GPIO_Port, &GPIO_InitStruct);
+#endif
 
   /* USER CODE END 1 */
   }
@@ -180,6 +212,7 @@ void HAL_TIM_Base_MspDeInit(TIM_HandleTypeDef* tim_baseHandle)
     /* Peripheral clock disable */
     __HAL_RCC_TIM2_CLK_DISABLE();
   /* USER CODE BEGIN TIM2_MspDeInit 1 */
+    HAL_NVIC_DisableIRQ(TIM2_IRQn);
 
   /* USER CODE END 1 */
   }
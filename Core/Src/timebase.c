@@ -0,0 +1,92 @@
+/*
+ * 64-bit microsecond timebase on TIM2 (see timebase.h).
+ * The wrap count is advanced from the TIM2 update interrupt; readers that run
+ * with a pending wrap (higher-priority ISRs, masked sections) fix it up from UIF.
+ */
+/* filename: Core/Src/timebase.c */
+#include "timebase.h"
+
+static TIM_HandleTypeDef* s_htim = NULL;
+static volatile uint32_t s_wraps = 0;   // TIM2 overflows since init
+static uint32_t s_tick_hz = 1000000U;
+static bool s_tick_is_us = true;        // Fast path: TIM2 prescaled to exactly 1 MHz
+static uint32_t s_us_per_tick_q32 = 0;  // ceil(1e6 * 2^32 / tick_hz) for the generic path
+
+HAL_StatusTypeDef Timebase_Init(TIM_HandleTypeDef* htim) {
+    if (htim == NULL) return HAL_ERROR;
+    s_htim = htim;
+
+    uint32_t timclk = HAL_RCC_GetPCLK1Freq();
+    if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1) {
+        timclk *= 2U;
+    }
+    s_tick_hz = timclk / (htim->Init.Prescaler + 1U);
+    if (s_tick_hz == 0U) s_tick_hz = 1U;
+    s_tick_is_us = (s_tick_hz == 1000000U);
+    s_us_per_tick_q32 = (uint32_t)(((1000000ULL << 32) + s_tick_hz - 1U) / s_tick_hz);
+
+    s_wraps = 0;
+    __HAL_TIM_CLEAR_FLAG(htim, TIM_FLAG_UPDATE);
+    return HAL_TIM_Base_Start_IT(htim);
+}
+
+uint32_t Timebase_TickHz(void) {
+    return s_tick_hz;
+}
+
+uint64_t Timebase_NowTicks64(void) {
+    if (s_htim == NULL) return 0U;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t hi = s_wraps;
+    uint32_t lo = __HAL_TIM_GET_COUNTER(s_htim);
+    // A wrap that has not been serviced yet: UIF is set and the counter has
+    // restarted from zero. The half-range test rejects a UIF that was raised
+    // right after lo was sampled.
+    if (__HAL_TIM_GET_FLAG(s_htim, TIM_FLAG_UPDATE) && lo < 0x80000000u) {
+        hi++;
+    }
+    __set_PRIMASK(primask);
+    return ((uint64_t)hi << 32) | lo;
+}
+
+uint64_t Timebase_NowUs64(void) {
+    return Timebase_TicksToUs64(Timebase_NowTicks64());
+}
+
+uint32_t Timebase_TicksToUs(uint32_t ticks) {
+    if (s_tick_is_us) return ticks;
+    uint64_t us = ((uint64_t)ticks * s_us_per_tick_q32) >> 32;
+    return (us > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)us;
+}
+
+uint64_t Timebase_TicksToUs64(uint64_t ticks) {
+    if (s_tick_is_us) return ticks;
+    uint64_t whole = ticks / s_tick_hz;
+    uint64_t rem = ticks % s_tick_hz;
+    return whole * 1000000ULL + (rem * 1000000ULL) / s_tick_hz;
+}
+
+uint64_t Timebase_ExtendTicks(uint32_t ticks32) {
+    const uint64_t now = Timebase_NowTicks64();
+    // Nearest stamp with this low word: extrapolated drain entries may lie a
+    // few ms ahead of now, across a wrap in either direction.
+    const int32_t d = (int32_t)(ticks32 - (uint32_t)now);
+    if (d < 0 && (uint64_t)(-(int64_t)d) > now) {
+        return ticks32; // Before the first wrap nothing is older than boot
+    }
+    return now + (uint64_t)(int64_t)d;
+}
+
+uint64_t Timebase_StampToUs64(uint32_t ticks32) {
+    return Timebase_TicksToUs64(Timebase_ExtendTicks(ticks32));
+}
+
+// --- HAL Callback Implementations ---
+
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim) {
+    if (s_htim != NULL && htim->Instance == s_htim->Instance) {
+        s_wraps++;
+    }
+    // TIM3 is not used for sensor data acquisition in FIFO watermark interrupt mode.
+}
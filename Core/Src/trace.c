@@ -0,0 +1,127 @@
+/* filename: Core/Src/trace.c */
+#include "trace.h"
+#include "main.h"
+#include "comm.h"
+#include "fmt.h"
+#include "api_schema.h"
+#include "sched.h"
+
+// Utläsningen är bara ett fönster i ringen; posterna ligger kvar tills de skrivs över.
+static TraceRec_t s_trace_ring[TRACE_RING_LEN];
+static volatile uint32_t s_head;       // antal skrivna poster totalt
+static uint32_t s_itm_tail;            // nästa post till ITM
+static uint32_t s_itm_lost;            // poster som skrevs över innan de strömmades
+static volatile uint8_t s_paused;      // under TRACE-dumpen
+
+#define TRACE_MASK       (TRACE_RING_LEN - 1u)
+#define TRACE_ITM_BURST  32u   // poster per Trace_Pump, så att ett pass inte dröjer
+#define TRACE_DUMP_PER_LINE 8u // 8 * 24 hex + prefix ryms i PROTO_MAX_LINE
+
+void Trace_Init(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_head = 0;
+    s_itm_tail = 0;
+    s_itm_lost = 0;
+    s_paused = 0;
+    __set_PRIMASK(primask);
+}
+
+#if TRACE_ENABLE
+void Trace_Log(TraceEvent_t id, uint16_t a16, uint32_t arg)
+{
+    if (s_paused) return;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    // CYCCNT läses under masken, så ringordningen är också tidsordning
+    TraceRec_t* r = &s_trace_ring[s_head & TRACE_MASK];
+    r->hdr = Trace_Hdr(id, a16);
+    r->cyc = DWT->CYCCNT;
+    r->arg = arg;
+    s_head++;
+    __set_PRIMASK(primask);
+}
+#endif
+
+static inline uint32_t _itm_ready(void)
+{
+    return ITM->PORT[TRACE_ITM_PORT].u32;
+}
+
+static inline void _itm_put(uint32_t w)
+{
+    while (_itm_ready() == 0u) { }
+    ITM->PORT[TRACE_ITM_PORT].u32 = w;
+}
+
+void Trace_Pump(void)
+{
+    if ((ITM->TCR & ITM_TCR_ITMENA_Msk) == 0u || (ITM->TER & (1u << TRACE_ITM_PORT)) == 0u) {
+        s_itm_tail = s_head;   // ingen SWO-mottagare: strömma från nu när den kopplas in
+        return;
+    }
+    for (uint32_t k = 0; k < TRACE_ITM_BURST; k++) {
+        if (_itm_ready() == 0u) {         // FIFO full, resten nästa pass
+            Sched_ArmTimeout(1u);
+            return;
+        }
+        TraceRec_t r;
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        const uint32_t head = s_head;
+        if (s_itm_tail == head) {
+            __set_PRIMASK(primask);
+            return;
+        }
+        if (head - s_itm_tail > TRACE_RING_LEN) {
+            s_itm_lost += head - s_itm_tail - TRACE_RING_LEN;
+            s_itm_tail = head - TRACE_RING_LEN;
+        }
+        r = s_trace_ring[s_itm_tail & TRACE_MASK];
+        s_itm_tail++;
+        __set_PRIMASK(primask);
+        // Huvudordet först: avkodaren synkar om på 0xA5 efter ett ITM-överflöde
+        _itm_put(r.hdr);
+        _itm_put(r.cyc);
+        _itm_put(r.arg);
+    }
+    Sched_ArmTimeout(1u);   // hela bursten gick åt; ringen kan ha mer
+}
+
+static char* _hex32(char* p, uint32_t v)
+{
+    static const char k_hex[] = "0123456789ABCDEF";
+    for (int s = 28; s >= 0; s -= 4) *p++ = k_hex[(v >> s) & 0xFu];
+    return p;
+}
+
+void Trace_SendDump(uint8_t clear)
+{
+    s_paused = 1;
+    const uint32_t head = s_head;
+    const uint32_t n = (head < TRACE_RING_LEN) ? head : TRACE_RING_LEN;
+    COMM_SendfBlocking(MSG_TRACE_INFO ",cpu_hz=%lu,ring=%u,n=%lu,seq=%lu,lost=%lu,itm_lost=%lu,enabled=%u" PROTO_EOL,
+                       (unsigned long)HAL_RCC_GetHCLKFreq(), (unsigned)TRACE_RING_LEN, (unsigned long)n,
+                       (unsigned long)head, (unsigned long)(head - n), (unsigned long)s_itm_lost,
+                       (unsigned)TRACE_ENABLE);
+    uint32_t seq = head - n;
+    while (seq != head) {
+        char line[PROTO_MAX_LINE];
+        char* q = line;
+        q = fmt_str(q, MSG_TRACE_DATA ",seq="); q = fmt_u32(q, seq);
+        q = fmt_str(q, ",hex=");
+        for (uint32_t k = 0; k < TRACE_DUMP_PER_LINE && seq != head; k++, seq++) {
+            const TraceRec_t* r = &s_trace_ring[seq & TRACE_MASK];
+            q = _hex32(q, r->hdr);
+            q = _hex32(q, r->cyc);
+            q = _hex32(q, r->arg);
+        }
+        q = fmt_str(q, PROTO_EOL);
+        Telemetry_WriteBlocking(line, (size_t)(q - line));
+    }
+    if (clear) {
+        Trace_Init();
+    }
+    s_paused = 0;
+}
@@ -10,97 +10,283 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include "dev_telemetry.h" // Inkludera ny debug-header
+#include "protocol_crc32.h"
+#include "protocol_cobs.h"
+#include "prof.h"          // PROF_BLK_RTT
+#include "trace.h"
 
 _Static_assert(PROTO_EOL_LEN == 2, "EOL length assumption is invalid");
 _Static_assert(PROTO_MAX_LINE >= 256, "Line buffer smaller than spec requirement");
 
-#ifndef TB_MAX_INFLIGHT
-#define TB_MAX_INFLIGHT 8u
-#endif
+/*
+ * Selective repeat: blocknummer blk ligger alltid i queue[blk % TB_MAX_QUEUE]
+ * (slotarna tilldelas i blockordning), så uppslag vid ACK är O(1). Fönstret
+ * (HELLO,win=) begränsar spannet från äldsta okvitterade block och kan vara
+ * upp till TB_MAX_INFLIGHT; arenan begränsar dessutom antalet bytes i luften.
+ */
 #ifndef TB_MAX_QUEUE
-#define TB_MAX_QUEUE 16u
+#define TB_MAX_QUEUE 32u
+#endif
+#define TB_Q_MASK (TB_MAX_QUEUE - 1u)
+_Static_assert((TB_MAX_QUEUE & TB_Q_MASK) == 0u, "TB_MAX_QUEUE must be a power of two");
+_Static_assert(TB_MAX_QUEUE >= TB_MAX_INFLIGHT, "Every in-flight block needs its own slot");
+_Static_assert(TB_MAX_QUEUE <= 128u, "Slot indices are 8-bit");
+/*
+ * Staging-arena: varje block renderas en gång vid TB_EnqueueBlock (CRC i samma
+ * pass) och sändning/omsändning spelar upp bytes direkt. Arenan är en ring i
+ * köordning; ett block frigörs när det och alla äldre är kvitterade. Ryms inte
+ * nästa block väntar burst_mgr (enqueue returnerar 0), så arenan begränsar
+ * även fönstret: CSV-block (~6 KB) ger 2 i luften, DELTA-block (~2.5 KB) 4+,
+ * BIN-block (~1.2 KB) 12+.
+ */
+#ifndef TB_ARENA_SIZE
+#define TB_ARENA_SIZE 16384u
 #endif
+_Static_assert(TB_ARENA_SIZE <= 65535u, "Arena offsets are 16-bit");
+_Static_assert((TB_ARENA_SIZE % 4u) == 0u, "Arena must hold whole words for the CRC unit");
+/*
+ * Sändning är en inkrementell tillståndsmaskin i TB_Pump: ett block i taget
+ * skrivs så långt TX-ringen räcker (hela rader, så andra meddelanden bara kan
+ * hamna mellan DATA-rader) och fortsätter vid nästa pump. Huvudloopen snurrar
+ * under tiden, så ACK_BLK hanteras och fönstret fylls på medan blocket går ut.
+ */
+#define TB_TX_LINE_MAX 80u /* BLOCK_HEADER/BLOCK_END */
+/*
+ * Binära block (TB_SetBinary) har en enda COBS-ram som kropp: 0x00 <COBS(poster)>
+ * 0x00. Ramen kan inte delas med andra rader emellan, så den skrivs i ett svep
+ * och får högst ta halva TX-ringen.
+ */
+#define TB_BIN_BODY_MAX (COMM_TX_RING_SIZE / 2u)
+#define TB_BIN_REC_MAX  32u /* generatorns utdata per rad i binärt läge */
+/*
+ * Länkregulator: RTO enligt RFC 6298 (SRTT/RTTVAR i fixpunkt, Karns regel: bara
+ * block utan omsändning mäts) och AIMD för blockstorlek och fönster. NACK och
+ * snabb omsändning tyder på bitfel och halverar blockstorleken, så ett fel
+ * kostar färre rader; timeout tyder på stopp hos värden och halverar fönstret
+ * samt dubblar RTO. TB_CTL_GROW_RUN felfria kvitton i rad växer båda igen upp
+ * till de förhandlade taken (blk_lines, window).
+ */
+#define TB_LINES_MIN     16u
+#define TB_RTO_MIN_MS    200u
+#define TB_RTO_MAX_MS    (PROTO_BLOCK_TIMEOUT_MS * 8u)
+#define TB_CTL_GROW_RUN  8u
+
+typedef enum {
+    TB_TX_IDLE = 0,
+    TB_TX_HEADER,
+    TB_TX_BODY,
+    TB_TX_END
+} tb_tx_stage_t;
 
 typedef struct {
-    TB_GenLineFn gen;
-    void*        user;
     uint16_t     lines;
     uint16_t     blk;
-    uint16_t     crc16;
+    uint32_t     crc;         /* CRC16 eller CRC32 enligt g_tb.crc32 */
+    uint16_t     off;         /* start i arenan, 4-bytejusterad för CRC-enheten */
+    uint16_t     len;         /* renderade bytes inkl. CRLF */
     uint8_t      retries;
     uint8_t      sent;
+    uint8_t      tx_pending;  /* väntar på (om)sändning */
+    uint16_t     tx_order;    /* sändningsordning för senaste BLOCK_END */
     uint32_t     t_last_tx_ms;
     uint8_t      inflight;
     uint8_t      done;
 } tb_entry_t;
 
 static struct {
-    uint16_t window;
-    uint16_t blk_lines;
+    uint16_t window;                 /* förhandlat tak */
+    uint16_t blk_lines;              /* förhandlat tak */
     uint8_t  max_retries;
+    uint16_t cur_window;             /* regulatorns fönster, 1..window */
+    uint16_t cur_lines;              /* regulatorns blockstorlek, TB_LINES_MIN..blk_lines */
+    uint16_t bpl;                    /* bytes/rad i senaste block, 0 = okänt i bursten */
+    uint8_t  rtt_valid;
+    uint32_t srtt8;                  /* SRTT << 3, ms */
+    uint32_t rttvar4;                /* RTTVAR << 2, ms */
+    uint32_t rto_ms;
+    uint8_t  clean_run;              /* felfria kvitton i rad */
+    uint32_t n_nack, n_timeout;
     uint32_t burst_id;
     uint16_t next_blk;
     uint8_t  burst_active;
+    uint8_t  crc32_req;              /* TB_SetCrc32 */
+    uint8_t  crc32;                  /* låst för pågående burst */
+    uint8_t  bin_req;                /* TB_SetBinary */
+    uint8_t  bin;                    /* låst för pågående burst */
     tb_entry_t queue[TB_MAX_QUEUE];
-    uint8_t q_head, q_tail, q_count;
-    tb_entry_t* inflight[TB_MAX_INFLIGHT];
-    uint8_t     inflight_count;
+    uint8_t q_head, q_tail, q_count; /* q_count = ej sända */
+    uint8_t q_live, q_used;          /* äldsta slot med arenabytes, slots i bruk */
+    uint8_t     inflight_count;      /* sända eller på väg ut, ej kvitterade */
+    uint16_t    tx_order;            /* räknare för tx_order */
+    uint16_t    a_head;              /* nästa lediga byte i arenan */
+    uint16_t    a_need;              /* minsta plats för nästa försök (0 = okänt) */
+    tb_entry_t* tx_e;                /* block som sänds just nu */
+    uint8_t     tx_stage;            /* tb_tx_stage_t */
+    uint16_t    tx_pos;              /* sända bytes av blockets kropp */
+    uint16_t    tx_line_len;
+    uint8_t     tx_wait;             /* väntar på COMM_TxNotifyFree, emit vilar */
+    char        tx_line[TB_TX_LINE_MAX];
 } g_tb;
 
-static inline int _queue_full(void)  { return g_tb.q_count >= TB_MAX_QUEUE; }
+static uint8_t g_tb_arena[TB_ARENA_SIZE] __attribute__((aligned(4)));
+
+/* Slots frigörs först när blocket är kvitterat, så inflight-pekarna förblir giltiga. */
+static inline int _queue_full(void)  { return g_tb.q_used >= TB_MAX_QUEUE; }
 static inline int _queue_empty(void) { return g_tb.q_count == 0; }
 
 static tb_entry_t* _queue_push(void) {
     if (_queue_full()) return NULL;
     tb_entry_t* e = &g_tb.queue[g_tb.q_tail];
     memset(e, 0, sizeof(*e));
-    g_tb.q_tail = (uint8_t)((g_tb.q_tail + 1u) % TB_MAX_QUEUE);
+    g_tb.q_tail = (uint8_t)((g_tb.q_tail + 1u) & TB_Q_MASK);
     g_tb.q_count++;
+    g_tb.q_used++;
     return e;
 }
 
+/* Frigör kvitterade block i köordning; en tom arena börjar om från 0.
+ * Ett block som fortfarande sänds behåller sina bytes. */
+static void _reclaim(void) {
+    while (g_tb.q_used > 0u && g_tb.queue[g_tb.q_live].done &&
+           &g_tb.queue[g_tb.q_live] != g_tb.tx_e) {
+        g_tb.q_live = (uint8_t)((g_tb.q_live + 1u) & TB_Q_MASK);
+        g_tb.q_used--;
+        g_tb.a_need = 0;
+    }
+    if (g_tb.q_used == 0u) {
+        g_tb.a_head = 0;
+    }
+}
+
+/* Slotindex följer blocknumret, så kön börjar vid next_blk:s slot. */
+static void _reset_queue(void) {
+    const uint8_t slot = (uint8_t)(g_tb.next_blk & TB_Q_MASK);
+    g_tb.q_head = g_tb.q_tail = g_tb.q_live = slot;
+    g_tb.q_count = g_tb.q_used = 0;
+    g_tb.inflight_count = 0;
+    g_tb.a_head = 0;
+    g_tb.a_need = 0;
+    g_tb.tx_e = NULL;
+    g_tb.tx_stage = TB_TX_IDLE;
+    g_tb.tx_wait = 0;
+}
+
 static tb_entry_t* _queue_pop(void) {
     if (_queue_empty()) return NULL;
     tb_entry_t* e = &g_tb.queue[g_tb.q_head];
-    g_tb.q_head = (uint8_t)((g_tb.q_head + 1u) % TB_MAX_QUEUE);
+    g_tb.q_head = (uint8_t)((g_tb.q_head + 1u) & TB_Q_MASK);
     g_tb.q_count--;
     return e;
 }
 
-static void _inflight_add(tb_entry_t* e) {
-    if (g_tb.inflight_count < TB_MAX_INFLIGHT) {
-        g_tb.inflight[g_tb.inflight_count++] = e;
-        e->inflight = 1;
-    }
+/* Slots från äldsta okvitterade till nästa osända: fönstrets spann. */
+static inline uint8_t _window_span(void) { return (uint8_t)(g_tb.q_used - g_tb.q_count); }
+#define TB_FOR_EACH_WINDOW(k) for (uint8_t k = g_tb.q_live, _n = _window_span(); _n > 0u; k = (uint8_t)((k + 1u) & TB_Q_MASK), --_n)
+
+/* O(1): blocket blk om det är ute och okvitterat, annars NULL. */
+static tb_entry_t* _inflight_find_blk(uint16_t blk) {
+    tb_entry_t* e = &g_tb.queue[blk & TB_Q_MASK];
+    return (e->inflight && e->blk == blk) ? e : NULL;
 }
 
-static void _inflight_remove_index(uint8_t idx) {
-    if (idx >= g_tb.inflight_count) return;
-    for (uint8_t i = (uint8_t)(idx + 1u); i < g_tb.inflight_count; ++i) {
-        g_tb.inflight[i - 1u] = g_tb.inflight[i];
-    }
+static void _inflight_ack(tb_entry_t* e) {
+    e->done = 1;
+    e->inflight = 0;
     g_tb.inflight_count--;
 }
 
-static int _inflight_find_blk(uint16_t blk, uint8_t* out_idx) {
-    for (uint8_t i = 0; i < g_tb.inflight_count; ++i) {
-        if (g_tb.inflight[i]->blk == blk && g_tb.inflight[i]->inflight) {
-            if (out_idx) *out_idx = i;
-            return 1;
-        }
+static void _abort_all(void) {
+    TB_FOR_EACH_WINDOW(k) {
+        g_tb.queue[k].inflight = 0;
+        g_tb.queue[k].done = 1;
     }
-    return 0;
+    _reset_queue();
+    g_tb.burst_active = 0;
 }
 
-static void _abort_all(void) {
-    for (uint8_t i = 0; i < g_tb.inflight_count; ++i) {
-        g_tb.inflight[i]->inflight = 0;
-        g_tb.inflight[i]->done = 1;
+/* Avbryter bursten och rapporterar code till burst_mgr. */
+static void _fail(uint16_t blk, uint32_t code) {
+    Trace_Log(TRACE_EV_TB_ABORT, blk, code);
+    _abort_all();
+    BM_EndAborted(code);
+}
+
+void TB_ResetLink(void) {
+    g_tb.cur_window = g_tb.window;
+    g_tb.cur_lines = (g_tb.blk_lines < PROTO_BLOCK_LINES_DEFAULT) ? g_tb.blk_lines : PROTO_BLOCK_LINES_DEFAULT;
+    g_tb.rtt_valid = 0;
+    g_tb.srtt8 = 0;
+    g_tb.rttvar4 = 0;
+    g_tb.rto_ms = PROTO_BLOCK_TIMEOUT_MS;
+    g_tb.clean_run = 0;
+    g_tb.n_nack = 0;
+    g_tb.n_timeout = 0;
+}
+
+/* Mätt RTT för ett block som kvitterades utan omsändning. */
+static void _ctl_on_ack(uint32_t rtt_ms) {
+    Prof_Record(PROF_BLK_RTT, rtt_ms);
+    if (!g_tb.rtt_valid) {
+        g_tb.srtt8 = rtt_ms << 3;
+        g_tb.rttvar4 = rtt_ms << 1; /* RTTVAR = R/2 */
+        g_tb.rtt_valid = 1;
+    } else {
+        int32_t err = (int32_t)rtt_ms - (int32_t)(g_tb.srtt8 >> 3);
+        g_tb.srtt8 = (uint32_t)((int32_t)g_tb.srtt8 + err);          /* += err/8 i skala 8 */
+        if (err < 0) err = -err;
+        err -= (int32_t)(g_tb.rttvar4 >> 2);
+        g_tb.rttvar4 = (uint32_t)((int32_t)g_tb.rttvar4 + err);      /* += (|err|-RTTVAR)/4 */
     }
-    g_tb.inflight_count = 0;
-    while (!_queue_empty()) { (void)_queue_pop(); }
-    g_tb.burst_active = 0;
+    uint32_t rto = (g_tb.srtt8 >> 3) + ((g_tb.rttvar4 > 1u) ? g_tb.rttvar4 : 1u);
+    if (rto < TB_RTO_MIN_MS) rto = TB_RTO_MIN_MS;
+    if (rto > TB_RTO_MAX_MS) rto = TB_RTO_MAX_MS;
+    g_tb.rto_ms = rto;
+
+    if (++g_tb.clean_run >= TB_CTL_GROW_RUN) {
+        g_tb.clean_run = 0;
+        uint16_t step = (uint16_t)(g_tb.cur_lines / 4u);
+        g_tb.cur_lines = (uint16_t)(g_tb.cur_lines + (step ? step : 1u));
+        if (g_tb.cur_lines > g_tb.blk_lines) g_tb.cur_lines = g_tb.blk_lines;
+        if (g_tb.cur_window < g_tb.window) g_tb.cur_window++;
+    }
+}
+
+static void _ctl_on_corrupt(void) {
+    g_tb.n_nack++;
+    g_tb.clean_run = 0;
+    g_tb.cur_lines = (uint16_t)(g_tb.cur_lines / 2u);
+    if (g_tb.cur_lines < TB_LINES_MIN) g_tb.cur_lines = TB_LINES_MIN;
+    if (g_tb.cur_lines > g_tb.blk_lines) g_tb.cur_lines = g_tb.blk_lines;
+}
+
+static void _ctl_on_timeout(void) {
+    g_tb.n_timeout++;
+    g_tb.clean_run = 0;
+    g_tb.cur_window = (uint16_t)(g_tb.cur_window / 2u);
+    if (g_tb.cur_window == 0u) g_tb.cur_window = 1u;
+    g_tb.rto_ms = (g_tb.rto_ms * 2u > TB_RTO_MAX_MS) ? TB_RTO_MAX_MS : g_tb.rto_ms * 2u;
+}
+
+uint16_t TB_GetBlockLines(void) {
+    uint16_t lines = g_tb.cur_lines;
+    /* Arenan ska rymma minst två block (BIN: ramen max TB_BIN_BODY_MAX). Innan
+     * första blocket i bursten är radlängden okänd; då gäller standardstorleken. */
+    uint16_t cap = PROTO_BLOCK_LINES_DEFAULT;
+    if (g_tb.bpl > 0u) {
+        cap = (uint16_t)((g_tb.bin ? (TB_BIN_BODY_MAX - 8u) : (TB_ARENA_SIZE / 2u)) / g_tb.bpl);
+    }
+    if (lines > cap) lines = cap;
+    return (lines > 0u) ? lines : 1u;
+}
+
+void TB_GetLinkStats(TB_LinkStats* out) {
+    out->lines = TB_GetBlockLines();
+    out->window = g_tb.cur_window;
+    out->rto_ms = g_tb.rto_ms;
+    out->srtt_ms = g_tb.rtt_valid ? (g_tb.srtt8 >> 3) : 0u;
+    out->rttvar_ms = g_tb.rtt_valid ? (g_tb.rttvar4 >> 2) : 0u;
+    out->nacks = g_tb.n_nack;
+    out->timeouts = g_tb.n_timeout;
 }
 
 void TB_Init(uint16_t window, uint16_t blk_lines, uint8_t max_retries) {
@@ -113,51 +299,224 @@ void TB_Init(uint16_t window, uint16_t blk_lines, uint8_t max_retries) {
     g_tb.burst_id = 0;
     g_tb.next_blk = 0;
     g_tb.burst_active = 0;
-    g_tb.q_head = g_tb.q_tail = g_tb.q_count = 0;
-    g_tb.inflight_count = 0;
+    _reset_queue();
+    TB_ResetLink();
 }
 
-void TB_SetWindow(uint16_t window) { g_tb.window = (window == 0) ? 1u : window; }
-void TB_SetBlockLines(uint16_t blk_lines) { g_tb.blk_lines = (blk_lines == 0) ? 1u : blk_lines; }
+void TB_SetWindow(uint16_t window) {
+    if (window == 0) window = 1u;
+    if (window > TB_MAX_INFLIGHT) window = TB_MAX_INFLIGHT;
+    g_tb.window = window;
+    if (g_tb.cur_window > window || g_tb.cur_window == 0u) g_tb.cur_window = window;
+}
+uint16_t TB_GetWindow(void) { return g_tb.window; }
+void TB_SetBlockLines(uint16_t blk_lines) {
+    g_tb.blk_lines = (blk_lines == 0) ? 1u : blk_lines;
+    if (g_tb.cur_lines > g_tb.blk_lines || g_tb.cur_lines == 0u) g_tb.cur_lines = g_tb.blk_lines;
+}
 void TB_SetMaxRetries(uint8_t max_retries) { g_tb.max_retries = (max_retries == 0) ? 1u : max_retries; }
+void TB_SetCrc32(uint8_t on) { g_tb.crc32_req = (on != 0u) ? 1u : 0u; }
+void TB_SetBinary(uint8_t on) { g_tb.bin_req = (on != 0u) ? 1u : 0u; }
 
 void TB_BeginBurst(uint32_t burst_id) {
     g_tb.burst_id = burst_id;
     g_tb.next_blk = 1;
     g_tb.burst_active = 1u;
-    g_tb.q_head = g_tb.q_tail = g_tb.q_count = 0;
-    g_tb.inflight_count = 0;
+    g_tb.crc32 = g_tb.crc32_req;
+    g_tb.bin = g_tb.bin_req;
+    g_tb.bpl = 0; /* CSV/DELTA/BIN har olika radlängd */
+    _reset_queue();
+    Trace_Log(TRACE_EV_TB_BEGIN, g_tb.cur_window, burst_id);
 }
 
 void TB_EndBurst(void) {
     g_tb.burst_active = 0;
+    Trace_Log(TRACE_EV_TB_END, (uint16_t)(g_tb.next_blk - 1u), g_tb.burst_id);
 }
 
-static uint16_t _compute_crc16(TB_GenLineFn gen, void* user, uint16_t lines) {
+/*
+ * Renderar blockets rader till arenan i [start, limit) och beräknar CRC16 i samma
+ * pass (CRC32 tas av CRC-enheten över arenan efteråt). Returnerar 1 vid OK,
+ * annars 0 med *need = minsta längd som hade behövts. En rad som generatorn
+ * inte kan skapa hoppas över (som tidigare vid sändning). Generatorn skriver
+ * direkt i arenan; bara de sista PROTO_MAX_LINE bytes före limit går via en
+ * stackbuffert, så att en rad som inte ryms ger sin längd till *need.
+ */
+static int _render_bin(const TB_BlockGen* blk, uint16_t start, uint16_t limit,
+                       uint16_t* out_len, uint32_t* out_crc, uint16_t* need);
+
+static int _render(const TB_BlockGen* blk, uint16_t start, uint16_t limit,
+                   uint16_t* out_len, uint32_t* out_crc, uint16_t* need) {
+    if (g_tb.bin) return _render_bin(blk, start, limit, out_len, out_crc, need);
     proto_crc16_t c; proto_crc16_init(&c);
     char line[PROTO_MAX_LINE];
-    for (uint16_t i = 0; i < lines; ++i) {
-        int n = gen(i, line, sizeof line, user);
-        if (n <= 0) return 0;
-        proto_crc16_update(&c, line, (size_t)n); /* inkluderar CRLF */
+    uint16_t pos = start;
+    for (uint16_t i = 0; i < blk->lines; ++i) {
+        char* dst = (char*)&g_tb_arena[pos];
+        const int in_place = (uint32_t)(limit - pos) >= sizeof line;
+        int n = blk->gen(i, in_place ? dst : line, sizeof line, blk->user);
+        if (n <= 0) continue;
+        if ((uint32_t)n > (uint32_t)(limit - pos)) {
+            *need = (uint16_t)((pos - start) + (uint16_t)n);
+            return 0;
+        }
+        if (!in_place) memcpy(dst, line, (size_t)n);
+        proto_crc16_update(&c, dst, (size_t)n); /* inkluderar CRLF */
+        pos = (uint16_t)(pos + (uint16_t)n);
     }
-    return proto_crc16_final(&c);
+    *out_len = (uint16_t)(pos - start);
+    *out_crc = g_tb.crc32 ? proto_crc32_hw(&g_tb_arena[start], *out_len) : proto_crc16_final(&c);
+    return 1;
 }
 
-static void _send_block(tb_entry_t* e) {
-    COMM_SendfBlocking("BLOCK_HEADER,burst_id=%lu,blk=%u,lines=%u,crc16=%u" PROTO_EOL,
-               (unsigned long)g_tb.burst_id, (unsigned)e->blk, (unsigned)e->lines, (unsigned)e->crc16);
-    char line[PROTO_MAX_LINE];
-    for (uint16_t i = 0; i < e->lines; ++i) {
-        int n = e->gen(i, line, sizeof line, e->user);
-        if (n > 0) {
-            Telemetry_WriteBlocking(line, (size_t)n);
+/*
+ * Binärt block: generatorns poster COBS-kodas direkt in i arenan mellan två
+ * 0x00. CRC:n tas över hela ramen som den sänds, avgränsare inräknade.
+ */
+static int _render_bin(const TB_BlockGen* blk, uint16_t start, uint16_t limit,
+                       uint16_t* out_len, uint32_t* out_crc, uint16_t* need) {
+    char rec[TB_BIN_REC_MAX];
+    uint16_t room = (uint16_t)(limit - start);
+    if (room > TB_BIN_BODY_MAX) room = TB_BIN_BODY_MAX;
+    if (room < 3u) { *need = 3u; return 0; } /* 0x00, kodbyte, 0x00 */
+    g_tb_arena[start] = PROTO_BIN_DELIM;
+    proto_cobs_enc_t enc;
+    proto_cobs_enc_init(&enc, &g_tb_arena[start + 1u]);
+    for (uint16_t i = 0; i < blk->lines; ++i) {
+        int n = blk->gen(i, rec, sizeof rec, blk->user);
+        if (n <= 0) continue;
+        const size_t used = 1u + enc.o + PROTO_COBS_MAX((size_t)n) + 1u;
+        if (used > room) {
+            *need = (uint16_t)used;
+            return 0;
+        }
+        proto_cobs_enc_put(&enc, (const uint8_t*)rec, (size_t)n);
+    }
+    const uint16_t len = (uint16_t)(1u + proto_cobs_enc_finish(&enc) + 1u);
+    g_tb_arena[start + len - 1u] = PROTO_BIN_DELIM;
+    *out_len = len;
+    *out_crc = g_tb.crc32 ? proto_crc32_hw(&g_tb_arena[start], len) : proto_crc16_buf(&g_tb_arena[start], len);
+    return 1;
+}
+
+/*
+ * Placerar ett block efter arenans senaste byte, eller från början om slutet
+ * inte räcker. Levande data ligger från äldsta slot till a_head (ring).
+ */
+static int _arena_stage(const TB_BlockGen* blk, uint16_t* off, uint16_t* len, uint32_t* crc) {
+    const uint16_t tail = (g_tb.q_used > 0u) ? g_tb.queue[g_tb.q_live].off : 0u;
+    const int wrapped = (g_tb.q_used > 0u) && (g_tb.a_head <= tail);
+    const uint16_t end_room = wrapped ? (uint16_t)(tail - g_tb.a_head) : (uint16_t)(TB_ARENA_SIZE - g_tb.a_head);
+    const uint16_t front_room = wrapped ? 0u : tail;
+    uint16_t need_end = 0, need_front = 0;
+
+    if (g_tb.a_need > end_room && g_tb.a_need > front_room) {
+        return 0; /* Senaste försöket visade att blocket inte ryms än */
+    }
+    if (_render(blk, g_tb.a_head, (uint16_t)(g_tb.a_head + end_room), len, crc, &need_end)) {
+        *off = g_tb.a_head;
+    } else if (_render(blk, 0u, front_room, len, crc, &need_front)) {
+        *off = 0u;
+    } else {
+        g_tb.a_need = (need_end > need_front) ? need_end : need_front;
+        return 0;
+    }
+    g_tb.a_head = (uint16_t)((*off + *len + 3u) & ~3u); /* Nästa block ordjusterat */
+    g_tb.a_need = 0;
+    return 1;
+}
+
+/* Ringen räckte inte: emit vilar tills need bytes är lediga i stället för att pollas. */
+static void _on_tx_room(void* arg) {
+    (void)arg;
+    g_tb.tx_wait = 0;
+}
+
+static void _tx_wait(uint16_t need) {
+    if (need > 0u && COMM_TxNotifyFree(need, _on_tx_room, NULL)) g_tb.tx_wait = 1u;
+}
+
+/* Skriver den förberedda header/end-raden om den ryms helt; 1 när den är skriven. */
+static int _tx_line(void) {
+    if (COMM_TxFree() < g_tb.tx_line_len) { _tx_wait(g_tb.tx_line_len); return 0; }
+    return Telemetry_Write(g_tb.tx_line, g_tb.tx_line_len) == g_tb.tx_line_len;
+}
+
+/* Skriver så många hela rader av kroppen som ryms; 1 när hela kroppen är skriven. */
+static int _tx_body(tb_entry_t* e) {
+    if (g_tb.bin) {
+        /* En COBS-ram: allt eller inget (ryms alltid, se TB_BIN_BODY_MAX) */
+        if (COMM_TxFree() < e->len) { _tx_wait(e->len); return 0; }
+        return Telemetry_Write((const char*)&g_tb_arena[e->off], e->len) == e->len;
+    }
+    while (g_tb.tx_pos < e->len) {
+        const uint8_t* p = &g_tb_arena[e->off + g_tb.tx_pos];
+        uint16_t n = (uint16_t)(e->len - g_tb.tx_pos);
+        uint16_t room = COMM_TxFree();
+        if (n > room) {
+            n = room;
+            while (n > 0u && p[n - 1u] != '\n') n--; /* backa till radslut */
+        }
+        if (n == 0u) {
+            /* Inte ens nästa rad ryms: vänta på just den längden */
+            uint16_t need = 1u;
+            while (need < e->len - g_tb.tx_pos && p[need - 1u] != '\n') need++;
+            _tx_wait(need);
+            return 0;
+        }
+        if (Telemetry_Write((const char*)p, n) != n) return 0;
+        g_tb.tx_pos = (uint16_t)(g_tb.tx_pos + n);
+    }
+    return 1;
+}
+
+/*
+ * Driver sändningen: väljer nästa block med tx_pending (i fönsterordning) och
+ * skriver header, kropp och end så långt ringen räcker. Timeouttiden räknas
+ * från att BLOCK_END är köad.
+ */
+static void _pump_emit(void) {
+    if (g_tb.tx_wait) return;
+    for (;;) {
+        if (g_tb.tx_e == NULL) {
+            tb_entry_t* next = NULL;
+            TB_FOR_EACH_WINDOW(k) {
+                if (g_tb.queue[k].inflight && g_tb.queue[k].tx_pending) { next = &g_tb.queue[k]; break; }
+            }
+            if (next == NULL) return;
+            next->tx_pending = 0;
+            g_tb.tx_e = next;
+            g_tb.tx_stage = TB_TX_HEADER;
+            g_tb.tx_pos = 0;
+            int n = snprintf(g_tb.tx_line, sizeof g_tb.tx_line,
+                             "BLOCK_HEADER,burst_id=%lu,blk=%u,lines=%u,%s=%lu" PROTO_EOL,
+                             (unsigned long)g_tb.burst_id, (unsigned)next->blk, (unsigned)next->lines,
+                             g_tb.crc32 ? "crc32" : "crc16", (unsigned long)next->crc);
+            g_tb.tx_line_len = (n > 0) ? (uint16_t)n : 0u;
+        }
+        tb_entry_t* e = g_tb.tx_e;
+        if (g_tb.tx_stage == TB_TX_HEADER) {
+            if (!_tx_line()) return;
+            g_tb.tx_stage = TB_TX_BODY;
+        }
+        if (g_tb.tx_stage == TB_TX_BODY) {
+            if (!_tx_body(e)) return;
+            int n = snprintf(g_tb.tx_line, sizeof g_tb.tx_line, "BLOCK_END,blk=%u,%s=%lu" PROTO_EOL,
+                             (unsigned)e->blk, g_tb.crc32 ? "crc32" : "crc16", (unsigned long)e->crc);
+            g_tb.tx_line_len = (n > 0) ? (uint16_t)n : 0u;
+            g_tb.tx_stage = TB_TX_END;
+        }
+        if (g_tb.tx_stage == TB_TX_END) {
+            if (!_tx_line()) return;
+            e->t_last_tx_ms = HAL_GetTick();
+            e->tx_order = ++g_tb.tx_order;
+            e->sent = 1;
+            Trace_Log(TRACE_EV_TB_SEND, e->blk, ((uint32_t)e->retries << 16) | e->lines);
+            g_tb.tx_e = NULL;
+            g_tb.tx_stage = TB_TX_IDLE;
+            if (e->done) _reclaim(); /* Kvitterat under omsändning */
         }
     }
-    COMM_SendfBlocking("BLOCK_END,blk=%u,crc16=%u" PROTO_EOL, (unsigned)e->blk, (unsigned)e->crc16);
-    e->t_last_tx_ms = HAL_GetTick();
-    e->sent = 1;
-    e->inflight = 1;
 }
 
 int TB_EnqueueBlock(const TB_BlockGen* blk) {
@@ -165,123 +524,190 @@ int TB_EnqueueBlock(const TB_BlockGen* blk) {
         return 0;
     }
     if (_queue_full()) return 0;
+    uint16_t off, len;
+    uint32_t crc;
+    if (!_arena_stage(blk, &off, &len, &crc)) {
+        if (g_tb.q_used == 0u) {
+            /* Tom arena och blocket ryms ändå inte: kan aldrig sändas. */
+            _fail(g_tb.next_blk, 400u);
+        }
+        return 0;
+    }
+    g_tb.bpl = (uint16_t)((len + blk->lines - 1u) / blk->lines);
     tb_entry_t* e = _queue_push();
-    e->gen = blk->gen;
-    e->user = blk->user;
     e->lines = blk->lines;
     e->blk = g_tb.next_blk++;
-    e->crc16 = _compute_crc16(e->gen, e->user, e->lines);
+    e->crc = crc;
+    e->off = off;
+    e->len = len;
     e->retries = 0;
     e->sent = 0;
+    e->tx_pending = 0;
     e->inflight = 0;
     e->done = 0;
     return 1;
 }
 
 static void _pump_send(void) {
-    while (g_tb.inflight_count < g_tb.window && !_queue_empty()) {
+    while (_window_span() < g_tb.cur_window && !_queue_empty()) {
         tb_entry_t* e = _queue_pop();
-        _send_block(e);
-        _inflight_add(e);
+        e->tx_pending = 1;
+        e->inflight = 1;
+        g_tb.inflight_count++;
     }
+    _pump_emit();
+}
+
+/* Köar en omsändning; 0 när blocket har slut på försök. */
+static int _retransmit(tb_entry_t* e) {
+    if (e->retries >= g_tb.max_retries) return 0;
+    e->retries++;
+    e->tx_pending = 1; /* Sänds efter pågående block */
+    Trace_Log(TRACE_EV_TB_RETX, e->blk, e->retries);
+    return 1;
 }
 
 static void _pump_timeouts(void) {
     uint32_t now = HAL_GetTick();
-    for (uint8_t i = 0; i < g_tb.inflight_count; ) {
-        tb_entry_t* e = g_tb.inflight[i];
-        if (!e->inflight) { _inflight_remove_index(i); continue; }
-        if ((uint32_t)(now - e->t_last_tx_ms) >= PROTO_BLOCK_TIMEOUT_MS) {
-            if (e->retries < g_tb.max_retries) {
-                e->retries++;
-                _send_block(e);
-                i++;
-            } else {
-                _abort_all();
-                BM_EndAborted(400u);
+    uint8_t timed_out = 0;
+    TB_FOR_EACH_WINDOW(k) {
+        tb_entry_t* e = &g_tb.queue[k];
+        if (!e->inflight) continue;
+        if (!e->sent || e->tx_pending || e == g_tb.tx_e) continue; /* Inte ute än */
+        if ((uint32_t)(now - e->t_last_tx_ms) >= g_tb.rto_ms) {
+            timed_out = 1;
+            if (!_retransmit(e)) {
+                _fail(e->blk, 400u);
+                return;
             }
-        } else {
-            i++;
         }
     }
+    if (timed_out) {
+        _ctl_on_timeout(); /* en backoff per stopp, inte per block */
+        Trace_Log(TRACE_EV_TB_TIMEOUT, g_tb.cur_window, g_tb.rto_ms);
+    }
 }
 
 void TB_Pump(void) {
     if (!g_tb.burst_active) return;
 
-    #if RXTX_DEBUG > 0
-    uint8_t q_before = g_tb.q_count;
-    uint8_t i_before = g_tb.inflight_count;
-    #endif
+    const uint8_t q_before = g_tb.q_count;
+    const uint8_t i_before = g_tb.inflight_count;
+    const uint16_t w_before = g_tb.cur_window;
 
     _pump_send();
     _pump_timeouts();
 
-    #if RXTX_DEBUG > 0
-    // Logga endast om status har ändrats för att minska spam
-    if (q_before != g_tb.q_count || i_before != g_tb.inflight_count) {
-        DevTel_LogTbStatus(g_tb.q_count, TB_MAX_QUEUE, g_tb.inflight_count, g_tb.window);
+    // Bara vid ändring, annars fyller varje pass ringen
+    if (q_before != g_tb.q_count || i_before != g_tb.inflight_count || w_before != g_tb.cur_window) {
+        Trace_Log(TRACE_EV_TB_STATUS, g_tb.q_count, ((uint32_t)g_tb.inflight_count << 16) | g_tb.cur_window);
     }
-    #endif
 }
 
 
 int TB_IsIdle(void) {
-    /* Idle = inga inflight-block och tom kö */
-    return (g_tb.inflight_count == 0) && _queue_empty();
+    /* Idle = inga inflight-block, tom kö och inget block halvvägs ute */
+    return (g_tb.inflight_count == 0) && _queue_empty() && (g_tb.tx_e == NULL);
 }
 
 void TB_OnAckBlk(uint16_t blk) {
-    uint8_t idx;
-    if (_inflight_find_blk(blk, &idx)) {
-        tb_entry_t* e = g_tb.inflight[idx];
-        e->done = 1;
-        e->inflight = 0;
-        _inflight_remove_index(idx);
+    tb_entry_t* e = _inflight_find_blk(blk);
+    if (e) {
+        uint32_t rtt_ms = UINT32_MAX;
+        if (e->sent && e->retries == 0u) {
+            rtt_ms = HAL_GetTick() - e->t_last_tx_ms;
+            _ctl_on_ack(rtt_ms);
+        }
+        Trace_Log(TRACE_EV_TB_ACK, blk, rtt_ms);
+        _inflight_ack(e);
+        _reclaim();
     }
 }
 
-void TB_OnNackBlk(uint16_t blk, uint32_t code) {
-    (void)code; /* felkod mappas högre upp i felmodellen */
-    uint8_t idx;
-    if (_inflight_find_blk(blk, &idx)) {
-        tb_entry_t* e = g_tb.inflight[idx];
-        if (e->retries < g_tb.max_retries) {
-            e->retries++;
-            _send_block(e);
-        } else {
-            _abort_all();
-            BM_EndAborted((code != 0u) ? code : 400u);
+/*
+ * ACK_BLKS: alla block < base är mottagna, och bit i i mask betyder att block
+ * base+i är mottaget. Länken levererar i ordning, så ett okvitterat block vars
+ * BLOCK_END gick ut före ett nu kvitterat block har gått förlorat: det sänds om
+ * direkt i stället för att vänta ut RTO. Block som redan sänts om efter det
+ * kvitterade lämnas i fred. Bara det nyaste kvitterade blocket ger RTT-prov.
+ */
+void TB_OnAckBlks(uint16_t base, uint32_t mask) {
+    uint16_t newest = 0;
+    uint8_t have_newest = 0;
+    uint8_t sample = 0, lost = 0;
+    uint32_t rtt_ms = 0;
+    Trace_Log(TRACE_EV_TB_ACKS, base, mask);
+    TB_FOR_EACH_WINDOW(k) {
+        tb_entry_t* e = &g_tb.queue[k];
+        if (!e->inflight) continue;
+        int16_t d = (int16_t)(e->blk - base);
+        if (d < 0 || (d < 32 && ((mask >> d) & 1u))) {
+            if (e->sent && (!have_newest || (int16_t)(e->tx_order - newest) > 0)) {
+                newest = e->tx_order;
+                have_newest = 1;
+                sample = (e->retries == 0u);
+                rtt_ms = HAL_GetTick() - e->t_last_tx_ms;
+            }
+            _inflight_ack(e);
         }
     }
+    if (have_newest) {
+        TB_FOR_EACH_WINDOW(k) {
+            tb_entry_t* e = &g_tb.queue[k];
+            if (!e->inflight || !e->sent || e->tx_pending || e == g_tb.tx_e) continue;
+            if ((int16_t)(e->tx_order - newest) < 0) {
+                lost = 1;
+                if (!_retransmit(e)) {
+                    _fail(e->blk, 400u);
+                    return;
+                }
+            }
+        }
+    }
+    if (lost) _ctl_on_corrupt();
+    else if (sample) _ctl_on_ack(rtt_ms);
+    _reclaim();
 }
 
-static int _parse_u16(const char* s, uint16_t* out) {
-    unsigned long v = 0;
-    if (sscanf(s, "%lu", &v) == 1) { *out = (uint16_t)v; return 1; }
-    return 0;
+void TB_OnNackBlk(uint16_t blk, uint32_t code) {
+    tb_entry_t* e = _inflight_find_blk(blk);
+    Trace_Log(TRACE_EV_TB_NACK, blk, code);
+    if (e) _ctl_on_corrupt();
+    if (e && !_retransmit(e)) {
+        _fail(blk, (code != 0u) ? code : 400u); /* felkod mappas högre upp i felmodellen */
+    }
 }
-static int _parse_u32(const char* s, uint32_t* out) {
-    unsigned long v = 0;
-    if (sscanf(s, "%lu", &v) == 1) { *out = (uint32_t)v; return 1; }
-    return 0;
+
+/* Blocknummer är u16 på tråden; större värden avvisas i stället för att trunkeras. */
+static int _parse_blk(const char* s, uint16_t* out) {
+    uint32_t v = 0;
+    if (!s || !api_parse_u32(s, &v) || v > 0xFFFFu) return 0;
+    *out = (uint16_t)v;
+    return 1;
 }
 
-int TB_HandleHostLine(const char* line) {
-    if (!line) return 0;
-    if (strncmp(line, "ACK_BLK", 7) == 0) {
-        const char* p = strstr(line, "blk=");
-        uint16_t blk = 0;
-        if (p && _parse_u16(p + 4, &blk)) {
+int TB_HandleHostLine(const api_tokens_t* t) {
+    if (!t || (t->cmd[0] != 'A' && t->cmd[0] != 'N')) return 0;
+    uint16_t blk = 0;
+    if (api_tok_is_cmd(t, "ACK_BLK")) {
+        /* Snabbväg: vanligaste inkommande raden vid stora fönster */
+        if (_parse_blk(api_tok_val(t, "blk"), &blk)) {
             TB_OnAckBlk(blk);
             return 1;
         }
-    } else if (strncmp(line, "NACK_BLK", 8) == 0) {
-        const char* p = strstr(line, "blk=");
-        const char* q = strstr(line, "code=");
-        uint16_t blk = 0; uint32_t code = 0;
-        if (p && _parse_u16(p + 4, &blk)) {
-            if (q) _parse_u32(q + 5, &code);
+    } else if (api_tok_is_cmd(t, "ACK_BLKS")) {
+        /* mask= får vara decimal eller 0x-hex */
+        const char* q = api_tok_val(t, "mask");
+        uint32_t mask = 0;
+        if (_parse_blk(api_tok_val(t, "base"), &blk) && (!q || api_parse_u32_auto(q, &mask))) {
+            TB_OnAckBlks(blk, mask);
+            return 1;
+        }
+    } else if (api_tok_is_cmd(t, "NACK_BLK")) {
+        const char* q = api_tok_val(t, "code");
+        uint32_t code = 0;
+        if (_parse_blk(api_tok_val(t, "blk"), &blk)) {
+            if (q) (void)api_parse_u32(q, &code);
             TB_OnNackBlk(blk, code);
             return 1;
         }
@@ -298,3 +724,18 @@ uint8_t TB_GetInflightCount(void)
 {
     return g_tb.inflight_count;
 }
+
+uint32_t TB_MsToTimeout(void)
+{
+    if (!g_tb.burst_active) return UINT32_MAX;
+    const uint32_t now = HAL_GetTick();
+    uint32_t left = UINT32_MAX;
+    TB_FOR_EACH_WINDOW(k) {
+        const tb_entry_t* e = &g_tb.queue[k];
+        if (!e->inflight || !e->sent || e->tx_pending || e == g_tb.tx_e) continue; /* som _pump_timeouts */
+        const uint32_t age = now - e->t_last_tx_ms;
+        const uint32_t l = (age >= g_tb.rto_ms) ? 0u : (g_tb.rto_ms - age);
+        if (l < left) left = l;
+    }
+    return left;
+}
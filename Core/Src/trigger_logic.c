@@ -21,10 +21,24 @@ PATCH SUMMARY:
 #include "sensor_hal.h"
 #include "telemetry.h"
 #include "countdown.h"
+#include "timebase.h"
+#include "api_parse.h"
+#include "conditioning.h"
+#include "hostclock.h"  // host_us= on TRIGGER_EDGE
+#include "sched.h"      // Sched_ArmTimeout for holdoff and capture deadlines
 #include <limits.h> // For INT16_MAX/MIN
 #include <stdlib.h> // For abs()
+#include <math.h>   // For sqrtf (MAG channel)
 #include <string.h>
 
+// --- RAW-trigger parameters ---
+#define TRG_MIN_NOISE_ABS 2u  // Minimum noise envelope in counts
+#define TRG_MIN_SAMPLES 100u  // Minimum samples for ARM/ZERO validation
+#define TRG_TH_MAX 16383      // Beyond the 13-bit range anyway; keeps μ ± th in int16
+#define TRG_STALL_MS 500u     // No samples for this long aborts a reference capture
+#define TRG_STA_RING 1024u    // STA ring slots; longer windows put D > 1 samples per slot
+#define TRG_E_MAX (1UL << 28) // Per-sample energy cap in counts², so D samples fit a slot
+
 // --- RAW-trigger state (private to this module) ---
 static int16_t g_zero_mu_raw[3] = {0}; // μ₀[x,y,z] from ZERO phase
 static uint16_t
@@ -32,15 +46,80 @@ static uint16_t
 static int16_t g_arm_mu_raw[3] = {0}; // μ_arm[x,y,z] from ARM phase
 static uint32_t trigger_last_event_time_ms = 0;
 
-// --- RAW-trigger parameters ---
-#define TRG_MIN_NOISE_ABS 2u  // Minimum noise envelope in counts
-#define TRG_MIN_SAMPLES 100u  // Minimum samples for ARM/ZERO validation
+// Precomputed limits: a sample fires when v > hi or v < lo on any axis, i.e.
+// |v - μ_arm| > k_mult · Δ₀. x/y are also kept packed (x in the low halfword)
+// for the parallel compare in Trigger_Scan.
+static int16_t g_trg_hi[3] = {0};
+static int16_t g_trg_lo[3] = {0};
+static int32_t g_trg_th[3] = {0};
+static uint32_t g_trg_hi_xy = 0;
+static uint32_t g_trg_lo_xy = 0;
+static uint32_t g_trg_sample_idx = 0; // Primary-sensor samples evaluated since ARM
+
+// STA/LTA detector (det=sta). The short-term sum covers win_ms as L ring slots
+// of D samples each (L·D ≈ win_ms·ODR, L <= TRG_STA_RING), updated with one
+// add and one subtract per slot. The long-term level is the armed baseline:
+// the per-sample energy of the ARM capture around μ_arm.
+static uint32_t g_sta_ring[TRG_STA_RING];
+static uint64_t g_sta_sum = 0;  // Sum over the L slots in the ring
+static uint64_t g_sta_thr = 0;  // Fires when g_sta_sum > g_sta_thr
+static uint32_t g_sta_part = 0; // Energy of the slot being filled
+static uint16_t g_sta_len = 1;  // L
+static uint16_t g_sta_div = 1;  // D
+static uint16_t g_sta_head = 0;
+static uint16_t g_sta_fill = 0;
+static uint16_t g_sta_pc = 0;   // Samples in g_sta_part
+static uint32_t g_arm_mu_xy = 0; // μ_arm x|y packed like Sample_t
+static float g_arm_mu_mag = 0.0f;
+static float g_lta_xyz = 0.0f;  // Baseline energy, counts² per sample
+static float g_lta_mag = 0.0f;
+
+// Reference capture (ZERO/ARM). Accumulated by Trigger_Pump as samples arrive,
+// so commands, heartbeats and background transfers keep running meanwhile.
+typedef enum {
+  REF_CAP_NONE = 0,
+  REF_CAP_ZERO_GUIDED, // After CAL_READY + countdown; ends in WAIT_ARM
+  REF_CAP_ZERO_QUICK,  // Standalone ZERO; ends in IDLE
+  REF_CAP_ARM          // ARM; ends armed
+} RefCapKind_t;
+
+typedef enum {
+  REF_STEP_RUNNING = 0,
+  REF_STEP_DONE,
+  REF_STEP_FAILED
+} RefStep_t;
+
+typedef struct {
+  RefCapKind_t kind;
+  uint32_t t0_ms;
+  uint32_t last_sample_ms;
+  uint32_t n;
+  int32_t sum[3];
+  int16_t minv[3];
+  int16_t maxv[3];
+  int64_t sumsq[3];   // ARM: baseline energy for det=sta
+  float mag_pivot;    // ARM: first |v|; the sums below are about it (keeps float exact enough)
+  float mag_sum;
+  float mag_sumsq;
+} RefCapture_t;
+
+static RefCapture_t g_ref;
+
+// Conditioned copy of the samples when flt_path includes the trigger; the
+// sample ring stays raw for the burst and its pre-trigger rewind.
+static Sample_t g_trg_cond_buf[COND_CHUNK];
+
 
 // --- Static Function Prototypes ---
-static void Zero_Capture_XYZ(AppContext_t *ctx, uint32_t ms);
-static void Arm_Capture_Mean_XYZ(AppContext_t *ctx, uint32_t ms);
-static bool SimpleTrigger_Exceeds(AppContext_t* ctx, int16_t x, int16_t y, int16_t z,
-                                  int32_t *out_diff, int32_t *out_th);
+static void RefCapture_Begin(RefCapKind_t kind);
+static RefStep_t RefCapture_Step(void);
+static void RefCapture_Pump(AppContext_t *ctx);
+static void Zero_Finish_XYZ(void);
+static void Arm_Finish_Mean_XYZ(void);
+static uint16_t Trigger_Scan(const Sample_t *span, uint16_t n, uint8_t *axis);
+static uint16_t Trigger_ScanSta(const Sample_t *span, uint16_t n, bool mag);
+static void Sta_Reset(void);
+static uint16_t Trigger_View(const Sample_t **span, uint16_t avail);
 
 // --- Public Functions ---
 
@@ -54,32 +133,80 @@ void Trigger_Reset(AppContext_t *ctx) {
   memset(g_zero_mu_raw, 0, sizeof(g_zero_mu_raw));
   memset(g_zero_noise_absmax, 0, sizeof(g_zero_noise_absmax));
   memset(g_arm_mu_raw, 0, sizeof(g_arm_mu_raw));
+  memset(g_trg_hi, 0, sizeof(g_trg_hi));
+  memset(g_trg_lo, 0, sizeof(g_trg_lo));
+  memset(g_trg_th, 0, sizeof(g_trg_th));
+  g_trg_hi_xy = 0;
+  g_trg_lo_xy = 0;
+  g_arm_mu_xy = 0;
+  g_arm_mu_mag = 0.0f;
+  g_lta_xyz = 0.0f;
+  g_lta_mag = 0.0f;
+  g_sta_thr = 0;
+  Sta_Reset();
   trigger_last_event_time_ms = 0;
+  g_ref.kind = REF_CAP_NONE; // Also cancels a running ZERO/ARM capture
+}
+
+void Trigger_UpdateThresholds(AppContext_t *ctx) {
+  for (int a = 0; a < 3; a++) {
+    const float f = ctx->trigger_settings.k_mult * (float)g_zero_noise_absmax[a];
+    int32_t th = (f >= (float)TRG_TH_MAX) ? TRG_TH_MAX : (int32_t)f; // as the old (int32_t) cast
+    if (th < 0)
+      th = 0;
+    g_trg_th[a] = th;
+    g_trg_hi[a] = (int16_t)(g_arm_mu_raw[a] + th);
+    g_trg_lo[a] = (int16_t)(g_arm_mu_raw[a] - th);
+  }
+  g_trg_hi_xy = (uint32_t)(uint16_t)g_trg_hi[0] | ((uint32_t)(uint16_t)g_trg_hi[1] << 16);
+  g_trg_lo_xy = (uint32_t)(uint16_t)g_trg_lo[0] | ((uint32_t)(uint16_t)g_trg_lo[1] << 16);
+  g_arm_mu_xy = (uint32_t)(uint16_t)g_arm_mu_raw[0] | ((uint32_t)(uint16_t)g_arm_mu_raw[1] << 16);
+
+  // STA window geometry at the current ODR
+  uint32_t n = (Sensor_SnapODR(ctx->cfg.odr_hz) * ctx->trigger_settings.win_ms + 500U) / 1000U;
+  if (n < 1U)
+    n = 1U;
+  const uint32_t d = (n + TRG_STA_RING - 1U) / TRG_STA_RING;
+  const uint32_t l = n / d;
+  g_sta_div = (uint16_t)d;
+  g_sta_len = (uint16_t)l;
+  const float lta = (ctx->trigger_settings.ch == TRG_AXIS_MAG) ? g_lta_mag : g_lta_xyz;
+  g_sta_thr = (uint64_t)(ctx->trigger_settings.k_mult * lta * (float)(l * d));
+  Sta_Reset();
 }
 
 void Trigger_Zero(AppContext_t *ctx) {
   // Sensor_StartSampling is called by the MODE,TRIGGER_ON command handler before this.
-  Zero_Capture_XYZ(ctx, REF_CAPTURE_DURATION_MS);
-  Sensor_StopSampling(ctx);
-  COMM_Sendf(MSG_CAL_INFO ",status=hold_zero_done" PROTO_EOL);
-  AppContext_SetOpMode(ctx, OP_MODE_WAIT_ARM);
+  (void)ctx;
+  RefCapture_Begin(REF_CAP_ZERO_GUIDED);
 }
 
 void Trigger_PerformQuickZero(AppContext_t *ctx) {
     // This function is for the standalone ZERO command.
-    // It assumes the sensor is already started and will be stopped by the caller.
-    Zero_Capture_XYZ(ctx, REF_CAPTURE_DURATION_MS);
+    // It assumes the sensor is already started; sampling stops when the capture ends.
+    RefCapture_Begin(REF_CAP_ZERO_QUICK);
+    AppContext_SetOpMode(ctx, OP_MODE_TRG_CAL_ZERO);
 }
 
 void Trigger_Arm(AppContext_t *ctx) {
-  Arm_Capture_Mean_XYZ(ctx, 2000); // Capture μ_arm for 2 seconds
+  ctx->trg_state = TRG_STATE_IDLE; // Armed when μ_arm is captured
+  RefCapture_Begin(REF_CAP_ARM);
+}
+
+bool Trigger_IsCapturingRef(void) {
+  return g_ref.kind != REF_CAP_NONE;
 }
 
 void Trigger_Pump(AppContext_t *ctx) {
+  if (g_ref.kind != REF_CAP_NONE) {
+      RefCapture_Pump(ctx);
+      return;
+  }
+
   // Handle state transition for guided zero calibration
   if (ctx->op_mode == OP_MODE_TRG_CAL_ZERO) {
       if (!Countdown_IsActive()) {
-          // Countdown finished, perform the zeroing action.
+          // Countdown finished, start the zeroing capture.
           Trigger_Zero(ctx);
       }
       return; // Do not perform other trigger logic in this state.
@@ -87,10 +214,12 @@ void Trigger_Pump(AppContext_t *ctx) {
 
   // 1. Handle holdoff state
   if (ctx->trg_state == TRG_STATE_IN_HOLDOFF) {
-    if (HAL_GetTick() - trigger_last_event_time_ms >=
-        ctx->trigger_settings.hold_ms) {
+    const uint32_t held = HAL_GetTick() - trigger_last_event_time_ms;
+    if (held >= ctx->trigger_settings.hold_ms) {
       ctx->trg_state = TRG_STATE_ARMED;
+      Cond_Reset(COND_PATH_TRG); // The burst consumed the samples in between
     } else {
+      Sched_ArmTimeout(ctx->trigger_settings.hold_ms - held);
       return; // Still in holdoff
     }
   }
@@ -109,40 +238,82 @@ void Trigger_Pump(AppContext_t *ctx) {
     uint32_t new_burst_id = BurstManager_GetNextBurstId(ctx);
 
     // Send telemetry with dummy placeholder RAW values for the test hook
-    COMM_Sendf(MSG_TRIGGER_EDGE
-               ",burst_id=%lu,edge=RISING,ts_us=%lu,val_raw=1,th_raw=0" PROTO_EOL,
-               (unsigned long)new_burst_id,
-               (unsigned long)Sensor_TicksToUs(
-                   ctx, __HAL_TIM_GET_COUNTER(ctx->htim2)));
-
-    BurstManager_Start(ctx, KIND_DAMP_TRG, new_burst_id, ctx->cfg.burst_ms);
+    char ts_str[API_U64_STR_MAX];
+    char host[HOSTCLOCK_FIELD_MAX + 1u];
+    const uint64_t ts_us = Timebase_NowUs64();
+    api_format_u64(ts_str, sizeof(ts_str), ts_us);
+    *HostClock_FmtField(host, ts_us) = '\0';
+    COMM_SendfCtrl(MSG_TRIGGER_EDGE
+               ",burst_id=%lu,edge=RISING,ts_us=%s,val_raw=1,th_raw=0%s" PROTO_EOL,
+               (unsigned long)new_burst_id, ts_str, host);
+
+    BurstManager_StartTriggered(ctx, new_burst_id, (uint32_t)Timebase_NowTicks64());
     return; // Exit immediately after handling the test trigger
   }
 
-  // 3. Get a sample from the sensor HAL
-  Sample_t s;
-  if (!Sensor_GetSample(&s)) {
-    return; // No new data
-  }
+  // 3. Evaluate every unread sample in this pass, span by span. A span never
+  // mixes sensors; only the primary sensor arms the trigger.
+  const Sample_t *span;
+  uint16_t avail;
+  const bool sta = (ctx->trigger_settings.det == TRG_DET_STA);
+  const bool mag = (ctx->trigger_settings.ch == TRG_AXIS_MAG);
+  while ((avail = Sensor_PeekSamples(&span)) > 0U) {
+    if (span[0].sensor != 0U) {
+      Sensor_CommitSamples(avail);
+      continue;
+    }
+    avail = Trigger_View(&span, avail);
+    uint8_t axis = 0;
+    const uint16_t i = sta ? Trigger_ScanSta(span, avail, mag) : Trigger_Scan(span, avail, &axis);
+    if (i == avail) {
+      g_trg_sample_idx += avail;
+      Sensor_CommitSamples(avail);
+      continue;
+    }
+
+    // 4. Trigger. Samples after the trigger sample stay in the ring, and the
+    // burst rewinds over the pre-trigger window before it.
+    const Sample_t s = span[i];
+    const uint32_t idx = g_trg_sample_idx + i;
+    g_trg_sample_idx = idx + 1U;
+    Sensor_CommitSamples((uint16_t)(i + 1U));
+    const char *axis_str;
+    int32_t diff_counts, th_counts;
+    if (sta) {
+      const uint32_t nw = (uint32_t)g_sta_len * g_sta_div;
+      const uint64_t e = g_sta_sum / nw, th = g_sta_thr / nw;
+      diff_counts = (e > INT32_MAX) ? INT32_MAX : (int32_t)e;
+      th_counts = (th > INT32_MAX) ? INT32_MAX : (int32_t)th;
+      axis_str = mag ? PROTO_TRG_CH_MAG : PROTO_TRG_CH_XYZ;
+      Sta_Reset(); // The next window starts after the holdoff
+    } else {
+      static const char *const k_axis[3] = {"x", "y", "z"};
+      const int16_t v = (axis == 0U) ? s.x : ((axis == 1U) ? s.y : s.z);
+      diff_counts = abs((int32_t)v - (int32_t)g_arm_mu_raw[axis]);
+      th_counts = g_trg_th[axis];
+      axis_str = k_axis[axis];
+    }
 
-  // 4. Check for trigger condition
-  int32_t diff_counts = 0, th_counts = 0;
-  if (SimpleTrigger_Exceeds(ctx, s.x, s.y, s.z, &diff_counts, &th_counts)) {
     ctx->trg_state = TRG_STATE_IN_HOLDOFF;
     trigger_last_event_time_ms = HAL_GetTick();
 
     uint32_t new_burst_id = BurstManager_GetNextBurstId(ctx);
 
     // Send telemetry in RAW counts
-    COMM_Sendf(MSG_TRIGGER_EDGE
-               ",burst_id=%lu,edge=RISING,ts_us=%lu,val_raw=%ld,th_raw=%ld"
+    char ts_str[API_U64_STR_MAX];
+    char host[HOSTCLOCK_FIELD_MAX + 1u];
+    const uint64_t ts_us = Timebase_StampToUs64(s.timestamp);
+    api_format_u64(ts_str, sizeof(ts_str), ts_us);
+    *HostClock_FmtField(host, ts_us) = '\0';
+    COMM_SendfCtrl(MSG_TRIGGER_EDGE
+               ",burst_id=%lu,edge=RISING,ts_us=%s,val_raw=%ld,th_raw=%ld,axis=%s,idx=%lu%s"
                PROTO_EOL,
-               (unsigned long)new_burst_id,
-               (unsigned long)Sensor_TicksToUs(ctx, s.timestamp),
-               (long)diff_counts, (long)th_counts);
+               (unsigned long)new_burst_id, ts_str,
+               (long)diff_counts, (long)th_counts, axis_str, (unsigned long)idx, host);
 
     // Delegate burst start to the burst manager
-    BurstManager_Start(ctx, KIND_DAMP_TRG, new_burst_id, ctx->cfg.burst_ms);
+    BurstManager_StartTriggered(ctx, new_burst_id, s.timestamp);
+    return;
   }
 }
 
@@ -153,49 +324,151 @@ bool Trigger_IsZeroCalibrated(AppContext_t *ctx) {
           g_zero_noise_absmax[2] != 0);
 }
 
+bool Trigger_GetZeroProfile(int16_t mu_raw[3], uint16_t noise_absmax[3]) {
+  memcpy(mu_raw, g_zero_mu_raw, sizeof(g_zero_mu_raw));
+  memcpy(noise_absmax, g_zero_noise_absmax, sizeof(g_zero_noise_absmax));
+  return Trigger_IsZeroCalibrated(NULL);
+}
+
+void Trigger_SetZeroProfile(const int16_t mu_raw[3], const uint16_t noise_absmax[3]) {
+  for (int a = 0; a < 3; a++) {
+    g_zero_mu_raw[a] = mu_raw[a];
+    // Same floor as a measured profile, so a restored one counts as calibrated
+    g_zero_noise_absmax[a] = (noise_absmax[a] < TRG_MIN_NOISE_ABS) ? TRG_MIN_NOISE_ABS : noise_absmax[a];
+  }
+}
+
 // --- Static Helper Functions (moved from main.c) ---
 
-static void Zero_Capture_XYZ(AppContext_t *ctx, uint32_t ms) {
-  int32_t sum[3] = {0};
-  int16_t minv[3] = {INT16_MAX, INT16_MAX, INT16_MAX};
-  int16_t maxv[3] = {INT16_MIN, INT16_MIN, INT16_MIN};
-  uint32_t n = 0U;
-  uint32_t t0 = HAL_GetTick();
-  uint32_t last_sample_ms = t0;
-
-  while (HAL_GetTick() - t0 < ms) {
-    Sample_t s;
-    if (Sensor_GetSample(&s)) {
-      int16_t v[3] = {s.x, s.y, s.z};
-      for (int a = 0; a < 3; a++) {
-        sum[a] += v[a];
-        if (v[a] < minv[a])
-          minv[a] = v[a];
-        if (v[a] > maxv[a])
-          maxv[a] = v[a];
+static void RefCapture_Begin(RefCapKind_t kind) {
+  memset(&g_ref, 0, sizeof(g_ref));
+  for (int a = 0; a < 3; a++) {
+    g_ref.minv[a] = INT16_MAX;
+    g_ref.maxv[a] = INT16_MIN;
+  }
+  g_ref.t0_ms = HAL_GetTick();
+  g_ref.last_sample_ms = g_ref.t0_ms;
+  g_ref.kind = kind;
+  Cond_Reset(COND_PATH_TRG);
+}
+
+// What the trigger (and ZERO/ARM) sees: the span itself, or a conditioned copy
+// of at most COND_CHUNK samples of the primary sensor. Returns the count to use.
+static uint16_t Trigger_View(const Sample_t **span, uint16_t avail) {
+  if (!Cond_IsOn(COND_PATH_TRG) || (*span)[0].sensor != 0U)
+    return avail;
+  if (avail > COND_CHUNK)
+    avail = COND_CHUNK;
+  memcpy(g_trg_cond_buf, *span, (size_t)avail * sizeof(Sample_t));
+  Cond_Apply(COND_PATH_TRG, g_trg_cond_buf, avail);
+  *span = g_trg_cond_buf;
+  return avail;
+}
+
+// Consumes the unread samples (only the primary sensor counts) and checks for
+// stall, end of the window and sample count.
+static RefStep_t RefCapture_Step(void) {
+  const char *who = (g_ref.kind == REF_CAP_ARM) ? "ARM" : "ZERO";
+  const bool track_minmax = (g_ref.kind != REF_CAP_ARM);
+  const uint32_t now = HAL_GetTick();
+  const bool window_open = (now - g_ref.t0_ms) < REF_CAPTURE_DURATION_MS;
+
+  const Sample_t *span;
+  uint16_t avail;
+  while (window_open && (avail = Sensor_PeekSamples(&span)) > 0U) {
+    avail = Trigger_View(&span, avail);
+    if (span[0].sensor == 0U) {
+      for (uint16_t i = 0; i < avail; i++) {
+        const int16_t v[3] = {span[i].x, span[i].y, span[i].z};
+        for (int a = 0; a < 3; a++) {
+          g_ref.sum[a] += v[a];
+          if (track_minmax) {
+            if (v[a] < g_ref.minv[a])
+              g_ref.minv[a] = v[a];
+            if (v[a] > g_ref.maxv[a])
+              g_ref.maxv[a] = v[a];
+          } else {
+            g_ref.sumsq[a] += (int32_t)v[a] * v[a];
+          }
+        }
+        if (!track_minmax) {
+          const float fx = (float)v[0], fy = (float)v[1], fz = (float)v[2];
+          const float m = sqrtf(fx * fx + fy * fy + fz * fz);
+          if (g_ref.n == 0U && i == 0U)
+            g_ref.mag_pivot = m;
+          const float dm = m - g_ref.mag_pivot;
+          g_ref.mag_sum += dm;
+          g_ref.mag_sumsq += dm * dm;
+        }
       }
-      n++;
-      last_sample_ms = HAL_GetTick();
+      g_ref.n += avail;
+    }
+    Sensor_CommitSamples(avail);
+    g_ref.last_sample_ms = now;
+  }
+
+  if (window_open) {
+    if (now - g_ref.last_sample_ms > TRG_STALL_MS) {
+      Telemetry_SendERROR(who, 500, "sampling_stalled");
+      return REF_STEP_FAILED;
+    }
+    // Wake at the window end, or at the stall limit if the samples stop
+    const uint32_t to_end = REF_CAPTURE_DURATION_MS - (now - g_ref.t0_ms);
+    const uint32_t to_stall = TRG_STALL_MS + 1u - (now - g_ref.last_sample_ms);
+    Sched_ArmTimeout((to_stall < to_end) ? to_stall : to_end);
+    return REF_STEP_RUNNING;
+  }
+  if (g_ref.n < TRG_MIN_SAMPLES) {
+    Telemetry_SendERROR(who, 500, "insufficient_samples");
+    return REF_STEP_FAILED;
+  }
+  return REF_STEP_DONE;
+}
+
+static void RefCapture_Pump(AppContext_t *ctx) {
+  const RefCapKind_t kind = g_ref.kind;
+  const RefStep_t st = RefCapture_Step();
+  if (st == REF_STEP_RUNNING)
+    return;
+  g_ref.kind = REF_CAP_NONE;
+
+  if (kind == REF_CAP_ARM) {
+    if (st == REF_STEP_DONE) {
+      Arm_Finish_Mean_XYZ();
+      Trigger_UpdateThresholds(ctx);
+      g_trg_sample_idx = 0;
+      Sensor_SetConsumer(ctx, SENSOR_CONSUMER_TRIGGER); // Low-latency watermark for edge detection
+      COMM_Sendf(MSG_CAL_INFO ",status=arm_done,n=%lu" PROTO_EOL, (unsigned long)g_ref.n);
+      ctx->trg_state = TRG_STATE_ARMED;
     } else {
-      if (HAL_GetTick() - last_sample_ms > 500) {
-        Telemetry_SendERROR("ZERO", 500, "sampling_stalled");
-        Trigger_Reset(ctx);
-        return;
-      }
-      HAL_Delay(1);
+      // Never arm on a partial μ_arm; the host can ARM again.
+      memset(g_arm_mu_raw, 0, sizeof(g_arm_mu_raw));
+      Sensor_StopSampling(ctx);
+      AppContext_SetOpMode(ctx, OP_MODE_WAIT_ARM);
     }
+    return;
   }
 
-  if (n < TRG_MIN_SAMPLES) {
-    Telemetry_SendERROR("ZERO", 500, "insufficient_samples");
+  if (st == REF_STEP_DONE) {
+    Zero_Finish_XYZ();
+  } else {
     Trigger_Reset(ctx);
-    return;
   }
+  Sensor_StopSampling(ctx);
+  if (kind == REF_CAP_ZERO_QUICK) {
+    COMM_Sendf(MSG_CAL_INFO ",status=zero_complete" PROTO_EOL);
+    AppContext_SetOpMode(ctx, OP_MODE_IDLE);
+  } else {
+    COMM_Sendf(MSG_CAL_INFO ",status=hold_zero_done" PROTO_EOL);
+    AppContext_SetOpMode(ctx, OP_MODE_WAIT_ARM);
+  }
+}
 
+static void Zero_Finish_XYZ(void) {
   for (int a = 0; a < 3; a++) {
-    int16_t mu = (int16_t)(sum[a] / (int32_t)n);
-    uint16_t d1 = (uint16_t)abs(maxv[a] - mu);
-    uint16_t d2 = (uint16_t)abs(mu - minv[a]);
+    int16_t mu = (int16_t)(g_ref.sum[a] / (int32_t)g_ref.n);
+    uint16_t d1 = (uint16_t)abs(g_ref.maxv[a] - mu);
+    uint16_t d2 = (uint16_t)abs(mu - g_ref.minv[a]);
     uint16_t dmax = (d1 > d2) ? d1 : d2;
     if (dmax < TRG_MIN_NOISE_ABS)
       dmax = TRG_MIN_NOISE_ABS;
@@ -204,54 +477,95 @@ static void Zero_Capture_XYZ(AppContext_t *ctx, uint32_t ms) {
   }
 }
 
-static void Arm_Capture_Mean_XYZ(AppContext_t *ctx, uint32_t ms) {
-  int32_t sum[3] = {0};
-  uint32_t n = 0U;
-  uint32_t t0 = HAL_GetTick();
-  uint32_t last_sample_ms = t0;
-
-  while (HAL_GetTick() - t0 < ms) {
-    Sample_t s;
-    if (Sensor_GetSample(&s)) {
-      sum[0] += s.x;
-      sum[1] += s.y;
-      sum[2] += s.z;
-      n++;
-      last_sample_ms = HAL_GetTick();
-    } else {
-      if (HAL_GetTick() - last_sample_ms > 500) {
-        Telemetry_SendERROR("ARM", 500, "sampling_stalled");
-        memset(g_arm_mu_raw, 0, sizeof(g_arm_mu_raw));
-        return;
-      }
-      HAL_Delay(1);
-    }
+static void Arm_Finish_Mean_XYZ(void) {
+  const int64_t n = (int64_t)g_ref.n;
+  const float n2 = (float)n * (float)n;
+  float lta = 0.0f;
+  for (int a = 0; a < 3; a++) {
+    g_arm_mu_raw[a] = (int16_t)(g_ref.sum[a] / (int32_t)g_ref.n);
+    // n²·var exactly in integers, then one division
+    lta += (float)(g_ref.sumsq[a] * n - (int64_t)g_ref.sum[a] * g_ref.sum[a]) / n2;
   }
+  const float floor1 = (float)(TRG_MIN_NOISE_ABS * TRG_MIN_NOISE_ABS);
+  g_lta_xyz = (lta < 3.0f * floor1) ? 3.0f * floor1 : lta;
 
-  if (n < TRG_MIN_SAMPLES) {
-    Telemetry_SendERROR("ARM", 500, "insufficient_samples");
-    memset(g_arm_mu_raw, 0, sizeof(g_arm_mu_raw));
-    return;
+  const float mean_d = g_ref.mag_sum / (float)n;
+  float var_m = g_ref.mag_sumsq / (float)n - mean_d * mean_d;
+  g_arm_mu_mag = g_ref.mag_pivot + mean_d;
+  g_lta_mag = (var_m < floor1) ? floor1 : var_m;
+}
+
+static void Sta_Reset(void) {
+  memset(g_sta_ring, 0, (size_t)g_sta_len * sizeof(g_sta_ring[0]));
+  g_sta_sum = 0;
+  g_sta_part = 0;
+  g_sta_head = 0;
+  g_sta_fill = 0;
+  g_sta_pc = 0;
+}
+
+// Energy of one sample about μ_arm in counts². xyz: x and y in one __QSUB16 and
+// __SMUAD (dx² + dy²), z scalar. mag: (|v| - |μ|)².
+static inline uint32_t Sta_Energy(const Sample_t *s, bool mag) {
+  if (mag) {
+    const float fx = (float)s->x, fy = (float)s->y, fz = (float)s->z;
+    const float d = sqrtf(fx * fx + fy * fy + fz * fz) - g_arm_mu_mag;
+    const float e = d * d;
+    return (e >= (float)TRG_E_MAX) ? TRG_E_MAX : (uint32_t)(e + 0.5f);
   }
+  uint32_t xy;
+  memcpy(&xy, &s->x, sizeof(xy));
+  const uint32_t dxy = __QSUB16(xy, g_arm_mu_xy);
+  const int32_t dz = (int32_t)s->z - (int32_t)g_arm_mu_raw[2];
+  const uint32_t e = (uint32_t)__SMUAD(dxy, dxy) + (uint32_t)(dz * dz);
+  return (e > TRG_E_MAX) ? TRG_E_MAX : e;
+}
 
-  for (int a = 0; a < 3; a++) {
-    g_arm_mu_raw[a] = (int16_t)(sum[a] / (int32_t)n);
+// Index of the sample that closes the first full window above the threshold
+// (n if none). The window is evaluated once per slot, i.e. every D samples.
+static uint16_t Trigger_ScanSta(const Sample_t *span, uint16_t n, bool mag) {
+  for (uint16_t i = 0; i < n; i++) {
+    g_sta_part += Sta_Energy(&span[i], mag);
+    if (++g_sta_pc < g_sta_div)
+      continue;
+    g_sta_sum += g_sta_part;
+    g_sta_sum -= g_sta_ring[g_sta_head];
+    g_sta_ring[g_sta_head] = g_sta_part;
+    g_sta_part = 0;
+    g_sta_pc = 0;
+    if (++g_sta_head == g_sta_len)
+      g_sta_head = 0;
+    if (g_sta_fill < g_sta_len)
+      g_sta_fill++;
+    if (g_sta_fill == g_sta_len && g_sta_sum > g_sta_thr)
+      return i;
   }
+  return n;
 }
 
-static bool SimpleTrigger_Exceeds(AppContext_t* ctx, int16_t x, int16_t y, int16_t z,
-                                  int32_t *out_diff, int32_t *out_th) {
-  const int16_t v[3] = {x, y, z};
-  for (int a = 0; a < 3; a++) {
-    int32_t diff = abs((int32_t)v[a] - (int32_t)g_arm_mu_raw[a]);
-    int32_t th = (int32_t)(ctx->trigger_settings.k_mult * g_zero_noise_absmax[a]);
-    if (diff > th) {
-      if (out_diff)
-        *out_diff = diff;
-      if (out_th)
-        *out_th = th;
-      return true;
+// Index of the first sample outside the limits (n if none), axis in *axis.
+// x and y are compared as one packed word: __SSUB16 sets the GE flag of each
+// halfword whose difference is >= 0 and __SEL turns the flags into a mask, so a
+// halfword of 'inside' is set only when v <= hi and v >= lo.
+static uint16_t Trigger_Scan(const Sample_t *span, uint16_t n, uint8_t *axis) {
+  const uint32_t hi_xy = g_trg_hi_xy, lo_xy = g_trg_lo_xy;
+  const int16_t hi_z = g_trg_hi[2], lo_z = g_trg_lo[2];
+  for (uint16_t i = 0; i < n; i++) {
+    uint32_t xy;
+    memcpy(&xy, &span[i].x, sizeof(xy)); // x low, y high (Sample_t layout)
+    (void)__SSUB16(hi_xy, xy);
+    const uint32_t below_hi = __SEL(0xFFFFFFFFu, 0u);
+    (void)__SSUB16(xy, lo_xy);
+    const uint32_t above_lo = __SEL(0xFFFFFFFFu, 0u);
+    const uint32_t inside = below_hi & above_lo;
+    if (inside != 0xFFFFFFFFu) {
+      *axis = ((inside & 0xFFFFu) != 0xFFFFu) ? 0U : 1U;
+      return i;
+    }
+    if (span[i].z > hi_z || span[i].z < lo_z) {
+      *axis = 2U;
+      return i;
     }
   }
-  return false;
+  return n;
 }
\ No newline at end of file
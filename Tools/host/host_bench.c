@@ -0,0 +1,361 @@
+/* filename: Tools/host/host_bench.c */
+/*
+ * Värdbygge av protokoll- och beräkningskärnan (make -C Tools/host run).
+ *
+ *   host_bench [micro] [sweep] [run] [key=value ...]
+ *
+ * micro: ns per anrop för CRC16/CRC32, tokenizer, fmt-rader, filterkaskad,
+ *        burststatistik och dämpningsanalys (värdens CPU, bara för jämförelser
+ *        mellan versioner på samma maskin).
+ * sweep: BLOCKS över link_sim för codec raw/delta/bin, fönster 1..32, och
+ *        förlust/latens vid standardfönstret.
+ * run:   en körning med parametrarna nedan.
+ *
+ * Parametrar (standard inom parentes): codec=raw|delta|bin (raw), crc=crc16|crc32,
+ * win=<1..32> (PROTO_WINDOW_DEFAULT), blk_lines=<n> (PROTO_BLOCK_LINES_DEFAULT),
+ * retries=<n> (PROTO_MAX_RETRIES), samples=<n> (8000), baud=<n> (921600),
+ * latency=<ms> (5), jitter=<ms> (0), drop=<p> (0), corrupt=<p> (0), sack=0|1,
+ * seed=<n>.
+ *
+ * Utdata är en rad per mätning, LINK,... respektive MICRO,..., med key=value
+ * som i firmwarens protokoll. Tiden i LINK är simulerad (1 ms steg), så samma
+ * parametrar ger samma resultat på alla maskiner; host_us är värdens CPU-tid.
+ */
+#include "transport_blocks.h"
+#include "protocol_crc16.h"
+#include "protocol_crc32.h"
+#include "api_parse.h"
+#include "api_schema.h"
+#include "fmt.h"
+#include "filter.h"
+#include "burst_stats.h"
+#include "damp_analysis.h"
+#include "link_sim.h"
+#include "host_shim.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_SIM_LIMIT_MS 120000u
+#define BENCH_ODR_HZ       800u
+
+typedef enum { CODEC_RAW = 0, CODEC_DELTA, CODEC_BIN } codec_t;
+static const char* const k_codec_name[] = { "raw", "delta", "bin" };
+
+typedef struct {
+    codec_t  codec;
+    uint8_t  crc32;
+    uint16_t win;
+    uint16_t blk_lines;
+    uint8_t  retries;
+    uint32_t samples;
+    LinkSimCfg_t link;
+} bench_cfg_t;
+
+static uint64_t _now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* --- Syntetisk DAMP-burst: två sensorer omlott, dämpad svängning i mm/s^2 --- */
+
+static void _sample(uint32_t i, int32_t mm[3])
+{
+    const float t = (float)(i >> 1) / (float)BENCH_ODR_HZ;
+    const float env = 20000.0f * expf(-t * 0.8f);
+    const float s = sinf(2.0f * 3.14159265f * 12.5f * t);
+    const int32_t noise = (int32_t)((i * 2654435761u) >> 27) - 16;
+    mm[0] = (int32_t)(env * s) + noise;
+    mm[1] = (int32_t)(0.3f * env * s) - noise;
+    mm[2] = 9807 + (int32_t)(0.1f * env * s) + noise;
+}
+
+typedef struct {
+    uint32_t base;
+    codec_t  codec;
+} gen_ctx_t;
+
+static void _put_u16le(uint8_t* p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+/* Samma radformat som burst_mgr.c:s GenDataLine/GenDeltaLine/GenBinRecord. */
+static int _gen(uint16_t index, char* out, size_t out_sz, void* user)
+{
+    const gen_ctx_t* g = (const gen_ctx_t*)user;
+    const uint32_t i = g->base + index;
+    const uint8_t sensor = (uint8_t)(i & 1u);
+    const uint64_t ts_us = (uint64_t)(i >> 1) * (1000000u / BENCH_ODR_HZ);
+    int32_t mm[3];
+    _sample(i, mm);
+
+    if (g->codec == CODEC_BIN) {
+        uint8_t* p = (uint8_t*)out;
+        size_t n = 0;
+        uint16_t dt_us = 0;
+        if (out_sz < 2u * PROTO_BLK_BIN_REC) return -1;
+        if (index < 2u) {
+            p[n++] = (uint8_t)(PROTO_BLK_BIN_KEY | sensor);
+            for (int b = 0; b < 8; ++b) p[n++] = (uint8_t)(ts_us >> (8 * b));
+        } else {
+            dt_us = (uint16_t)(1000000u / BENCH_ODR_HZ);
+        }
+        p[n++] = sensor;
+        for (int k = 0; k < 3; ++k) {
+            _put_u16le(&p[n], (uint16_t)(int16_t)(mm[k] / 38)); // ~3.9 mg/LSB
+            n += 2;
+        }
+        _put_u16le(&p[n], dt_us);
+        n += 2;
+        return (int)n;
+    }
+
+    if (out_sz < PROTO_MAX_LINE) return -1;
+    char* o = out;
+    if (g->codec == CODEC_DELTA && index >= 2u) {
+        int32_t prev[3];
+        _sample(i - 2u, prev);
+        o = fmt_str(o, MSG_DATA_DELTA ",");
+        o = fmt_u32(o, 1000000u / BENCH_ODR_HZ);
+        for (int k = 0; k < 3; ++k) {
+            *o++ = ',';
+            o = fmt_i32(o, mm[k] - prev[k]);
+        }
+    } else if (g->codec == CODEC_DELTA) {
+        o = fmt_str(o, MSG_DATA_KEY ",");
+        o = fmt_u64(o, ts_us);
+        for (int k = 0; k < 3; ++k) {
+            *o++ = ',';
+            o = fmt_i32(o, mm[k]);
+        }
+    } else {
+        o = fmt_str(o, "DATA,");
+        o = fmt_u64(o, ts_us);
+        for (int k = 0; k < 3; ++k) {
+            *o++ = ',';
+            o = fmt_milli(o, mm[k]);
+        }
+        o = fmt_str(o, ",0.000");
+    }
+    *o++ = ',';
+    o = fmt_u32(o, sensor);
+    o = fmt_str(o, PROTO_EOL);
+    *o = '\0';
+    return (int)(o - out);
+}
+
+/* --- En BLOCKS-burst över den simulerade länken --- */
+
+static void _run(const bench_cfg_t* c)
+{
+    HostShim_Reset();
+    LinkSim_Init(&c->link);
+    TB_Init(c->win, c->blk_lines, c->retries);
+    TB_SetCrc32(c->crc32);
+    TB_SetBinary(c->codec == CODEC_BIN);
+    TB_BeginBurst(1u);
+
+    gen_ctx_t g = { 0u, c->codec };
+    uint32_t next = 0;
+    uint32_t now = 0;
+    const uint64_t t0 = _now_ns();
+    while (now < BENCH_SIM_LIMIT_MS && HostShim_AbortCount() == 0u) {
+        // Som BurstEnqueueReady: hela samplet finns, köa så länge TB tar emot
+        while (next < c->samples) {
+            uint32_t lines = TB_GetBlockLines();
+            if (lines > c->samples - next) lines = c->samples - next;
+            g.base = next;
+            TB_BlockGen blk = { _gen, &g, (uint16_t)lines };
+            if (!TB_EnqueueBlock(&blk)) break;
+            next += lines;
+        }
+        TB_Pump();
+        if (next >= c->samples && TB_IsIdle() && LinkSim_IsIdle()) break;
+        HostShim_SetTick(++now);
+        LinkSim_Step(now);
+    }
+    const uint64_t host_ns = _now_ns() - t0;
+    TB_EndBurst();
+
+    LinkSimStats_t st;
+    TB_LinkStats ls;
+    LinkSim_GetStats(&st);
+    TB_GetLinkStats(&ls);
+    const uint32_t ms = now ? now : 1u;
+    const uint32_t done = (HostShim_AbortCount() == 0u && next >= c->samples) ? c->samples : 0u;
+    printf("LINK,codec=%s,crc=%s,win=%u,blk_lines=%u,baud=%lu,lat_ms=%lu,jit_ms=%lu,drop=%.3f,corrupt=%.3f,"
+           "sack=%u,samples=%lu,ms=%lu,wire_Bps=%llu,goodput_Bps=%llu,sps=%lu,util_pm=%llu,"
+           "blocks=%lu,dups=%lu,nacks=%lu,timeouts=%lu,lines=%u,win_end=%u,srtt_ms=%lu,"
+           "crc_err=%lu,aborted=%lu,host_us=%llu\n",
+           k_codec_name[c->codec], c->crc32 ? "crc32" : "crc16", (unsigned)c->win, (unsigned)c->blk_lines,
+           (unsigned long)c->link.baud, (unsigned long)c->link.latency_ms, (unsigned long)c->link.jitter_ms,
+           c->link.drop, c->link.corrupt, (unsigned)c->link.sack, (unsigned long)c->samples, (unsigned long)ms,
+           (unsigned long long)(st.wire_bytes * 1000u / ms), (unsigned long long)(st.body_bytes * 1000u / ms),
+           (unsigned long)((uint64_t)done * 1000u / ms),
+           (unsigned long long)(st.wire_bytes * 1000u * 1000u / ms / (c->link.baud / 10u)),
+           (unsigned long)st.blocks, (unsigned long)st.dup_blocks, (unsigned long)ls.nacks,
+           (unsigned long)ls.timeouts, (unsigned)ls.lines, (unsigned)ls.window, (unsigned long)ls.srtt_ms,
+           (unsigned long)st.crc_errors, (unsigned long)HostShim_AbortCode(),
+           (unsigned long long)(host_ns / 1000u));
+}
+
+static void _sweep(const bench_cfg_t* base)
+{
+    static const uint16_t wins[] = { 1, 2, 4, 8, 16, 32 };
+    static const double losses[] = { 0.0, 0.01, 0.05 };
+    static const uint32_t lats[] = { 2, 10, 50 };
+    for (int k = CODEC_RAW; k <= CODEC_BIN; ++k) {
+        for (size_t w = 0; w < sizeof(wins) / sizeof(wins[0]); ++w) {
+            bench_cfg_t c = *base;
+            c.codec = (codec_t)k;
+            c.win = wins[w];
+            _run(&c);
+        }
+    }
+    for (size_t l = 0; l < sizeof(lats) / sizeof(lats[0]); ++l) {
+        for (size_t p = 0; p < sizeof(losses) / sizeof(losses[0]); ++p) {
+            for (uint8_t sack = 0; sack <= 1u; ++sack) {
+                bench_cfg_t c = *base;
+                c.link.latency_ms = lats[l];
+                c.link.drop = losses[p];
+                c.link.corrupt = losses[p];
+                c.link.sack = sack;
+                _run(&c);
+            }
+        }
+    }
+}
+
+/* --- Mikromätningar --- */
+
+#define MICRO(name, n, bytes, body)                                                   \
+    do {                                                                              \
+        const uint64_t _t0 = _now_ns();                                               \
+        for (uint32_t _i = 0; _i < (n); ++_i) { body; }                               \
+        const uint64_t _dt = _now_ns() - _t0;                                         \
+        printf("MICRO,name=%s,n=%lu,ns=%llu,MBps=%llu\n", (name), (unsigned long)(n), \
+               (unsigned long long)(_dt / (n)),                                       \
+               (unsigned long long)((_dt > 0u && (bytes) > 0u)                        \
+                   ? (uint64_t)(bytes) * (n) * 1000u / _dt : 0u));                    \
+    } while (0)
+
+static volatile uint32_t s_sink;
+
+static bool _damp_get(uint16_t i, float* v, void* user)
+{
+    (void)user;
+    int32_t mm[3];
+    _sample(i, mm);
+    *v = (float)mm[0] * 0.001f;
+    return true;
+}
+
+static void _micro(void)
+{
+    static uint8_t buf[4096];
+    for (size_t i = 0; i < sizeof(buf); ++i) buf[i] = (uint8_t)(i * 37u + 11u);
+
+    MICRO("crc16_4k", 2000u, sizeof(buf), s_sink += proto_crc16_buf(buf, sizeof(buf)));
+    MICRO("crc32_ref_4k", 200u, sizeof(buf), s_sink += proto_crc32_ref(buf, sizeof(buf)));
+
+    static const char ack[] = "ACK_BLKS,base=1234,mask=0x0000FFFF";
+    MICRO("tokenize_ack_blks", 200000u, sizeof(ack) - 1u, {
+        api_tokens_t t;
+        uint32_t m = 0;
+        api_tokenize(ack, &t);
+        (void)api_parse_u32_auto(api_tok_val(&t, "mask"), &m);
+        s_sink += m;
+    });
+
+    char line[PROTO_MAX_LINE];
+    gen_ctx_t raw = { 0u, CODEC_RAW };
+    gen_ctx_t delta = { 0u, CODEC_DELTA };
+    gen_ctx_t bin = { 0u, CODEC_BIN };
+    MICRO("line_raw", 200000u, 0u, s_sink += (uint32_t)_gen((uint16_t)(_i & 0xFFu), line, sizeof(line), &raw));
+    MICRO("line_delta", 200000u, 0u, s_sink += (uint32_t)_gen((uint16_t)(_i & 0xFFu), line, sizeof(line), &delta));
+    MICRO("rec_bin", 200000u, 0u, s_sink += (uint32_t)_gen((uint16_t)(_i & 0xFFu), line, sizeof(line), &bin));
+
+    filter_cascade_t fc;
+    filter_xyz_state_t fs;
+    const float v0[3] = { 0.0f, 0.0f, 9.81f };
+    float xyz[FILTER_BLOCK_MAX * 3u];
+    Filter_CascadeDesign(&fc, FILTER_BANDPASS, 2.0f, 100.0f, 2u, (float)BENCH_ODR_HZ);
+    Filter_CascadeSeed(&fc, &fs, v0);
+    for (uint32_t i = 0; i < FILTER_BLOCK_MAX * 3u; ++i) xyz[i] = (float)(i % 7u) - 3.0f;
+    MICRO("cascade_bp2_32", 20000u, 0u, { Filter_CascadeRun(&fc, &fs, xyz, FILTER_BLOCK_MAX); s_sink += (uint32_t)xyz[0]; });
+
+    BurstStats_t bs;
+    BurstStats_Reset(&bs);
+    MICRO("burst_stats_add", 200000u, 0u, BurstStats_Add(&bs, (uint8_t)(_i & 1u), 0.1f * (float)(_i & 63u), -1.0f, 9.81f));
+
+    DampResult_t dr;
+    MICRO("damp_analyze_8000", 20u, 0u, { (void)Damp_Analyze(_damp_get, NULL, 8000u, (float)BENCH_ODR_HZ, &dr); s_sink += dr.cycles; });
+}
+
+/* --- Argument --- */
+
+static int _arg(const char* a, const char* key, const char** val)
+{
+    const size_t n = strlen(key);
+    if (strncmp(a, key, n) != 0 || a[n] != '=') return 0;
+    *val = &a[n + 1];
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    bench_cfg_t c = {
+        .codec = CODEC_RAW,
+        .crc32 = 0,
+        .win = PROTO_WINDOW_DEFAULT,
+        .blk_lines = PROTO_BLOCK_LINES_DEFAULT,
+        .retries = PROTO_MAX_RETRIES,
+        .samples = 8000u,
+        .link = { .baud = 921600u, .latency_ms = 5u, .jitter_ms = 0u, .drop = 0.0, .corrupt = 0.0, .sack = 0u, .seed = 1u },
+    };
+    int do_micro = 0, do_sweep = 0, do_run = 0;
+
+    if (!proto_crc16_selftest() || fmt_selftest() != 0u) {
+        fprintf(stderr, "selftest failed\n");
+        return 1;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        const char* a = argv[i];
+        const char* v;
+        if (strcmp(a, "micro") == 0) do_micro = 1;
+        else if (strcmp(a, "sweep") == 0) do_sweep = 1;
+        else if (strcmp(a, "run") == 0) do_run = 1;
+        else if (_arg(a, "codec", &v)) c.codec = !strcmp(v, "bin") ? CODEC_BIN : !strcmp(v, "delta") ? CODEC_DELTA : CODEC_RAW;
+        else if (_arg(a, "crc", &v)) c.crc32 = (uint8_t)(strcmp(v, "crc32") == 0);
+        else if (_arg(a, "win", &v)) c.win = (uint16_t)atoi(v);
+        else if (_arg(a, "blk_lines", &v)) c.blk_lines = (uint16_t)atoi(v);
+        else if (_arg(a, "retries", &v)) c.retries = (uint8_t)atoi(v);
+        else if (_arg(a, "samples", &v)) c.samples = (uint32_t)strtoul(v, NULL, 10);
+        else if (_arg(a, "baud", &v)) c.link.baud = (uint32_t)strtoul(v, NULL, 10);
+        else if (_arg(a, "latency", &v)) c.link.latency_ms = (uint32_t)strtoul(v, NULL, 10);
+        else if (_arg(a, "jitter", &v)) c.link.jitter_ms = (uint32_t)strtoul(v, NULL, 10);
+        else if (_arg(a, "drop", &v)) c.link.drop = atof(v);
+        else if (_arg(a, "corrupt", &v)) c.link.corrupt = atof(v);
+        else if (_arg(a, "sack", &v)) c.link.sack = (uint8_t)atoi(v);
+        else if (_arg(a, "seed", &v)) c.link.seed = (uint32_t)strtoul(v, NULL, 10);
+        else {
+            fprintf(stderr, "unknown argument: %s\n", a);
+            return 2;
+        }
+    }
+    if (c.link.baud < 10u) c.link.baud = 10u;
+    if (!do_micro && !do_sweep && !do_run) do_micro = do_sweep = 1;
+
+    if (do_micro) _micro();
+    if (do_sweep) _sweep(&c);
+    if (do_run) _run(&c);
+    return 0;
+}
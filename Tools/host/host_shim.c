@@ -0,0 +1,69 @@
+/* filename: Tools/host/host_shim.c */
+#include "stm32f4xx_hal.h"
+#include "protocol_crc32.h"
+#include "burst_mgr.h"
+#include "prof.h"
+#include "host_shim.h"
+
+/*
+ * Det som de värdkompilerade modulerna länkar mot utanför sig själva:
+ * simulerad klocka, CRC-32 i mjukvara i stället för CRC-enheten, och
+ * burst_mgr/prof-anropen från transport_blocks.c. Spårningen byggs bort
+ * (TRACE_ENABLE=0 i Makefile).
+ */
+
+static DWT_Type s_dwt;
+static CoreDebug_Type s_core_debug;
+DWT_Type* DWT = &s_dwt;
+CoreDebug_Type* CoreDebug = &s_core_debug;
+
+static uint32_t s_now_ms;
+static uint32_t s_abort_code;
+static uint32_t s_abort_count;
+
+uint32_t HAL_GetTick(void) { return s_now_ms; }
+uint32_t HAL_RCC_GetHCLKFreq(void) { return 180000000u; }
+
+void HostShim_SetTick(uint32_t ms) { s_now_ms = ms; }
+
+void HostShim_Reset(void)
+{
+    s_now_ms = 0;
+    s_abort_code = 0;
+    s_abort_count = 0;
+}
+
+uint32_t HostShim_AbortCount(void) { return s_abort_count; }
+uint32_t HostShim_AbortCode(void) { return s_abort_code; }
+
+/* TB avbryter bursten (slut på omsändningar, block som aldrig ryms). */
+void BM_EndAborted(uint32_t code)
+{
+    s_abort_count++;
+    s_abort_code = code;
+}
+
+void Prof_Record(ProfProbe_t p, uint32_t v)
+{
+    (void)p;
+    (void)v;
+}
+
+/* CRC-32/MPEG-2 med samma nollutfyllnad som enheten (protocol_crc32.h). */
+uint32_t proto_crc32_ref(const void* data, size_t len)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    const size_t padded = (len + 3u) & ~(size_t)3u;
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < padded; ++i) {
+        crc ^= (uint32_t)((i < len) ? p[i] : 0u) << 24;
+        for (uint8_t b = 0; b < 8u; ++b) {
+            crc = (crc & 0x80000000u) ? ((crc << 1) ^ 0x04C11DB7u) : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+uint32_t proto_crc32_hw(const void* data, size_t len) { return proto_crc32_ref(data, len); }
+int proto_crc32_selftest(void) { return 1; }
+int proto_crc32_available(void) { return 1; }
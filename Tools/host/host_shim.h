@@ -0,0 +1,15 @@
+/* filename: Tools/host/host_shim.h */
+#ifndef HOST_SHIM_H_
+#define HOST_SHIM_H_
+
+#include <stdint.h>
+
+/* Simulerad HAL_GetTick (ms). */
+void HostShim_SetTick(uint32_t ms);
+/* Nollställer klockan och avbrottsräkningen inför en ny körning. */
+void HostShim_Reset(void);
+/* BM_EndAborted-anrop från transport_blocks.c sedan HostShim_Reset. */
+uint32_t HostShim_AbortCount(void);
+uint32_t HostShim_AbortCode(void);
+
+#endif /* HOST_SHIM_H_ */
@@ -0,0 +1,264 @@
+/* filename: Tools/host/link_sim.c */
+#include "link_sim.h"
+#include "comm.h"
+#include "api_parse.h"
+#include "protocol_crc16.h"
+#include "protocol_crc32.h"
+#include "transport_blocks.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* --- Enhetens TX-ring (ersätter comm.c) --- */
+
+static uint8_t  s_ring[COMM_TX_RING_SIZE];
+static uint16_t s_head, s_tail, s_used;
+
+static struct {
+    uint16_t len;
+    COMM_TxFreeFn fn;
+    void* arg;
+} s_notify[COMM_TX_NOTIFY_MAX];
+
+uint16_t COMM_TxFree(void) { return (uint16_t)(COMM_TX_RING_SIZE - s_used); }
+
+size_t Telemetry_Write(const char* data, size_t len)
+{
+    if (!data || !len || len > COMM_TxFree()) return 0;   // allt eller inget, som comm.c
+    for (size_t i = 0; i < len; ++i) {
+        s_ring[s_head] = (uint8_t)data[i];
+        s_head = (uint16_t)((s_head + 1u) % COMM_TX_RING_SIZE);
+    }
+    s_used = (uint16_t)(s_used + len);
+    return len;
+}
+
+int COMM_TxNotifyFree(uint16_t len, COMM_TxFreeFn fn, void* arg)
+{
+    if (fn == NULL || len > COMM_TX_RING_SIZE) return 0;
+    for (uint32_t i = 0; i < COMM_TX_NOTIFY_MAX; ++i) {
+        if (s_notify[i].fn == NULL) {
+            s_notify[i].len = len;
+            s_notify[i].fn = fn;
+            s_notify[i].arg = arg;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* --- Värden --- */
+
+#define HOST_LINE_MAX  (PROTO_MAX_LINE * 2u)
+#define HOST_BODY_MAX  65536u
+#define HOST_RESP_MAX  256u
+#define HOST_RESP_LEN  64u
+
+static LinkSimCfg_t   s_cfg;
+static LinkSimStats_t s_st;
+static uint32_t s_rng;
+static uint32_t s_credit;            /* bytes * 1000 som länken får skicka */
+static uint32_t s_now;
+
+static char     s_line[HOST_LINE_MAX];
+static uint16_t s_line_len;
+static uint8_t  s_in_frame;          /* inne i en COBS-ram (binärt block) */
+static uint8_t  s_in_block;
+static uint16_t s_blk;
+static uint8_t  s_crc32;
+static uint8_t  s_body[HOST_BODY_MAX];
+static uint32_t s_body_len;
+static uint8_t  s_rx_map[65536u / 8u]; /* mottagna blocknummer */
+
+static struct {
+    uint32_t due_ms;
+    char line[HOST_RESP_LEN];
+} s_resp[HOST_RESP_MAX];
+static uint32_t s_resp_head, s_resp_count, s_resp_last_due;
+
+static uint32_t _rand(void)
+{
+    uint32_t x = s_rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_rng = x;
+    return x;
+}
+
+static double _rand01(void) { return (double)_rand() / 4294967296.0; }
+
+static int  _rx_has(uint16_t b) { return (s_rx_map[b >> 3] >> (b & 7u)) & 1u; }
+static void _rx_set(uint16_t b) { s_rx_map[b >> 3] |= (uint8_t)(1u << (b & 7u)); }
+
+static void _respond(const char* line)
+{
+    if (s_resp_count >= HOST_RESP_MAX) return;   // värden hinner inte: svaret uteblir
+    uint32_t due = s_now + s_cfg.latency_ms + (s_cfg.jitter_ms ? _rand() % (s_cfg.jitter_ms + 1u) : 0u);
+    if (due < s_resp_last_due) due = s_resp_last_due;   // länken levererar i ordning
+    s_resp_last_due = due;
+    const uint32_t k = (s_resp_head + s_resp_count) % HOST_RESP_MAX;
+    s_resp[k].due_ms = due;
+    snprintf(s_resp[k].line, sizeof(s_resp[k].line), "%s", line);
+    s_resp_count++;
+}
+
+static void _ack(uint16_t blk)
+{
+    char r[HOST_RESP_LEN];
+    if (!s_cfg.sack) {
+        snprintf(r, sizeof(r), "ACK_BLK,blk=%u", (unsigned)blk);
+    } else {
+        uint16_t base = 1;   // TB_BeginBurst numrerar från 1
+        while (_rx_has(base)) base++;
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < 32u; ++i) {
+            if (_rx_has((uint16_t)(base + i))) mask |= 1u << i;
+        }
+        snprintf(r, sizeof(r), "ACK_BLKS,base=%u,mask=0x%08lX", (unsigned)base, (unsigned long)mask);
+    }
+    _respond(r);
+}
+
+static void _block_end(const api_tokens_t* t)
+{
+    uint32_t want = 0;
+    const char* v = api_tok_val(t, s_crc32 ? "crc32" : "crc16");
+    (void)api_parse_u32(v ? v : "0", &want);
+    const uint32_t got = s_crc32 ? proto_crc32_ref(s_body, s_body_len) : proto_crc16_buf(s_body, s_body_len);
+    s_in_block = 0;
+
+    const double r = _rand01();
+    if (r < s_cfg.drop) {
+        s_st.dropped++;
+        return;
+    }
+    char nack[HOST_RESP_LEN];
+    snprintf(nack, sizeof(nack), "NACK_BLK,blk=%u,code=1", (unsigned)s_blk);
+    if (r < s_cfg.drop + s_cfg.corrupt) {
+        s_st.nacked++;
+        _respond(nack);
+        return;
+    }
+    if (got != want) {
+        s_st.crc_errors++;
+        _respond(nack);
+        return;
+    }
+    if (_rx_has(s_blk)) {
+        s_st.dup_blocks++;
+    } else {
+        _rx_set(s_blk);
+        s_st.blocks++;
+        s_st.body_bytes += s_body_len;
+    }
+    _ack(s_blk);
+}
+
+static void _body_put(const void* p, uint32_t n)
+{
+    if (s_body_len + n > HOST_BODY_MAX) n = HOST_BODY_MAX - s_body_len;
+    memcpy(&s_body[s_body_len], p, n);
+    s_body_len += n;
+}
+
+static void _host_line(void)
+{
+    if (s_line_len >= 9u && memcmp(s_line, "BLOCK_END", 9) == 0 && s_in_block) {
+        s_line[s_line_len - PROTO_EOL_LEN] = '\0';
+        api_tokens_t t;
+        api_tokenize(s_line, &t);
+        _block_end(&t);
+    } else if (s_line_len >= 12u && memcmp(s_line, "BLOCK_HEADER", 12) == 0) {
+        s_line[s_line_len - PROTO_EOL_LEN] = '\0';
+        api_tokens_t t;
+        api_tokenize(s_line, &t);
+        uint32_t blk = 0;
+        (void)api_parse_u32(api_tok_val(&t, "blk") ? api_tok_val(&t, "blk") : "0", &blk);
+        s_blk = (uint16_t)blk;
+        s_crc32 = api_tok_val(&t, "crc32") != NULL;
+        s_in_block = 1;
+        s_body_len = 0;
+    } else if (s_in_block) {
+        _body_put(s_line, s_line_len);   // DATA/DK/DD inklusive CRLF
+    }
+    s_line_len = 0;
+}
+
+static void _host_byte(uint8_t b)
+{
+    if (s_in_frame) {
+        _body_put(&b, 1u);
+        if (b == PROTO_BIN_DELIM) s_in_frame = 0;
+        return;
+    }
+    if (b == PROTO_BIN_DELIM && s_line_len == 0u && s_in_block) {
+        s_in_frame = 1;
+        _body_put(&b, 1u);
+        return;
+    }
+    if (s_line_len < HOST_LINE_MAX - 1u) s_line[s_line_len++] = (char)b;
+    if (b == '\n') _host_line();
+}
+
+/* --- Länken --- */
+
+void LinkSim_Init(const LinkSimCfg_t* cfg)
+{
+    s_cfg = *cfg;
+    memset(&s_st, 0, sizeof(s_st));
+    s_rng = cfg->seed ? cfg->seed : 1u;
+    s_credit = 0;
+    s_now = 0;
+    s_head = s_tail = s_used = 0;
+    memset(s_notify, 0, sizeof(s_notify));
+    s_line_len = 0;
+    s_in_frame = 0;
+    s_in_block = 0;
+    s_body_len = 0;
+    memset(s_rx_map, 0, sizeof(s_rx_map));
+    s_resp_head = s_resp_count = s_resp_last_due = 0;
+}
+
+void LinkSim_Step(uint32_t now_ms)
+{
+    s_now = now_ms;
+    s_credit += s_cfg.baud / 10u;
+    uint32_t n = s_credit / 1000u;
+    s_credit %= 1000u;
+    if (n > s_used) n = s_used;
+    for (uint32_t i = 0; i < n; ++i) {
+        const uint8_t b = s_ring[s_tail];
+        s_tail = (uint16_t)((s_tail + 1u) % COMM_TX_RING_SIZE);
+        _host_byte(b);
+    }
+    s_used = (uint16_t)(s_used - n);
+    s_st.wire_bytes += n;
+
+    while (s_resp_count > 0u && s_resp[s_resp_head].due_ms <= now_ms) {
+        api_tokens_t t;
+        api_tokenize(s_resp[s_resp_head].line, &t);
+        (void)TB_HandleHostLine(&t);
+        s_st.acks++;
+        s_resp_head = (s_resp_head + 1u) % HOST_RESP_MAX;
+        s_resp_count--;
+    }
+
+    for (uint32_t i = 0; i < COMM_TX_NOTIFY_MAX; ++i) {
+        if (s_notify[i].fn != NULL && COMM_TxFree() >= s_notify[i].len) {
+            COMM_TxFreeFn fn = s_notify[i].fn;
+            s_notify[i].fn = NULL;   // engångs, fn får registrera igen
+            fn(s_notify[i].arg);
+        }
+    }
+}
+
+int LinkSim_IsIdle(void)
+{
+    return s_used == 0u && s_resp_count == 0u;
+}
+
+void LinkSim_GetStats(LinkSimStats_t* out)
+{
+    *out = s_st;
+}
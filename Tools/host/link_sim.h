@@ -0,0 +1,46 @@
+/* filename: Tools/host/link_sim.h */
+#ifndef LINK_SIM_H_
+#define LINK_SIM_H_
+
+#include <stdint.h>
+
+/*
+ * Simulerad länk mellan transport_blocks.c och en värd.
+ *  - Enhetssidan: COMM_TxFree/Telemetry_Write/COMM_TxNotifyFree mot en ring
+ *    med COMM_TX_RING_SIZE bytes, som töms med baud/10 bytes per sekund.
+ *  - Värdsidan läser BLOCK_HEADER, kropp (rader eller COBS-ram) och BLOCK_END,
+ *    kontrollerar CRC:n och svarar ACK_BLK (eller ACK_BLKS) efter latency_ms
+ *    plus slumpad jitter. Med sannolikhet drop försvinner blocket utan svar,
+ *    med sannolikhet corrupt svarar värden NACK_BLK som vid ett CRC-fel.
+ *  - Svaren går genom api_tokenize och TB_HandleHostLine, som i firmware.
+ */
+
+typedef struct {
+    uint32_t baud;          /* 8N1: baud/10 bytes/s */
+    uint32_t latency_ms;    /* BLOCK_END ute -> svaret hos enheten */
+    uint32_t jitter_ms;     /* + 0..jitter_ms, svaren behåller ordningen */
+    double   drop;          /* sannolikhet per block */
+    double   corrupt;       /* sannolikhet per block */
+    uint8_t  sack;          /* 1 = ACK_BLKS (base/mask), 0 = ACK_BLK */
+    uint32_t seed;
+} LinkSimCfg_t;
+
+typedef struct {
+    uint64_t wire_bytes;    /* allt som gick ut på länken */
+    uint64_t body_bytes;    /* blockkroppar första gången de togs emot */
+    uint32_t blocks;        /* unika block mottagna och kvitterade */
+    uint32_t dup_blocks;    /* omsända block som redan var mottagna */
+    uint32_t dropped;
+    uint32_t nacked;
+    uint32_t crc_errors;    /* CRC stämde inte med BLOCK_END (fel i TB) */
+    uint32_t acks;          /* svarsrader levererade till enheten */
+} LinkSimStats_t;
+
+void LinkSim_Init(const LinkSimCfg_t* cfg);
+/* Ett steg om 1 ms: tömmer ringen mot värden och levererar förfallna svar. */
+void LinkSim_Step(uint32_t now_ms);
+/* Inget i TX-ringen och inga svar på väg. */
+int  LinkSim_IsIdle(void);
+void LinkSim_GetStats(LinkSimStats_t* out);
+
+#endif /* LINK_SIM_H_ */
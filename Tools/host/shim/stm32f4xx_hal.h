@@ -0,0 +1,69 @@
+/* filename: Tools/host/shim/stm32f4xx_hal.h */
+#ifndef HOST_STM32F4XX_HAL_H_
+#define HOST_STM32F4XX_HAL_H_
+
+/*
+ * Värdbyggets ersättning för STM32 HAL: bara det som headrarna och de
+ * kompilerade modulerna (transport_blocks, api_parse, protocol_crc16, fmt,
+ * filter, burst_stats, damp_analysis) behöver. Handtagen är tomma typer,
+ * HAL_GetTick är den simulerade klockan i host_shim.c och avbrottsmaskning
+ * är no-ops (allt körs i en tråd).
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef enum { HAL_OK = 0, HAL_ERROR, HAL_BUSY, HAL_TIMEOUT } HAL_StatusTypeDef;
+
+typedef struct { uint32_t BaudRate; } UART_InitTypeDef;
+typedef struct { void* Instance; } DMA_HandleTypeDef;
+typedef struct { void* Instance; UART_InitTypeDef Init; } UART_HandleTypeDef;
+typedef struct { void* Instance; } TIM_HandleTypeDef;
+typedef struct { void* Instance; } I2C_HandleTypeDef;
+typedef struct { void* Instance; } SPI_HandleTypeDef;
+typedef struct { uint32_t MODER; } GPIO_TypeDef;
+
+#define GPIOA ((GPIO_TypeDef*)0)
+#define GPIOB ((GPIO_TypeDef*)0)
+#define GPIOC ((GPIO_TypeDef*)0)
+#define GPIO_PIN_0  0x0001u
+#define GPIO_PIN_1  0x0002u
+#define GPIO_PIN_2  0x0004u
+#define GPIO_PIN_3  0x0008u
+#define GPIO_PIN_4  0x0010u
+#define GPIO_PIN_5  0x0020u
+#define GPIO_PIN_6  0x0040u
+#define GPIO_PIN_7  0x0080u
+#define GPIO_PIN_8  0x0100u
+#define GPIO_PIN_9  0x0200u
+#define GPIO_PIN_10 0x0400u
+#define GPIO_PIN_11 0x0800u
+#define GPIO_PIN_12 0x1000u
+#define GPIO_PIN_13 0x2000u
+#define GPIO_PIN_14 0x4000u
+#define GPIO_PIN_15 0x8000u
+
+/* prof.h läser DWT->CYCCNT inline; på värden står räknaren still. */
+typedef struct { volatile uint32_t CTRL, CYCCNT; } DWT_Type;
+typedef struct { volatile uint32_t DEMCR; } CoreDebug_Type;
+extern DWT_Type* DWT;
+extern CoreDebug_Type* CoreDebug;
+#define DWT_CTRL_CYCCNTENA_Msk     1u
+#define CoreDebug_DEMCR_TRCENA_Msk (1u << 24)
+
+static inline void     __disable_irq(void) {}
+static inline void     __enable_irq(void) {}
+static inline uint32_t __get_PRIMASK(void) { return 0u; }
+static inline void     __set_PRIMASK(uint32_t m) { (void)m; }
+static inline void     __DMB(void) {}
+static inline void     __DSB(void) {}
+static inline void     __SEV(void) {}
+static inline void     __WFE(void) {}
+static inline uint32_t __CLZ(uint32_t v) { return v ? (uint32_t)__builtin_clz(v) : 32u; }
+static inline uint32_t __REV(uint32_t v) { return __builtin_bswap32(v); }
+
+uint32_t HAL_GetTick(void);
+uint32_t HAL_RCC_GetHCLKFreq(void);
+
+#endif /* HOST_STM32F4XX_HAL_H_ */
@@ -0,0 +1,269 @@
+/* filename: Tools/host/trace_decode.c */
+#include "trace.h"
+#include "api_schema.h"   // MSG_TRACE_INFO, MSG_TRACE_DATA
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+/*
+ * Avkodare för händelsespårningen i Core/Inc/trace.h.
+ *
+ *   trace_decode log <fil> [cpu_hz=N]            TRACE_INFO/TRACE_DATA-rader ur en länklogg
+ *   trace_decode swo <fil> [cpu_hz=N] [port=1]   rå ITM-ström från SWO (t.ex. OpenOCD
+ *                                                "tpiu config internal <fil> uart off <hz>")
+ *
+ * En rad per händelse: t_us från första posten, dt_us sedan föregående, namn
+ * och fälten. Tiden är skillnaden i CYCCNT modulo 2^32, så en lucka längre än
+ * ett varv (23,9 s vid 180 MHz) syns som kortare. Till sist antal per händelse
+ * på stderr.
+ */
+
+typedef struct {
+    const char* name;
+    const char* a16;
+    const char* arg;
+    char        fmt;
+} EvInfo_t;
+
+#define TRACE_X_INFO(id, name, a16, arg, f) [id] = { name, a16, arg, f },
+static const EvInfo_t k_ev[TRACE_EV_COUNT] = { TRACE_EVENTS(TRACE_X_INFO) };
+#undef TRACE_X_INFO
+
+static double   s_cpu_hz = 180e6;
+static int      s_cpu_hz_fixed;
+static int      s_have_prev;
+static uint32_t s_prev_cyc;
+static uint64_t s_t_cyc;
+static uint32_t s_count[TRACE_EV_COUNT + 1u];   // sista facket: okända id
+static uint32_t s_bad;
+
+static void _restart(void)
+{
+    s_have_prev = 0;
+    s_t_cyc = 0;
+}
+
+static void _emit(uint32_t hdr, uint32_t cyc, uint32_t arg)
+{
+    if ((hdr >> 24) != TRACE_SYNC) {
+        s_bad++;
+        return;
+    }
+    const uint32_t id = (hdr >> 16) & 0xFFu;
+    const uint32_t a16 = hdr & 0xFFFFu;
+    const uint32_t dt = s_have_prev ? (uint32_t)(cyc - s_prev_cyc) : 0u;
+    s_have_prev = 1;
+    s_prev_cyc = cyc;
+    s_t_cyc += dt;
+
+    const double us_per_cyc = 1e6 / s_cpu_hz;
+    printf("%14.3f %10.3f ", (double)s_t_cyc * us_per_cyc, (double)dt * us_per_cyc);
+    if (id >= TRACE_EV_COUNT) {
+        s_count[TRACE_EV_COUNT]++;
+        printf("ev%-10" PRIu32 " a16=%" PRIu32 " arg=0x%08" PRIX32 "\n", id, a16, arg);
+        return;
+    }
+    const EvInfo_t* e = &k_ev[id];
+    s_count[id]++;
+    printf("%-12s %s=%" PRIu32 " %s=", e->name, e->a16, a16, e->arg);
+    switch (e->fmt) {
+    case 'x': printf("0x%08" PRIX32 "\n", arg); break;
+    case 'h': printf("%" PRIu32 "/%" PRIu32 "\n", arg >> 16, arg & 0xFFFFu); break;
+    default:  printf("%" PRIu32 "\n", arg); break;
+    }
+}
+
+/* --- TRACE_DATA-rader --- */
+
+static int _hexword(const char* s, uint32_t* out)
+{
+    uint32_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        const char c = s[i];
+        uint32_t d;
+        if (c >= '0' && c <= '9') d = (uint32_t)(c - '0');
+        else if (c >= 'A' && c <= 'F') d = (uint32_t)(c - 'A' + 10);
+        else if (c >= 'a' && c <= 'f') d = (uint32_t)(c - 'a' + 10);
+        else return 0;
+        v = (v << 4) | d;
+    }
+    *out = v;
+    return 1;
+}
+
+static const char* _field(const char* line, const char* key)
+{
+    const size_t n = strlen(key);
+    for (const char* p = strstr(line, key); p; p = strstr(p + 1, key)) {
+        if ((p == line || p[-1] == ',') && p[n] == '=') return p + n + 1;
+    }
+    return NULL;
+}
+
+static int _decode_log(FILE* f)
+{
+    char line[1024];
+    uint32_t next_seq = 0;
+    int have_seq = 0;
+    while (fgets(line, sizeof line, f)) {
+        const char* info = strstr(line, MSG_TRACE_INFO ",");
+        if (info) {
+            const char* hz = _field(info, "cpu_hz");
+            if (hz && !s_cpu_hz_fixed) s_cpu_hz = strtod(hz, NULL);
+            const char* n = _field(info, "n");
+            const char* lost = _field(info, "lost");
+            printf("# dump: n=%lu lost=%lu cpu_hz=%.0f\n", n ? strtoul(n, NULL, 10) : 0ul,
+                   lost ? strtoul(lost, NULL, 10) : 0ul, s_cpu_hz);
+            _restart();
+            have_seq = 0;
+            continue;
+        }
+        const char* data = strstr(line, MSG_TRACE_DATA ",");
+        if (!data) continue;
+        const char* seq = _field(data, "seq");
+        const char* hex = _field(data, "hex");
+        if (!seq || !hex) {
+            s_bad++;
+            continue;
+        }
+        const uint32_t s = (uint32_t)strtoul(seq, NULL, 10);
+        if (have_seq && s != next_seq) {
+            printf("# gap: seq %" PRIu32 " -> %" PRIu32 "\n", next_seq, s);
+            _restart();
+        }
+        next_seq = s;
+        uint32_t w[3];
+        while (_hexword(hex, &w[0]) && _hexword(hex + 8, &w[1]) && _hexword(hex + 16, &w[2])) {
+            _emit(w[0], w[1], w[2]);
+            hex += 24;
+            next_seq++;
+        }
+        have_seq = 1;
+    }
+    return 0;
+}
+
+/* --- ITM-ström --- */
+
+typedef struct {
+    uint32_t port;
+    uint32_t w[3];
+    uint32_t k;          // ord i aktuell post
+    uint32_t overflows;
+    uint32_t skipped;    // ord före första huvudordet eller efter överflöde
+} Swo_t;
+
+static void _swo_word(Swo_t* s, uint32_t v)
+{
+    if (s->k == 0u && (v >> 24) != TRACE_SYNC) {
+        s->skipped++;
+        return;
+    }
+    s->w[s->k++] = v;
+    if (s->k == 3u) {
+        _emit(s->w[0], s->w[1], s->w[2]);
+        s->k = 0;
+    }
+}
+
+/*
+ * ITM-paket (ARMv7-M ARM, D4.2): synk (>= 47 nollbitar och en etta), överflöde
+ * 0x70, tidsstämplar och utökningar med fortsättningsbit 7, och källpaket med
+ * storlek i bit 1:0 och port i bit 7:3. Bara 32-bitarsskrivningar från vår port
+ * används; hårdvarukällor (DWT, bit 2) hoppas över.
+ */
+static int _decode_swo(FILE* f, uint32_t port)
+{
+    Swo_t s = { .port = port };
+    int c;
+    uint32_t zeros = 0;
+    while ((c = fgetc(f)) != EOF) {
+        const uint8_t h = (uint8_t)c;
+        if (h == 0x00u) {
+            zeros++;
+            continue;
+        }
+        if (zeros >= 5u && h == 0x80u) {   // slutet på ett synkpaket
+            zeros = 0;
+            continue;
+        }
+        zeros = 0;
+        if (h == 0x70u) {
+            s.overflows++;
+            s.k = 0;
+            printf("# ITM overflow\n");
+            continue;
+        }
+        if ((h & 0x03u) == 0u) {
+            // Tidsstämpel, utökning eller global tidsstämpel: hoppa över fortsättningen
+            if (h & 0x80u) {
+                while ((c = fgetc(f)) != EOF && (c & 0x80)) { }
+            }
+            continue;
+        }
+        const uint32_t size = ((h & 0x03u) == 3u) ? 4u : (h & 0x03u);
+        uint32_t v = 0;
+        for (uint32_t i = 0; i < size; i++) {
+            if ((c = fgetc(f)) == EOF) return 0;
+            v |= (uint32_t)(uint8_t)c << (8u * i);
+        }
+        if ((h & 0x04u) == 0u && (uint32_t)(h >> 3) == s.port && size == 4u) {
+            _swo_word(&s, v);
+        }
+    }
+    fprintf(stderr, "# swo: port=%" PRIu32 " overflows=%" PRIu32 " skipped_words=%" PRIu32 "\n",
+            s.port, s.overflows, s.skipped);
+    return 0;
+}
+
+static void _usage(void)
+{
+    fprintf(stderr, "usage: trace_decode log|swo <file> [cpu_hz=<hz>] [port=<0..31>]\n");
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        _usage();
+        return 2;
+    }
+    uint32_t port = TRACE_ITM_PORT;
+    for (int i = 3; i < argc; i++) {
+        if (strncmp(argv[i], "cpu_hz=", 7) == 0) {
+            s_cpu_hz = strtod(argv[i] + 7, NULL);
+            s_cpu_hz_fixed = 1;
+        } else if (strncmp(argv[i], "port=", 5) == 0) {
+            port = (uint32_t)strtoul(argv[i] + 5, NULL, 10);
+        } else {
+            _usage();
+            return 2;
+        }
+    }
+    if (s_cpu_hz <= 0.0 || port > 31u) {
+        _usage();
+        return 2;
+    }
+    const int swo = (strcmp(argv[1], "swo") == 0);
+    if (!swo && strcmp(argv[1], "log") != 0) {
+        _usage();
+        return 2;
+    }
+    FILE* f = fopen(argv[2], swo ? "rb" : "r");
+    if (!f) {
+        perror(argv[2]);
+        return 1;
+    }
+    _restart();
+    const int rc = swo ? _decode_swo(f, port) : _decode_log(f);
+    fclose(f);
+
+    fflush(stdout);
+    for (uint32_t i = 0; i < TRACE_EV_COUNT; i++) {
+        if (s_count[i]) fprintf(stderr, "# %-12s %" PRIu32 "\n", k_ev[i].name, s_count[i]);
+    }
+    if (s_count[TRACE_EV_COUNT]) fprintf(stderr, "# %-12s %" PRIu32 "\n", "unknown", s_count[TRACE_EV_COUNT]);
+    if (s_bad) fprintf(stderr, "# bad records %" PRIu32 "\n", s_bad);
+    return rc;
+}